@@ -0,0 +1,18 @@
+// hizps.glsl
+// one level of the hierarchical depth buffer: the farthest of the four texels
+// below. the texture's base level is set to the level below, and sizes are
+// powers of two, so every texel has exactly four children
+
+#version 400
+
+uniform sampler2D Depth;
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy) * 2;
+    float d = texelFetch(Depth, p, 0).r;
+    d = max(d, texelFetch(Depth, p + ivec2(1, 0), 0).r);
+    d = max(d, texelFetch(Depth, p + ivec2(0, 1), 0).r);
+    d = max(d, texelFetch(Depth, p + ivec2(1, 1), 0).r);
+    gl_FragDepth = d;
+}
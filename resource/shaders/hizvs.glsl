@@ -0,0 +1,12 @@
+// hizvs.glsl
+#version 400
+#vertex mesh_vertex
+
+uniform vec4 PosScale;
+uniform vec4 PosOffset;
+
+void main()
+{
+    // the quad is already in clip space
+    gl_Position = vec4(iPos.xy * PosScale.xy + PosOffset.xy, 0, 1);
+}
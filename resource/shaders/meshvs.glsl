@@ -9,13 +9,25 @@ uniform mat4 World;
 uniform mat4 View;
 uniform mat4 Proj;
 uniform vec4 Colour;
+uniform vec4 PosScale;
+uniform vec4 PosOffset;
+
+// iNorm is an octahedral encoded unit vector
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0);
+    n.x += n.x >= 0 ? -t : t;
+    n.y += n.y >= 0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
     vec3 lightDir = vec3(-1, -3, 2);
-    vec3 worldNorm = (World * vec4(iNorm, 0)).xyz;
+    vec3 worldNorm = (World * vec4(octDecode(iNorm), 0)).xyz;
     float d = dot(normalize(-lightDir), normalize(worldNorm));
-    vec4 pos = Proj * View * World * vec4(iPos, 1);
+    vec4 pos = Proj * View * World * vec4(iPos.xyz * PosScale.xyz + PosOffset.xyz, 1);
 
     vTex = iTex;
     vCol = Colour * vec4(d,d,d,1);
@@ -0,0 +1,51 @@
+// skinnedvs.glsl
+#version 400
+#vertex animated_mesh_vertex
+
+out vec2 vTex;
+out vec4 vCol;
+
+uniform mat4 World;
+uniform mat4 View;
+uniform mat4 Proj;
+uniform vec4 Colour;
+uniform vec4 PosScale;
+uniform vec4 PosOffset;
+
+// three columns of every bone's skinning matrix (see SkinningBuffer)
+layout(std140) uniform Bones
+{
+    vec4 BoneColumns[3 * 128];
+};
+
+// iNorm is an octahedral encoded unit vector
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0);
+    n.x += n.x >= 0 ? -t : t;
+    n.y += n.y >= 0 ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    vec4 pos = vec4(iPos.xyz * PosScale.xyz + PosOffset.xyz, 1);
+    vec4 norm = vec4(octDecode(iNorm), 0);
+    vec3 skinnedPos = vec3(0);
+    vec3 skinnedNorm = vec3(0);
+    for (int i = 0; i < 4; i++)
+    {
+        int b = int(iBoneIndices[i]) * 3;
+        skinnedPos += iBoneWeights[i] * vec3(dot(BoneColumns[b], pos), dot(BoneColumns[b + 1], pos), dot(BoneColumns[b + 2], pos));
+        skinnedNorm += iBoneWeights[i] * vec3(dot(BoneColumns[b], norm), dot(BoneColumns[b + 1], norm), dot(BoneColumns[b + 2], norm));
+    }
+
+    vec3 lightDir = vec3(-1, -3, 2);
+    vec3 worldNorm = (World * vec4(skinnedNorm, 0)).xyz;
+    float d = dot(normalize(-lightDir), normalize(worldNorm));
+
+    vTex = iTex;
+    vCol = Colour * vec4(d,d,d,1);
+    gl_Position = Proj * View * World * vec4(skinnedPos, 1);
+}
@@ -0,0 +1,319 @@
+#ifndef _CUBE_ASSETS_H
+#define _CUBE_ASSETS_H
+
+#include "definitions.h"
+
+// loaded assets of one type by string id, behind 32 bit handles
+//
+// a handle is a slot index plus that slot's generation; unloading an asset
+// bumps the generation, so a stale handle gets nullptr rather than whatever
+// took the slot next. ids are found through an open addressing table of
+// slot indices (linear probing, kept under half full), so a lookup costs one
+// hash of the id and usually one string compare; hot paths hold handles and
+// skip even that. acquire() adds a reference and release() drops one. an
+// asset nobody references stays loaded for keepFrames, so getting it back
+// quickly is still a hit, and collect() unloads at most budget of them a
+// frame, so a level change doesn't stall on one frame. an id that fails to
+// load keeps a slot with no asset until clear(), so asking for a missing
+// asset again doesn't go back to the disk. unloading happens on the thread
+// that calls collect(), since most assets own GL objects; the registry
+// itself isn't thread safe
+template<typename T>
+class AssetRegistry
+{
+public:
+    typedef uint Handle;
+    static constexpr Handle Null = 0;
+
+    // the loader returns nullptr or throws when id can't be loaded
+    typedef function<T*(const string&)> Loader;
+    typedef function<void(T*)> Unloader;
+
+    struct Stats
+    {
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+        uint loads = 0;
+        uint failures = 0;
+        uint unloads = 0;
+
+        float hitRate() const { return lookups ? (float)hits / lookups : 0.0f; }
+    };
+
+private:
+    static constexpr uint IndexBits = 20;
+    static constexpr uint IndexMask = (1u << IndexBits) - 1;
+    static constexpr uint Generations = (1u << (32 - IndexBits)) - 1;
+    static constexpr uint Empty = ~0u;
+
+    struct Slot
+    {
+        T* asset = nullptr;
+        string id;
+        uint64_t hash = 0;
+        uint generation = 1;    // 1 to Generations, so no handle is Null
+        int refs = 0;
+        uint releasedAt = 0;    // frame the last reference went
+        bool queued = false;
+        bool failed = false;    // the loader gave nothing for id
+    };
+
+    vector<Slot> slots;
+    vector<uint> freeSlots;
+    vector<uint> table;         // slot indices or Empty; a power of two long
+    uint count = 0;             // ids in the table, failed ones included
+    uint failed = 0;
+    deque<uint> unloadQueue;    // slots in release order; reacquired ones are skipped
+
+    Loader loader;
+    Unloader unloader;
+    uint keepFrames;
+    uint budget;
+    uint frame = 0;
+    Stats stats;
+
+    // fnv-1a
+    static uint64_t hashId(const string& id)
+    {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (char c : id)
+        {
+            h = (h ^ (uchar)c) * 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    Handle handleOf(uint slot) const
+    {
+        return (slots[slot].generation << IndexBits) | slot;
+    }
+    // the slot a handle refers to, or Empty if it's stale
+    uint slotOf(Handle h) const
+    {
+        uint s = h & IndexMask;
+        if (h == Null || s >= slots.size() || slots[s].generation != h >> IndexBits)
+            return Empty;
+        return s;
+    }
+
+    // where id is in the table, or the empty entry where it would go
+    uint probe(const string& id, uint64_t hash) const
+    {
+        uint mask = table.size() - 1;
+        for (uint i = (uint)hash & mask; ; i = (i + 1) & mask)
+        {
+            uint s = table[i];
+            if (s == Empty || (slots[s].hash == hash && slots[s].id == id))
+                return i;
+        }
+    }
+
+    void grow()
+    {
+        vector<uint> old(table.size() ? table.size() * 2 : 64, Empty);
+        old.swap(table);
+        for (uint s : old)
+        {
+            if (s != Empty)
+                table[probe(slots[s].id, slots[s].hash)] = s;
+        }
+    }
+
+    // takes an entry out, shifting later entries of its probe run back into
+    // the hole so that every run stays unbroken
+    void erase(uint pos)
+    {
+        uint mask = table.size() - 1;
+        table[pos] = Empty;
+        for (uint i = (pos + 1) & mask; table[i] != Empty; i = (i + 1) & mask)
+        {
+            uint home = (uint)slots[table[i]].hash & mask;
+            if (((i - home) & mask) >= ((i - pos) & mask))
+            {
+                table[pos] = table[i];
+                table[i] = Empty;
+                pos = i;
+            }
+        }
+        count--;
+    }
+
+    void unload(uint s)
+    {
+        Slot& slot = slots[s];
+        erase(probe(slot.id, slot.hash));
+        if (slot.failed)
+            failed--;
+        else
+        {
+            unloader(slot.asset);
+            stats.unloads++;
+        }
+        slot.asset = nullptr;
+        slot.id.clear();
+        slot.refs = 0;
+        slot.queued = false;
+        slot.failed = false;
+        slot.generation = slot.generation % Generations + 1;
+        freeSlots.push_back(s);
+    }
+
+    // the slot id is in, failed or not, or Empty
+    uint lookup(const string& id)
+    {
+        stats.lookups++;
+        if (!count)
+            return Empty;
+        uint s = table[probe(id, hashId(id))];
+        if (s != Empty)
+            stats.hits++;
+        return s;
+    }
+
+    Handle load(const string& id)
+    {
+        T* asset = nullptr;
+        try
+        {
+            asset = loader(id);
+        }
+        catch (const exception& e)
+        {
+            cout << "   failed to load: " << id << " (" << e.what() << ")" << endl;
+        }
+        if ((count + 1) * 2 > table.size())
+            grow();
+        uint s;
+        if (freeSlots.size())
+        {
+            s = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            s = slots.size();
+            assert(s <= IndexMask);
+            slots.push_back(Slot());
+        }
+        Slot& slot = slots[s];
+        slot.asset = asset;
+        slot.id = id;
+        slot.hash = hashId(id);
+        table[probe(id, slot.hash)] = s;
+        count++;
+        if (!asset)
+        {
+            slot.failed = true;
+            failed++;
+            stats.failures++;
+            return Null;
+        }
+        stats.loads++;
+        return handleOf(s);
+    }
+
+public:
+    AssetRegistry(Loader _loader, Unloader _unloader = [](T* asset) { delete asset; }, uint _keepFrames = 120, uint _budget = 4) :
+        loader(_loader), unloader(_unloader), keepFrames(_keepFrames), budget(_budget) {}
+    ~AssetRegistry()
+    {
+        clear();
+    }
+    AssetRegistry(const AssetRegistry&) = delete;
+    AssetRegistry& operator = (const AssetRegistry&) = delete;
+
+    // the handle for id, loading it on a miss, with a reference added;
+    // Null if it can't be loaded, or couldn't be before
+    Handle acquire(const string& id)
+    {
+        uint s = lookup(id);
+        if (s == Empty)
+        {
+            Handle h = load(id);
+            if (h == Null)
+                return Null;
+            s = h & IndexMask;
+        }
+        if (slots[s].failed)
+            return Null;
+        slots[s].refs++;
+        return handleOf(s);
+    }
+    // the handle for id if it is loaded, without adding a reference
+    Handle find(const string& id)
+    {
+        uint s = lookup(id);
+        return s != Empty && !slots[s].failed ? handleOf(s) : Null;
+    }
+    void addRef(Handle h)
+    {
+        uint s = slotOf(h);
+        if (s != Empty)
+            slots[s].refs++;
+    }
+    // the asset is unloaded by collect() some time after its last reference goes
+    void release(Handle h)
+    {
+        uint s = slotOf(h);
+        if (s == Empty || slots[s].refs <= 0 || --slots[s].refs > 0)
+            return;
+        slots[s].releasedAt = frame;
+        if (!slots[s].queued)
+        {
+            slots[s].queued = true;
+            unloadQueue.push_back(s);
+        }
+    }
+
+    // nullptr for Null or stale handles
+    T* get(Handle h) const
+    {
+        uint s = slotOf(h);
+        return s != Empty ? slots[s].asset : nullptr;
+    }
+
+    // call once a frame
+    void collect()
+    {
+        frame++;
+        uint unloaded = 0;
+        while (unloadQueue.size() && unloaded < budget)
+        {
+            uint s = unloadQueue.front();
+            if (slots[s].refs > 0)
+            {
+                slots[s].queued = false;
+                unloadQueue.pop_front();
+                continue;
+            }
+            // kept for now; the queue is in release order, near enough (a
+            // slot released again keeps its old place)
+            if (frame - slots[s].releasedAt < keepFrames)
+                break;
+            unloadQueue.pop_front();
+            unload(s);
+            unloaded++;
+        }
+    }
+
+    // unloads everything, referenced or not; every handle goes stale
+    void clear()
+    {
+        for (uint s = 0; s < slots.size(); s++)
+        {
+            if (slots[s].asset || slots[s].failed)
+                unload(s);
+        }
+        unloadQueue.clear();
+    }
+
+    uint size() const { return count - failed; }
+    const Stats& getStats() const { return stats; }
+    void printStats(const string& name) const
+    {
+        cout << "    " << name << ": " << size() << " loaded, " << stats.loads << " loads, " << stats.failures << " failed, "
+             << stats.unloads << " unloaded, hit rate " << stats.hitRate() * 100.0f << "% of " << stats.lookups << " lookups" << endl;
+    }
+};
+
+#endif
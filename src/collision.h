@@ -1,6 +1,11 @@
 #ifndef _CUBE_COLLISION_H
 #define _CUBE_COLLISION_H
 
+#include "definitions.h"
+#include "math3d.h"
+#include "simd.h"
+#include "jobs.h"
+
 struct Circle
 {
     float2 centre;
@@ -20,13 +25,24 @@ struct Rect
     Rect(const Rect& b) : centre(b.centre), extent(b.extent) {}
 };
 
+inline void pack(const Circle& c, float* v) { v[0] = c.centre.x; v[1] = c.centre.y; v[2] = c.radius; }
+inline void pack(const Rect& r, float* v)   { v[0] = r.centre.x; v[1] = r.centre.y; v[2] = r.extent.x; v[3] = r.extent.y; }
+
+typedef SoA<Circle, 3> CircleSoA;
+typedef SoA<Rect, 4> RectSoA;
+
+// extents are half sizes; shapes that just touch count as intersecting
+
 bool intersect(const Circle& circle, const Rect& box)
 {
-    return false;
+    // distance from the centre to the closest point of the box
+    float dx = fmaxf(fabsf(circle.centre.x - box.centre.x) - box.extent.x, 0.0f);
+    float dy = fmaxf(fabsf(circle.centre.y - box.centre.y) - box.extent.y, 0.0f);
+    return dx*dx + dy*dy <= circle.radius * circle.radius;
 }
 bool intersect(const Circle& circle, const float2& point)
 {
-    return false;
+    return len2(point - circle.centre) <= circle.radius * circle.radius;
 }
 bool intersect(const Rect& r, const float2& point)
 {
@@ -35,11 +51,13 @@ bool intersect(const Rect& r, const float2& point)
 }
 bool intersect(const Rect& r1, const Rect& r2)
 {
-    return false;
+    return fabsf(r1.centre.x - r2.centre.x) <= r1.extent.x + r2.extent.x
+        && fabsf(r1.centre.y - r2.centre.y) <= r1.extent.y + r2.extent.y;
 }
 bool intersect(const Circle& c1, const Circle& c2)
 {
-    return false;
+    float r = c1.radius + c2.radius;
+    return len2(c1.centre - c2.centre) <= r * r;
 }
 
 struct Ray
@@ -68,34 +86,636 @@ struct Sphere
     Sphere(const float3& _centre, float _r) : centre(_centre), radius(_r) {}
     Sphere(const Sphere& s) : centre(s.centre), radius(s.radius) {}
 };
+// a segment swept by a sphere
+struct Capsule
+{
+    float3 a, b;
+    float radius;
+
+    Capsule() {}
+    Capsule(const float3& _a, const float3& _b, float _r) : a(_a), b(_b), radius(_r) {}
+    Capsule(const Capsule& c) : a(c.a), b(c.b), radius(c.radius) {}
+};
+
+inline void pack(const Sphere& s, float* v) { v[0] = s.centre.x; v[1] = s.centre.y; v[2] = s.centre.z; v[3] = s.radius; }
+inline void pack(const Box& b, float* v)
+{
+    v[0] = b.centre.x; v[1] = b.centre.y; v[2] = b.centre.z;
+    v[3] = b.extent.x; v[4] = b.extent.y; v[5] = b.extent.z;
+}
+
+typedef SoA<Sphere, 4> SphereSoA;
+typedef SoA<Box, 6> BoxSoA;
+
+// ray slab tests multiply by 1/direction; a zero component uses a huge finite
+// value instead of inf so an origin lying on a slab plane doesn't give 0*inf = nan
+inline float rayInvDir(float d)
+{
+    return (d != 0.0f) ? 1.0f / d : 1e30f;
+}
 
+// the ray direction needn't be normalized: outDist is in units of its length.
+// a ray starting inside the shape hits at distance 0
 bool intersect(const Ray& r1, const Sphere& s, float& outDist)
 {
-    return false;
+    float3 m = r1.origin - s.centre;
+    float a = dot(r1.direction, r1.direction);
+    float b = dot(m, r1.direction);
+    float c = dot(m, m) - s.radius * s.radius;
+
+    // outside and pointing away
+    if (c > 0.0f && b > 0.0f)
+        return false;
+
+    float disc = b*b - a*c;
+    if (disc < 0.0f)
+        return false;
+
+    outDist = fmaxf((-b - sqrtf(disc)) / a, 0.0f);
+    return true;
 }
 bool intersect(const Ray& r1, const Box& b, float& outDist)
 {
-    return false;
+    float tmin = 0.0f;
+    float tmax = INFINITY;
+    for (int i = 0; i < 3; i++)
+    {
+        float inv = rayInvDir(r1.direction._x[i]);
+        float t1 = (b.centre._x[i] - b.extent._x[i] - r1.origin._x[i]) * inv;
+        float t2 = (b.centre._x[i] + b.extent._x[i] - r1.origin._x[i]) * inv;
+        tmin = fmaxf(tmin, fminf(t1, t2));
+        tmax = fminf(tmax, fmaxf(t1, t2));
+    }
+    if (tmin > tmax)
+        return false;
+
+    outDist = tmin;
+    return true;
 }
 bool intersect(const Sphere& s, const Box& b)
 {
-    return false;
+    float d2 = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        float d = fmaxf(fabsf(s.centre._x[i] - b.centre._x[i]) - b.extent._x[i], 0.0f);
+        d2 += d*d;
+    }
+    return d2 <= s.radius * s.radius;
 }
 bool intersect(const Sphere& s1, const Sphere& s2)
 {
-    return false;
+    float r = s1.radius + s2.radius;
+    return len2(s1.centre - s2.centre) <= r * r;
 }
 bool intersect(const Box& b1, const Box& b2)
 {
-    return false;
+    return fabsf(b1.centre.x - b2.centre.x) <= b1.extent.x + b2.extent.x
+        && fabsf(b1.centre.y - b2.centre.y) <= b1.extent.y + b2.extent.y
+        && fabsf(b1.centre.z - b2.centre.z) <= b1.extent.z + b2.extent.z;
 }
 bool intersect(const Sphere& s, const float3& pos)
 {
-    return false;
+    return len2(pos - s.centre) <= s.radius * s.radius;
 }
 bool intersect(const Box& b, const float3& pos)
 {
-    return false;
+    return fabsf(pos.x - b.centre.x) <= b.extent.x
+        && fabsf(pos.y - b.centre.y) <= b.extent.y
+        && fabsf(pos.z - b.centre.z) <= b.extent.z;
+}
+float3 closestOnSegment(const float3& a, const float3& b, const float3& pos)
+{
+    float3 ab = b - a;
+    float l2 = len2(ab);
+    float t = l2 > 0.0f ? dot(pos - a, ab) / l2 : 0.0f;
+    return a + ab * fminf(fmaxf(t, 0.0f), 1.0f);
+}
+bool intersect(const Capsule& c, const float3& pos)
+{
+    return len2(pos - closestOnSegment(c.a, c.b, pos)) <= c.radius * c.radius;
+}
+bool intersect(const Capsule& c, const Sphere& s)
+{
+    float r = c.radius + s.radius;
+    return len2(s.centre - closestOnSegment(c.a, c.b, s.centre)) <= r * r;
+}
+bool intersect(const Ray& r1, const Capsule& c, float& outDist)
+{
+    // infinite cylinder around the axis first, then the sphere at whichever
+    // end the ray reaches past (ericson 5.3.7)
+    float3 d = c.b - c.a;
+    float3 m = r1.origin - c.a;
+    const float3& n = r1.direction;
+    float md = dot(m, d), nd = dot(n, d), dd = dot(d, d);
+    float k = dot(m, m) - c.radius * c.radius;
+    float cc = dd * k - md * md;
+    float a = dd * dot(n, n) - nd * nd;
+
+    float t = 0.0f;
+    if (cc > 0.0f)
+    {
+        // outside the cylinder
+        float b = dd * dot(m, n) - nd * md;
+        float disc = b*b - a*cc;
+        if (a <= 0.0f || b >= 0.0f || disc < 0.0f)
+            return false;
+        t = (-b - sqrtf(disc)) / a;
+        md += t * nd;
+    }
+    if (md >= 0.0f && md <= dd)
+    {
+        outDist = t;
+        return true;
+    }
+    return intersect(r1, Sphere(md < 0.0f ? c.a : c.b, c.radius), outDist);
+}
+
+// swept tests: motion is the displacement over the tick and outT the fraction
+// of it covered at first contact, in [0, 1]. shapes touching at the start hit at 0
+bool sweep(const Sphere& s, const float3& motion, const Box& b, float& outT)
+{
+    // ray against the box grown by the radius; hits on the grown box's edges
+    // and corners are redone against the capsules that round them off (ericson 5.5.7)
+    float3 e = b.extent;
+    Box grown(b.centre, e + float3(s.radius, s.radius, s.radius));
+    Ray ray(s.centre, motion);
+    float t;
+    if (!intersect(ray, grown, t) || t > 1.0f)
+        return false;
+
+    int u = 0, v = 0;
+    float3 p = s.centre + motion * t;
+    for (int i = 0; i < 3; i++)
+    {
+        if (p._x[i] < b.centre._x[i] - e._x[i]) u |= 1 << i;
+        if (p._x[i] > b.centre._x[i] + e._x[i]) v |= 1 << i;
+    }
+    int mask = u | v;
+    if (s.radius <= 0.0f || (mask & (mask - 1)) == 0)
+    {
+        // inside or on a face
+        outT = t;
+        return true;
+    }
+
+    auto corner = [&](int n) {
+        return b.centre + float3(n & 1 ? e.x : -e.x, n & 2 ? e.y : -e.y, n & 4 ? e.z : -e.z);
+    };
+    if (mask == 7)
+    {
+        // corner: the three edges meeting there
+        float best = INFINITY;
+        for (int k = 1; k < 8; k <<= 1)
+        {
+            if (intersect(ray, Capsule(corner(v), corner(v ^ k), s.radius), t))
+                best = fminf(best, t);
+        }
+        t = best;
+    }
+    else if (!intersect(ray, Capsule(corner(u ^ 7), corner(v), s.radius), t))
+    {
+        return false;
+    }
+    if (t > 1.0f)
+        return false;
+    outT = t;
+    return true;
+}
+// time of impact of two moving spheres
+bool sweep(const Sphere& s1, const float3& motion1, const Sphere& s2, const float3& motion2, float& outT)
+{
+    float3 m = s1.centre - s2.centre;
+    float3 d = motion1 - motion2;
+    float r = s1.radius + s2.radius;
+    float c = dot(m, m) - r*r;
+    if (c <= 0.0f)
+    {
+        outT = 0.0f;
+        return true;
+    }
+    float a = dot(d, d);
+    float b = dot(m, d);
+    float disc = b*b - a*c;
+    if (b >= 0.0f || disc < 0.0f)
+        return false;
+    float t = (-b - sqrtf(disc)) / a;
+    if (t > 1.0f)
+        return false;
+    outT = t;
+    return true;
+}
+
+// six inward facing planes, xyz = unit normal and w = distance:
+// a point p is inside when dot(xyz, p) + w >= 0 for every plane
+struct Frustum
+{
+    enum { Left, Right, Bottom, Top, Near, Far };
+    float4 planes[6];
+
+    Frustum() {}
+
+    // from a world to clip space matrix, e.g. camera.view * camera.proj
+    static Frustum fromMatrix(const matrix& m)
+    {
+        // clip = v * m, so clip space component j is dot(v, column j)
+        float4 col[4];
+        for (int j = 0; j < 4; j++)
+        {
+            col[j] = float4(m.m[j], m.m[4 + j], m.m[8 + j], m.m[12 + j]);
+        }
+
+        Frustum f;
+        f.planes[Left]   = col[3] + col[0];
+        f.planes[Right]  = col[3] - col[0];
+        f.planes[Bottom] = col[3] + col[1];
+        f.planes[Top]    = col[3] - col[1];
+        f.planes[Near]   = col[3] + col[2];
+        f.planes[Far]    = col[3] - col[2];
+        for (auto& p : f.planes)
+        {
+            p /= len(float3(p.x, p.y, p.z));
+        }
+        return f;
+    }
+};
+
+// frustum tests are conservative: a shape is only rejected when it is
+// entirely outside one plane, so large shapes near corners can pass
+bool intersect(const Frustum& f, const float3& pos)
+{
+    for (auto& p : f.planes)
+    {
+        if (p.x*pos.x + p.y*pos.y + p.z*pos.z + p.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+bool intersect(const Frustum& f, const Sphere& s)
+{
+    for (auto& p : f.planes)
+    {
+        if (p.x*s.centre.x + p.y*s.centre.y + p.z*s.centre.z + p.w < -s.radius)
+            return false;
+    }
+    return true;
+}
+bool intersect(const Frustum& f, const Box& b)
+{
+    for (auto& p : f.planes)
+    {
+        float r = fabsf(p.x)*b.extent.x + fabsf(p.y)*b.extent.y + fabsf(p.z)*b.extent.z;
+        if (p.x*b.centre.x + p.y*b.centre.y + p.z*b.centre.z + p.w < -r)
+            return false;
+    }
+    return true;
+}
+
+// batch tests: one shape against every element of an SoA array
+// outHits gets bit (i % 32) of word (i / 32) set when element i intersects;
+// it must hold array.maskWords() words. the results match the scalar tests above
+
+template<typename Shape, int N, typename Test>
+void intersectBatch(const SoA<Shape, N>& array, uint* outHits, const Test& test)
+{
+    uint words = array.maskWords();
+    memset(outHits, 0, words * sizeof(uint));
+    for (uint i = 0; i < array.count; i += SimdFloat::Width)
+    {
+        outHits[i / 32] |= test(i).mask() << (i % 32);
+    }
+    // padding lanes
+    if (array.count % 32)
+    {
+        outHits[words - 1] &= (1u << (array.count % 32)) - 1;
+    }
+}
+
+void intersect(const Circle& circle, const RectSoA& rects, uint* outHits)
+{
+    SimdFloat cx = circle.centre.x, cy = circle.centre.y, r2 = circle.radius * circle.radius;
+    intersectBatch(rects, outHits, [&](uint i) {
+        SimdFloat dx = vmax(vabs(cx - rects.load(0, i)) - rects.load(2, i), 0.0f);
+        SimdFloat dy = vmax(vabs(cy - rects.load(1, i)) - rects.load(3, i), 0.0f);
+        return dx*dx + dy*dy <= r2;
+    });
+}
+void intersect(const Circle& circle, const Float2SoA& points, uint* outHits)
+{
+    SimdFloat cx = circle.centre.x, cy = circle.centre.y, r2 = circle.radius * circle.radius;
+    intersectBatch(points, outHits, [&](uint i) {
+        SimdFloat dx = points.load(0, i) - cx;
+        SimdFloat dy = points.load(1, i) - cy;
+        return dx*dx + dy*dy <= r2;
+    });
+}
+void intersect(const Rect& r, const Float2SoA& points, uint* outHits)
+{
+    SimdFloat cx = r.centre.x, cy = r.centre.y;
+    SimdFloat ex = fabsf(r.extent.x), ey = fabsf(r.extent.y);
+    intersectBatch(points, outHits, [&](uint i) {
+        return (vabs(cx - points.load(0, i)) < ex) & (vabs(cy - points.load(1, i)) < ey);
+    });
+}
+void intersect(const Rect& r, const RectSoA& rects, uint* outHits)
+{
+    SimdFloat cx = r.centre.x, cy = r.centre.y, ex = r.extent.x, ey = r.extent.y;
+    intersectBatch(rects, outHits, [&](uint i) {
+        return (vabs(cx - rects.load(0, i)) <= ex + rects.load(2, i))
+             & (vabs(cy - rects.load(1, i)) <= ey + rects.load(3, i));
+    });
+}
+void intersect(const Circle& c, const CircleSoA& circles, uint* outHits)
+{
+    SimdFloat cx = c.centre.x, cy = c.centre.y, cr = c.radius;
+    intersectBatch(circles, outHits, [&](uint i) {
+        SimdFloat dx = circles.load(0, i) - cx;
+        SimdFloat dy = circles.load(1, i) - cy;
+        SimdFloat r = cr + circles.load(2, i);
+        return dx*dx + dy*dy <= r*r;
+    });
+}
+
+// outDist may be null; otherwise it gets a distance for every element, valid where the bit is set
+void intersect(const Ray& ray, const SphereSoA& spheres, uint* outHits, float* outDist = nullptr)
+{
+    SimdFloat ox = ray.origin.x, oy = ray.origin.y, oz = ray.origin.z;
+    SimdFloat dx = ray.direction.x, dy = ray.direction.y, dz = ray.direction.z;
+    SimdFloat a = dot(ray.direction, ray.direction);
+    intersectBatch(spheres, outHits, [&](uint i) {
+        SimdFloat mx = ox - spheres.load(0, i);
+        SimdFloat my = oy - spheres.load(1, i);
+        SimdFloat mz = oz - spheres.load(2, i);
+        SimdFloat r = spheres.load(3, i);
+        SimdFloat b = mx*dx + my*dy + mz*dz;
+        SimdFloat c = mx*mx + my*my + mz*mz - r*r;
+        SimdFloat disc = b*b - a*c;
+
+        SimdFloat away = (c > 0.0f) & (b > 0.0f);
+        if (outDist)
+        {
+            vmax((SimdFloat(0.0f) - b - vsqrt(vmax(disc, 0.0f))) / a, 0.0f).store(outDist + i);
+        }
+        return select(away, 0.0f, disc >= 0.0f);
+    });
+}
+void intersect(const Ray& ray, const BoxSoA& boxes, uint* outHits, float* outDist = nullptr)
+{
+    SimdFloat o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+    SimdFloat inv[3];
+    for (int k = 0; k < 3; k++)
+    {
+        inv[k] = rayInvDir(ray.direction._x[k]);
+    }
+    intersectBatch(boxes, outHits, [&](uint i) {
+        SimdFloat tmin = 0.0f;
+        SimdFloat tmax = INFINITY;
+        for (int k = 0; k < 3; k++)
+        {
+            SimdFloat c = boxes.load(k, i);
+            SimdFloat e = boxes.load(k + 3, i);
+            SimdFloat t1 = (c - e - o[k]) * inv[k];
+            SimdFloat t2 = (c + e - o[k]) * inv[k];
+            tmin = vmax(tmin, vmin(t1, t2));
+            tmax = vmin(tmax, vmax(t1, t2));
+        }
+        if (outDist)
+        {
+            tmin.store(outDist + i);
+        }
+        return tmin <= tmax;
+    });
+}
+void intersect(const Sphere& s, const BoxSoA& boxes, uint* outHits)
+{
+    SimdFloat c[3] = { s.centre.x, s.centre.y, s.centre.z };
+    SimdFloat r2 = s.radius * s.radius;
+    intersectBatch(boxes, outHits, [&](uint i) {
+        SimdFloat d2 = 0.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            SimdFloat d = vmax(vabs(c[k] - boxes.load(k, i)) - boxes.load(k + 3, i), 0.0f);
+            d2 = d2 + d*d;
+        }
+        return d2 <= r2;
+    });
+}
+void intersect(const Sphere& s, const SphereSoA& spheres, uint* outHits)
+{
+    SimdFloat cx = s.centre.x, cy = s.centre.y, cz = s.centre.z, cr = s.radius;
+    intersectBatch(spheres, outHits, [&](uint i) {
+        SimdFloat dx = spheres.load(0, i) - cx;
+        SimdFloat dy = spheres.load(1, i) - cy;
+        SimdFloat dz = spheres.load(2, i) - cz;
+        SimdFloat r = cr + spheres.load(3, i);
+        return dx*dx + dy*dy + dz*dz <= r*r;
+    });
+}
+void intersect(const Box& b, const BoxSoA& boxes, uint* outHits)
+{
+    SimdFloat c[3] = { b.centre.x, b.centre.y, b.centre.z };
+    SimdFloat e[3] = { b.extent.x, b.extent.y, b.extent.z };
+    intersectBatch(boxes, outHits, [&](uint i) {
+        SimdFloat hit = vabs(c[0] - boxes.load(0, i)) <= e[0] + boxes.load(3, i);
+        hit = hit & (vabs(c[1] - boxes.load(1, i)) <= e[1] + boxes.load(4, i));
+        hit = hit & (vabs(c[2] - boxes.load(2, i)) <= e[2] + boxes.load(5, i));
+        return hit;
+    });
+}
+void intersect(const Sphere& s, const Float3SoA& points, uint* outHits)
+{
+    SimdFloat cx = s.centre.x, cy = s.centre.y, cz = s.centre.z, r2 = s.radius * s.radius;
+    intersectBatch(points, outHits, [&](uint i) {
+        SimdFloat dx = points.load(0, i) - cx;
+        SimdFloat dy = points.load(1, i) - cy;
+        SimdFloat dz = points.load(2, i) - cz;
+        return dx*dx + dy*dy + dz*dz <= r2;
+    });
+}
+void intersect(const Box& b, const Float3SoA& points, uint* outHits)
+{
+    SimdFloat c[3] = { b.centre.x, b.centre.y, b.centre.z };
+    SimdFloat e[3] = { b.extent.x, b.extent.y, b.extent.z };
+    intersectBatch(points, outHits, [&](uint i) {
+        SimdFloat hit = vabs(points.load(0, i) - c[0]) <= e[0];
+        hit = hit & (vabs(points.load(1, i) - c[1]) <= e[1]);
+        hit = hit & (vabs(points.load(2, i) - c[2]) <= e[2]);
+        return hit;
+    });
+}
+
+// frustum culling for the draw path: fills outVisible with the index of every
+// element the scalar frustum tests accept, in order, SimdFloat::Width at a time
+template<typename Shape, int N, typename Test>
+void cullBatch(const SoA<Shape, N>& array, vector<uint>& outVisible, const Test& test)
+{
+    outVisible.clear();
+    for (uint i = 0; i < array.count; i += SimdFloat::Width)
+    {
+        uint bits = test(i).mask();
+        if (i + SimdFloat::Width > array.count)
+            bits &= (1u << (array.count - i)) - 1;
+        for (; bits; bits &= bits - 1)
+        {
+            outVisible.push_back(i + __builtin_ctz(bits));
+        }
+    }
+}
+
+void cull(const Frustum& f, const SphereSoA& spheres, vector<uint>& outVisible)
+{
+    cullBatch(spheres, outVisible, [&](uint i) {
+        SimdFloat x = spheres.load(0, i), y = spheres.load(1, i), z = spheres.load(2, i);
+        SimdFloat r = SimdFloat(0.0f) - spheres.load(3, i);
+        SimdFloat outside = 0.0f;
+        for (auto& p : f.planes)
+        {
+            SimdFloat d = x * p.x + y * p.y + z * p.z + p.w;
+            outside = outside | (d < r);
+        }
+        return select(outside, 0.0f, SimdFloat(0.0f) <= 0.0f);
+    });
+}
+void cull(const Frustum& f, const BoxSoA& boxes, vector<uint>& outVisible)
+{
+    cullBatch(boxes, outVisible, [&](uint i) {
+        SimdFloat x = boxes.load(0, i), y = boxes.load(1, i), z = boxes.load(2, i);
+        SimdFloat ex = boxes.load(3, i), ey = boxes.load(4, i), ez = boxes.load(5, i);
+        SimdFloat outside = 0.0f;
+        for (auto& p : f.planes)
+        {
+            SimdFloat d = x * p.x + y * p.y + z * p.z + p.w;
+            SimdFloat r = ex * fabsf(p.x) + ey * fabsf(p.y) + ez * fabsf(p.z);
+            outside = outside | (d < SimdFloat(0.0f) - r);
+        }
+        return select(outside, 0.0f, SimdFloat(0.0f) <= 0.0f);
+    });
+}
+
+// batch swept tests: every moving sphere (radius 0 for points) against a
+// whole array, keeping its first hit. spheres are split over the job system in
+// fixed ranges and each result depends only on its own inputs, with ties going
+// to the lowest index, so the output is identical for any thread count
+struct SweepHit
+{
+    float t = 1.0f;     // fraction of the motion covered
+    uint index = ~0u;   // element hit, ~0u for none
+};
+
+template<typename Function>
+void sweepBatch(uint count, JobSystem* jobs, const Function& function)
+{
+    auto range = [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            function(i);
+    };
+    if (jobs)
+        jobs->parallelFor(0, count, 256, range);
+    else
+        range(0, count);
+}
+
+// against static geometry, e.g. bullets against walls
+void sweep(const SphereSoA& spheres, const Float3SoA& motion, const BoxSoA& boxes, SweepHit* out, JobSystem* jobs = nullptr)
+{
+    sweepBatch(spheres.count, jobs, [&](uint i) {
+        Sphere s(float3(spheres.data[0][i], spheres.data[1][i], spheres.data[2][i]), spheres.data[3][i]);
+        float3 d(motion.data[0][i], motion.data[1][i], motion.data[2][i]);
+        SimdFloat o[3] = { s.centre.x, s.centre.y, s.centre.z };
+        SimdFloat inv[3], r = s.radius;
+        for (int k = 0; k < 3; k++)
+        {
+            inv[k] = rayInvDir(d._x[k]);
+        }
+
+        SweepHit hit;
+        for (uint j = 0; j < boxes.count; j += SimdFloat::Width)
+        {
+            // slab test against the grown boxes: exact for points, a lower
+            // bound that the scalar test refines otherwise
+            SimdFloat tmin = 0.0f;
+            SimdFloat tmax = INFINITY;
+            for (int k = 0; k < 3; k++)
+            {
+                SimdFloat c = boxes.load(k, j);
+                SimdFloat e = boxes.load(k + 3, j) + r;
+                SimdFloat t1 = (c - e - o[k]) * inv[k];
+                SimdFloat t2 = (c + e - o[k]) * inv[k];
+                tmin = vmax(tmin, vmin(t1, t2));
+                tmax = vmin(tmax, vmax(t1, t2));
+            }
+            uint bits = ((tmin <= tmax) & (tmin <= hit.t)).mask();
+            if (j + SimdFloat::Width > boxes.count)
+                bits &= (1u << (boxes.count - j)) - 1;
+            if (!bits)
+                continue;
+
+            float tmins[SimdFloat::Width];
+            tmin.store(tmins);
+            for (; bits; bits &= bits - 1)
+            {
+                uint lane = __builtin_ctz(bits);
+                float t = tmins[lane];
+                if (s.radius > 0.0f)
+                {
+                    Box b(float3(boxes.data[0][j + lane], boxes.data[1][j + lane], boxes.data[2][j + lane]),
+                          float3(boxes.data[3][j + lane], boxes.data[4][j + lane], boxes.data[5][j + lane]));
+                    if (!sweep(s, d, b, t))
+                        continue;
+                }
+                if (t < hit.t || (t == hit.t && hit.index == ~0u))
+                {
+                    hit.t = t;
+                    hit.index = j + lane;
+                }
+            }
+        }
+        out[i] = hit;
+    });
+}
+
+// against other moving spheres, e.g. bullets against ships
+void sweep(const SphereSoA& spheres, const Float3SoA& motion, const SphereSoA& targets, const Float3SoA& targetMotion, SweepHit* out, JobSystem* jobs = nullptr)
+{
+    sweepBatch(spheres.count, jobs, [&](uint i) {
+        SimdFloat cx = spheres.data[0][i], cy = spheres.data[1][i], cz = spheres.data[2][i], cr = spheres.data[3][i];
+        SimdFloat vx = motion.data[0][i], vy = motion.data[1][i], vz = motion.data[2][i];
+
+        SweepHit hit;
+        for (uint j = 0; j < targets.count; j += SimdFloat::Width)
+        {
+            // same steps as the scalar sweep, lane by lane
+            SimdFloat mx = cx - targets.load(0, j), my = cy - targets.load(1, j), mz = cz - targets.load(2, j);
+            SimdFloat dx = vx - targetMotion.load(0, j), dy = vy - targetMotion.load(1, j), dz = vz - targetMotion.load(2, j);
+            SimdFloat r = cr + targets.load(3, j);
+            SimdFloat c = mx*mx + my*my + mz*mz - r*r;
+            SimdFloat a = dx*dx + dy*dy + dz*dz;
+            SimdFloat b = mx*dx + my*dy + mz*dz;
+            SimdFloat disc = b*b - a*c;
+            SimdFloat t = (SimdFloat(0.0f) - b - vsqrt(vmax(disc, 0.0f))) / a;
+
+            SimdFloat touching = c <= 0.0f;
+            t = select(touching, 0.0f, t);
+            SimdFloat ok = touching | ((b < 0.0f) & (disc >= 0.0f) & (t <= 1.0f));
+            uint bits = (ok & (t <= hit.t)).mask();
+            if (j + SimdFloat::Width > targets.count)
+                bits &= (1u << (targets.count - j)) - 1;
+            if (!bits)
+                continue;
+
+            float ts[SimdFloat::Width];
+            t.store(ts);
+            for (; bits; bits &= bits - 1)
+            {
+                uint lane = __builtin_ctz(bits);
+                if (ts[lane] < hit.t || (ts[lane] == hit.t && hit.index == ~0u))
+                {
+                    hit.t = ts[lane];
+                    hit.index = j + lane;
+                }
+            }
+        }
+        out[i] = hit;
+    });
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -6,20 +6,36 @@ class CubeGame : public GameState
 {
     Camera camera;
     Mesh* mesh;
+    ShaderManager::Handle shaderHandle;
     Shader* shader;
     Sprite* sprite;
+    TextureManager::FontHandle fontHandle;
     SpriteFont* font;
     float f = 0;
 
-    vector<float3> cubes;
+    struct Cube
+    {
+        float3 position;
+        Broadphase::Handle handle;
+    };
+    vector<Cube> cubes;
+    Broadphase* broadphase = nullptr;
+    vector<uint> hits;
     float3 player;
     float cubeSpeed = 0.5;
     float tilt = 0;
     int score = 0;
 
+    // the cube mesh spans (-0.5, 0, -0.5) to (0.5, 1, 0.5) around its position
+    static Box cubeBounds(const float3& pos)
+    {
+        return Box(pos + float3(0, 0.5, 0), float3(0.5, 0.5, 0.5));
+    }
+
     void spawnCube()
     {
-        cubes.push_back(float3(player.x + uniform(-20, 20), 0, 99));
+        float3 pos(player.x + uniform(-20, 20), 0, 99);
+        cubes.push_back({ pos, broadphase->insert(cubeBounds(pos), 0) });
     }
 
     void init()
@@ -29,8 +45,10 @@ class CubeGame : public GameState
         camera.up = float3(0, 1, 0);
         camera.update();
 
-        shader = game->shaders->getShader("cubevs.glsl", "cubeps.glsl");
-        font = game->textures->getFont("Futura-60");
+        shaderHandle = game->shaders->acquireShader("meshvs.glsl", "meshps.glsl");
+        fontHandle = game->textures->acquireFont("Futura-60");
+        shader = game->shaders->getShader(shaderHandle);
+        font = game->textures->getFont(fontHandle);
 
         MeshBuilder builder;
         builder.box({-0.5, 0, -0.5}, {0.5, 1, 0.5}, {0, 0}, {1, 1}, 0);
@@ -38,6 +56,9 @@ class CubeGame : public GameState
 
         sprite = new Sprite(game->shaders);
 
+        // the cubes all share one velocity, so their order along x barely changes
+        broadphase = new SweepAndPrune(256);
+
         spawnCube();
         spawnCube();
     }
@@ -46,26 +67,28 @@ class CubeGame : public GameState
         // update cubes
         for (auto cube = cubes.begin(); cube != cubes.end(); )
         {
-            cube->z -= cubeSpeed;
-            float xdist = abs(player.x - cube->x);
-            float zdist = abs(player.z - cube->z);
-            if (xdist < 1 && zdist < 1)
-            {
-                // game over!
-                score = 0;
-                cubes.clear();
-                break;
-            }
-
-            if (cube->z < -10)
+            cube->position.z -= cubeSpeed;
+            if (cube->position.z < -10)
             {
+                broadphase->remove(cube->handle);
                 cube = cubes.erase(cube);
             }
             else
             {
+                broadphase->move(cube->handle, cubeBounds(cube->position));
                 cube++;
             }
         }
+
+        broadphase->query(cubeBounds(player), hits);
+        if (hits.size())
+        {
+            // game over!
+            score = 0;
+            cubes.clear();
+            broadphase->clear();
+        }
+
         if (cubeSpeed < 1)
         {
             cubeSpeed *= 1.001;
@@ -104,6 +127,7 @@ class CubeGame : public GameState
         shader->bind();
         shader->set("View", camera.view);
         shader->set("Proj", camera.proj);
+        mesh->setDecode(shader);
 
         // draw floor
         shader->set("Colour", float4(0.6, 0.6, 0.6, 1));
@@ -128,11 +152,11 @@ class CubeGame : public GameState
         // draw cubes
         for (auto& c : cubes)
         {
-            shader->set("World", matrix::translation(c));
+            shader->set("World", matrix::translation(c.position));
             shader->set("Colour", float4(0.4, 0.7, 0.3, 1));
             mesh->render();
 
-            shader->set("World", matrix::translation(c+float3(0, 0.1, 0)) * shadow);
+            shader->set("World", matrix::translation(c.position+float3(0, 0.1, 0)) * shadow);
             shader->set("Colour", float4(0,0,0,0.25));
             mesh->render();
         }
@@ -140,8 +164,11 @@ class CubeGame : public GameState
         stringstream scorestr;
         scorestr << "Score: " << score;
 
+        stringstream cubestr;
+        cubestr << "cubes: " << cubes.size();
+
         sprite->drawText(font, scorestr.str(), {-635, 320});
-        sprite->drawText(font, (stringstream("cubes: ") << cubes.size()).str(), {-635, 300});
+        sprite->drawText(font, cubestr.str(), {-635, 300});
         
         sprite->begin(font->texture->texture);
         sprite->addSprite({0, 0}, {100, 100});
@@ -149,8 +176,11 @@ class CubeGame : public GameState
     }
     void close()
     {
+        delete broadphase;
         delete sprite;
         delete mesh;
+        game->shaders->releaseShader(shaderHandle);
+        game->textures->releaseFont(fontHandle);
     }
 };
 
@@ -4,6 +4,12 @@
 #include <cassert>
 #include <fstream>
 #include <cstdint>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define GLFW_INCLUDE_NONE
 #include "../dep/glad.h"
@@ -49,6 +55,70 @@ bool readTextFile(const string& fname, vector<string>& lines)
     return true;
 }
 
+// a read only view of a whole file, mapped into memory where the platform
+// allows (elsewhere it is read in)
+class MappedFile
+{
+    const char* ptr = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    string contents;
+#endif
+
+public:
+    MappedFile(const string& fname)
+    {
+#ifdef _WIN32
+        ifstream file(fname, ios::binary);
+        if (!file.is_open())
+            return;
+        contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        ptr = contents.data();
+        length = contents.size();
+        opened = true;
+#else
+        int fd = ::open(fname.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+        {
+            length = st.st_size;
+            opened = true;
+            if (length)
+            {
+                void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED)
+                {
+                    length = 0;
+                    opened = false;
+                }
+                else
+                {
+                    ptr = (const char*)p;
+                    madvise(p, length, MADV_WILLNEED);
+                }
+            }
+        }
+        close(fd);
+#endif
+    }
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (ptr)
+            munmap((void*)ptr, length);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+};
+
 void split(const string& str, char c, vector<string>& tokens)
 {
     int s = 0;
@@ -43,41 +43,6 @@ public:
     }
 };
 
-class Input
-{
-    friend class Game;
-
-    bool oldKeys[GLFW_KEY_LAST] = { false };
-    bool newKeys[GLFW_KEY_LAST] = { false };
-    bool oldMouse[GLFW_MOUSE_BUTTON_LAST] = { false };
-    bool newMouse[GLFW_MOUSE_BUTTON_LAST] = { false };
-    float2 oldMousePos;
-    float2 newMousePos;
-    float2 oldScroll;
-    float2 newScroll;
-
-public:
-    bool keyPressed(int key)    const { return newKeys[key] && !oldKeys[key]; }
-    bool keyReleased(int key)   const { return oldKeys[key] && !newKeys[key]; }
-    bool keyDown(int key)       const { return newKeys[key]; }
-    bool mousePressed(int but)  const { return newMouse[but] && !oldMouse[but]; }
-    bool mouseReleased(int but) const { return oldMouse[but] && !newMouse[but]; }
-    bool mouseDown(int but)     const { return newMouse[but]; }
-    float2 mousePos()   const { return newMousePos; }
-    float2 mouseMove()  const { return newMousePos - oldMousePos; }
-
-    void update()
-    {
-        memcpy(oldKeys, newKeys, sizeof(bool) * GLFW_KEY_LAST);
-        memcpy(oldMouse, newMouse, sizeof(bool) * GLFW_MOUSE_BUTTON_LAST);
-        oldMousePos = newMousePos;
-        oldScroll = newScroll;
-
-        glfwPollEvents();
-    }
-};
-
-
 #include "gamestate.h"
 
 class Game
@@ -86,11 +51,42 @@ class Game
     int windowWidth = 0;
     int windowHeight = 0;
     bool shouldExit = false;
+
+    // headless mode runs on the NullGL backend with no window,
+    // for a fixed number of frames (0 = until exit() is called)
+    int headless = -1;
+    int headlessFrames = 0;
+    int frame = 0;
+
+    // headless_backend = soft rasterizes every frame on the CPU,
+    // and writes them to headless_capture (a directory) if that's set
+    SoftRasterizer* rasterizer = nullptr;
+    string captureDir;
+
+    // input_thread = 1 polls window events on the main thread while the
+    // game loop runs on its own, so input latency isn't tied to frame time
+    bool inputThread = false;
     int devicePixelRatio = 2;
     GameState* currentState = nullptr;
 
+    // set with setOption(), they win over options.txt
+    map<string, string> options;
+
+    // profiler overlay, toggled with F3; F4 dumps a chrome trace
+    bool showProfiler = false;
+    Sprite* profilerSprite = nullptr;
+    SpriteFont* profilerFont = nullptr;
+
     int initWindow()
     {
+        if (headless)
+        {
+            windowWidth = atoi(config->get("display_width", "1280").c_str());
+            windowHeight = atoi(config->get("display_height", "720").c_str());
+            NullGL::get().setViewport(windowWidth, windowHeight);
+            return 1;
+        }
+
         if (!glfwInit())
         {
             glfwTerminate();
@@ -123,9 +119,23 @@ class Game
     }
     int initGraphics()
     {
-        glfwMakeContextCurrent(window);
-        // glewInit();
-        gladLoadGL(glfwGetProcAddress);
+        if (headless)
+        {
+            if (!gladLoadGL(NullGL::getProcAddress))
+                return 0;
+
+            if (config->get("headless_backend", "null") == "soft")
+            {
+                rasterizer = new SoftRasterizer(windowWidth, windowHeight, jobs);
+                captureDir = config->get("headless_capture", "");
+            }
+        }
+        else
+        {
+            glfwMakeContextCurrent(window);
+            // glewInit();
+            gladLoadGL(glfwGetProcAddress);
+        }
 
         GLint dims[4];
         glGetIntegerv(GL_VIEWPORT, dims);
@@ -148,31 +158,37 @@ class Game
     }
     int initInput()
     {
+        if (headless)
+        {
+            return 1;
+        }
+
+        // callbacks only queue events, Input::update applies them on the game thread
         glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
             auto game = (Game*)glfwGetWindowUserPointer(window);
-            if (action == GLFW_PRESS)
-                game->input.newKeys[key] = true;
-            if (action == GLFW_RELEASE)
-                game->input.newKeys[key] = false;
+            InputEvent e { InputEvent::Key, (uchar)action, (short)key };
+            e.time = glfwGetTime();
+            game->input.push(e);
         });
         glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int mods) {
             auto game = (Game*)glfwGetWindowUserPointer(window);
-            if (action == GLFW_PRESS)
-                game->input.newMouse[button] = true;
-            if (action == GLFW_RELEASE)
-                game->input.newMouse[button] = false;
+            InputEvent e { InputEvent::MouseButton, (uchar)action, (short)button };
+            e.time = glfwGetTime();
+            game->input.push(e);
         });
         glfwSetCursorPosCallback(window, [](GLFWwindow* window, double x, double y) {
             auto game = (Game*)glfwGetWindowUserPointer(window);
-            game->input.newMousePos.x = x;
-            game->input.newMousePos.y = y;
-            // game->input.newMousePos.x = min(max(0, game->input.newMousePos.x), game->windowWidth);
-            // game->input.newMousePos.y = min(max(0, game->input.newMousePos.y), game->windowWidth);
+            InputEvent e { InputEvent::MouseMove };
+            e.value = float2(x, y);
+            e.time = glfwGetTime();
+            game->input.push(e);
         });
         glfwSetScrollCallback(window, [](GLFWwindow* window, double xscr, double yscr) {
             auto game = (Game*)glfwGetWindowUserPointer(window);
-            game->input.newScroll.x = xscr;
-            game->input.newScroll.y = yscr;
+            InputEvent e { InputEvent::Scroll };
+            e.value = float2(xscr, yscr);
+            e.time = glfwGetTime();
+            game->input.push(e);
         });
         
         // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -185,6 +201,7 @@ protected:
 
     void logGlError()
     {
+        PROFILE_SCOPE("glGetError");
         while (true)
         {
             auto err = glGetError();
@@ -210,57 +227,155 @@ protected:
         }
     }
 
-    int init()
+    // window and input; must run on the main thread
+    int initPlatform()
     {
-        if (!initWindow())
-            return 1;
-        if (!initGraphics())
-            return 2;
-        if (!initInput())
-            return 3;
-
         glfwSetErrorCallback([](int err, const char* msg) {
             cout << "GLFW Error: " << err << " - " << msg << endl;
             ::exit(5);
         });
 
+        if (!initWindow())
+            return 0;
+        if (!initInput())
+            return 0;
+        return 1;
+    }
+    // everything else; runs on the thread that runs the game loop
+    int init()
+    {
+        int workers = atoi(config->get("worker_threads", "-1").c_str());
+        jobs = new JobSystem(workers);
+        cout << "job system: " << jobs->numThreads() << " threads" << endl;
+
+        if (!initGraphics())
+            return 0;
+
         shaders = new ShaderManager();
         textures = new TextureManager();
-        meshes = new MeshManager();
+        meshes = new MeshManager(shaders, jobs);
 
         logGlError();
         cout << "starting main loop" << endl;
 
         currentState->init();
+        return 1;
     }
     void update()
     {
+        PROFILE_SCOPE("update");
+        if (!headless && !inputThread)
+        {
+            glfwPollEvents();
+        }
         input.update();
+
+        if (input.keyPressed(GLFW_KEY_F3))
+        {
+            showProfiler = !showProfiler;
+        }
+        if (input.keyPressed(GLFW_KEY_F4))
+        {
+            Profiler::get().exportChromeTrace("profile.json");
+        }
+
         currentState->update();
     }
     void render()
     {
-        glClearColor(0.25, 0.4, 0.8, 1);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        currentState->render();
+        {
+            PROFILE_SCOPE("render");
+            PROFILE_GPU_SCOPE("render");
 
-        glfwSwapBuffers(window);
+            glClearColor(0.25, 0.4, 0.8, 1);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            currentState->render();
+        }
+
+        if (showProfiler)
+        {
+            if (!profilerSprite)
+            {
+                profilerSprite = new Sprite(shaders);
+                profilerFont = textures->getFont("SourceCodePro-Light-56");
+            }
+            Profiler::get().drawOverlay(profilerSprite, profilerFont, float2(8, 8));
+        }
+
+        if (headless)
+        {
+            if (rasterizer && captureDir.size())
+            {
+                stringstream fname;
+                fname << captureDir << "/frame" << setw(5) << setfill('0') << frame << ".png";
+                rasterizer->writePNG(fname.str());
+            }
+            else if (rasterizer)
+            {
+                rasterizer->flush();
+            }
+            NullGL::get().endFrame();
+        }
+        else
+        {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
         logGlError();
+        frame++;
+
+        meshes->collect();
+        textures->collect();
+        shaders->collect();
+
+        Profiler::get().endFrame();
     }
     void close()
     {
         currentState->close();
         delete currentState;
 
+        delete profilerSprite;
+        Profiler::get().releaseGpu();
+        delete rasterizer;
+
+        cout << "assets:" << endl;
+        meshes->printStats();
+        textures->printStats();
+        shaders->printStats();
         delete meshes;
         delete textures;
         delete shaders;
+        delete jobs;
+    }
+    void closePlatform()
+    {
         delete config;
+
+        if (headless)
+        {
+            NullGL::get().stats.print("nullgl totals over " + to_string(frame) + " frames:");
+            return;
+        }
         glfwDestroyWindow(window);
         glfwTerminate();
     }
 
+    void mainLoop()
+    {
+        while (!shouldExit)
+        {
+            if (headless ? (headlessFrames && frame >= headlessFrames) : glfwWindowShouldClose(window))
+            {
+                break;
+            }
+
+            update();
+            render();
+        }
+    }
+
     void exitGame()
     {
         shouldExit = true;
@@ -272,12 +387,28 @@ public:
     TextureManager* textures = nullptr;
     MeshManager* meshes = nullptr;
     Config* config = nullptr;
+    JobSystem* jobs = nullptr;
 
     void exit()
     {
         shouldExit = true;
     }
 
+    bool isHeadless() const { return headless == 1; }
+
+    // run without a window on the NullGL backend; overrides the 'headless' option
+    void setHeadless(bool enable, int frames = 0)
+    {
+        headless = enable ? 1 : 0;
+        headlessFrames = frames;
+    }
+
+    // overrides an options.txt setting; call before run()
+    void setOption(const string& key, const string& value)
+    {
+        options[key] = value;
+    }
+
     void setState(GameState* state)
     {
         currentState->close();
@@ -291,24 +422,61 @@ public:
     int run(GameState* state)
     {
         config = new Config(string(RESOURCE_BASE) + "/options.txt");
+        for (auto& option : options)
+        {
+            config->settings[option.first] = option.second;
+        }
+        if (headless < 0)
+        {
+            headless = atoi(config->get("headless", "0").c_str()) ? 1 : 0;
+            headlessFrames = atoi(config->get("headless_frames", "0").c_str());
+        }
+        inputThread = !headless && atoi(config->get("input_thread", "0").c_str());
 
         currentState = state;
         currentState->game = this;
-        
-        if (!init())
+
+        if (!initPlatform())
             return 1;
 
-        while (!glfwWindowShouldClose(window) && !shouldExit)
+        int result = 0;
+        if (inputThread)
         {
-            update();
-            // TODO: separate thread
-            render();
-
+            // this thread only pumps window events into the input queue;
+            // the game loop gets its own thread and takes the GL context with it
+            atomic<bool> loopDone { false };
+            thread loopThread([&] {
+                if (init())
+                {
+                    mainLoop();
+                    close();
+                }
+                else
+                {
+                    result = 1;
+                }
+                loopDone = true;
+                glfwPostEmptyEvent();
+            });
+            while (!loopDone)
+            {
+                glfwWaitEvents();
+            }
+            loopThread.join();
+        }
+        else if (init())
+        {
+            mainLoop();
+            close();
+        }
+        else
+        {
+            result = 1;
         }
 
-        close();
+        closePlatform();
 
-        return 0;
+        return result;
     }
 };
 
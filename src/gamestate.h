@@ -12,7 +12,10 @@ private:
 protected:
     Game* game;
 public:
+    virtual ~GameState() {}
+
     virtual void init() = 0;
+    // game->jobs can be used to spread update work across cores
     virtual void update() = 0;
     virtual void render() = 0;
     virtual void close() = 0;
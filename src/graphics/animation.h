@@ -0,0 +1,724 @@
+#ifndef _CUBE_ANIMATION_H
+#define _CUBE_ANIMATION_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../simd.h"
+#include "../jobs.h"
+#include "buffer.h"
+#include "shader.h"
+
+// skeletal animation
+//
+// a skeleton is flat arrays indexed by bone, every bone after its parent, so
+// posing one is a single pass in bone order. a pose is every bone's
+// transform relative to its parent, and clips are keyframes per bone sampled
+// into a pose; CompressedClip holds them in a fraction of the memory, for
+// playing rather than editing. skinCharacters() turns the poses of many
+// characters sharing a skeleton into skinning matrices a register's worth of
+// characters at a time, one per SIMD lane: building the local matrices,
+// concatenating them down the hierarchy and applying the inverse bind
+// matrices are all straight line SIMD with no shuffles, and groups of
+// characters run as jobs. the matrices reach skinnedvs.glsl through a
+// uniform buffer (SkinningBuffer)
+
+// relative to the parent bone
+struct BoneTransform
+{
+    float3 translation = float3(0, 0, 0);
+    float4 rotation = float4(0, 0, 0, 1);   // unit quaternion, xyzw
+    float3 scale = float3(1, 1, 1);
+
+    // scale, then rotate, then translate (row vectors, like matrix)
+    matrix toMatrix() const
+    {
+        float x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+        return {{
+            (1 - 2 * (y * y + z * z)) * scale.x, 2 * (x * y + w * z) * scale.x, 2 * (x * z - w * y) * scale.x, 0,
+            2 * (x * y - w * z) * scale.y, (1 - 2 * (x * x + z * z)) * scale.y, 2 * (y * z + w * x) * scale.y, 0,
+            2 * (x * z + w * y) * scale.z, 2 * (y * z - w * x) * scale.z, (1 - 2 * (x * x + y * y)) * scale.z, 0,
+            translation.x, translation.y, translation.z, 1,
+        }};
+    }
+    matrix toInverseMatrix() const
+    {
+        BoneTransform rotate;
+        rotate.rotation = rotation;
+        return matrix::translation(-translation) * transpose(rotate.toMatrix()) * matrix::scale(float3(1 / scale.x, 1 / scale.y, 1 / scale.z));
+    }
+};
+
+inline float4 quatAxisAngle(const float3& axis, float angle)
+{
+    float3 a = normalize(axis) * sinf(angle * 0.5f);
+    return float4(a.x, a.y, a.z, cosf(angle * 0.5f));
+}
+
+// translation and scale lerped, rotation nlerped the short way round
+inline BoneTransform blend(const BoneTransform& a, const BoneTransform& b, float t)
+{
+    BoneTransform r;
+    r.translation = a.translation + (b.translation - a.translation) * t;
+    r.scale = a.scale + (b.scale - a.scale) * t;
+    float4 q = b.rotation;
+    if (dot(a.rotation, q) < 0)
+        q = -q;
+    r.rotation = normalize(a.rotation + (q - a.rotation) * t);
+    return r;
+}
+
+struct Skeleton
+{
+    vector<string> names;
+    vector<int> parents;                // -1 for a root
+    vector<BoneTransform> bindPose;     // relative to parents
+    vector<matrix> inverseBind;         // model space to bone space, in the bind pose
+
+    uint size() const { return parents.size(); }
+
+    // parent must already be added (or -1); returns the new bone's index
+    int addBone(const string& name, int parent, const BoneTransform& bind)
+    {
+        assert(parent < (int)size());
+        names.push_back(name);
+        parents.push_back(parent);
+        bindPose.push_back(bind);
+        inverseBind.push_back(parent >= 0 ? inverseBind[parent] * bind.toInverseMatrix() : bind.toInverseMatrix());
+        return size() - 1;
+    }
+    int find(const string& name) const
+    {
+        for (uint b = 0; b < names.size(); b++)
+        {
+            if (names[b] == name)
+                return b;
+        }
+        return -1;
+    }
+};
+
+// keyframes for one bone
+struct AnimationTrack
+{
+    uint bone = 0;
+    vector<float> times;                // ascending, in seconds
+    vector<BoneTransform> keys;
+
+    // held before the first key and after the last; keys must not be empty
+    BoneTransform at(float time) const
+    {
+        uint next = upper_bound(times.begin(), times.end(), time) - times.begin();
+        if (next == 0)
+            return keys[0];
+        if (next == keys.size())
+            return keys.back();
+        float t0 = times[next - 1], t1 = times[next];
+        return blend(keys[next - 1], keys[next], (time - t0) / (t1 - t0));
+    }
+};
+
+struct AnimationClip
+{
+    string name;
+    float duration = 0.0f;
+    vector<AnimationTrack> tracks;
+
+    // the clip at time, wrapped to its duration; bones without a track keep
+    // whatever pose has
+    void sample(float time, BoneTransform* pose) const
+    {
+        if (duration > 0)
+        {
+            time = fmodf(time, duration);
+            time += time < 0 ? duration : 0;
+        }
+        for (auto& t : tracks)
+        {
+            if (t.keys.size())
+                pose[t.bone] = t.at(time);
+        }
+    }
+};
+
+// how far a CompressedClip may stray from its source, at every frame
+struct ClipTolerance
+{
+    float translation = 0.001f;     // distance
+    float rotation = 0.002f;        // radians
+    float scale = 0.001f;
+};
+
+// an AnimationClip resampled at a fixed frame rate and compressed. each
+// channel (one bone's translation, rotation or scale) is a cubic spline
+// through as few of its frames as keep every other frame within tolerance,
+// found by dropping whichever key costs least until none can go. keys are
+// quantized, rotations to their smallest three components and translations
+// and scales to 16 bits over the channel's range, and a channel that never
+// moves is a single constant. the keys of all channels are one stream,
+// ordered by the frame at which a sampler first needs them, so playing
+// forward with a Cursor reads the stream front to back and decodes every
+// key once
+class CompressedClip
+{
+    enum { Translation, Rotation, Scale };
+
+    struct Channel
+    {
+        ushort bone;
+        ushort kind;
+        float3 lo;          // the range translation and scale keys are quantized to
+        float3 extent;
+    };
+    struct Constant
+    {
+        ushort bone;
+        ushort kind;
+        float4 value;
+    };
+    struct Key
+    {
+        ushort frame;
+        ushort channel;
+        ushort data[3];
+    };
+
+    vector<Channel> channels;
+    vector<Constant> constants;
+    vector<Key> keys;               // sorted by when they are needed
+    float frameRate;
+    uint lastFrame;
+
+public:
+    // the four keys around the segment of a channel being played
+    struct Window
+    {
+        ushort frames[4];
+        float4 keys[4];
+
+        Window()
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                frames[i] = 0;
+                keys[i] = float4(0, 0, 0, 0);
+            }
+        }
+    };
+    // and the segment itself, by powers of the fraction through it
+    struct Segment
+    {
+        float4 curve[4];
+        float start = 0.0f, scale = 0.0f;   // the fraction is (frame - start) * scale
+    };
+
+    // where one player of a clip is up to; kept from frame to frame, so that
+    // playing forward only decodes the keys it passes. segments are apart
+    // from windows, as every sample reads them but windows only change when
+    // a key is taken
+    struct Cursor
+    {
+        vector<Window> windows;         // by channel
+        vector<Segment> segments;
+        uint position = 0;              // next key in the stream
+        int frame = -1;
+    };
+
+private:
+    static float4 get(const BoneTransform& t, uint kind)
+    {
+        if (kind == Rotation)
+            return t.rotation;
+        const float3& v = kind == Translation ? t.translation : t.scale;
+        return float4(v.x, v.y, v.z, 0);
+    }
+    static void set(BoneTransform& t, uint kind, const float4& v)
+    {
+        if (kind == Rotation)
+            t.rotation = v;
+        else if (kind == Translation)
+            t.translation = float3(v.x, v.y, v.z);
+        else
+            t.scale = float3(v.x, v.y, v.z);
+    }
+    // distance, or the angle between rotations; not by acos, which is no
+    // good for the small angles that matter here
+    static float difference(uint kind, const float4& a, const float4& b)
+    {
+        if (kind != Rotation)
+            return len(float3(a.x - b.x, a.y - b.y, a.z - b.z));
+        float4 c = dot(a, b) < 0 ? -b : b;
+        return 4 * atan2f(len(a - c), len(a + c));
+    }
+
+    // shifts key in at the end of w, moving s on a segment. rotations are
+    // kept in one hemisphere so the curve takes the short way round
+    static void advance(uint kind, Window& w, Segment& s, uint frame, const float4& key)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            w.frames[i] = w.frames[i + 1];
+            w.keys[i] = w.keys[i + 1];
+        }
+        w.frames[3] = frame;
+        w.keys[3] = (kind == Rotation && dot(w.keys[2], key) < 0) ? -key : key;
+
+        // hermite, with each key's tangent that of the parabola through it
+        // and its neighbours (which unlike catmull-rom's holds up when keys
+        // are unevenly spaced), scaled to the segment
+        float h0 = (float)(w.frames[1] - w.frames[0]);
+        float h = (float)(w.frames[2] - w.frames[1]);
+        float h1 = (float)(w.frames[3] - w.frames[2]);
+        float4 d0 = w.keys[1] - w.keys[0], d = w.keys[2] - w.keys[1], d1 = w.keys[3] - w.keys[2];
+        float4 m1 = d, m2 = d;
+        if (h > 0 && h0 > 0)
+            m1 = (d0 * (h * h) + d * (h0 * h0)) * (1.0f / (h0 * (h0 + h)));
+        if (h > 0 && h1 > 0)
+            m2 = (d * (h1 * h1) + d1 * (h * h)) * (1.0f / (h1 * (h + h1)));
+        s.curve[0] = w.keys[1];
+        s.curve[1] = m1;
+        s.curve[2] = d * 3.0f - m1 * 2.0f - m2;
+        s.curve[3] = m1 + m2 - d * 2.0f;
+        s.start = (float)w.frames[1];
+        s.scale = h > 0 ? 1.0f / h : 0.0f;
+    }
+    static float4 evaluate(uint kind, const Segment& s, float at)
+    {
+        float t = s.scale > 0 ? fminf(fmaxf((at - s.start) * s.scale, 0.0f), 1.0f) : 1.0f;
+        float4 v;
+        for (int i = 0; i < 4; i++)
+            v._x[i] = s.curve[0]._x[i] + (s.curve[1]._x[i] + (s.curve[2]._x[i] + s.curve[3]._x[i] * t) * t) * t;
+        if (kind == Rotation)
+        {
+            float l = 1.0f / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+            v = float4(v.x * l, v.y * l, v.z * l, v.w * l);
+        }
+        return v;
+    }
+
+    // the largest component of a rotation is left out, its sign made
+    // positive; two bits say which it was, and the others are 15 bits each
+    static void encode(const Channel& c, const float4& v, ushort* data)
+    {
+        if (c.kind == Rotation)
+        {
+            int largest = 0;
+            for (int i = 1; i < 4; i++)
+                largest = fabsf(v._x[i]) > fabsf(v._x[largest]) ? i : largest;
+            float sign = v._x[largest] < 0 ? -1.0f : 1.0f;
+            for (int i = 0, j = 0; i < 4; i++)
+            {
+                if (i == largest)
+                    continue;
+                float f = (v._x[i] * sign * 0.70710678f + 0.5f) * 32766.0f;
+                data[j++] = (ushort)floorf(fminf(fmaxf(f, 0.0f), 32766.0f) + 0.5f);
+            }
+            data[0] |= (largest >> 1) << 15;
+            data[1] |= (largest & 1) << 15;
+            return;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            float f = c.extent._x[i] > 0 ? (v._x[i] - c.lo._x[i]) / c.extent._x[i] * 65535.0f : 0.0f;
+            data[i] = (ushort)floorf(fminf(fmaxf(f, 0.0f), 65535.0f) + 0.5f);
+        }
+    }
+    static float4 decode(const Channel& c, const ushort* data)
+    {
+        if (c.kind == Rotation)
+        {
+            int largest = ((data[0] >> 15) << 1) | (data[1] >> 15);
+            float4 q;
+            float sum = 0;
+            for (int i = 0, j = 0; i < 4; i++)
+            {
+                if (i == largest)
+                    continue;
+                float f = ((data[j++] & 0x7fff) / 32766.0f - 0.5f) * 1.41421356f;
+                q._x[i] = f;
+                sum += f * f;
+            }
+            q._x[largest] = sqrtf(fmaxf(1.0f - sum, 0.0f));
+            return q;
+        }
+        return float4(c.lo.x + c.extent.x * (data[0] / 65535.0f),
+                      c.lo.y + c.extent.y * (data[1] / 65535.0f),
+                      c.lo.z + c.extent.z * (data[2] / 65535.0f), 0);
+    }
+
+public:
+    string name;
+    float duration = 0.0f;
+
+    // throws runtime_error if the clip is too long for 16 bit frame numbers
+    CompressedClip(const AnimationClip& clip, const ClipTolerance& tolerance = ClipTolerance(), float _frameRate = 30.0f) :
+        frameRate(_frameRate), name(clip.name), duration(clip.duration)
+    {
+        float frames = ceilf(fmaxf(duration, 0.0f) * frameRate);
+        if (frames > 65535)
+            throw runtime_error("clip " + name + " is too long to compress");
+        lastFrame = (uint)frames;
+
+        struct Pending
+        {
+            uint needed;
+            Key key;
+        };
+        vector<Pending> pending;
+        vector<float4> values(lastFrame + 1), quantized(lastFrame + 1);
+        vector<Key> encoded(lastFrame + 1);
+        vector<uint> previous(lastFrame + 1), next(lastFrame + 1), sequence;
+        vector<float> errors(lastFrame + 1);
+        for (auto& track : clip.tracks)
+        {
+            if (!track.keys.size())
+                continue;
+            for (uint kind = Translation; kind <= Scale; kind++)
+            {
+                float limit = kind == Translation ? tolerance.translation : kind == Rotation ? tolerance.rotation : tolerance.scale;
+                bool moves = false;
+                for (uint f = 0; f <= lastFrame; f++)
+                {
+                    values[f] = get(track.at(fminf(f / frameRate, duration)), kind);
+                    moves = moves || difference(kind, values[f], values[0]) > limit;
+                }
+                if (!moves)
+                {
+                    constants.push_back({ (ushort)track.bone, (ushort)kind, values[0] });
+                    continue;
+                }
+
+                Channel channel = { (ushort)track.bone, (ushort)kind, float3(0, 0, 0), float3(0, 0, 0) };
+                if (kind != Rotation)
+                {
+                    float4 lo = values[0], hi = values[0];
+                    for (auto& v : values)
+                    {
+                        lo = float4(fminf(lo.x, v.x), fminf(lo.y, v.y), fminf(lo.z, v.z), 0);
+                        hi = float4(fmaxf(hi.x, v.x), fmaxf(hi.y, v.y), fmaxf(hi.z, v.z), 0);
+                    }
+                    channel.lo = float3(lo.x, lo.y, lo.z);
+                    channel.extent = float3(hi.x - lo.x, hi.y - lo.y, hi.z - lo.z);
+                }
+                ushort index = channels.size();
+                channels.push_back(channel);
+                for (uint f = 0; f <= lastFrame; f++)
+                {
+                    encoded[f] = { (ushort)f, index, { 0, 0, 0 } };
+                    encode(channel, values[f], encoded[f].data);
+                    quantized[f] = decode(channel, encoded[f].data);
+                }
+
+                // every frame is a key to start with, then the key that
+                // costs least to drop is dropped until every one left would
+                // take some frame past the limit. dropping a key changes the
+                // segments on either side of it too, their tangents depending
+                // on it. spans are capped so that fitting stays quick on long
+                // clips; the ends count as their own neighbours
+                const uint MaxSpan = 256;
+                for (uint f = 0; f <= lastFrame; f++)
+                {
+                    previous[f] = f ? f - 1 : 0;
+                    next[f] = f < lastFrame ? f + 1 : lastFrame;
+                }
+                auto segmentError = [&](uint a, uint b, uint c, uint d) {
+                    // the segment from b to c
+                    Window w;
+                    Segment s;
+                    for (uint k : { a, b, c, d })
+                        advance(kind, w, s, k, quantized[k]);
+                    float error = 0.0f;
+                    for (uint f = b + 1; f < c; f++)
+                        error = fmaxf(error, difference(kind, evaluate(kind, s, (float)f), values[f]));
+                    return error;
+                };
+                auto dropError = [&](uint f) {
+                    uint b = previous[f], c = next[f];
+                    uint a = previous[b], d = next[c];
+                    if (c - b > MaxSpan)
+                        return INFINITY;
+                    return fmaxf(segmentError(previous[a], a, b, c), fmaxf(segmentError(a, b, c, d), segmentError(b, c, d, next[d])));
+                };
+                typedef pair<float, uint> Candidate;
+                priority_queue<Candidate, vector<Candidate>, greater<Candidate>> queue;
+                for (uint f = 1; f < lastFrame; f++)
+                {
+                    errors[f] = dropError(f);
+                    queue.push({ errors[f], f });
+                }
+                while (queue.size())
+                {
+                    Candidate top = queue.top();
+                    queue.pop();
+                    uint f = top.second;
+                    if (top.first != errors[f] || next[previous[f]] != f)
+                        continue;   // stale, or already dropped
+                    if (top.first > limit)
+                        break;
+                    uint b = previous[f], c = next[f];
+                    next[b] = c;
+                    previous[c] = b;
+                    // every key whose drop would touch the segments that changed
+                    uint around[6] = { b, previous[b], previous[previous[b]], c, next[c], next[next[c]] };
+                    for (uint k : around)
+                    {
+                        if (k == 0 || k == lastFrame)
+                            continue;
+                        float e = dropError(k);
+                        if (e != errors[k])
+                        {
+                            errors[k] = e;
+                            queue.push({ e, k });
+                        }
+                    }
+                }
+
+                // the keys as a sampler sees them, the ends doubled so the
+                // first and last segments have four
+                sequence.assign(1, 0);
+                for (uint f = 0; ; f = next[f])
+                {
+                    sequence.push_back(f);
+                    if (f == lastFrame)
+                        break;
+                }
+                sequence.push_back(lastFrame);
+
+                // a sampler needs a key once it reaches the key two before
+                for (uint i = 0; i < sequence.size(); i++)
+                    pending.push_back({ i >= 2 ? sequence[i - 2] : 0, encoded[sequence[i]] });
+            }
+        }
+
+        stable_sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) { return a.needed < b.needed; });
+        keys.reserve(pending.size());
+        for (auto& p : pending)
+            keys.push_back(p.key);
+    }
+
+    // the clip at time, wrapped to its duration, carrying on from where
+    // cursor left off; going back (when looping, say) starts again from the
+    // top. bones without a track keep whatever pose has
+    void sample(float time, BoneTransform* pose, Cursor& cursor) const
+    {
+        if (duration > 0)
+        {
+            time = fmodf(time, duration);
+            time += time < 0 ? duration : 0;
+        }
+        float at = fminf(fmaxf(time, 0.0f) * frameRate, (float)lastFrame);
+        int frame = (int)at;
+        if (frame < cursor.frame || cursor.windows.size() != channels.size())
+        {
+            cursor.windows.assign(channels.size(), Window());
+            cursor.segments.assign(channels.size(), Segment());
+            cursor.position = 0;
+        }
+        cursor.frame = frame;
+
+        // take keys until one's channel hasn't reached the end of its segment
+        while (cursor.position < keys.size())
+        {
+            const Key& k = keys[cursor.position];
+            Window& w = cursor.windows[k.channel];
+            if ((int)w.frames[2] > frame)
+                break;
+            advance(channels[k.channel].kind, w, cursor.segments[k.channel], k.frame, decode(channels[k.channel], k.data));
+            cursor.position++;
+        }
+
+        for (auto& c : constants)
+            set(pose[c.bone], c.kind, c.value);
+        for (uint i = 0; i < channels.size(); i++)
+            set(pose[channels[i].bone], channels[i].kind, evaluate(channels[i].kind, cursor.segments[i], at));
+    }
+    // from the top of the stream every time; play clips with a Cursor
+    void sample(float time, BoneTransform* pose) const
+    {
+        Cursor cursor;
+        sample(time, pose, cursor);
+    }
+
+    // bytes of keys and tables
+    size_t size() const
+    {
+        return keys.size() * sizeof(Key) + channels.size() * sizeof(Channel) + constants.size() * sizeof(Constant);
+    }
+};
+
+// an affine matrix as its first three columns, which is how skinnedvs.glsl
+// reads it: p' = (dot(columns[0], p), dot(columns[1], p), dot(columns[2], p))
+struct SkinMatrix
+{
+    float4 columns[3];
+};
+
+// skinning matrices for count characters sharing skeleton. character i starts
+// from the bind pose and is posed by pose(i, BoneTransform* bones); its
+// matrices go to out + i * stride bytes, one per bone
+template<typename PoseFunction>
+void skinCharacters(const Skeleton& skeleton, uint count, const PoseFunction& pose, void* out, size_t stride, JobSystem* jobs = nullptr)
+{
+    const int Width = SimdFloat::Width;
+    uint bones = skeleton.size();
+    uint groups = (count + Width - 1) / Width;
+    if (!bones || !groups)
+        return;
+
+    auto work = [&](int begin, int end) {
+        vector<BoneTransform> poses(bones * Width);
+        vector<SimdFloat> models(bones * 12);   // rows of the 3x3, then the translation
+        float lanes[10][Width];
+        float skin[12][Width];
+
+        for (int g = begin; g < end; g++)
+        {
+            uint first = g * Width;
+            uint n = count - first < (uint)Width ? count - first : Width;
+            for (uint c = 0; c < n; c++)
+            {
+                copy(skeleton.bindPose.begin(), skeleton.bindPose.end(), poses.begin() + c * bones);
+                pose(first + c, &poses[c * bones]);
+            }
+
+            for (uint b = 0; b < bones; b++)
+            {
+                // transposed so that each lane is a character; spare lanes repeat the last
+                for (int c = 0; c < Width; c++)
+                {
+                    const BoneTransform& t = poses[((uint)c < n ? c : n - 1) * bones + b];
+                    lanes[0][c] = t.translation.x;
+                    lanes[1][c] = t.translation.y;
+                    lanes[2][c] = t.translation.z;
+                    lanes[3][c] = t.rotation.x;
+                    lanes[4][c] = t.rotation.y;
+                    lanes[5][c] = t.rotation.z;
+                    lanes[6][c] = t.rotation.w;
+                    lanes[7][c] = t.scale.x;
+                    lanes[8][c] = t.scale.y;
+                    lanes[9][c] = t.scale.z;
+                }
+                SimdFloat x = SimdFloat::load(lanes[3]), y = SimdFloat::load(lanes[4]), z = SimdFloat::load(lanes[5]), w = SimdFloat::load(lanes[6]);
+                SimdFloat sx = SimdFloat::load(lanes[7]), sy = SimdFloat::load(lanes[8]), sz = SimdFloat::load(lanes[9]);
+                SimdFloat one(1.0f), two(2.0f);
+                SimdFloat xx = x * x * two, yy = y * y * two, zz = z * z * two;
+                SimdFloat xy = x * y * two, xz = x * z * two, yz = y * z * two;
+                SimdFloat wx = w * x * two, wy = w * y * two, wz = w * z * two;
+
+                // the local matrix, as BoneTransform::toMatrix
+                SimdFloat local[12] = {
+                    (one - yy - zz) * sx, (xy + wz) * sx, (xz - wy) * sx,
+                    (xy - wz) * sy, (one - xx - zz) * sy, (yz + wx) * sy,
+                    (xz + wy) * sz, (yz - wx) * sz, (one - xx - yy) * sz,
+                    SimdFloat::load(lanes[0]), SimdFloat::load(lanes[1]), SimdFloat::load(lanes[2]),
+                };
+
+                // model = local * parent's model
+                SimdFloat* m = &models[b * 12];
+                int parent = skeleton.parents[b];
+                if (parent < 0)
+                {
+                    copy(local, local + 12, m);
+                }
+                else
+                {
+                    const SimdFloat* p = &models[parent * 12];
+                    for (int i = 0; i < 4; i++)
+                    {
+                        for (int j = 0; j < 3; j++)
+                        {
+                            SimdFloat r = local[i * 3] * p[j] + local[i * 3 + 1] * p[3 + j] + local[i * 3 + 2] * p[6 + j];
+                            m[i * 3 + j] = i < 3 ? r : r + p[9 + j];
+                        }
+                    }
+                }
+
+                // skin = inverse bind * model; the inverse bind is the same in every lane
+                const float* ib = skeleton.inverseBind[b].m;
+                for (int i = 0; i < 4; i++)
+                {
+                    for (int j = 0; j < 3; j++)
+                    {
+                        SimdFloat r = SimdFloat(ib[i * 4]) * m[j] + SimdFloat(ib[i * 4 + 1]) * m[3 + j] + SimdFloat(ib[i * 4 + 2]) * m[6 + j];
+                        (i < 3 ? r : r + m[9 + j]).store(skin[i * 3 + j]);
+                    }
+                }
+                for (uint c = 0; c < n; c++)
+                {
+                    SkinMatrix* dst = (SkinMatrix*)((uchar*)out + (first + c) * stride) + b;
+                    for (int j = 0; j < 3; j++)
+                        dst->columns[j] = float4(skin[j][c], skin[3 + j][c], skin[6 + j][c], skin[9 + j][c]);
+                }
+            }
+        }
+    };
+
+    if (jobs)
+        jobs->parallelFor(0, groups, 4, work);
+    else
+        work(0, groups);
+}
+
+// the skinning matrices of many characters in one uniform buffer, rewritten
+// every frame. each character's start on the uniform buffer alignment, and
+// bind() points the Bones block (see skinnedvs.glsl) at one of them
+class SkinningBuffer
+{
+    Buffer* buffer = nullptr;
+    vector<uchar> data;
+    uint bones;
+    uint characters = 0;
+    size_t stride;
+
+public:
+    static const uint MaxBones = 128;   // as skinnedvs.glsl declares
+    static const uint Binding = 0;      // uniform buffer binding point
+
+    // throws runtime_error if bones is over MaxBones
+    SkinningBuffer(uint _bones) : bones(_bones)
+    {
+        if (bones > MaxBones)
+            throw runtime_error("skeleton has " + to_string(bones) + " bones, skinning takes " + to_string(MaxBones));
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = alignment > 0 ? alignment : 256;
+        stride = (bones * sizeof(SkinMatrix) + alignment - 1) / alignment * alignment;
+        buffer = new Buffer(GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
+    }
+    ~SkinningBuffer()
+    {
+        delete buffer;
+    }
+    SkinningBuffer(const SkinningBuffer&) = delete;
+    SkinningBuffer& operator = (const SkinningBuffer&) = delete;
+
+    // poses count characters of skeleton (see skinCharacters) and uploads them
+    template<typename PoseFunction>
+    void update(const Skeleton& skeleton, uint count, const PoseFunction& pose, JobSystem* jobs = nullptr)
+    {
+        assert(skeleton.size() == bones);
+        characters = count;
+        if (!count)
+            return;
+        // the last range bound is the whole block, so the buffer runs on past the last character
+        data.resize((count - 1) * stride + MaxBones * sizeof(SkinMatrix));
+        skinCharacters(skeleton, count, pose, &data[0], stride, jobs);
+        buffer->write(&data[0], data.size());
+    }
+
+    // for shaders with a Bones block, once
+    static void setup(Shader* shader)
+    {
+        shader->setBlock("Bones", Binding);
+    }
+    // before drawing character
+    void bind(uint character) const
+    {
+        assert(character < characters);
+        glBindBufferRange(GL_UNIFORM_BUFFER, Binding, buffer->buffer, character * stride, MaxBones * sizeof(SkinMatrix));
+    }
+
+    const SkinMatrix* getMatrices(uint character) const { return (const SkinMatrix*)&data[character * stride]; }
+    uint size() const { return characters; }
+};
+
+#endif
@@ -88,14 +88,80 @@ struct VertexAttr
     {
         return "in " + shaderType + " " + name + ";";
     }
+
+    // bytes per vertex
+    int getSize() const
+    {
+        int typeSize = (glType == GL_DOUBLE) ? 8 :
+                       (glType == GL_FLOAT || glType == GL_INT || glType == GL_UNSIGNED_INT) ? 4 :
+                       (glType == GL_BYTE || glType == GL_UNSIGNED_BYTE) ? 1 : 2;
+        return typeSize * bindCount;
+    }
+
+    static ushort floatToHalf(float f)
+    {
+        uint bits;
+        memcpy(&bits, &f, 4);
+        uint sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xff) - 112;
+        uint mantissa = bits & 0x7fffff;
+        if (exponent == 143)
+            return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+        if (exponent >= 31)
+            return sign | 0x7c00;
+        if (exponent <= 0)
+        {
+            // denormal, or too small for one
+            if (exponent < -10)
+                return sign;
+            mantissa |= 0x800000;
+            uint shift = 14 - exponent;
+            uint h = mantissa >> shift;
+            uint rest = mantissa & ((1u << shift) - 1), half = 1u << (shift - 1);
+            if (rest > half || (rest == half && (h & 1)))
+                h++;
+            return sign | h;
+        }
+        // round to nearest even; a carry correctly bumps the exponent
+        uint h = sign | (exponent << 10) | (mantissa >> 13);
+        uint rest = mantissa & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+            h++;
+        return h;
+    }
+
+    // converts the first bindCount components of v to glType at dst;
+    // normalized types clamp to their range
+    void write(void* dst, const float4& v) const
+    {
+        for (int i = 0; i < bindCount && i < 4; i++)
+        {
+            float f = v._x[i];
+            auto unorm = [&](float scale) { return floorf(fminf(fmaxf(f, 0.f), 1.f) * scale + 0.5f); };
+            auto snorm = [&](float scale) { return floorf(fminf(fmaxf(f, -1.f), 1.f) * scale + 0.5f); };
+            switch (glType)
+            {
+                case GL_FLOAT:          ((float*)dst)[i] = f; break;
+                case GL_DOUBLE:         ((double*)dst)[i] = f; break;
+                case GL_HALF_FLOAT:     ((ushort*)dst)[i] = floatToHalf(f); break;
+                case GL_UNSIGNED_BYTE:  ((uchar*)dst)[i] = normalized ? (uchar)unorm(255.f) : (uchar)f; break;
+                case GL_BYTE:           ((int8_t*)dst)[i] = normalized ? (int8_t)snorm(127.f) : (int8_t)f; break;
+                case GL_UNSIGNED_SHORT: ((ushort*)dst)[i] = normalized ? (ushort)unorm(65535.f) : (ushort)f; break;
+                case GL_SHORT:          ((int16_t*)dst)[i] = normalized ? (int16_t)snorm(32767.f) : (int16_t)f; break;
+                case GL_UNSIGNED_INT:   ((uint*)dst)[i] = (uint)f; break;
+                case GL_INT:            ((int32_t*)dst)[i] = (int32_t)f; break;
+            }
+        }
+    }
 };
 
 struct Buffer
 {
     GLuint type = 0;
     GLuint buffer = 0;
+    GLenum usage = GL_STATIC_DRAW;
 
-    Buffer(void* data=nullptr, uint size=0, bool ibuf=false)
+    Buffer(const void* data=nullptr, uint size=0, bool ibuf=false)
     {
         type = ibuf ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER;
         glGenBuffers(1, &buffer);
@@ -104,15 +170,21 @@ struct Buffer
             write(data, size);
         }
     }
+    // any other target (GL_UNIFORM_BUFFER, ...), or data rewritten every
+    // frame (GL_STREAM_DRAW); written with write()
+    Buffer(GLenum target, GLenum _usage) : type(target), usage(_usage)
+    {
+        glGenBuffers(1, &buffer);
+    }
     ~Buffer()
     {
         glDeleteBuffers(1, &buffer);
     }
 
-    void write(void* data, uint size)
+    void write(const void* data, uint size)
     {
         glBindBuffer(type, buffer);
-        glBufferData(type, size, data, GL_STATIC_DRAW);
+        glBufferData(type, size, data, usage);
         glBindBuffer(type, 0);
     }
 };
@@ -130,7 +202,12 @@ struct VertexArray
         for (int i = 0; i < attrs.size(); i++)
         {
             glBindBuffer(GL_ARRAY_BUFFER, bufs[i]->buffer);
-            glVertexAttribPointer(attrs[i].bindPos, attrs[i].bindCount, attrs[i].glType, attrs[i].normalized, attrs[i].stride, attrs[i].offset);
+            // ivec and uvec inputs (unnormalized integer types) need the integer pointer
+            const string& shaderType = attrs[i].shaderType;
+            if (shaderType[0] == 'i' || shaderType[0] == 'u')
+                glVertexAttribIPointer(attrs[i].bindPos, attrs[i].bindCount, attrs[i].glType, attrs[i].stride, attrs[i].offset);
+            else
+                glVertexAttribPointer(attrs[i].bindPos, attrs[i].bindCount, attrs[i].glType, attrs[i].normalized, attrs[i].stride, attrs[i].offset);
             glEnableVertexAttribArray(attrs[i].bindPos);
         }
 
@@ -2,6 +2,7 @@
 #define _CUBE_CAMERA_H
 
 #include "../math3d.h"
+#include "../collision.h"
 
 struct Camera
 {
@@ -16,11 +17,13 @@ struct Camera
 
     matrix view;
     matrix proj;
+    Frustum frustum;    // world space, from view * proj
 
     void update()
     {
         view = matrix::lookAt(position, target, up);
         proj = matrix::perspective(angle, aspect, znear, zfar);
+        frustum = Frustum::fromMatrix(view * proj);
     }
 };
 
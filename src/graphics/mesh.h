@@ -2,23 +2,44 @@
 #define _CUBE_MESH_H
 
 #include "../definitions.h"
+#include "../assets.h"
 // #include "../xml/src/xml.h"
 #include "mesh.h"
+#include "camera.h"
+#include "simplify.h"
+#include "meshopt.h"
+#include "objloader.h"
+#include "meshfile.h"
+#include "meshlet.h"
+#include "animation.h"
 
 struct MeshSubset
 {
     uint startIndex;
     uint numIndices;
     uint materialId;
+    int baseVertex = 0;     // added to every index when drawn
+    uint firstMeshlet = 0;  // its clusters in Mesh::meshlets, if it was clustered
+    uint meshletCount = 0;
 };
 struct Mesh
 {
-    Buffer* posBuf = nullptr;
-    Buffer* normalBuf = nullptr;
-    Buffer* texBuf = nullptr;
+    Buffer* vertexBuf = nullptr;    // interleaved, see MeshBuilder::end
     Buffer* indexBuf = nullptr;
     VertexArray* array = nullptr;
     vector<MeshSubset> subsets;
+    vector<Meshlet> meshlets;       // see MeshBuilder::setMeshlets
+    uint vertexSize = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+
+    // quantized positions decode as iPos.xyz * PosScale.xyz + PosOffset.xyz
+    float4 posScale = float4(1, 1, 1, 0);
+    float4 posOffset = float4(0, 0, 0, 0);
+
+    // the draw list renderCulled() builds for a subset
+    vector<GLsizei> drawCounts;
+    vector<const void*> drawOffsets;
+    vector<GLint> drawBases;
 
     Mesh() = default;
     Mesh(const Mesh&) = delete;
@@ -29,19 +50,53 @@ struct Mesh
 
     ~Mesh()
     {
-        delete posBuf;
-        delete normalBuf;
-        delete texBuf;
+        delete vertexBuf;
         delete indexBuf;
         delete array;
     }
 
+    // creates the buffers and vertex array from vertices packed as layout
+    // says and indices of indexType; both are copied straight to the driver
+    void upload(const vector<VertexAttr>& layout, const void* vertices, size_t vertexBytes, const void* indices, size_t indexBytes, GLenum type)
+    {
+        vertexSize = layout.size() ? layout[0].stride : 0;
+        indexType = type;
+        vertexBuf = new Buffer(vertices, vertexBytes);
+        indexBuf = new Buffer(indices, indexBytes, true);
+        array = new VertexArray(layout, vector<Buffer*>(layout.size(), vertexBuf), indexBuf);
+    }
+
+    // before rendering with a shader using mesh_vertex
+    void setDecode(Shader* shader) const
+    {
+        shader->set("PosScale", posScale);
+        shader->set("PosOffset", posOffset);
+    }
+
+    // one subset, with the vertex array already bound
+    void draw(const MeshSubset& s) const
+    {
+        void* offset = (void*)(size_t)(s.startIndex * (indexType == GL_UNSIGNED_INT ? 4 : 2));
+        if (s.baseVertex)
+            glDrawElementsBaseVertex(GL_TRIANGLES, s.numIndices, indexType, offset, s.baseVertex);
+        else
+            glDrawElements(GL_TRIANGLES, s.numIndices, indexType, offset);
+    }
+    void drawInstanced(const MeshSubset& s, int numInstances) const
+    {
+        void* offset = (void*)(size_t)(s.startIndex * (indexType == GL_UNSIGNED_INT ? 4 : 2));
+        if (s.baseVertex)
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, s.numIndices, indexType, offset, numInstances, s.baseVertex);
+        else
+            glDrawElementsInstanced(GL_TRIANGLES, s.numIndices, indexType, offset, numInstances);
+    }
+
     void render()
     {
         array->bind();
         for (auto& s : subsets)
         {
-            glDrawElements(GL_TRIANGLES, s.numIndices, GL_UNSIGNED_SHORT, (void*)(s.startIndex * sizeof(ushort)));
+            draw(s);
         }
         array->unbind();
     }
@@ -52,9 +107,61 @@ struct Mesh
         for (auto& s : subsets)
         {
             callback(s);
-            glDrawElements(GL_TRIANGLES, s.numIndices, GL_UNSIGNED_SHORT, (void*)(s.startIndex * sizeof(ushort)));
+            draw(s);
+        }
+        array->unbind();
+    }
+
+    // like render(), but skips the meshlets outside the camera's frustum and,
+    // with backfaces, those facing wholly away from it; that is only right for
+    // closed meshes or with GL_CULL_FACE on. the rest of every subset is one
+    // multi draw, neighbouring meshlets merged; subsets without meshlets are
+    // drawn whole. returns the triangles drawn
+    uint renderCulled(const Camera& camera, const matrix& world, bool backfaces = true)
+    {
+        // both in model space, so the meshlets needn't be transformed
+        Frustum frustum = Frustum::fromMatrix(world * camera.view * camera.proj);
+        float3 eye = toModelSpace(world, camera.position);
+        uint indexSize = indexType == GL_UNSIGNED_INT ? 4 : 2;
+        uint drawn = 0;
+
+        array->bind();
+        for (auto& s : subsets)
+        {
+            if (!s.meshletCount)
+            {
+                draw(s);
+                drawn += s.numIndices / 3;
+                continue;
+            }
+
+            drawCounts.clear();
+            drawOffsets.clear();
+            drawBases.clear();
+            uint runEnd = ~0u;
+            for (uint i = s.firstMeshlet; i < s.firstMeshlet + s.meshletCount; i++)
+            {
+                const Meshlet& m = meshlets[i];
+                if (!meshletVisible(m, frustum, eye, backfaces))
+                    continue;
+                drawn += m.triangles;
+                if (m.startIndex == runEnd)
+                {
+                    drawCounts.back() += m.triangles * 3;
+                }
+                else
+                {
+                    drawCounts.push_back(m.triangles * 3);
+                    drawOffsets.push_back((const void*)(size_t)(m.startIndex * indexSize));
+                    drawBases.push_back(s.baseVertex);
+                }
+                runEnd = m.startIndex + m.triangles * 3;
+            }
+            if (drawCounts.size())
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, &drawCounts[0], indexType, &drawOffsets[0], drawCounts.size(), &drawBases[0]);
         }
         array->unbind();
+        return drawn;
     }
 
     void renderInstanced(int numInstances)
@@ -62,8 +169,7 @@ struct Mesh
         array->bind();
         for (auto& s : subsets)
         {
-            glDrawElementsInstanced(GL_TRIANGLES, s.numIndices, GL_UNSIGNED_SHORT,
-                (void*)(s.startIndex * sizeof(ushort)), numInstances);
+            drawInstanced(s, numInstances);
         }
         array->unbind();
     }
@@ -74,17 +180,72 @@ struct Mesh
         for (auto& s : subsets)
         {
             callback(s);
-            glDrawElementsInstanced(GL_TRIANGLES, s.numIndices, GL_UNSIGNED_SHORT,
-                (void*)(s.startIndex * sizeof(ushort)), numInstances);
-
+            drawInstanced(s, numInstances);
         }
         array->unbind();
     }
 };
 
-struct Skeleton
+// levels of detail of one mesh; every level is a set of ranges in the same
+// index buffer, over the same vertices. level 0 is the full mesh
+struct MeshLOD
 {
-    vector<Skeleton*> children;
+    struct Level
+    {
+        vector<MeshSubset> subsets;
+        uint triangles = 0;
+        float error = 0.0f;     // how far it strays from level 0, in model units
+    };
+
+    Mesh* mesh = nullptr;
+    vector<Level> levels;
+    Sphere bounds;              // model space
+
+    // a coarser level is only taken once its error is this fraction of the
+    // allowed error, so objects sitting on a threshold don't flicker
+    static constexpr float Hysteresis = 0.75f;
+
+    MeshLOD() = default;
+    MeshLOD(const MeshLOD&) = delete;
+    MeshLOD& operator = (const MeshLOD&) = delete;
+    ~MeshLOD()
+    {
+        delete mesh;
+    }
+
+    // the coarsest level whose error stays under pixelError on screen, for a
+    // mesh at position with uniform scale, starting from the current level
+    uint select(const Camera& camera, const float3& position, float scale, uint current, float screenHeight, float pixelError = 1.0f) const
+    {
+        if (current >= levels.size())
+            current = 0;
+        float distance = len(position + bounds.centre * scale - camera.position) - bounds.radius * scale;
+        if (distance <= camera.znear)
+            return 0;
+        float pixels = scale * screenHeight * 0.5f / (distance * tanf(camera.angle * 0.5f));
+
+        if (levels[current].error * pixels > pixelError)
+        {
+            while (current > 0 && levels[current].error * pixels > pixelError)
+                current--;
+        }
+        else
+        {
+            while (current + 1 < levels.size() && levels[current + 1].error * pixels <= pixelError * Hysteresis)
+                current++;
+        }
+        return current;
+    }
+
+    void render(uint level)
+    {
+        mesh->array->bind();
+        for (auto& s : levels[level].subsets)
+        {
+            mesh->draw(s);
+        }
+        mesh->array->unbind();
+    }
 };
 
 class MeshBuilder
@@ -92,15 +253,314 @@ class MeshBuilder
     vector<float3> vertices;
     vector<float3> normals;
     vector<float2> texcoords;
-    vector<ushort> indices;
+    vector<int4> boneIndices;       // up to four bones a vertex, for animated_mesh_vertex
+    vector<float4> boneWeights;
+    uint lastGeometry = 0;          // the first vertex of the last geometry(), for skin()
+    vector<uint> indices;           // into all vertices; narrowed by upload()
     vector<MeshSubset> subsets;
+    vector<Meshlet> meshlets;       // from clusterize()
+    uint meshletVertices = 0;       // 0 when not clustering
+    uint meshletTriangles = 0;
+
+    // reorders every range of indices for the vertex cache and overdraw, then
+    // the vertices for fetching
+    void optimize(const vector<MeshSubset>& ranges)
+    {
+        optimizedBefore = vertexCacheStats(&indices[0], indices.size(), vertices.size());
+
+        vector<uint> clusters;
+        for (auto& r : ranges)
+        {
+            optimizeVertexCache(&indices[r.startIndex], r.numIndices, vertices.size(), &clusters);
+            optimizeOverdraw(&indices[r.startIndex], r.numIndices, &vertices[0], vertices.size(), clusters);
+        }
+
+        vector<uint> remap;
+        optimizeVertexFetch(&indices[0], indices.size(), vertices.size(), remap);
+        remapVertices(vertices, remap);
+        remapVertices(normals, remap);
+        remapVertices(texcoords, remap);
+        remapVertices(boneIndices, remap);
+        remapVertices(boneWeights, remap);
+
+        optimizedAfter = vertexCacheStats(&indices[0], indices.size(), vertices.size());
+    }
+
+    // splits every range into meshlets, if setMeshlets() asked for them,
+    // reordering its triangles so each meshlet is a run of them. after
+    // optimize(), which would scatter them again
+    void clusterize(vector<MeshSubset>& ranges)
+    {
+        meshlets.clear();
+        if (!meshletTriangles)
+            return;
+        for (auto& r : ranges)
+        {
+            r.firstMeshlet = meshlets.size();
+            buildMeshlets(&indices[0], r.startIndex, r.numIndices, &vertices[0], vertices.size(), meshlets, meshletVertices, meshletTriangles);
+            r.meshletCount = meshlets.size() - r.firstMeshlet;
+        }
+    }
+
+    // interleaves position, normal, texcoord, bone indices and bone weights
+    // (attrs 0 to 4; any others are zero) as the types attrs declares, setting
+    // their stride and offset. integer positions are quantized to the bounds,
+    // to be decoded with posScale and posOffset; two component normals are
+    // octahedral encoded; normalized weights still sum to one once quantized
+    vector<uchar> pack(vector<VertexAttr>& attrs, float4& posScale, float4& posOffset) const
+    {
+        int stride = 0;
+        for (auto& a : attrs)
+        {
+            a.offset = (void*)(size_t)stride;
+            stride += (a.getSize() + 3) & ~3;
+        }
+        for (auto& a : attrs)
+        {
+            a.stride = stride;
+        }
+
+        float3 lo(0, 0, 0), hi(0, 0, 0);
+        if (vertices.size())
+            lo = hi = vertices[0];
+        for (auto& v : vertices)
+        {
+            lo = float3(fminf(lo.x, v.x), fminf(lo.y, v.y), fminf(lo.z, v.z));
+            hi = float3(fmaxf(hi.x, v.x), fmaxf(hi.y, v.y), fmaxf(hi.z, v.z));
+        }
+        bool quantize = attrs.size() && attrs[0].glType != GL_FLOAT && attrs[0].glType != GL_HALF_FLOAT && attrs[0].glType != GL_DOUBLE;
+        float3 size = hi - lo;
+        posScale = quantize ? float4(size.x, size.y, size.z, 0) : float4(1, 1, 1, 0);
+        posOffset = quantize ? float4(lo.x, lo.y, lo.z, 0) : float4(0, 0, 0, 0);
+
+        vector<uchar> data(stride * vertices.size(), 0);
+        for (uint v = 0; v < vertices.size(); v++)
+        {
+            uchar* out = &data[v * stride];
+            for (uint a = 0; a < attrs.size() && a < 5; a++)
+            {
+                float4 value(0, 0, 0, 0);
+                if (a == 0)
+                {
+                    float3 p = vertices[v];
+                    if (quantize)
+                    {
+                        p -= lo;
+                        p = float3(size.x > 0 ? p.x / size.x : 0, size.y > 0 ? p.y / size.y : 0, size.z > 0 ? p.z / size.z : 0);
+                    }
+                    value = float4(p.x, p.y, p.z, 1);
+                }
+                else if (a == 1)
+                {
+                    float3 n = normals[v];
+                    if (attrs[a].bindCount == 2)
+                    {
+                        // onto the octahedron |x|+|y|+|z| = 1, folding the lower half out
+                        float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+                        float x = l1 > 0 ? n.x / l1 : 0, y = l1 > 0 ? n.y / l1 : 0;
+                        if (n.z < 0)
+                        {
+                            float fx = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+                            float fy = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+                            x = fx;
+                            y = fy;
+                        }
+                        value = float4(x, y, 0, 0);
+                    }
+                    else
+                    {
+                        value = float4(n.x, n.y, n.z, 0);
+                    }
+                }
+                else if (a == 2)
+                {
+                    value = float4(texcoords[v].x, texcoords[v].y, 0, 0);
+                }
+                else if (a == 3)
+                {
+                    const int4& b = boneIndices[v];
+                    value = float4(b.x, b.y, b.z, b.w);
+                }
+                else
+                {
+                    value = boneWeights[v];
+                    float scale = attrs[a].glType == GL_UNSIGNED_BYTE ? 255.f : attrs[a].glType == GL_UNSIGNED_SHORT ? 65535.f : 0.f;
+                    if (attrs[a].normalized && scale > 0)
+                    {
+                        // round each, then give what rounding lost or gained to the heaviest
+                        int heaviest = 0;
+                        float total = 0;
+                        for (int i = 0; i < attrs[a].bindCount && i < 4; i++)
+                        {
+                            value._x[i] = floorf(value._x[i] * scale + 0.5f);
+                            total += value._x[i];
+                            heaviest = value._x[i] > value._x[heaviest] ? i : heaviest;
+                        }
+                        value._x[heaviest] += scale - total;
+                        value = value / scale;
+                    }
+                }
+                attrs[a].write(out + (size_t)attrs[a].offset, value);
+            }
+        }
+        return data;
+    }
+
+    // the index buffer for ranges, which get their base vertex. indices are
+    // 16 bit when every range spans fewer than 65536 vertices, each rebased
+    // to its lowest, and 32 bit otherwise; returns which
+    GLenum narrow(const vector<MeshSubset*>& ranges, vector<uchar>& out) const
+    {
+        bool narrow = true;
+        for (MeshSubset* r : ranges)
+        {
+            uint lo = ~0u, hi = 0;
+            for (uint i = r->startIndex; i < r->startIndex + r->numIndices; i++)
+            {
+                lo = indices[i] < lo ? indices[i] : lo;
+                hi = indices[i] > hi ? indices[i] : hi;
+            }
+            r->baseVertex = r->numIndices ? lo : 0;
+            narrow = narrow && (!r->numIndices || hi - lo <= 0xffff);
+        }
+
+        if (narrow)
+        {
+            // anything outside the ranges isn't drawn
+            vector<ushort> narrowed(indices.size(), 0);
+            for (MeshSubset* r : ranges)
+            {
+                for (uint i = r->startIndex; i < r->startIndex + r->numIndices; i++)
+                    narrowed[i] = indices[i] - r->baseVertex;
+            }
+            out.resize(sizeof(ushort) * narrowed.size());
+            memcpy(&out[0], &narrowed[0], out.size());
+            return GL_UNSIGNED_SHORT;
+        }
+        for (MeshSubset* r : ranges)
+        {
+            r->baseVertex = 0;
+        }
+        out.resize(sizeof(uint) * indices.size());
+        memcpy(&out[0], &indices[0], out.size());
+        return GL_UNSIGNED_INT;
+    }
+
+    // vertex and index buffers for a mesh drawing ranges
+    Mesh* upload(const vector<VertexAttr>& attrs, const vector<MeshSubset*>& ranges)
+    {
+        Mesh* mesh = new Mesh();
+        vector<VertexAttr> layout = attrs;
+        vector<uchar> vertexData = pack(layout, mesh->posScale, mesh->posOffset);
+        vector<uchar> indexData;
+        GLenum type = narrow(ranges, indexData);
+        mesh->upload(layout, &vertexData[0], vertexData.size(), &indexData[0], indexData.size(), type);
+        mesh->meshlets = meshlets;
+        return mesh;
+    }
+
+    // bounds and levels of detail (see endLOD), every level's indices going
+    // after the full mesh's in the builder; the mesh is left to the caller
+    MeshLOD* buildLevels(uint maxLevels, float reduction, float errorLimit, bool optimizeOrder)
+    {
+        MeshLOD* lod = new MeshLOD();
+
+        float3 lo = vertices[0], hi = vertices[0];
+        for (auto& v : vertices)
+        {
+            lo = float3(fminf(lo.x, v.x), fminf(lo.y, v.y), fminf(lo.z, v.z));
+            hi = float3(fmaxf(hi.x, v.x), fmaxf(hi.y, v.y), fmaxf(hi.z, v.z));
+        }
+        lod->bounds.centre = (lo + hi) * 0.5f;
+        lod->bounds.radius = 0.0f;
+        for (auto& v : vertices)
+        {
+            lod->bounds.radius = fmaxf(lod->bounds.radius, len(v - lod->bounds.centre));
+        }
+
+        MeshLOD::Level full;
+        full.subsets = subsets;
+        full.triangles = indices.size() / 3;
+        lod->levels.push_back(full);
+
+        if (maxLevels > 1)
+        {
+            vector<uint> subsetOf(indices.size() / 3);
+            for (uint s = 0; s < subsets.size(); s++)
+            {
+                for (uint i = subsets[s].startIndex; i < subsets[s].startIndex + subsets[s].numIndices; i += 3)
+                    subsetOf[i / 3] = s;
+            }
+            MeshSimplifier simplifier(&vertices[0], vertices.size(), &indices[0], indices.size(), &subsetOf[0]);
+
+            vector<uint> levelIndices, counts;
+            for (uint l = 1; l < maxLevels; l++)
+            {
+                uint before = simplifier.triangleCount();
+                simplifier.simplify((uint)(before * reduction), errorLimit);
+                // not worth a level of its own
+                if (simplifier.triangleCount() > before * 0.9f)
+                    break;
+
+                simplifier.getIndices(subsets.size(), levelIndices, counts);
+                MeshLOD::Level level;
+                level.triangles = simplifier.triangleCount();
+                level.error = simplifier.error();
+                uint start = indices.size();
+                for (uint s = 0; s < subsets.size(); s++)
+                {
+                    if (counts[s])
+                        level.subsets.push_back({ start, counts[s], subsets[s].materialId });
+                    start += counts[s];
+                }
+                indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+                lod->levels.push_back(level);
+            }
+        }
+
+        if (optimizeOrder)
+        {
+            vector<MeshSubset> ranges;
+            for (auto& l : lod->levels)
+                ranges.insert(ranges.end(), l.subsets.begin(), l.subsets.end());
+            optimize(ranges);
+        }
+        // only the full mesh is clustered; coarser levels are drawn far off,
+        // where there is little to cull
+        clusterize(lod->levels[0].subsets);
+        return lod;
+    }
+
+    static vector<MeshSubset*> levelRanges(MeshLOD* lod)
+    {
+        vector<MeshSubset*> ranges;
+        for (auto& l : lod->levels)
+        {
+            for (auto& r : l.subsets)
+                ranges.push_back(&r);
+        }
+        return ranges;
+    }
 
 public:
+    // from the last optimized end()
+    VertexCacheStats optimizedBefore, optimizedAfter;
+
     void begin()
     {
         clear();
     }
-    void geometry(const float3* vert, const float3* norm, const float2* tex, const ushort* ind, int numvert, int numind, int materialId=0)
+    // end() and the like also split the mesh into meshlets of at most
+    // maxVertices and maxTriangles (see meshlet.h), for Mesh::renderCulled;
+    // 0 stops them. kept across clear()
+    void setMeshlets(uint maxVertices = MeshletMaxVertices, uint maxTriangles = MeshletMaxTriangles)
+    {
+        meshletVertices = maxVertices;
+        meshletTriangles = maxVertices ? maxTriangles : 0;
+    }
+    // ind may be ushort or uint
+    template<typename Index>
+    void geometry(const float3* vert, const float3* norm, const float2* tex, const Index* ind, int numvert, int numind, int materialId=0)
     {
         // create new subset
         subsets.push_back({ (uint)indices.size(), (uint)numind, (uint)materialId });
@@ -112,15 +572,30 @@ public:
             indices.push_back(ind[i] + v);
         }
 
-        // add vertices
+        // add vertices, rigidly on bone 0 until skin()
+        lastGeometry = v;
         for (int i = 0; i < numvert; i++)
         {
             vertices.push_back(vert[i]);
             normals.push_back(norm[i]);
             texcoords.push_back(tex[i]);
+            boneIndices.push_back(int4(0, 0, 0, 0));
+            boneWeights.push_back(float4(1, 0, 0, 0));
         }
 
     }
+    // binds the vertices of the last geometry() to up to four bones each;
+    // weights are scaled to sum to one
+    void skin(const int4* bones, const float4* weights)
+    {
+        for (uint v = lastGeometry; v < vertices.size(); v++)
+        {
+            const float4& w = weights[v - lastGeometry];
+            float total = w.x + w.y + w.z + w.w;
+            boneIndices[v] = bones[v - lastGeometry];
+            boneWeights[v] = total > 0 ? w / total : float4(1, 0, 0, 0);
+        }
+    }
     void sphere(const float3& center, float radius, int sectors, int rings, int materialId=0)
     {
         int numVertices = sectors * (rings+1);
@@ -129,7 +604,7 @@ public:
         float3* vertices = new float3[numVertices];
         float3* normals = new float3[numVertices];
         float2* texcoords = new float2[numVertices];
-        ushort* indices = new ushort[numIndices];
+        uint* indices = new uint[numIndices];
 
         for (int i = 0; i < sectors; i++)
         {
@@ -236,7 +711,7 @@ public:
 
 		geometry(vert, norm, tex, ind, 24, 36, materialId);
     }
-    void prism(const vector<float3>& points, const float3& origin, const float3& extr, const float2& tmin, const float2& tmax)
+    void prism(const vector<float3>& points, const float3& origin, const float3& extr, const float2& tmin, const float2& tmax, int materialId=0)
     {
         // "points" must be vertices of a convex polygon
         // TODO: triangulate with ear clipping (allows concavities)
@@ -253,50 +728,242 @@ public:
         //      6N vertices
         //      12N-12 indices
 
-        float3* vertices = new float3[points.size() * 6];
-        float3* normals = new float3[points.size() * 6];
-        float2* texcoords = new float2[points.size() * 6];
-        ushort* indices = new ushort[points.size() * 12 - 12];
+        int n = points.size();
+        if (n < 3)
+            return;
+
+        int numVertices = n * 6;
+        int numIndices = n * 12 - 12;
+
+        float3* vertices = new float3[numVertices];
+        float3* normals = new float3[numVertices];
+        float2* texcoords = new float2[numVertices];
+        uint* indices = new uint[numIndices];
+
+        // polygon normal (newell), pointing the same way as the extrusion
+        float3 up;
+        float3 centre;
+        for (int i = 0; i < n; i++)
+        {
+            const float3& p = points[i];
+            const float3& q = points[(i+1) % n];
+            up += float3((p.y - q.y) * (p.z + q.z), (p.z - q.z) * (p.x + q.x), (p.x - q.x) * (p.y + q.y));
+            centre += p;
+        }
+        centre /= (float)n;
+        bool flip = dot(up, extr) < 0;
+        up = normalize(flip ? -up : up);
+
+        // planar mapping for the faces
+        float3 tu = normalize(points[1] - points[0]);
+        float3 tv = cross(up, tu);
+        float2 lo(INFINITY, INFINITY), hi(-INFINITY, -INFINITY);
+        for (int i = 0; i < n; i++)
+        {
+            float2 uv(dot(points[i], tu), dot(points[i], tv));
+            lo = float2(fminf(lo.x, uv.x), fminf(lo.y, uv.y));
+            hi = float2(fmaxf(hi.x, uv.x), fmaxf(hi.y, uv.y));
+        }
+        float2 range = hi - lo;
+
+        // vertices for top "face" [0, n) and bottom "face" [n, 2n)
+        for (int i = 0; i < n; i++)
+        {
+            float2 uv((dot(points[i], tu) - lo.x) / range.x, (dot(points[i], tv) - lo.y) / range.y);
+            float2 tex = tmin + (tmax - tmin) * uv;
+
+            vertices[i]    = origin + points[i] + extr;
+            normals[i]     = up;
+            texcoords[i]   = tex;
+            vertices[n+i]  = origin + points[i];
+            normals[n+i]   = -up;
+            texcoords[n+i] = tex;
+        }
 
-        for (int i = 0; i < points.size(); i++)
+        // vertices for ring, 4 per edge: bottom i, bottom i+1, top i, top i+1
+        float perimeter = 0.0f;
+        for (int i = 0; i < n; i++)
         {
-            // vertices for top "face"
-            // vertices for bottom "face"
+            perimeter += len(points[(i+1) % n] - points[i]);
         }
+        float along = 0.0f;
+        for (int i = 0; i < n; i++)
+        {
+            const float3& p = points[i];
+            const float3& q = points[(i+1) % n];
+            float3 side = normalize(cross(q - p, extr));
+            if (dot(side, p - centre) < 0)
+                side = -side;
 
+            float u0 = along / perimeter;
+            along += len(q - p);
+            float u1 = along / perimeter;
+
+            int v = 2*n + i*4;
+            vertices[v+0] = origin + p;
+            vertices[v+1] = origin + q;
+            vertices[v+2] = origin + p + extr;
+            vertices[v+3] = origin + q + extr;
+            texcoords[v+0] = tmin + (tmax - tmin) * float2(u0, 0.0f);
+            texcoords[v+1] = tmin + (tmax - tmin) * float2(u1, 0.0f);
+            texcoords[v+2] = tmin + (tmax - tmin) * float2(u0, 1.0f);
+            texcoords[v+3] = tmin + (tmax - tmin) * float2(u1, 1.0f);
+            for (int j = 0; j < 4; j++)
+            {
+                normals[v+j] = side;
+            }
+        }
+
+        // counter-clockwise seen from outside, like box()
+        int k = 0;
 
-        // vertices for ring
-        
         // indices for top "face"
+        for (int i = 1; i < n-1; i++)
+        {
+            indices[k++] = 0;
+            indices[k++] = flip ? i+1 : i;
+            indices[k++] = flip ? i : i+1;
+        }
 
-        // indices for bottom "face" (reversed?)
+        // indices for bottom "face" (reversed)
+        for (int i = 1; i < n-1; i++)
+        {
+            indices[k++] = n;
+            indices[k++] = n + (flip ? i : i+1);
+            indices[k++] = n + (flip ? i+1 : i);
+        }
 
-        // indcices for ring
+        // indices for ring
+        for (int i = 0; i < n; i++)
+        {
+            int v = 2*n + i*4;
+            // p -> q runs counter-clockwise around "up" unless flipped
+            int a = flip ? v+1 : v+0;
+            int b = flip ? v+0 : v+1;
+            int c = flip ? v+3 : v+2;
+            int d = flip ? v+2 : v+3;
+            indices[k++] = a;
+            indices[k++] = b;
+            indices[k++] = c;
+            indices[k++] = c;
+            indices[k++] = b;
+            indices[k++] = d;
+        }
+
+        geometry(vertices, normals, texcoords, indices, numVertices, numIndices, materialId);
 
         delete[] vertices;
         delete[] indices;
         delete[] normals;
         delete[] texcoords;
     }
-    Mesh* end(const vector<VertexAttr>& attrs)
+    // a subset per material of an obj file, materialIds in order of first
+    // use; throws runtime_error if it can't be loaded
+    void obj(const string& fname, JobSystem* jobs = nullptr, vector<string>* materials = nullptr)
     {
-        Mesh* mesh = new Mesh();
-        mesh->posBuf = new Buffer(&vertices[0], sizeof(float3)*vertices.size());
-        mesh->normalBuf = new Buffer(&normals[0], sizeof(float3)*normals.size());
-        mesh->texBuf = new Buffer(&texcoords[0], sizeof(float2)*texcoords.size());
-        mesh->indexBuf = new Buffer(&indices[0], sizeof(ushort)*indices.size(), true);
-        mesh->array = new VertexArray(attrs, { mesh->posBuf, mesh->normalBuf, mesh->texBuf }, mesh->indexBuf);
-        mesh->subsets = subsets;
-        
+        vector<ObjGroup> groups;
+        ObjLoader::load(fname, groups, jobs);
+        for (uint i = 0; i < groups.size(); i++)
+        {
+            auto& g = groups[i];
+            geometry(&g.positions[0], &g.normals[0], &g.texcoords[0], &g.indices[0], g.positions.size(), g.indices.size(), i);
+            if (materials)
+                materials->push_back(g.material);
+        }
+    }
+    // optimizeOrder reorders indices and vertices before upload (see meshopt.h);
+    // it leaves the builder holding the reordered mesh
+    Mesh* end(const vector<VertexAttr>& attrs, bool optimizeOrder = false)
+    {
+        if (optimizeOrder)
+            optimize(subsets);
+        clusterize(subsets);
+
+        vector<MeshSubset> ranges = subsets;
+        vector<MeshSubset*> rangePtrs;
+        for (auto& r : ranges)
+        {
+            rangePtrs.push_back(&r);
+        }
+        Mesh* mesh = upload(attrs, rangePtrs);
+        mesh->subsets = ranges;
         return mesh;
     }
+    // like end(), but adds up to maxLevels - 1 simplified levels, each with
+    // about reduction times the triangles of the one before. levels stop early
+    // once the simplifier can't get below errorLimit (model units)
+    MeshLOD* endLOD(const vector<VertexAttr>& attrs, uint maxLevels = 4, float reduction = 0.5f, float errorLimit = INFINITY, bool optimizeOrder = false)
+    {
+        MeshLOD* lod = buildLevels(maxLevels, reduction, errorLimit, optimizeOrder);
+        lod->mesh = upload(attrs, levelRanges(lod));
+        lod->mesh->subsets = lod->levels[0].subsets;
+
+        // the builder keeps the full mesh, which comes first
+        indices.resize(lod->levels[0].triangles * 3);
+        return lod;
+    }
+    // like endLOD(), but writes a mesh file (see meshfile.h) instead of
+    // uploading; throws runtime_error if it can't
+    void bake(const string& fname, const vector<VertexAttr>& attrs, uint maxLevels = 1, float reduction = 0.5f, float errorLimit = INFINITY, bool optimizeOrder = true)
+    {
+        MeshLOD* lod = buildLevels(maxLevels, reduction, errorLimit, optimizeOrder);
+        vector<MeshSubset*> ranges = levelRanges(lod);
+
+        MeshFileHeader header;
+        vector<VertexAttr> layout = attrs;
+        float4 posScale, posOffset;
+        vector<uchar> vertexData = pack(layout, posScale, posOffset);
+        vector<uchar> indexData;
+        header.indexType = narrow(ranges, indexData);
+        header.vertexCount = vertices.size();
+        header.vertexSize = layout.size() ? layout[0].stride : 0;
+        header.indexCount = indices.size();
+        for (int i = 0; i < 4; i++)
+        {
+            header.posScale[i] = posScale._x[i];
+            header.posOffset[i] = posOffset._x[i];
+        }
+        const Sphere& b = lod->bounds;
+        header.bounds[0] = b.centre.x;
+        header.bounds[1] = b.centre.y;
+        header.bounds[2] = b.centre.z;
+        header.bounds[3] = b.radius;
+
+        vector<MeshFileAttr> attrTable;
+        for (auto& a : layout)
+        {
+            attrTable.push_back({ a.glType, a.bindCount, a.normalized, (uint)(size_t)a.offset });
+        }
+        vector<MeshFileLevel> levelTable;
+        vector<MeshFileSubset> subsetTable;
+        for (auto& l : lod->levels)
+        {
+            levelTable.push_back({ (uint)subsetTable.size(), (uint)l.subsets.size(), l.triangles, l.error });
+            for (auto& r : l.subsets)
+                subsetTable.push_back({ r.startIndex, r.numIndices, r.materialId, r.baseVertex, r.firstMeshlet, r.meshletCount });
+        }
+        vector<MeshFileMeshlet> meshletTable;
+        for (auto& m : meshlets)
+        {
+            meshletTable.push_back({ m.startIndex, m.triangles, { m.centre.x, m.centre.y, m.centre.z }, m.radius,
+                                     { m.coneAxis.x, m.coneAxis.y, m.coneAxis.z }, m.coneCos, m.coneSin });
+        }
+        indices.resize(lod->levels[0].triangles * 3);
+        delete lod;
+
+        MeshFile::write(fname, header, attrTable, levelTable, subsetTable, meshletTable, &vertexData[0], &indexData[0]);
+    }
     void clear()
     {
         vertices.clear();
         normals.clear();
         texcoords.clear();
+        boneIndices.clear();
+        boneWeights.clear();
+        lastGeometry = 0;
         indices.clear();
         subsets.clear();
+        meshlets.clear();
     }
 };
 
@@ -304,62 +971,108 @@ public:
 class MeshManager
 {
     string baseDir;
+    ShaderManager* shaders;
+    JobSystem* jobs;
+    AssetRegistry<MeshLOD> meshes;
 
-    map<string, Mesh*> meshes;
-    map<string, Skeleton*> skeletons;
-
-    void loadMesh(const string& fname)
+    // the vertex and index blobs go from the mapped file to the driver
+    MeshLOD* loadMeshFile(const string& path, const vector<VertexAttr>& attrs)
     {
-        try
-        {
-            Mesh* mesh = nullptr;
-            Skeleton* skeleton = nullptr;
-            
-            // xml::Element document;
-            // xml::load(baseDir + fname, document);
+        MeshFile file(path);
+        const MeshFileHeader& header = file.getHeader();
+        vector<VertexAttr> layout = attrs;
+        if (!file.getLayout(layout))
+            throw runtime_error("vertex layout differs from mesh_vertex, rebake it");
+        if (!header.levelCount)
+            throw runtime_error("no levels");
 
-            // do things to doc... terrible things...
-
-            meshes[fname] = mesh;
-            skeletons[fname] = skeleton;
+        MeshLOD* lod = new MeshLOD();
+        lod->bounds.centre = float3(header.bounds[0], header.bounds[1], header.bounds[2]);
+        lod->bounds.radius = header.bounds[3];
+        const MeshFileSubset* subsets = file.getSubsets();
+        for (uint l = 0; l < header.levelCount; l++)
+        {
+            const MeshFileLevel& stored = file.getLevels()[l];
+            MeshLOD::Level level;
+            level.triangles = stored.triangles;
+            level.error = stored.error;
+            for (uint i = stored.firstSubset; i < stored.firstSubset + stored.subsetCount; i++)
+            {
+                const MeshFileSubset& s = subsets[i];
+                level.subsets.push_back({ s.startIndex, s.numIndices, s.materialId, s.baseVertex, s.firstMeshlet, s.meshletCount });
+            }
+            lod->levels.push_back(level);
         }
-        catch (const exception& e)
+
+        Mesh* mesh = new Mesh();
+        mesh->posScale = float4(header.posScale[0], header.posScale[1], header.posScale[2], header.posScale[3]);
+        mesh->posOffset = float4(header.posOffset[0], header.posOffset[1], header.posOffset[2], header.posOffset[3]);
+        mesh->upload(layout, file.getVertices(), file.getVertexBytes(), file.getIndices(), file.getIndexBytes(), header.indexType);
+        mesh->subsets = lod->levels[0].subsets;
+        const MeshFileMeshlet* meshlets = file.getMeshlets();
+        for (uint i = 0; i < header.meshletCount; i++)
         {
-            cout << "   failed to load: " << fname << "(" << e.what() << ")" << endl;
+            const MeshFileMeshlet& m = meshlets[i];
+            mesh->meshlets.push_back({ m.startIndex, m.triangles, float3(m.centre[0], m.centre[1], m.centre[2]), m.radius,
+                                       float3(m.coneAxis[0], m.coneAxis[1], m.coneAxis[2]), m.coneCos, m.coneSin });
         }
+        lod->mesh = mesh;
+        return lod;
     }
 
-public:
-    MeshManager(const string& dir=string(RESOURCE_BASE)+"/meshes") : baseDir(dir) {}
-    Mesh* getMesh(const string& fname)
+    MeshLOD* loadMesh(const string& fname)
     {
         cout << "loading mesh: " << fname << endl;
+        auto start = chrono::steady_clock::now();
+        MeshLOD* lod = nullptr;
 
-        auto mesh = meshes.find(fname);
-        if (mesh == meshes.end())
+        string path = baseDir + "/" + fname;
+        size_t dot = fname.rfind('.');
+        string extension = dot != string::npos ? fname.substr(dot) : "";
+        if (extension == ".mesh" && shaders)
         {
-            loadMesh(fname);
-            return meshes[fname];
+            lod = loadMeshFile(path, shaders->getVertexAttrs("mesh_vertex"));
         }
-        else
+        else if (extension == ".obj" && shaders)
         {
-            cout << "    using cache" << endl;
-        }
-    }
-    Skeleton* getSkeleton(const string& fname)
-    {
-        cout << "loading skeleton: " << fname << endl;
-        auto skeleton = skeletons.find(fname);
-        if (skeleton == skeletons.end())
-        {
-            loadMesh(fname);
-            return skeletons[fname];
+            MeshBuilder builder;
+            builder.obj(path, jobs);
+            lod = builder.endLOD(shaders->getVertexAttrs("mesh_vertex"), 1);
         }
         else
         {
-            cout << "    using cache" << endl;
+            throw runtime_error("unknown mesh format");
         }
+        cout << "    loaded in " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+        return lod;
+    }
+
+public:
+    typedef AssetRegistry<MeshLOD>::Handle Handle;
+
+    MeshManager(ShaderManager* _shaders=nullptr, JobSystem* _jobs=nullptr, const string& dir=string(RESOURCE_BASE)+"/meshes") :
+        baseDir(dir), shaders(_shaders), jobs(_jobs), meshes([this](const string& fname) { return loadMesh(fname); }) {}
+
+    // loads fname on first use; Null if it can't be
+    Handle acquire(const string& fname) { return meshes.acquire(fname); }
+    void release(Handle h) { meshes.release(h); }
+
+    Mesh* getMesh(Handle h) const
+    {
+        MeshLOD* lod = meshes.get(h);
+        return lod ? lod->mesh : nullptr;
     }
+    // with the levels of detail a mesh file holds (just one for other formats)
+    MeshLOD* getMeshLOD(Handle h) const { return meshes.get(h); }
+
+    // these take a reference that is never released, so the mesh stays loaded
+    Mesh* getMesh(const string& fname) { return getMesh(acquire(fname)); }
+    MeshLOD* getMeshLOD(const string& fname) { return getMeshLOD(acquire(fname)); }
+
+    // unloads meshes released a while ago; once a frame
+    void collect() { meshes.collect(); }
+    const AssetRegistry<MeshLOD>::Stats& getStats() const { return meshes.getStats(); }
+    void printStats() const { meshes.printStats("meshes"); }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,230 @@
+#ifndef _CUBE_MESHFILE_H
+#define _CUBE_MESHFILE_H
+
+#include "../definitions.h"
+#include "buffer.h"
+
+// binary mesh container, baked offline (tools/meshbake.cpp) so that loading
+// does no parsing at all
+//
+//      header
+//      attribute table     the layout the vertices were packed for
+//      level table         levels of detail, each a run of the subset table
+//      subset table        MeshSubset records, one level after another
+//      meshlet table       clusters of the full mesh's subsets (see meshlet.h)
+//      vertex blob         interleaved, as MeshBuilder packs them
+//      index blob          ushort or uint, with per subset base vertices
+//
+// both blobs start on page boundaries, so a mapped file hands them to
+// glBufferData (or a copy into a persistently mapped buffer) as they are.
+// files are little endian; any other version is rejected and should be rebaked
+
+static const uint MeshFileMagic = 'C' | ('M' << 8) | ('S' << 16) | ('H' << 24);
+static const uint MeshFileVersion = 2;
+static const uint MeshFileAlignment = 4096;
+
+struct MeshFileHeader
+{
+    uint magic = MeshFileMagic;
+    uint version = MeshFileVersion;
+    uint vertexCount = 0;
+    uint vertexSize = 0;
+    uint indexCount = 0;
+    uint indexType = GL_UNSIGNED_SHORT;
+    uint attrCount = 0;
+    uint levelCount = 0;
+    uint subsetCount = 0;
+    uint meshletCount = 0;
+    float posScale[4] = { 1, 1, 1, 0 };
+    float posOffset[4] = { 0, 0, 0, 0 };
+    float bounds[4] = { 0, 0, 0, 0 };   // model space sphere: centre, radius
+    uint64_t attrOffset = 0;
+    uint64_t levelOffset = 0;
+    uint64_t subsetOffset = 0;
+    uint64_t meshletOffset = 0;
+    uint64_t vertexOffset = 0;
+    uint64_t indexOffset = 0;
+    uint64_t fileSize = 0;
+};
+
+struct MeshFileAttr
+{
+    int glType;
+    int bindCount;
+    int normalized;
+    uint offset;
+};
+
+struct MeshFileLevel
+{
+    uint firstSubset;
+    uint subsetCount;
+    uint triangles;
+    float error;
+};
+
+struct MeshFileSubset
+{
+    uint startIndex;
+    uint numIndices;
+    uint materialId;
+    int baseVertex;
+    uint firstMeshlet;
+    uint meshletCount;
+};
+
+struct MeshFileMeshlet
+{
+    uint startIndex;
+    uint triangles;
+    float centre[3];
+    float radius;
+    float coneAxis[3];
+    float coneCos;
+    float coneSin;
+};
+
+// a mapped mesh file; the pointers it hands out live as long as it does
+class MeshFile
+{
+    MappedFile file;
+    const MeshFileHeader* header = nullptr;
+
+    bool inside(uint64_t offset, uint64_t bytes) const
+    {
+        return offset <= file.size() && bytes <= file.size() - offset;
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + MeshFileAlignment - 1) & ~(uint64_t)(MeshFileAlignment - 1);
+    }
+
+public:
+    // throws runtime_error if fname is missing, truncated, not this version, or
+    // has tables or indices reaching outside what it holds
+    MeshFile(const string& fname) : file(fname)
+    {
+        if (!file.isOpen())
+            throw runtime_error("can't open " + fname);
+        if (file.size() < sizeof(MeshFileHeader))
+            throw runtime_error("truncated mesh file " + fname);
+        header = (const MeshFileHeader*)file.data();
+        if (header->magic != MeshFileMagic)
+            throw runtime_error("not a mesh file: " + fname);
+        if (header->version != MeshFileVersion)
+            throw runtime_error("mesh file version " + to_string(header->version) + ", expected " + to_string(MeshFileVersion) + ": " + fname);
+
+        uint indexSize = header->indexType == GL_UNSIGNED_INT ? 4 : 2;
+        if (header->fileSize != file.size() ||
+            !inside(header->attrOffset, (uint64_t)header->attrCount * sizeof(MeshFileAttr)) ||
+            !inside(header->levelOffset, (uint64_t)header->levelCount * sizeof(MeshFileLevel)) ||
+            !inside(header->subsetOffset, (uint64_t)header->subsetCount * sizeof(MeshFileSubset)) ||
+            !inside(header->meshletOffset, (uint64_t)header->meshletCount * sizeof(MeshFileMeshlet)) ||
+            !inside(header->vertexOffset, getVertexBytes()) ||
+            !inside(header->indexOffset, (uint64_t)header->indexCount * indexSize))
+            throw runtime_error("truncated mesh file " + fname);
+
+        const MeshFileLevel* levels = getLevels();
+        for (uint l = 0; l < header->levelCount; l++)
+        {
+            if (levels[l].firstSubset > header->subsetCount || levels[l].subsetCount > header->subsetCount - levels[l].firstSubset)
+                throw runtime_error("bad level table in " + fname);
+        }
+        const MeshFileSubset* subsets = getSubsets();
+        for (uint s = 0; s < header->subsetCount; s++)
+        {
+            if (subsets[s].startIndex > header->indexCount || subsets[s].numIndices > header->indexCount - subsets[s].startIndex ||
+                subsets[s].firstMeshlet > header->meshletCount || subsets[s].meshletCount > header->meshletCount - subsets[s].firstMeshlet)
+                throw runtime_error("bad subset table in " + fname);
+
+            // every vertex a subset draws, once its base is added, must be in the blob
+            int64_t lo = INT64_MAX, hi = INT64_MIN;
+            for (uint i = subsets[s].startIndex; i < subsets[s].startIndex + subsets[s].numIndices; i++)
+            {
+                int64_t index = indexSize == 4 ? ((const uint*)getIndices())[i] : ((const ushort*)getIndices())[i];
+                lo = index < lo ? index : lo;
+                hi = index > hi ? index : hi;
+            }
+            if (subsets[s].numIndices && (subsets[s].baseVertex + lo < 0 || subsets[s].baseVertex + hi >= header->vertexCount))
+                throw runtime_error("subset indices out of range in " + fname);
+        }
+        const MeshFileMeshlet* meshlets = getMeshlets();
+        for (uint m = 0; m < header->meshletCount; m++)
+        {
+            if (meshlets[m].startIndex > header->indexCount || meshlets[m].triangles > (header->indexCount - meshlets[m].startIndex) / 3)
+                throw runtime_error("bad meshlet table in " + fname);
+        }
+    }
+
+    const MeshFileHeader& getHeader() const { return *header; }
+    const MeshFileAttr* getAttrs() const { return (const MeshFileAttr*)(file.data() + header->attrOffset); }
+    const MeshFileLevel* getLevels() const { return (const MeshFileLevel*)(file.data() + header->levelOffset); }
+    const MeshFileSubset* getSubsets() const { return (const MeshFileSubset*)(file.data() + header->subsetOffset); }
+    const MeshFileMeshlet* getMeshlets() const { return (const MeshFileMeshlet*)(file.data() + header->meshletOffset); }
+    const void* getVertices() const { return file.data() + header->vertexOffset; }
+    const void* getIndices() const { return file.data() + header->indexOffset; }
+    uint64_t getVertexBytes() const { return (uint64_t)header->vertexCount * header->vertexSize; }
+    uint64_t getIndexBytes() const { return (uint64_t)header->indexCount * (header->indexType == GL_UNSIGNED_INT ? 4 : 2); }
+
+    // sets the stride and offsets of attrs from the file, if the vertices were
+    // packed as attrs declares them; false if they weren't
+    bool getLayout(vector<VertexAttr>& attrs) const
+    {
+        if (attrs.size() != header->attrCount)
+            return false;
+        const MeshFileAttr* stored = getAttrs();
+        for (uint a = 0; a < attrs.size(); a++)
+        {
+            if (attrs[a].glType != stored[a].glType || attrs[a].bindCount != stored[a].bindCount || attrs[a].normalized != stored[a].normalized)
+                return false;
+            attrs[a].offset = (void*)(size_t)stored[a].offset;
+            attrs[a].stride = header->vertexSize;
+        }
+        return true;
+    }
+
+    // writes a mesh file from header's counts and vertex layout, filling in
+    // the offsets; throws runtime_error if it can't
+    static void write(const string& fname, MeshFileHeader header,
+                      const vector<MeshFileAttr>& attrs, const vector<MeshFileLevel>& levels, const vector<MeshFileSubset>& subsets,
+                      const vector<MeshFileMeshlet>& meshlets, const void* vertices, const void* indices)
+    {
+        header.attrCount = attrs.size();
+        header.levelCount = levels.size();
+        header.subsetCount = subsets.size();
+        header.meshletCount = meshlets.size();
+        header.attrOffset = sizeof(MeshFileHeader);
+        header.levelOffset = header.attrOffset + attrs.size() * sizeof(MeshFileAttr);
+        header.subsetOffset = header.levelOffset + levels.size() * sizeof(MeshFileLevel);
+        uint64_t vertexBytes = (uint64_t)header.vertexCount * header.vertexSize;
+        uint64_t indexBytes = (uint64_t)header.indexCount * (header.indexType == GL_UNSIGNED_INT ? 4 : 2);
+        header.meshletOffset = header.subsetOffset + subsets.size() * sizeof(MeshFileSubset);
+        header.vertexOffset = align(header.meshletOffset + meshlets.size() * sizeof(MeshFileMeshlet));
+        header.indexOffset = align(header.vertexOffset + vertexBytes);
+        header.fileSize = header.indexOffset + indexBytes;
+
+        ofstream file(fname, ios::binary | ios::trunc);
+        if (!file.is_open())
+            throw runtime_error("can't write " + fname);
+
+        auto put = [&](const void* data, uint64_t bytes) { file.write((const char*)data, bytes); };
+        auto pad = [&](uint64_t to) {
+            static const char zeros[MeshFileAlignment] = { 0 };
+            put(zeros, to - (uint64_t)file.tellp());
+        };
+        put(&header, sizeof(header));
+        put(attrs.data(), attrs.size() * sizeof(MeshFileAttr));
+        put(levels.data(), levels.size() * sizeof(MeshFileLevel));
+        put(subsets.data(), subsets.size() * sizeof(MeshFileSubset));
+        put(meshlets.data(), meshlets.size() * sizeof(MeshFileMeshlet));
+        pad(header.vertexOffset);
+        put(vertices, vertexBytes);
+        pad(header.indexOffset);
+        put(indices, indexBytes);
+        if (!file.good())
+            throw runtime_error("can't write " + fname);
+    }
+};
+
+#endif
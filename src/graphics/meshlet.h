@@ -0,0 +1,225 @@
+#ifndef _CUBE_MESHLET_H
+#define _CUBE_MESHLET_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../collision.h"
+
+// meshlets: small clusters of a mesh's triangles, culled one by one
+//
+// buildMeshlets grows every cluster from the first triangle not yet taken,
+// always adding the neighbouring triangle that brings the fewest new
+// vertices (then the one nearest the cluster), until the cluster is out of
+// vertices or triangles or neighbours. clusters come out compact and fairly
+// flat, and the range is reordered so each is one run of indices. every
+// cluster keeps a bounding sphere and the cone its face normals lie in, so
+// a cluster is skipped when its sphere is outside the frustum, or when the
+// eye sees the back of every normal in the cone from every point of the
+// sphere. everything is in model space
+
+static const uint MeshletMaxVertices = 64;
+static const uint MeshletMaxTriangles = 124;
+
+struct Meshlet
+{
+    uint startIndex;        // into the mesh's index buffer
+    uint triangles;
+    float3 centre;
+    float radius;
+    float3 coneAxis;
+    float coneCos;          // of the widest normal from the axis; <= 0 is never back facing
+    float coneSin;
+};
+
+// clusters the triangles of indices[start, start + count), reordering them in
+// place, and appends the clusters to out
+template<typename Index>
+void buildMeshlets(Index* indices, uint start, uint count, const float3* positions, uint vertexCount, vector<Meshlet>& out,
+                   uint maxVertices = MeshletMaxVertices, uint maxTriangles = MeshletMaxTriangles)
+{
+    const Index* tris = indices + start;
+    uint triangles = count / 3;
+    if (!triangles)
+        return;
+
+    // triangles around each vertex
+    vector<uint> offsets(vertexCount + 1, 0);
+    for (uint i = 0; i < triangles * 3; i++)
+        offsets[tris[i] + 1]++;
+    for (uint v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    vector<uint> adjacency(triangles * 3);
+    vector<uint> slot(offsets.begin(), offsets.end() - 1);
+    for (uint i = 0; i < triangles * 3; i++)
+        adjacency[slot[tris[i]]++] = i / 3;
+
+    vector<float3> centroids(triangles);
+    for (uint t = 0; t < triangles; t++)
+        centroids[t] = (positions[tris[t * 3]] + positions[tris[t * 3 + 1]] + positions[tris[t * 3 + 2]]) / 3.0f;
+
+    vector<bool> taken(triangles, false);
+    vector<uint> owner(vertexCount, ~0u);  // the cluster a vertex is in
+    vector<uint> queued(triangles, ~0u);   // the cluster a triangle is a candidate of
+    vector<uint> order, members, candidates;
+    vector<Index> vertices;
+    order.reserve(triangles);
+    uint cursor = 0;
+
+    for (uint cluster = 0; order.size() < triangles; cluster++)
+    {
+        while (taken[cursor])
+            cursor++;
+        members.clear();
+        vertices.clear();
+        candidates.clear();
+        float3 sum(0, 0, 0);
+
+        uint next = cursor;
+        while (true)
+        {
+            // take next, and queue its neighbours
+            taken[next] = true;
+            members.push_back(next);
+            sum += centroids[next];
+            for (int k = 0; k < 3; k++)
+            {
+                Index v = tris[next * 3 + k];
+                if (owner[v] == cluster)
+                    continue;
+                owner[v] = cluster;
+                vertices.push_back(v);
+                for (uint a = offsets[v]; a < offsets[v + 1]; a++)
+                {
+                    uint t = adjacency[a];
+                    if (!taken[t] && queued[t] != cluster)
+                    {
+                        queued[t] = cluster;
+                        candidates.push_back(t);
+                    }
+                }
+            }
+            if (members.size() >= maxTriangles)
+                break;
+
+            // the candidate adding the fewest vertices, then the nearest
+            float3 centre = sum / (float)members.size();
+            uint best = ~0u, bestNew = 4;
+            float bestDistance = INFINITY;
+            for (uint c = 0; c < candidates.size(); )
+            {
+                uint t = candidates[c];
+                if (taken[t])
+                {
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                uint added = (owner[tris[t * 3]] != cluster) + (owner[tris[t * 3 + 1]] != cluster) + (owner[tris[t * 3 + 2]] != cluster);
+                float distance = len2(centroids[t] - centre);
+                if (vertices.size() + added <= maxVertices && (added < bestNew || (added == bestNew && distance < bestDistance)))
+                {
+                    best = t;
+                    bestNew = added;
+                    bestDistance = distance;
+                }
+                c++;
+            }
+            if (best == ~0u)
+                break;
+            next = best;
+        }
+
+        // bounds of the vertices, and the cone of the face normals
+        Meshlet m;
+        m.startIndex = start + order.size() * 3;
+        m.triangles = members.size();
+        float3 lo = positions[vertices[0]], hi = lo;
+        for (Index v : vertices)
+        {
+            const float3& p = positions[v];
+            lo = float3(fminf(lo.x, p.x), fminf(lo.y, p.y), fminf(lo.z, p.z));
+            hi = float3(fmaxf(hi.x, p.x), fmaxf(hi.y, p.y), fmaxf(hi.z, p.z));
+        }
+        m.centre = (lo + hi) * 0.5f;
+        m.radius = 0.0f;
+        for (Index v : vertices)
+            m.radius = fmaxf(m.radius, len(positions[v] - m.centre));
+
+        float3 axis(0, 0, 0);
+        for (uint t : members)
+        {
+            const Index* tri = tris + t * 3;
+            float3 n = cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+            if (len2(n) > 0.0f)
+                axis += normalize(n);
+        }
+        m.coneAxis = len2(axis) > 0.0f ? normalize(axis) : float3(0, 0, 1);
+        m.coneCos = len2(axis) > 0.0f ? 1.0f : -1.0f;
+        for (uint t : members)
+        {
+            const Index* tri = tris + t * 3;
+            float3 n = cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+            if (len2(n) > 0.0f)
+                m.coneCos = fminf(m.coneCos, dot(normalize(n), m.coneAxis));
+        }
+        m.coneSin = sqrtf(fmaxf(0.0f, 1.0f - m.coneCos * m.coneCos));
+        out.push_back(m);
+
+        order.insert(order.end(), members.begin(), members.end());
+    }
+
+    vector<Index> reordered(triangles * 3);
+    for (uint i = 0; i < triangles; i++)
+    {
+        for (int k = 0; k < 3; k++)
+            reordered[i * 3 + k] = tris[order[i] * 3 + k];
+    }
+    memcpy(indices + start, &reordered[0], triangles * 3 * sizeof(Index));
+}
+
+// false when m is outside f, or (with backfaces) every triangle of it faces
+// away from eye; f and eye are in model space
+inline bool meshletVisible(const Meshlet& m, const Frustum& f, const float3& eye, bool backfaces = true)
+{
+    for (auto& p : f.planes)
+    {
+        if (p.x * m.centre.x + p.y * m.centre.y + p.z * m.centre.z + p.w < -m.radius)
+            return false;
+    }
+    if (!backfaces || m.coneCos <= 0.0f)
+        return true;
+
+    // every normal n within the cone faces away from every point of the
+    // sphere when the smallest dot(n, centre - eye) is at least the radius;
+    // that smallest is |d| cos(angle from the axis to d + cone angle)
+    float3 d = m.centre - eye;
+    float distance = len(d);
+    if (distance <= m.radius)
+        return true;
+    float cosAngle = dot(m.coneAxis, d) / distance;
+    float sinAngle = sqrtf(fmaxf(0.0f, 1.0f - cosAngle * cosAngle));
+    return cosAngle * m.coneCos - sinAngle * m.coneSin < m.radius / distance;
+}
+
+// a world space point in the model space of an affine world matrix
+inline float3 toModelSpace(const matrix& world, const float3& p)
+{
+    // p = x * A + t, with A the upper 3x3 (row vectors)
+    const float* a = world.m;
+    float3 q = p - float3(a[12], a[13], a[14]);
+    float c00 = a[5] * a[10] - a[6] * a[9], c01 = a[6] * a[8] - a[4] * a[10], c02 = a[4] * a[9] - a[5] * a[8];
+    float det = a[0] * c00 + a[1] * c01 + a[2] * c02;
+    if (det == 0.0f)
+        return q;
+    // x = q * inverse(A), inverse(A) = adjugate / det
+    float inv[9] = {
+        c00, a[2] * a[9] - a[1] * a[10], a[1] * a[6] - a[2] * a[5],
+        c01, a[0] * a[10] - a[2] * a[8], a[2] * a[4] - a[0] * a[6],
+        c02, a[1] * a[8] - a[0] * a[9], a[0] * a[5] - a[1] * a[4],
+    };
+    return float3(q.x * inv[0] + q.y * inv[3] + q.z * inv[6],
+                  q.x * inv[1] + q.y * inv[4] + q.z * inv[7],
+                  q.x * inv[2] + q.y * inv[5] + q.z * inv[8]) / det;
+}
+
+#endif
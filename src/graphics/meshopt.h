@@ -0,0 +1,294 @@
+#ifndef _CUBE_MESHOPT_H
+#define _CUBE_MESHOPT_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+
+// index and vertex order optimizations for static meshes
+//
+// optimizeVertexCache is Tipsify (Sander, Nehab & Barczak 2007): it fans
+// around one vertex at a time and moves on to the neighbour that is still in
+// the post transform cache and has the fewest triangles left, so most vertices
+// are transformed only once. optimizeOverdraw then cuts that order into
+// clusters that each still use the cache well, and draws the clusters facing
+// away from the middle of the mesh first, so they tend to hide the rest.
+// optimizeVertexFetch renumbers vertices in the order they are first used,
+// which keeps vertex fetches moving forward through memory.
+// everything here is deterministic: the same input always gives the same order
+
+static const uint VertexCacheSize = 16;
+
+// average cache miss ratio (transformed vertices per triangle, 0.5 at best
+// for large grids, 3 at worst) and average transform to vertex ratio (1 at
+// best), for a fifo cache of cacheSize entries
+struct VertexCacheStats
+{
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+template<typename Index>
+VertexCacheStats vertexCacheStats(const Index* indices, uint count, uint vertexCount, uint cacheSize = VertexCacheSize)
+{
+    VertexCacheStats stats;
+    if (!count)
+        return stats;
+
+    // a vertex is in the cache while fewer than cacheSize misses happened since it was loaded
+    vector<uint> loaded(vertexCount, 0);
+    vector<bool> used(vertexCount, false);
+    uint misses = 0, unique = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        Index v = indices[i];
+        if (!used[v])
+        {
+            used[v] = true;
+            unique++;
+        }
+        else if (misses - loaded[v] < cacheSize)
+        {
+            continue;
+        }
+        misses++;
+        loaded[v] = misses;
+    }
+    stats.acmr = (float)misses / (count / 3);
+    stats.atvr = (float)misses / unique;
+    return stats;
+}
+
+// reorders the triangles of one index range in place. clusterStarts, if
+// given, gets the first index of every run that follows a jump to an
+// unrelated part of the mesh; optimizeOverdraw never splits across them badly
+template<typename Index>
+void optimizeVertexCache(Index* indices, uint count, uint vertexCount, vector<uint>* clusterStarts = nullptr, uint cacheSize = VertexCacheSize)
+{
+    assert(count % 3 == 0 && "index count isn't whole triangles");
+    uint triangles = count / 3;
+    if (!triangles)
+        return;
+    // only whole triangles are reordered, the rest of the range is left alone
+    count = triangles * 3;
+
+    // triangles around each vertex
+    vector<uint> offsets(vertexCount + 1, 0);
+    for (uint i = 0; i < count; i++)
+        offsets[indices[i] + 1]++;
+    for (uint v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    vector<uint> adjacency(count);
+    vector<uint> slot(offsets.begin(), offsets.end() - 1);
+    for (uint i = 0; i < count; i++)
+        adjacency[slot[indices[i]]++] = i / 3;
+
+    vector<uint> live(vertexCount);
+    for (uint v = 0; v < vertexCount; v++)
+        live[v] = offsets[v + 1] - offsets[v];
+
+    vector<uint> timestamp(vertexCount, 0);
+    vector<bool> emitted(triangles, false);
+    vector<uint> deadEnds;
+    vector<uint> candidates;
+    vector<Index> out;
+    out.reserve(count);
+
+    uint time = cacheSize + 1;
+    uint cursor = 0;
+    int fan = indices[0];
+    if (clusterStarts)
+        clusterStarts->assign(1, 0);
+
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (uint a = offsets[fan]; a < offsets[fan + 1]; a++)
+        {
+            uint t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                Index v = indices[t * 3 + k];
+                out.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - timestamp[v] > cacheSize)
+                    timestamp[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // the candidate that stays in the cache for all of its remaining
+        // triangles and was loaded the longest ago
+        int next = -1;
+        uint best = 0;
+        for (uint v : candidates)
+        {
+            if (!live[v])
+                continue;
+            uint priority = 0;
+            if (time - timestamp[v] + 2 * live[v] <= cacheSize)
+                priority = time - timestamp[v];
+            if (priority > best || next < 0)
+            {
+                best = priority;
+                next = v;
+            }
+        }
+
+        if (next < 0)
+        {
+            // dead end: the most recent vertex with triangles left, or else the next one in input order
+            while (!deadEnds.empty() && next < 0)
+            {
+                uint d = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[d])
+                    next = d;
+            }
+            while (next < 0 && cursor < count)
+            {
+                uint v = indices[cursor++];
+                if (live[v])
+                {
+                    next = v;
+                    if (clusterStarts)
+                        clusterStarts->push_back(out.size());
+                }
+            }
+        }
+        fan = next;
+    }
+
+    memcpy(indices, &out[0], count * sizeof(Index));
+}
+
+// reorders clusters of triangles of one (cache optimized) index range in
+// place. clusters are cut wherever the range from the cluster start has an
+// acmr within threshold times that of the whole range, so the cache cost of
+// the new order is bounded by the threshold
+template<typename Index>
+void optimizeOverdraw(Index* indices, uint count, const float3* positions, uint vertexCount, const vector<uint>& hardStarts, float threshold = 1.05f, uint cacheSize = VertexCacheSize)
+{
+    uint triangles = count / 3;
+    if (triangles < 2)
+        return;
+
+    float target = vertexCacheStats(indices, count, vertexCount, cacheSize).acmr * threshold;
+
+    // soft cluster starts, in index units
+    vector<uint> starts;
+    vector<uint> loaded(vertexCount, 0);
+    vector<uint> stamp(vertexCount, 0);
+    uint hard = 0;
+    uint misses = 0, start = 0, generation = 0;
+    for (uint t = 0; t < triangles; t++)
+    {
+        uint i = t * 3;
+        bool hardStart = hard < hardStarts.size() && hardStarts[hard] <= i;
+        while (hard < hardStarts.size() && hardStarts[hard] <= i)
+            hard++;
+        if (t == 0 || hardStart || (t > start / 3 && (float)misses / (t - start / 3) <= target))
+        {
+            // a fresh cache for each cluster, as if drawn after anything else
+            starts.push_back(i);
+            start = i;
+            misses = 0;
+            generation++;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            Index v = indices[i + k];
+            if (stamp[v] == generation && misses - loaded[v] < cacheSize)
+                continue;
+            stamp[v] = generation;
+            misses++;
+            loaded[v] = misses;
+        }
+    }
+    starts.push_back(count);
+
+    // centre of the whole range
+    float3 centre(0, 0, 0);
+    float area = 0.0f;
+    vector<float3> clusterCentre(starts.size() - 1), clusterNormal(starts.size() - 1);
+    vector<float> clusterArea(starts.size() - 1, 0.0f);
+    for (uint c = 0; c + 1 < starts.size(); c++)
+    {
+        float3 sum(0, 0, 0), normal(0, 0, 0);
+        float a = 0.0f;
+        for (uint i = starts[c]; i < starts[c + 1]; i += 3)
+        {
+            const float3& p0 = positions[indices[i]];
+            const float3& p1 = positions[indices[i + 1]];
+            const float3& p2 = positions[indices[i + 2]];
+            float3 n = cross(p1 - p0, p2 - p0);
+            float ta = len(n) * 0.5f;
+            sum += (p0 + p1 + p2) * (ta / 3.0f);
+            normal += n;
+            a += ta;
+        }
+        clusterCentre[c] = a > 0.0f ? sum / a : positions[indices[starts[c]]];
+        clusterNormal[c] = len2(normal) > 0.0f ? normalize(normal) : float3(0, 0, 0);
+        clusterArea[c] = a;
+        centre += sum;
+        area += a;
+    }
+    if (area > 0.0f)
+        centre /= area;
+
+    // outward facing clusters far from the centre first
+    vector<uint> order(starts.size() - 1);
+    vector<float> sortKey(order.size());
+    for (uint c = 0; c < order.size(); c++)
+    {
+        order[c] = c;
+        sortKey[c] = dot(clusterCentre[c] - centre, clusterNormal[c]);
+    }
+    stable_sort(order.begin(), order.end(), [&](uint a, uint b) { return sortKey[a] > sortKey[b]; });
+
+    vector<Index> out;
+    out.reserve(count);
+    for (uint c : order)
+    {
+        out.insert(out.end(), indices + starts[c], indices + starts[c + 1]);
+    }
+    memcpy(indices, &out[0], count * sizeof(Index));
+}
+
+// renumbers vertices in order of first use; remap[old] = new. unused vertices
+// keep their relative order after the used ones
+template<typename Index>
+void optimizeVertexFetch(Index* indices, uint count, uint vertexCount, vector<uint>& remap)
+{
+    const uint None = ~0u;
+    remap.assign(vertexCount, None);
+    uint next = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        if (remap[indices[i]] == None)
+            remap[indices[i]] = next++;
+        indices[i] = remap[indices[i]];
+    }
+    for (uint v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] == None)
+            remap[v] = next++;
+    }
+}
+
+// moves vertex data to match a remap from optimizeVertexFetch
+template<typename T>
+void remapVertices(vector<T>& data, const vector<uint>& remap)
+{
+    vector<T> out(data.size());
+    for (uint v = 0; v < data.size(); v++)
+    {
+        out[remap[v]] = data[v];
+    }
+    data.swap(out);
+}
+
+#endif
@@ -0,0 +1,986 @@
+#ifndef _CUBE_GRAPHICS_NULLGL_H
+#define _CUBE_GRAPHICS_NULLGL_H
+
+#include <cstring>
+#include "../definitions.h"
+
+// headless GL backend
+//
+// glad resolves every GL entry point through a loader function, so instead of
+// wrapping each GL call site we load glad with NullGL::getProcAddress. the
+// engine keeps calling glBindBuffer etc. as usual and ends up in these stubs,
+// which validate object names, track bound state and count the work that would
+// have been sent to a driver. entry points that aren't emulated load as null,
+// so code that starts using new GL functions fails loudly in headless runs.
+
+struct NullGLStats
+{
+    uint64_t drawCalls = 0;
+    uint64_t indices = 0;
+    uint64_t instances = 0;
+    uint64_t bytesUploaded = 0;
+    uint64_t stateChanges = 0;
+    uint64_t redundantStateChanges = 0;
+    uint64_t uniformUpdates = 0;
+    uint64_t objectsCreated = 0;
+    uint64_t errors = 0;
+
+    void print(const string& title) const
+    {
+        cout << title << endl;
+        cout << "    draw calls:      " << drawCalls << endl;
+        cout << "    indices:         " << indices << endl;
+        cout << "    instances:       " << instances << endl;
+        cout << "    bytes uploaded:  " << bytesUploaded << endl;
+        cout << "    state changes:   " << stateChanges << " (" << redundantStateChanges << " redundant)" << endl;
+        cout << "    uniform updates: " << uniformUpdates << endl;
+        cout << "    objects created: " << objectsCreated << endl;
+        cout << "    errors:          " << errors << endl;
+    }
+};
+
+class NullGL
+{
+public:
+    static const int MaxAttribs = 16;
+    static const int MaxTextureUnits = 16;
+    static const int MaxUniformBindings = 36;
+    static const int UniformBufferAlignment = 256;
+    static const int MaxUniformBlockSize = 65536;
+
+    struct BufferObject
+    {
+        bool alive = false;
+        size_t size = 0;
+        vector<uchar> data; // only filled when keepData is set
+        vector<uchar> mapped; // what glMapBufferRange hands out without keepData
+    };
+    struct TextureObject
+    {
+        bool alive = false;
+        GLenum target = 0;
+        int width = 0;
+        int height = 0;
+        GLenum format = GL_RGBA;
+        GLenum type = GL_UNSIGNED_BYTE;
+        vector<uchar> data; // level 0, only filled when keepData is set
+    };
+    struct VertexAttrib
+    {
+        bool enabled = false;
+        GLuint buffer = 0;
+        GLint size = 4;
+        GLenum type = GL_FLOAT;
+        bool normalized = false;
+        bool integer = false;   // set with glVertexAttribIPointer
+        GLsizei stride = 0;
+        size_t offset = 0;
+    };
+    struct VertexArrayObject
+    {
+        bool alive = false;
+        VertexAttrib attribs[MaxAttribs];
+        GLuint elementBuffer = 0;
+    };
+    struct ShaderObject
+    {
+        bool alive = false;
+        GLenum type = 0;
+        string source;
+        string label; // file name, see labelShader
+    };
+    struct UniformValue
+    {
+        vector<float> f;
+        vector<GLint> i;
+    };
+    struct ProgramObject
+    {
+        bool alive = false;
+        bool linked = false;
+        vector<GLuint> shaders;
+        map<string, GLint> locations;
+        map<string, GLuint> attribLocations;
+        vector<UniformValue> values;
+        map<string, GLuint> blockIndices;
+        vector<GLuint> blockBindings;   // by block index
+    };
+    struct UniformBinding
+    {
+        GLuint buffer = 0;
+        size_t offset = 0;
+        size_t size = 0;        // 0 for the whole buffer
+    };
+    struct FramebufferObject
+    {
+        bool alive = false;
+        GLuint colour = 0;
+    };
+    struct QueryObject
+    {
+        bool alive = false;
+        GLenum target = 0;
+    };
+
+    // set once glad has been loaded from getProcAddress
+    bool active = false;
+
+    // keep copies of buffer and texture contents (for backends that need to read them back)
+    bool keepData = false;
+
+    NullGLStats stats;      // since startup
+    NullGLStats frameStats; // since the last endFrame()
+    NullGLStats lastFrame;  // the previous complete frame
+
+    vector<BufferObject> buffers = vector<BufferObject>(1);
+    vector<TextureObject> textures = vector<TextureObject>(1);
+    vector<VertexArrayObject> vertexArrays = vector<VertexArrayObject>(1);
+    vector<ShaderObject> shaders = vector<ShaderObject>(1);
+    vector<ProgramObject> programs = vector<ProgramObject>(1);
+    vector<FramebufferObject> framebuffers = vector<FramebufferObject>(1);
+    vector<QueryObject> queries = vector<QueryObject>(1);
+
+    // bound state
+    GLuint arrayBuffer = 0;
+    GLuint pixelPackBuffer = 0;
+    GLuint uniformBuffer = 0;
+    UniformBinding uniformBindings[MaxUniformBindings];
+    GLuint vertexArray = 0;
+    GLuint program = 0;
+    GLuint framebuffer = 0;
+    GLuint activeTexture = 0;
+    GLuint boundTextures[MaxTextureUnits] = { 0 };
+    GLint viewport[4] = { 0, 0, 1280, 720 };
+    float clearColour[4] = { 0, 0, 0, 0 };
+    bool depthTest = false;
+    bool blend = false;
+    bool cullFace = false;
+    GLenum depthFunc = GL_LESS;
+    GLenum blendSrc = GL_ONE;
+    GLenum blendDst = GL_ZERO;
+    GLenum error = GL_NO_ERROR;
+
+    // hooks for backends that actually do something with the calls
+    function<void(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instances, GLint baseVertex)> onDraw;
+    function<void(GLbitfield mask)> onClear;
+
+    static NullGL& get()
+    {
+        static NullGL gl;
+        return gl;
+    }
+
+    // pass to gladLoadGL
+    static GLADapiproc getProcAddress(const char* name);
+
+    void setViewport(int width, int height)
+    {
+        viewport[0] = 0;
+        viewport[1] = 0;
+        viewport[2] = width;
+        viewport[3] = height;
+    }
+
+    // lets backends tell shaders apart; does nothing unless NullGL is the loaded GL
+    void labelShader(GLuint shader, const string& label)
+    {
+        if (active && shader < shaders.size())
+        {
+            shaders[shader].label = label;
+        }
+    }
+
+    // the contents of the buffer range bound to a program's uniform block, for
+    // backends (keepData must be set); nullptr if nothing is bound to it
+    const uchar* getUniformBlock(const ProgramObject& p, const string& name, size_t& size) const
+    {
+        auto iter = p.blockIndices.find(name);
+        if (iter == p.blockIndices.end())
+            return nullptr;
+        const UniformBinding& b = uniformBindings[p.blockBindings[iter->second]];
+        if (!b.buffer || b.buffer >= buffers.size() || buffers[b.buffer].data.size() < b.offset + b.size)
+            return nullptr;
+        size = b.size ? b.size : buffers[b.buffer].data.size() - b.offset;
+        return size ? &buffers[b.buffer].data[b.offset] : nullptr;
+    }
+
+    void endFrame()
+    {
+        lastFrame = frameStats;
+        frameStats = NullGLStats();
+    }
+
+    static size_t pixelSize(GLenum format, GLenum type)
+    {
+        size_t channels = 4;
+        switch (format)
+        {
+            case GL_RED: case GL_DEPTH_COMPONENT: channels = 1; break;
+            case GL_RG: case GL_DEPTH_STENCIL: channels = 2; break;
+            case GL_RGB: case GL_BGR: channels = 3; break;
+        }
+        switch (type)
+        {
+            case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return channels * 2;
+            case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: return channels * 4;
+            case GL_UNSIGNED_INT_24_8: return 4;
+        }
+        return channels;
+    }
+
+private:
+    NullGL() = default;
+    NullGL(const NullGL&) = delete;
+    NullGL& operator = (const NullGL&) = delete;
+
+    void fail(GLenum err, const char* func, const string& what)
+    {
+        stats.errors++;
+        frameStats.errors++;
+        if (error == GL_NO_ERROR)
+        {
+            error = err;
+        }
+        if (stats.errors <= 32)
+        {
+            cout << "nullgl: " << func << ": " << what << endl;
+        }
+    }
+    void count(uint64_t NullGLStats::* field, uint64_t n = 1)
+    {
+        stats.*field += n;
+        frameStats.*field += n;
+    }
+    template<typename T>
+    void setState(T& state, const T& value)
+    {
+        count(state == value ? &NullGLStats::redundantStateChanges : &NullGLStats::stateChanges);
+        state = value;
+    }
+    template<typename Object>
+    void create(vector<Object>& objects, GLsizei n, GLuint* names)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            names[i] = objects.size();
+            objects.push_back(Object());
+            objects.back().alive = true;
+        }
+        count(&NullGLStats::objectsCreated, n);
+    }
+    template<typename Object>
+    void destroy(vector<Object>& objects, GLsizei n, const GLuint* names, const char* /*func*/)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            // deleting 0 or an already deleted name is silently ignored, same as GL
+            if (names[i] && names[i] < objects.size())
+            {
+                objects[names[i]] = Object();
+            }
+        }
+    }
+    template<typename Object>
+    bool valid(vector<Object>& objects, GLuint name, const char* func, bool allowZero = true)
+    {
+        if ((name == 0 && allowZero) || (name < objects.size() && objects[name].alive))
+        {
+            return true;
+        }
+        fail(GL_INVALID_OPERATION, func, "invalid object name " + to_string(name));
+        return false;
+    }
+    GLuint* bufferBinding(GLenum target, const char* func)
+    {
+        if (target == GL_ARRAY_BUFFER) return &arrayBuffer;
+        if (target == GL_ELEMENT_ARRAY_BUFFER) return &vertexArrays[vertexArray].elementBuffer;
+        if (target == GL_PIXEL_PACK_BUFFER) return &pixelPackBuffer;
+        if (target == GL_UNIFORM_BUFFER) return &uniformBuffer;
+        fail(GL_INVALID_ENUM, func, "unsupported buffer target");
+        return nullptr;
+    }
+    UniformValue* uniformAt(GLint location, const char* func)
+    {
+        if (location == -1)
+        {
+            // setting location -1 is legal and does nothing
+            return nullptr;
+        }
+        if (!program)
+        {
+            fail(GL_INVALID_OPERATION, func, "no program bound");
+            return nullptr;
+        }
+        auto& p = programs[program];
+        if (location < 0 || location >= (GLint)p.values.size())
+        {
+            fail(GL_INVALID_OPERATION, func, "invalid uniform location " + to_string(location));
+            return nullptr;
+        }
+        count(&NullGLStats::uniformUpdates);
+        return &p.values[location];
+    }
+    void setUniform(GLint location, GLsizei n, const GLfloat* value, const char* func)
+    {
+        if (auto u = uniformAt(location, func))
+        {
+            u->f.assign(value, value + n);
+        }
+    }
+    void draw(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances, GLint baseVertex, const char* func)
+    {
+        if (!program || !programs[program].linked)
+        {
+            fail(GL_INVALID_OPERATION, func, "no linked program bound");
+            return;
+        }
+        if (!vertexArray)
+        {
+            fail(GL_INVALID_OPERATION, func, "no vertex array bound");
+            return;
+        }
+        auto& vao = vertexArrays[vertexArray];
+        if (!vao.elementBuffer)
+        {
+            fail(GL_INVALID_OPERATION, func, "no element buffer bound");
+            return;
+        }
+        size_t offset = (size_t)indices;
+        size_t indexSize = (type == GL_UNSIGNED_INT) ? 4 : (type == GL_UNSIGNED_SHORT) ? 2 : 1;
+        if (offset + count * indexSize > buffers[vao.elementBuffer].size)
+        {
+            fail(GL_INVALID_OPERATION, func, "index range outside element buffer");
+            return;
+        }
+
+        this->count(&NullGLStats::drawCalls);
+        this->count(&NullGLStats::indices, count);
+        this->count(&NullGLStats::instances, instances);
+        if (onDraw)
+        {
+            onDraw(mode, count, type, offset, instances, baseVertex);
+        }
+    }
+
+    // entry points
+    static const GLubyte* GLAD_API_PTR getString(GLenum name)
+    {
+        switch (name)
+        {
+            case GL_VERSION: return (const GLubyte*)"3.3 NullGL";
+            case GL_RENDERER: return (const GLubyte*)"NullGL";
+            case GL_VENDOR: return (const GLubyte*)"lwcgl";
+            case GL_SHADING_LANGUAGE_VERSION: return (const GLubyte*)"4.00";
+        }
+        return nullptr;
+    }
+    static const GLubyte* GLAD_API_PTR getStringi(GLenum /*name*/, GLuint /*index*/)
+    {
+        // glad won't finish loading with an empty extension list
+        return (const GLubyte*)"GL_LWCGL_null_backend";
+    }
+    static GLenum GLAD_API_PTR getError()
+    {
+        auto& gl = get();
+        GLenum err = gl.error;
+        gl.error = GL_NO_ERROR;
+        return err;
+    }
+    static void GLAD_API_PTR getIntegerv(GLenum pname, GLint* data)
+    {
+        auto& gl = get();
+        switch (pname)
+        {
+            case GL_VIEWPORT: memcpy(data, gl.viewport, sizeof(gl.viewport)); break;
+            case GL_NUM_EXTENSIONS: *data = 1; break;
+            case GL_MAX_VERTEX_ATTRIBS: *data = MaxAttribs; break;
+            case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS: *data = MaxTextureUnits; break;
+            case GL_MAX_UNIFORM_BUFFER_BINDINGS: *data = MaxUniformBindings; break;
+            case GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT: *data = UniformBufferAlignment; break;
+            case GL_MAX_UNIFORM_BLOCK_SIZE: *data = MaxUniformBlockSize; break;
+            default: *data = 0; break;
+        }
+    }
+
+    static void GLAD_API_PTR enable(GLenum cap)
+    {
+        auto& gl = get();
+        if (cap == GL_DEPTH_TEST) gl.setState(gl.depthTest, true);
+        else if (cap == GL_BLEND) gl.setState(gl.blend, true);
+        else if (cap == GL_CULL_FACE) gl.setState(gl.cullFace, true);
+        else gl.count(&NullGLStats::stateChanges);
+    }
+    static void GLAD_API_PTR disable(GLenum cap)
+    {
+        auto& gl = get();
+        if (cap == GL_DEPTH_TEST) gl.setState(gl.depthTest, false);
+        else if (cap == GL_BLEND) gl.setState(gl.blend, false);
+        else if (cap == GL_CULL_FACE) gl.setState(gl.cullFace, false);
+        else gl.count(&NullGLStats::stateChanges);
+    }
+    static void GLAD_API_PTR depthFuncStub(GLenum func) { auto& gl = get(); gl.setState(gl.depthFunc, func); }
+    static void GLAD_API_PTR blendFunc(GLenum src, GLenum dst)
+    {
+        auto& gl = get();
+        gl.setState(gl.blendSrc, src);
+        gl.blendDst = dst;
+    }
+    static void GLAD_API_PTR viewportStub(GLint x, GLint y, GLsizei w, GLsizei h)
+    {
+        auto& gl = get();
+        gl.count(&NullGLStats::stateChanges);
+        gl.viewport[0] = x;
+        gl.viewport[1] = y;
+        gl.viewport[2] = w;
+        gl.viewport[3] = h;
+    }
+    static void GLAD_API_PTR clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+    {
+        auto& gl = get();
+        gl.clearColour[0] = r;
+        gl.clearColour[1] = g;
+        gl.clearColour[2] = b;
+        gl.clearColour[3] = a;
+    }
+    static void GLAD_API_PTR clear(GLbitfield mask)
+    {
+        auto& gl = get();
+        if (gl.onClear)
+        {
+            gl.onClear(mask);
+        }
+    }
+    static void GLAD_API_PTR colorMask(GLboolean /*r*/, GLboolean /*g*/, GLboolean /*b*/, GLboolean /*a*/) { get().count(&NullGLStats::stateChanges); }
+    static void GLAD_API_PTR depthMask(GLboolean /*flag*/) { get().count(&NullGLStats::stateChanges); }
+
+    // buffers
+    static void GLAD_API_PTR genBuffers(GLsizei n, GLuint* names) { get().create(get().buffers, n, names); }
+    static void GLAD_API_PTR deleteBuffers(GLsizei n, const GLuint* names) { get().destroy(get().buffers, n, names, "glDeleteBuffers"); }
+    static void GLAD_API_PTR bindBuffer(GLenum target, GLuint buffer)
+    {
+        auto& gl = get();
+        if (!gl.valid(gl.buffers, buffer, "glBindBuffer"))
+            return;
+        if (auto binding = gl.bufferBinding(target, "glBindBuffer"))
+            gl.setState(*binding, buffer);
+    }
+    static void GLAD_API_PTR bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum /*usage*/)
+    {
+        auto& gl = get();
+        auto binding = gl.bufferBinding(target, "glBufferData");
+        if (!binding)
+            return;
+        if (!*binding)
+        {
+            gl.fail(GL_INVALID_OPERATION, "glBufferData", "no buffer bound");
+            return;
+        }
+        auto& b = gl.buffers[*binding];
+        b.size = size;
+        if (gl.keepData)
+        {
+            b.data.resize(size);
+            if (data && size)
+                memcpy(&b.data[0], data, size);
+        }
+        gl.count(&NullGLStats::bytesUploaded, data ? size : 0);
+    }
+    static void GLAD_API_PTR bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+    {
+        auto& gl = get();
+        auto binding = gl.bufferBinding(target, "glBufferSubData");
+        if (!binding)
+            return;
+        auto& b = gl.buffers[*binding];
+        if (!*binding || offset + size > (GLintptr)b.size)
+        {
+            gl.fail(GL_INVALID_VALUE, "glBufferSubData", "range outside buffer");
+            return;
+        }
+        if (gl.keepData && size)
+        {
+            memcpy(&b.data[offset], data, size);
+        }
+        gl.count(&NullGLStats::bytesUploaded, size);
+    }
+
+    static void GLAD_API_PTR bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+    {
+        auto& gl = get();
+        if (target != GL_UNIFORM_BUFFER || index >= MaxUniformBindings)
+        {
+            gl.fail(GL_INVALID_VALUE, "glBindBufferRange", "not a uniform buffer binding");
+            return;
+        }
+        if (!gl.valid(gl.buffers, buffer, "glBindBufferRange"))
+            return;
+        if (buffer && (offset % UniformBufferAlignment || size <= 0 || offset + size > (GLintptr)gl.buffers[buffer].size))
+        {
+            gl.fail(GL_INVALID_VALUE, "glBindBufferRange", "misaligned range or range outside buffer");
+            return;
+        }
+        // binding a range also binds the generic target
+        gl.setState(gl.uniformBuffer, buffer);
+        auto& b = gl.uniformBindings[index];
+        b.buffer = buffer;
+        b.offset = offset;
+        b.size = size;
+    }
+    static void GLAD_API_PTR bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        auto& gl = get();
+        if (target != GL_UNIFORM_BUFFER || index >= MaxUniformBindings)
+        {
+            gl.fail(GL_INVALID_VALUE, "glBindBufferBase", "not a uniform buffer binding");
+            return;
+        }
+        if (!gl.valid(gl.buffers, buffer, "glBindBufferBase"))
+            return;
+        gl.setState(gl.uniformBuffer, buffer);
+        gl.uniformBindings[index] = { buffer, 0, 0 };
+    }
+
+    static void* GLAD_API_PTR mapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield /*access*/)
+    {
+        auto& gl = get();
+        auto binding = gl.bufferBinding(target, "glMapBufferRange");
+        if (!binding)
+            return nullptr;
+        auto& b = gl.buffers[*binding];
+        if (!*binding || offset + length > (GLintptr)b.size)
+        {
+            gl.fail(GL_INVALID_VALUE, "glMapBufferRange", "range outside buffer");
+            return nullptr;
+        }
+        if (gl.keepData)
+            return &b.data[offset];
+        b.mapped.assign(length, 0);
+        return &b.mapped[0];
+    }
+    static GLboolean GLAD_API_PTR unmapBuffer(GLenum target)
+    {
+        auto& gl = get();
+        auto binding = gl.bufferBinding(target, "glUnmapBuffer");
+        if (binding && *binding)
+            gl.buffers[*binding].mapped.clear();
+        return GL_TRUE;
+    }
+
+    // vertex arrays
+    static void GLAD_API_PTR genVertexArrays(GLsizei n, GLuint* names) { get().create(get().vertexArrays, n, names); }
+    static void GLAD_API_PTR deleteVertexArrays(GLsizei n, const GLuint* names) { get().destroy(get().vertexArrays, n, names, "glDeleteVertexArrays"); }
+    static void GLAD_API_PTR bindVertexArray(GLuint vao)
+    {
+        auto& gl = get();
+        if (gl.valid(gl.vertexArrays, vao, "glBindVertexArray"))
+            gl.setState(gl.vertexArray, vao);
+    }
+    static void GLAD_API_PTR vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
+    {
+        auto& gl = get();
+        if (!gl.vertexArray || index >= MaxAttribs || !gl.arrayBuffer)
+        {
+            gl.fail(GL_INVALID_OPERATION, "glVertexAttribPointer", "no vertex array / array buffer bound, or bad index");
+            return;
+        }
+        auto& a = gl.vertexArrays[gl.vertexArray].attribs[index];
+        a.buffer = gl.arrayBuffer;
+        a.size = size;
+        a.type = type;
+        a.normalized = normalized;
+        a.integer = false;
+        a.stride = stride;
+        a.offset = (size_t)pointer;
+    }
+    static void GLAD_API_PTR vertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer)
+    {
+        vertexAttribPointer(index, size, type, GL_FALSE, stride, pointer);
+        auto& gl = get();
+        if (gl.vertexArray && index < MaxAttribs)
+            gl.vertexArrays[gl.vertexArray].attribs[index].integer = true;
+    }
+    static void GLAD_API_PTR enableVertexAttribArray(GLuint index)
+    {
+        auto& gl = get();
+        if (!gl.vertexArray || index >= MaxAttribs)
+        {
+            gl.fail(GL_INVALID_OPERATION, "glEnableVertexAttribArray", "no vertex array bound, or bad index");
+            return;
+        }
+        gl.vertexArrays[gl.vertexArray].attribs[index].enabled = true;
+    }
+
+    // textures
+    static void GLAD_API_PTR genTextures(GLsizei n, GLuint* names) { get().create(get().textures, n, names); }
+    static void GLAD_API_PTR deleteTextures(GLsizei n, const GLuint* names) { get().destroy(get().textures, n, names, "glDeleteTextures"); }
+    static void GLAD_API_PTR activeTextureStub(GLenum unit)
+    {
+        auto& gl = get();
+        if (unit < GL_TEXTURE0 || unit >= GL_TEXTURE0 + MaxTextureUnits)
+        {
+            gl.fail(GL_INVALID_ENUM, "glActiveTexture", "bad texture unit");
+            return;
+        }
+        gl.setState(gl.activeTexture, unit - GL_TEXTURE0);
+    }
+    static void GLAD_API_PTR bindTexture(GLenum target, GLuint texture)
+    {
+        auto& gl = get();
+        if (!gl.valid(gl.textures, texture, "glBindTexture"))
+            return;
+        if (texture)
+            gl.textures[texture].target = target;
+        gl.setState(gl.boundTextures[gl.activeTexture], texture);
+    }
+    static void GLAD_API_PTR texImage2D(GLenum /*target*/, GLint level, GLint /*iformat*/, GLsizei w, GLsizei h, GLint /*border*/, GLenum format, GLenum type, const void* pixels)
+    {
+        auto& gl = get();
+        GLuint name = gl.boundTextures[gl.activeTexture];
+        if (!name)
+        {
+            gl.fail(GL_INVALID_OPERATION, "glTexImage2D", "no texture bound");
+            return;
+        }
+        size_t size = (size_t)w * h * pixelSize(format, type);
+        if (level == 0)
+        {
+            auto& t = gl.textures[name];
+            t.width = w;
+            t.height = h;
+            t.format = format;
+            t.type = type;
+            if (gl.keepData)
+            {
+                t.data.assign(size, 0);
+                if (pixels)
+                    memcpy(&t.data[0], pixels, size);
+            }
+        }
+        gl.count(&NullGLStats::bytesUploaded, pixels ? size : 0);
+    }
+    static void GLAD_API_PTR texParameteri(GLenum /*target*/, GLenum /*pname*/, GLint /*param*/) { get().count(&NullGLStats::stateChanges); }
+    static void GLAD_API_PTR generateMipmap(GLenum /*target*/) {}
+    static void GLAD_API_PTR getTexLevelParameteriv(GLenum /*target*/, GLint level, GLenum pname, GLint* params)
+    {
+        auto& gl = get();
+        auto& t = gl.textures[gl.boundTextures[gl.activeTexture]];
+        *params = (pname == GL_TEXTURE_WIDTH) ? (t.width >> level) : (pname == GL_TEXTURE_HEIGHT) ? (t.height >> level) : 0;
+    }
+
+    // framebuffers
+    static void GLAD_API_PTR genFramebuffers(GLsizei n, GLuint* names) { get().create(get().framebuffers, n, names); }
+    static void GLAD_API_PTR deleteFramebuffers(GLsizei n, const GLuint* names) { get().destroy(get().framebuffers, n, names, "glDeleteFramebuffers"); }
+    static void GLAD_API_PTR bindFramebuffer(GLenum /*target*/, GLuint fbo)
+    {
+        auto& gl = get();
+        if (gl.valid(gl.framebuffers, fbo, "glBindFramebuffer"))
+            gl.setState(gl.framebuffer, fbo);
+    }
+    static void GLAD_API_PTR framebufferTexture(GLenum /*target*/, GLenum attachment, GLuint texture, GLint /*level*/)
+    {
+        auto& gl = get();
+        if (!gl.framebuffer || !gl.valid(gl.textures, texture, "glFramebufferTexture"))
+        {
+            gl.fail(GL_INVALID_OPERATION, "glFramebufferTexture", "no framebuffer bound");
+            return;
+        }
+        if (attachment == GL_COLOR_ATTACHMENT0)
+            gl.framebuffers[gl.framebuffer].colour = texture;
+    }
+    static void GLAD_API_PTR drawBuffers(GLsizei /*n*/, const GLenum* /*bufs*/) {}
+    static void GLAD_API_PTR readBuffer(GLenum /*src*/) {}
+    // nothing is rendered, so reads come back as zeros
+    static void GLAD_API_PTR readPixels(GLint /*x*/, GLint /*y*/, GLsizei w, GLsizei h, GLenum format, GLenum type, void* pixels)
+    {
+        auto& gl = get();
+        size_t size = (size_t)w * h * pixelSize(format, type);
+        if (!gl.pixelPackBuffer)
+        {
+            memset(pixels, 0, size);
+            return;
+        }
+        auto& b = gl.buffers[gl.pixelPackBuffer];
+        size_t offset = (size_t)pixels;
+        if (offset + size > b.size)
+        {
+            gl.fail(GL_INVALID_OPERATION, "glReadPixels", "range outside pixel pack buffer");
+            return;
+        }
+        if (gl.keepData)
+            memset(&b.data[offset], 0, size);
+    }
+
+    // shaders and programs
+    static GLuint GLAD_API_PTR createShader(GLenum type)
+    {
+        GLuint name = 0;
+        get().create(get().shaders, 1, &name);
+        get().shaders[name].type = type;
+        return name;
+    }
+    static void GLAD_API_PTR deleteShader(GLuint shader) { get().destroy(get().shaders, 1, &shader, "glDeleteShader"); }
+    static void GLAD_API_PTR shaderSource(GLuint shader, GLsizei n, const GLchar* const* strings, const GLint* lengths)
+    {
+        auto& gl = get();
+        if (!gl.valid(gl.shaders, shader, "glShaderSource", false))
+            return;
+        auto& s = gl.shaders[shader];
+        s.source.clear();
+        for (int i = 0; i < n; i++)
+        {
+            s.source += (lengths && lengths[i] >= 0) ? string(strings[i], lengths[i]) : string(strings[i]);
+        }
+    }
+    static void GLAD_API_PTR compileShader(GLuint shader) { get().valid(get().shaders, shader, "glCompileShader", false); }
+    static void GLAD_API_PTR getShaderiv(GLuint /*shader*/, GLenum pname, GLint* params)
+    {
+        *params = (pname == GL_COMPILE_STATUS) ? GL_TRUE : 0;
+    }
+    static void GLAD_API_PTR getShaderInfoLog(GLuint /*shader*/, GLsizei size, GLsizei* length, GLchar* log)
+    {
+        if (length) *length = 0;
+        if (size) log[0] = 0;
+    }
+    static GLuint GLAD_API_PTR createProgram()
+    {
+        GLuint name = 0;
+        get().create(get().programs, 1, &name);
+        return name;
+    }
+    static void GLAD_API_PTR deleteProgram(GLuint program) { get().destroy(get().programs, 1, &program, "glDeleteProgram"); }
+    static void GLAD_API_PTR attachShader(GLuint program, GLuint shader)
+    {
+        auto& gl = get();
+        if (gl.valid(gl.programs, program, "glAttachShader", false) && gl.valid(gl.shaders, shader, "glAttachShader", false))
+            gl.programs[program].shaders.push_back(shader);
+    }
+    static void GLAD_API_PTR detachShader(GLuint program, GLuint shader)
+    {
+        auto& gl = get();
+        if (!gl.valid(gl.programs, program, "glDetachShader", false))
+            return;
+        auto& s = gl.programs[program].shaders;
+        s.erase(remove(s.begin(), s.end(), shader), s.end());
+    }
+    static void GLAD_API_PTR bindAttribLocation(GLuint program, GLuint index, const GLchar* name)
+    {
+        auto& gl = get();
+        if (gl.valid(gl.programs, program, "glBindAttribLocation", false))
+            gl.programs[program].attribLocations[name] = index;
+    }
+    static void GLAD_API_PTR linkProgram(GLuint program)
+    {
+        auto& gl = get();
+        if (!gl.valid(gl.programs, program, "glLinkProgram", false))
+            return;
+        auto& p = gl.programs[program];
+        if (p.shaders.size() < 2)
+        {
+            gl.fail(GL_INVALID_OPERATION, "glLinkProgram", "program needs a vertex and a fragment shader");
+            return;
+        }
+        p.linked = true;
+    }
+    static void GLAD_API_PTR useProgram(GLuint program)
+    {
+        auto& gl = get();
+        if (gl.valid(gl.programs, program, "glUseProgram"))
+            gl.setState(gl.program, program);
+    }
+    static GLint GLAD_API_PTR getUniformLocation(GLuint program, const GLchar* name)
+    {
+        // every name gets a location; we can't tell which uniforms the GLSL actually declares
+        auto& gl = get();
+        if (!gl.valid(gl.programs, program, "glGetUniformLocation", false))
+            return -1;
+        auto& p = gl.programs[program];
+        auto iter = p.locations.find(name);
+        if (iter != p.locations.end())
+            return iter->second;
+        GLint location = p.values.size();
+        p.locations[name] = location;
+        p.values.push_back(UniformValue());
+        return location;
+    }
+    static GLuint GLAD_API_PTR getUniformBlockIndex(GLuint program, const GLchar* name)
+    {
+        // like uniform locations, every name gets a block index
+        auto& gl = get();
+        if (!gl.valid(gl.programs, program, "glGetUniformBlockIndex", false))
+            return GL_INVALID_INDEX;
+        auto& p = gl.programs[program];
+        auto iter = p.blockIndices.find(name);
+        if (iter != p.blockIndices.end())
+            return iter->second;
+        GLuint index = p.blockBindings.size();
+        p.blockIndices[name] = index;
+        p.blockBindings.push_back(0);
+        return index;
+    }
+    static void GLAD_API_PTR uniformBlockBinding(GLuint program, GLuint index, GLuint binding)
+    {
+        auto& gl = get();
+        if (!gl.valid(gl.programs, program, "glUniformBlockBinding", false))
+            return;
+        auto& p = gl.programs[program];
+        if (index >= p.blockBindings.size() || binding >= MaxUniformBindings)
+        {
+            gl.fail(GL_INVALID_VALUE, "glUniformBlockBinding", "bad block index or binding");
+            return;
+        }
+        p.blockBindings[index] = binding;
+        gl.count(&NullGLStats::stateChanges);
+    }
+    static void GLAD_API_PTR uniform1i(GLint location, GLint v)
+    {
+        if (auto u = get().uniformAt(location, "glUniform1i"))
+            u->i.assign(1, v);
+    }
+    static void GLAD_API_PTR uniform1fv(GLint location, GLsizei n, const GLfloat* v) { get().setUniform(location, n, v, "glUniform1fv"); }
+    static void GLAD_API_PTR uniform2fv(GLint location, GLsizei n, const GLfloat* v) { get().setUniform(location, n * 2, v, "glUniform2fv"); }
+    static void GLAD_API_PTR uniform3fv(GLint location, GLsizei n, const GLfloat* v) { get().setUniform(location, n * 3, v, "glUniform3fv"); }
+    static void GLAD_API_PTR uniform4fv(GLint location, GLsizei n, const GLfloat* v) { get().setUniform(location, n * 4, v, "glUniform4fv"); }
+    static void GLAD_API_PTR uniformMatrix4fv(GLint location, GLsizei n, GLboolean /*transpose*/, const GLfloat* v) { get().setUniform(location, n * 16, v, "glUniformMatrix4fv"); }
+
+    // draws
+    static void GLAD_API_PTR drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+    {
+        get().draw(mode, count, type, indices, 1, 0, "glDrawElements");
+    }
+    static void GLAD_API_PTR drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances)
+    {
+        get().draw(mode, count, type, indices, instances, 0, "glDrawElementsInstanced");
+    }
+    static void GLAD_API_PTR drawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex)
+    {
+        get().draw(mode, count, type, indices, 1, baseVertex, "glDrawElementsBaseVertex");
+    }
+    static void GLAD_API_PTR drawElementsInstancedBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instances, GLint baseVertex)
+    {
+        get().draw(mode, count, type, indices, instances, baseVertex, "glDrawElementsInstancedBaseVertex");
+    }
+    // counted as the separate draws it stands for
+    static void GLAD_API_PTR multiDrawElementsBaseVertex(GLenum mode, const GLsizei* count, GLenum type, const void* const* indices, GLsizei drawCount, const GLint* baseVertex)
+    {
+        for (GLsizei i = 0; i < drawCount; i++)
+        {
+            get().draw(mode, count[i], type, indices[i], 1, baseVertex ? baseVertex[i] : 0, "glMultiDrawElementsBaseVertex");
+        }
+    }
+
+    // queries; results are always available and always zero
+    static void GLAD_API_PTR genQueries(GLsizei n, GLuint* names) { get().create(get().queries, n, names); }
+    static void GLAD_API_PTR deleteQueries(GLsizei n, const GLuint* names) { get().destroy(get().queries, n, names, "glDeleteQueries"); }
+    static void GLAD_API_PTR beginQuery(GLenum target, GLuint query)
+    {
+        auto& gl = get();
+        if (gl.valid(gl.queries, query, "glBeginQuery", false))
+            gl.queries[query].target = target;
+    }
+    static void GLAD_API_PTR endQuery(GLenum /*target*/) {}
+    static void GLAD_API_PTR getQueryObjectiv(GLuint /*query*/, GLenum pname, GLint* params)
+    {
+        *params = (pname == GL_QUERY_RESULT_AVAILABLE) ? GL_TRUE : 0;
+    }
+    static void GLAD_API_PTR getQueryObjectui64v(GLuint /*query*/, GLenum pname, GLuint64* params)
+    {
+        *params = (pname == GL_QUERY_RESULT_AVAILABLE) ? GL_TRUE : 0;
+    }
+    // conditional draws always go ahead, the same as a driver without the result yet
+    static void GLAD_API_PTR beginConditionalRender(GLuint query, GLenum /*mode*/)
+    {
+        auto& gl = get();
+        gl.valid(gl.queries, query, "glBeginConditionalRender", false);
+    }
+    static void GLAD_API_PTR endConditionalRender() {}
+};
+
+GLADapiproc NullGL::getProcAddress(const char* name)
+{
+    static const map<string, GLADapiproc> procs = {
+        { "glGetString",                (GLADapiproc)(PFNGLGETSTRINGPROC)getString },
+        { "glGetStringi",               (GLADapiproc)(PFNGLGETSTRINGIPROC)getStringi },
+        { "glGetError",                 (GLADapiproc)(PFNGLGETERRORPROC)getError },
+        { "glGetIntegerv",              (GLADapiproc)(PFNGLGETINTEGERVPROC)getIntegerv },
+        { "glEnable",                   (GLADapiproc)(PFNGLENABLEPROC)enable },
+        { "glDisable",                  (GLADapiproc)(PFNGLDISABLEPROC)disable },
+        { "glDepthFunc",                (GLADapiproc)(PFNGLDEPTHFUNCPROC)depthFuncStub },
+        { "glBlendFunc",                (GLADapiproc)(PFNGLBLENDFUNCPROC)blendFunc },
+        { "glViewport",                 (GLADapiproc)(PFNGLVIEWPORTPROC)viewportStub },
+        { "glClearColor",               (GLADapiproc)(PFNGLCLEARCOLORPROC)clearColor },
+        { "glClear",                    (GLADapiproc)(PFNGLCLEARPROC)clear },
+        { "glColorMask",                (GLADapiproc)(PFNGLCOLORMASKPROC)colorMask },
+        { "glDepthMask",                (GLADapiproc)(PFNGLDEPTHMASKPROC)depthMask },
+        { "glGenBuffers",               (GLADapiproc)(PFNGLGENBUFFERSPROC)genBuffers },
+        { "glDeleteBuffers",            (GLADapiproc)(PFNGLDELETEBUFFERSPROC)deleteBuffers },
+        { "glBindBuffer",               (GLADapiproc)(PFNGLBINDBUFFERPROC)bindBuffer },
+        { "glBufferData",               (GLADapiproc)(PFNGLBUFFERDATAPROC)bufferData },
+        { "glBufferSubData",            (GLADapiproc)(PFNGLBUFFERSUBDATAPROC)bufferSubData },
+        { "glBindBufferBase",           (GLADapiproc)(PFNGLBINDBUFFERBASEPROC)bindBufferBase },
+        { "glBindBufferRange",          (GLADapiproc)(PFNGLBINDBUFFERRANGEPROC)bindBufferRange },
+        { "glMapBufferRange",           (GLADapiproc)(PFNGLMAPBUFFERRANGEPROC)mapBufferRange },
+        { "glUnmapBuffer",              (GLADapiproc)(PFNGLUNMAPBUFFERPROC)unmapBuffer },
+        { "glGenVertexArrays",          (GLADapiproc)(PFNGLGENVERTEXARRAYSPROC)genVertexArrays },
+        { "glDeleteVertexArrays",       (GLADapiproc)(PFNGLDELETEVERTEXARRAYSPROC)deleteVertexArrays },
+        { "glBindVertexArray",          (GLADapiproc)(PFNGLBINDVERTEXARRAYPROC)bindVertexArray },
+        { "glVertexAttribPointer",      (GLADapiproc)(PFNGLVERTEXATTRIBPOINTERPROC)vertexAttribPointer },
+        { "glVertexAttribIPointer",     (GLADapiproc)(PFNGLVERTEXATTRIBIPOINTERPROC)vertexAttribIPointer },
+        { "glEnableVertexAttribArray",  (GLADapiproc)(PFNGLENABLEVERTEXATTRIBARRAYPROC)enableVertexAttribArray },
+        { "glGenTextures",              (GLADapiproc)(PFNGLGENTEXTURESPROC)genTextures },
+        { "glDeleteTextures",           (GLADapiproc)(PFNGLDELETETEXTURESPROC)deleteTextures },
+        { "glActiveTexture",            (GLADapiproc)(PFNGLACTIVETEXTUREPROC)activeTextureStub },
+        { "glBindTexture",              (GLADapiproc)(PFNGLBINDTEXTUREPROC)bindTexture },
+        { "glTexImage2D",               (GLADapiproc)(PFNGLTEXIMAGE2DPROC)texImage2D },
+        { "glTexParameteri",            (GLADapiproc)(PFNGLTEXPARAMETERIPROC)texParameteri },
+        { "glGenerateMipmap",           (GLADapiproc)(PFNGLGENERATEMIPMAPPROC)generateMipmap },
+        { "glGetTexLevelParameteriv",   (GLADapiproc)(PFNGLGETTEXLEVELPARAMETERIVPROC)getTexLevelParameteriv },
+        { "glGenFramebuffers",          (GLADapiproc)(PFNGLGENFRAMEBUFFERSPROC)genFramebuffers },
+        { "glDeleteFramebuffers",       (GLADapiproc)(PFNGLDELETEFRAMEBUFFERSPROC)deleteFramebuffers },
+        { "glBindFramebuffer",          (GLADapiproc)(PFNGLBINDFRAMEBUFFERPROC)bindFramebuffer },
+        { "glFramebufferTexture",       (GLADapiproc)(PFNGLFRAMEBUFFERTEXTUREPROC)framebufferTexture },
+        { "glDrawBuffers",              (GLADapiproc)(PFNGLDRAWBUFFERSPROC)drawBuffers },
+        { "glReadBuffer",               (GLADapiproc)(PFNGLREADBUFFERPROC)readBuffer },
+        { "glReadPixels",               (GLADapiproc)(PFNGLREADPIXELSPROC)readPixels },
+        { "glCreateShader",             (GLADapiproc)(PFNGLCREATESHADERPROC)createShader },
+        { "glDeleteShader",             (GLADapiproc)(PFNGLDELETESHADERPROC)deleteShader },
+        { "glShaderSource",             (GLADapiproc)(PFNGLSHADERSOURCEPROC)shaderSource },
+        { "glCompileShader",            (GLADapiproc)(PFNGLCOMPILESHADERPROC)compileShader },
+        { "glGetShaderiv",              (GLADapiproc)(PFNGLGETSHADERIVPROC)getShaderiv },
+        { "glGetShaderInfoLog",         (GLADapiproc)(PFNGLGETSHADERINFOLOGPROC)getShaderInfoLog },
+        { "glCreateProgram",            (GLADapiproc)(PFNGLCREATEPROGRAMPROC)createProgram },
+        { "glDeleteProgram",            (GLADapiproc)(PFNGLDELETEPROGRAMPROC)deleteProgram },
+        { "glAttachShader",             (GLADapiproc)(PFNGLATTACHSHADERPROC)attachShader },
+        { "glDetachShader",             (GLADapiproc)(PFNGLDETACHSHADERPROC)detachShader },
+        { "glBindAttribLocation",       (GLADapiproc)(PFNGLBINDATTRIBLOCATIONPROC)bindAttribLocation },
+        { "glLinkProgram",              (GLADapiproc)(PFNGLLINKPROGRAMPROC)linkProgram },
+        { "glUseProgram",               (GLADapiproc)(PFNGLUSEPROGRAMPROC)useProgram },
+        { "glGetUniformLocation",       (GLADapiproc)(PFNGLGETUNIFORMLOCATIONPROC)getUniformLocation },
+        { "glGetUniformBlockIndex",     (GLADapiproc)(PFNGLGETUNIFORMBLOCKINDEXPROC)getUniformBlockIndex },
+        { "glUniformBlockBinding",      (GLADapiproc)(PFNGLUNIFORMBLOCKBINDINGPROC)uniformBlockBinding },
+        { "glUniform1i",                (GLADapiproc)(PFNGLUNIFORM1IPROC)uniform1i },
+        { "glUniform1fv",               (GLADapiproc)(PFNGLUNIFORM1FVPROC)uniform1fv },
+        { "glUniform2fv",               (GLADapiproc)(PFNGLUNIFORM2FVPROC)uniform2fv },
+        { "glUniform3fv",               (GLADapiproc)(PFNGLUNIFORM3FVPROC)uniform3fv },
+        { "glUniform4fv",               (GLADapiproc)(PFNGLUNIFORM4FVPROC)uniform4fv },
+        { "glUniformMatrix4fv",         (GLADapiproc)(PFNGLUNIFORMMATRIX4FVPROC)uniformMatrix4fv },
+        { "glDrawElements",             (GLADapiproc)(PFNGLDRAWELEMENTSPROC)drawElements },
+        { "glDrawElementsInstanced",    (GLADapiproc)(PFNGLDRAWELEMENTSINSTANCEDPROC)drawElementsInstanced },
+        { "glDrawElementsBaseVertex",   (GLADapiproc)(PFNGLDRAWELEMENTSBASEVERTEXPROC)drawElementsBaseVertex },
+        { "glDrawElementsInstancedBaseVertex", (GLADapiproc)(PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC)drawElementsInstancedBaseVertex },
+        { "glMultiDrawElementsBaseVertex", (GLADapiproc)(PFNGLMULTIDRAWELEMENTSBASEVERTEXPROC)multiDrawElementsBaseVertex },
+        { "glGenQueries",               (GLADapiproc)(PFNGLGENQUERIESPROC)genQueries },
+        { "glDeleteQueries",            (GLADapiproc)(PFNGLDELETEQUERIESPROC)deleteQueries },
+        { "glBeginQuery",               (GLADapiproc)(PFNGLBEGINQUERYPROC)beginQuery },
+        { "glEndQuery",                 (GLADapiproc)(PFNGLENDQUERYPROC)endQuery },
+        { "glGetQueryObjectiv",         (GLADapiproc)(PFNGLGETQUERYOBJECTIVPROC)getQueryObjectiv },
+        { "glGetQueryObjectui64v",      (GLADapiproc)(PFNGLGETQUERYOBJECTUI64VPROC)getQueryObjectui64v },
+        { "glBeginConditionalRender",   (GLADapiproc)(PFNGLBEGINCONDITIONALRENDERPROC)beginConditionalRender },
+        { "glEndConditionalRender",     (GLADapiproc)(PFNGLENDCONDITIONALRENDERPROC)endConditionalRender },
+    };
+
+    get().active = true;
+    auto iter = procs.find(name);
+    return (iter == procs.end()) ? nullptr : iter->second;
+}
+
+#endif
@@ -0,0 +1,530 @@
+#ifndef _CUBE_OBJLOADER_H
+#define _CUBE_OBJLOADER_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../jobs.h"
+
+// wavefront obj loading
+//
+// the file is mapped and cut into chunks at line ends, and every chunk is
+// parsed on its own (on the job system, when given one) with a hand written
+// number parser. faces keep their indices until every chunk's counts are
+// known, since negative indices count back from the vertices read so far.
+// polygons are fanned into triangles, and every distinct position, texcoord
+// and normal triple becomes one vertex through a hash table. faces are
+// grouped by material (usemtl), and groups without normals get smooth ones
+// from their faces
+
+// the triangles of one material, over vertices of their own
+struct ObjGroup
+{
+    string material;
+    vector<float3> positions;
+    vector<float3> normals;
+    vector<float2> texcoords;
+    vector<uint> indices;
+};
+
+class ObjLoader
+{
+    static constexpr uint None = ~0u;
+    static constexpr size_t ChunkSize = 4 << 20;
+
+    // face corners are three indices (position, texcoord, normal). the
+    // parser stores them 0 based, relative ones (counting back from what the
+    // chunk has read) as a 31 bit offset from the chunk's start with the top
+    // bit set, and missing ones as Missing; resolving makes them absolute
+    static constexpr uint Relative = 0x80000000u;
+    static constexpr uint Missing = 0x7fffffffu;
+
+    struct Chunk
+    {
+        const char* begin;
+        const char* end;
+        vector<float3> positions;
+        vector<float3> normals;
+        vector<float2> texcoords;
+        vector<uint> corners;                   // 9 per triangle
+        vector<pair<uint, string>> materials;   // first triangle, usemtl name
+        string error;
+    };
+
+    // triangles of one chunk in one material
+    struct Run
+    {
+        const uint* corners;
+        uint triangles;
+    };
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // returns p where parsing stopped, or s if there was no number
+    static const char* parseFloat(const char* s, const char* end, float& out)
+    {
+        static const double pow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        const char* p = s;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+
+        // up to 18 significant digits, the rest only scale
+        uint64_t mantissa = 0;
+        int exponent = 0, digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+        {
+            if (mantissa < 100000000000000000ull)
+                mantissa = mantissa * 10 + (*p - '0');
+            else
+                exponent++;
+        }
+        if (p < end && *p == '.')
+        {
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+            {
+                if (mantissa < 100000000000000000ull)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    exponent--;
+                }
+            }
+        }
+        if (!digits)
+            return s;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* e = p + 1;
+            int sign = 1, value = 0;
+            if (e < end && (*e == '-' || *e == '+'))
+            {
+                sign = *e == '-' ? -1 : 1;
+                e++;
+            }
+            if (e < end && *e >= '0' && *e <= '9')
+            {
+                for (; e < end && *e >= '0' && *e <= '9'; e++)
+                    value = value < 10000 ? value * 10 + (*e - '0') : value;
+                exponent += sign * value;
+                p = e;
+            }
+        }
+
+        double v = (double)mantissa;
+        if (exponent < 0)
+            v = exponent >= -22 ? v / pow10[-exponent] : v * pow(10.0, exponent);
+        else
+            v = exponent <= 22 ? v * pow10[exponent] : v * pow(10.0, exponent);
+        out = (float)(negative ? -v : v);
+        return p;
+    }
+
+    static const char* parseInt(const char* s, const char* end, int& out)
+    {
+        const char* p = s;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9')
+            return s;
+        int64_t v = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            v = v < INT32_MAX ? v * 10 + (*p - '0') : v;
+        out = (int)(negative ? -(v < INT32_MAX ? v : INT32_MAX) : (v < INT32_MAX ? v : INT32_MAX));
+        return p;
+    }
+
+    // parses up to n floats, returning how many there were
+    static int parseFloats(const char* p, const char* end, float* out, int n)
+    {
+        int i = 0;
+        for (; i < n; i++)
+        {
+            p = skipSpace(p, end);
+            const char* next = parseFloat(p, end, out[i]);
+            if (next == p)
+                break;
+            p = next;
+        }
+        return i;
+    }
+
+    static bool startsWith(const char* p, const char* end, const char* word)
+    {
+        size_t n = strlen(word);
+        return (size_t)(end - p) > n && !memcmp(p, word, n) && isSpace(p[n]);
+    }
+
+    // one index of a face corner, against count items read so far in the chunk
+    static bool encodeIndex(uint& out, int value, size_t count)
+    {
+        if (value > 0)
+            out = value - 1;
+        else if (value < 0)
+            out = Relative | (((uint)((int)count + value)) & ~Relative);
+        return value != 0;
+    }
+
+    static void parse(Chunk& c)
+    {
+        vector<uint> polygon;
+        const char* p = c.begin;
+        while (p < c.end)
+        {
+            const char* eol = (const char*)memchr(p, '\n', c.end - p);
+            if (!eol)
+                eol = c.end;
+            const char* q = skipSpace(p, eol);
+            p = eol + 1;
+            if (eol - q < 2)
+                continue;
+
+            if (q[0] == 'v' && isSpace(q[1]))
+            {
+                float f[3];
+                if (parseFloats(q + 2, eol, f, 3) < 3)
+                {
+                    c.error = "bad vertex position";
+                    return;
+                }
+                c.positions.push_back(float3(f[0], f[1], f[2]));
+            }
+            else if (q[0] == 'v' && q[1] == 't' && startsWith(q, eol, "vt"))
+            {
+                float f[2] = { 0, 0 };
+                if (parseFloats(q + 3, eol, f, 2) < 1)
+                {
+                    c.error = "bad texcoord";
+                    return;
+                }
+                c.texcoords.push_back(float2(f[0], f[1]));
+            }
+            else if (q[0] == 'v' && q[1] == 'n' && startsWith(q, eol, "vn"))
+            {
+                float f[3];
+                if (parseFloats(q + 3, eol, f, 3) < 3)
+                {
+                    c.error = "bad normal";
+                    return;
+                }
+                c.normals.push_back(float3(f[0], f[1], f[2]));
+            }
+            else if (q[0] == 'f' && isSpace(q[1]))
+            {
+                polygon.clear();
+                const char* r = q + 2;
+                while (true)
+                {
+                    r = skipSpace(r, eol);
+                    if (r == eol)
+                        break;
+
+                    // v, v/t, v//n or v/t/n
+                    uint corner[3] = { Missing, Missing, Missing };
+                    int value = 0;
+                    const char* next = parseInt(r, eol, value);
+                    bool ok = next != r && encodeIndex(corner[0], value, c.positions.size());
+                    r = next;
+                    if (ok && r < eol && *r == '/')
+                    {
+                        r++;
+                        next = parseInt(r, eol, value);
+                        if (next != r)
+                            ok = encodeIndex(corner[1], value, c.texcoords.size());
+                        r = next;
+                        if (ok && r < eol && *r == '/')
+                        {
+                            r++;
+                            next = parseInt(r, eol, value);
+                            ok = next != r && encodeIndex(corner[2], value, c.normals.size());
+                            r = next;
+                        }
+                    }
+                    if (!ok || (r < eol && !isSpace(*r)))
+                    {
+                        c.error = "bad face";
+                        return;
+                    }
+                    polygon.insert(polygon.end(), corner, corner + 3);
+                }
+
+                // fan out from the first corner
+                for (size_t i = 6; i < polygon.size(); i += 3)
+                {
+                    c.corners.insert(c.corners.end(), &polygon[0], &polygon[3]);
+                    c.corners.insert(c.corners.end(), &polygon[i - 3], &polygon[i + 3]);
+                }
+            }
+            else if (startsWith(q, eol, "usemtl"))
+            {
+                const char* name = skipSpace(q + 6, eol);
+                const char* last = eol;
+                while (last > name && isSpace(last[-1]))
+                    last--;
+                c.materials.push_back({ (uint)(c.corners.size() / 9), string(name, last) });
+            }
+            // anything else (comments, groups, smoothing, mtllib...) is skipped
+        }
+    }
+
+    // the position index stays in the low bits, so a mesh that walks its
+    // vertices in order walks the table in order too
+    static uint hash(uint v, uint t, uint n)
+    {
+        uint64_t h = (t + 1) * 0x9E3779B97F4A7C15ull ^ (n + 1) * 0xC2B2AE3D27D4EB4Full;
+        return v + (uint)(h >> 32);
+    }
+
+    // dedups the (resolved) corners of runs into group
+    static void buildGroup(const vector<Run>& runs,
+                           const vector<float3>& positions, const vector<float2>& texcoords, const vector<float3>& normals,
+                           ObjGroup& group)
+    {
+        size_t triangles = 0;
+        for (auto& r : runs)
+            triangles += r.triangles;
+
+        // every position is usually one vertex, so start there and grow at half full
+        uint capacity = 64;
+        while (capacity < positions.size() * 2 && capacity < triangles * 6)
+            capacity *= 2;
+        uint mask = capacity - 1;
+        vector<uint> table(capacity, None);
+        vector<uint> keys;      // 3 per vertex
+
+        group.indices.reserve(triangles * 3);
+        for (auto& r : runs)
+        {
+            for (size_t i = 0; i < (size_t)r.triangles * 3; i++)
+            {
+                const uint* key = &r.corners[i * 3];
+                uint slot = hash(key[0], key[1], key[2]) & mask;
+                uint vertex;
+                while ((vertex = table[slot]) != None)
+                {
+                    const uint* other = &keys[vertex * 3];
+                    if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2])
+                        break;
+                    slot = (slot + 1) & mask;
+                }
+                if (vertex == None)
+                {
+                    vertex = keys.size() / 3;
+                    table[slot] = vertex;
+                    keys.insert(keys.end(), key, key + 3);
+                    if ((vertex + 1) * 2 > capacity)
+                    {
+                        capacity *= 2;
+                        mask = capacity - 1;
+                        table.assign(capacity, None);
+                        for (uint k = 0; k <= vertex; k++)
+                        {
+                            uint s = hash(keys[k * 3], keys[k * 3 + 1], keys[k * 3 + 2]) & mask;
+                            while (table[s] != None)
+                                s = (s + 1) & mask;
+                            table[s] = k;
+                        }
+                    }
+                }
+                group.indices.push_back(vertex);
+            }
+        }
+
+        uint count = keys.size() / 3;
+        group.positions.resize(count);
+        group.texcoords.resize(count);
+        group.normals.resize(count);
+        bool smooth = false;
+        for (uint i = 0; i < count; i++)
+        {
+            group.positions[i] = positions[keys[i * 3]];
+            group.texcoords[i] = keys[i * 3 + 1] != None ? texcoords[keys[i * 3 + 1]] : float2(0, 0);
+            group.normals[i] = keys[i * 3 + 2] != None ? normals[keys[i * 3 + 2]] : float3(0, 0, 0);
+            smooth = smooth || keys[i * 3 + 2] == None;
+        }
+        if (!smooth)
+            return;
+
+        // area weighted face normals for the vertices that have none
+        vector<float3> sum(count, float3(0, 0, 0));
+        for (size_t i = 0; i < group.indices.size(); i += 3)
+        {
+            uint a = group.indices[i], b = group.indices[i + 1], c = group.indices[i + 2];
+            float3 n = cross(group.positions[b] - group.positions[a], group.positions[c] - group.positions[a]);
+            sum[a] += n;
+            sum[b] += n;
+            sum[c] += n;
+        }
+        for (uint i = 0; i < count; i++)
+        {
+            if (keys[i * 3 + 2] == None)
+                group.normals[i] = len2(sum[i]) > 0 ? normalize(sum[i]) : float3(0, 1, 0);
+        }
+    }
+
+public:
+    // reads fname into one group per material, in order of first use;
+    // throws runtime_error if it can't be read
+    static void load(const string& fname, vector<ObjGroup>& groups, JobSystem* jobs = nullptr)
+    {
+        groups.clear();
+        MappedFile file(fname);
+        if (!file.isOpen())
+            throw runtime_error("can't open " + fname);
+
+        vector<Chunk> chunks;
+        const char* p = file.data();
+        const char* end = p + file.size();
+        while (p < end)
+        {
+            const char* e = (size_t)(end - p) > ChunkSize ? p + ChunkSize : end;
+            if (e < end)
+            {
+                const char* eol = (const char*)memchr(e, '\n', end - e);
+                e = eol ? eol + 1 : end;
+            }
+            chunks.push_back(Chunk());
+            chunks.back().begin = p;
+            chunks.back().end = e;
+            p = e;
+        }
+
+        auto parseChunks = [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                parse(chunks[i]);
+        };
+        if (jobs)
+            jobs->parallelFor(0, chunks.size(), 1, parseChunks);
+        else
+            parseChunks(0, chunks.size());
+
+        // where every chunk's items start in the whole file
+        vector<uint> positionBase(chunks.size()), texcoordBase(chunks.size()), normalBase(chunks.size());
+        uint positionCount = 0, texcoordCount = 0, normalCount = 0;
+        for (uint i = 0; i < chunks.size(); i++)
+        {
+            if (chunks[i].error.size())
+                throw runtime_error(chunks[i].error + " in " + fname);
+            positionBase[i] = positionCount;
+            texcoordBase[i] = texcoordCount;
+            normalBase[i] = normalCount;
+            positionCount += chunks[i].positions.size();
+            texcoordCount += chunks[i].texcoords.size();
+            normalCount += chunks[i].normals.size();
+        }
+
+        vector<float3> positions(positionCount), normals(normalCount);
+        vector<float2> texcoords(texcoordCount);
+        auto resolve = [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+            {
+                Chunk& c = chunks[i];
+                copy(c.positions.begin(), c.positions.end(), positions.begin() + positionBase[i]);
+                copy(c.texcoords.begin(), c.texcoords.end(), texcoords.begin() + texcoordBase[i]);
+                copy(c.normals.begin(), c.normals.end(), normals.begin() + normalBase[i]);
+                vector<float3>().swap(c.positions);
+                vector<float2>().swap(c.texcoords);
+                vector<float3>().swap(c.normals);
+
+                const int64_t bases[3] = { positionBase[i], texcoordBase[i], normalBase[i] };
+                const int64_t counts[3] = { positionCount, texcoordCount, normalCount };
+                for (size_t j = 0; j < c.corners.size(); j++)
+                {
+                    uint& index = c.corners[j];
+                    int k = j % 3;
+                    if (index == Missing)
+                    {
+                        index = None;
+                        continue;
+                    }
+                    int64_t absolute = index;
+                    if (index & Relative)
+                        absolute = bases[k] + ((int)(index << 1) >> 1);
+                    if (absolute < 0 || absolute >= counts[k])
+                    {
+                        c.error = "face index out of range";
+                        index = 0;
+                        continue;
+                    }
+                    index = (uint)absolute;
+                }
+            }
+        };
+        if (jobs)
+            jobs->parallelFor(0, chunks.size(), 1, resolve);
+        else
+            resolve(0, chunks.size());
+
+        // runs of triangles in every material; faces before any usemtl get ""
+        map<string, uint> materialIds;
+        vector<vector<Run>> materialRuns;
+        uint current = None;
+        auto use = [&](const string& name) {
+            auto found = materialIds.find(name);
+            if (found == materialIds.end())
+            {
+                found = materialIds.insert({ name, (uint)materialRuns.size() }).first;
+                materialRuns.push_back({});
+                groups.push_back(ObjGroup());
+                groups.back().material = name;
+            }
+            current = found->second;
+        };
+        size_t triangles = 0;
+        for (auto& c : chunks)
+        {
+            if (c.error.size())
+                throw runtime_error(c.error + " in " + fname);
+
+            uint count = c.corners.size() / 9;
+            triangles += count;
+            uint first = 0;
+            for (size_t m = 0; m <= c.materials.size(); m++)
+            {
+                uint last = m < c.materials.size() ? c.materials[m].first : count;
+                if (last > first)
+                {
+                    if (current == None)
+                        use("");
+                    materialRuns[current].push_back({ &c.corners[first * 9], last - first });
+                }
+                if (m < c.materials.size())
+                    use(c.materials[m].second);
+                first = last;
+            }
+        }
+        if (!triangles)
+            throw runtime_error("no faces in " + fname);
+
+        auto build = [&](int begin, int end) {
+            for (int m = begin; m < end; m++)
+                buildGroup(materialRuns[m], positions, texcoords, normals, groups[m]);
+        };
+        if (jobs)
+            jobs->parallelFor(0, groups.size(), 1, build);
+        else
+            build(0, groups.size());
+
+        // materials with no faces
+        groups.erase(remove_if(groups.begin(), groups.end(), [](const ObjGroup& g) { return g.indices.empty(); }), groups.end());
+    }
+};
+
+#endif
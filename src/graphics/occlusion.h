@@ -0,0 +1,642 @@
+#ifndef _CUBE_OCCLUSION_H
+#define _CUBE_OCCLUSION_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../simd.h"
+#include "../collision.h"
+#include "camera.h"
+#include "surface.h"
+#include "shader.h"
+#include "mesh.h"
+
+// occlusion culling against a hierarchical depth buffer
+//
+// occluders are solid boxes (walls, buildings) drawn into a small depth
+// buffer; every level of the pyramid above it keeps the farthest depth of the
+// four texels below. a box is hidden when its nearest point is behind the
+// farthest occluder depth over the whole screen rectangle it covers, which
+// only takes a few texels at the level where the rectangle is about 2x2.
+// depths are window depths in [0, 1]; 1 is the far plane and nothing drawn
+
+// screen rectangle in pyramid texels and nearest window depth of a box
+struct ScreenRect
+{
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    float zmin = 0;
+};
+
+// false when the box reaches behind the near plane; such boxes can't be
+// bounded on screen and are always treated as visible
+bool project(const Box& b, const matrix& viewProj, float width, float height, ScreenRect& out)
+{
+    out.x0 = out.y0 = INFINITY;
+    out.x1 = out.y1 = -INFINITY;
+    out.zmin = INFINITY;
+    for (int c = 0; c < 8; c++)
+    {
+        float3 p = b.centre + float3(c & 1 ? b.extent.x : -b.extent.x, c & 2 ? b.extent.y : -b.extent.y, c & 4 ? b.extent.z : -b.extent.z);
+        const float* m = viewProj.m;
+        float w = p.x * m[3] + p.y * m[7] + p.z * m[11] + m[15];
+        if (w <= 1e-5f)
+            return false;
+        float x = (p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12]) / w;
+        float y = (p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13]) / w;
+        float z = (p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]) / w;
+        out.x0 = fminf(out.x0, x);
+        out.x1 = fmaxf(out.x1, x);
+        out.y0 = fminf(out.y0, y);
+        out.y1 = fmaxf(out.y1, y);
+        out.zmin = fminf(out.zmin, z);
+    }
+    out.x0 = (out.x0 * 0.5f + 0.5f) * width;
+    out.x1 = (out.x1 * 0.5f + 0.5f) * width;
+    out.y0 = (out.y0 * 0.5f + 0.5f) * height;
+    out.y1 = (out.y1 * 0.5f + 0.5f) * height;
+    out.zmin = out.zmin * 0.5f + 0.5f;
+    return true;
+}
+
+// max depth mip chain; level sizes round up, so the last texel of an odd
+// sized level only covers one texel below
+class DepthPyramid
+{
+    struct Level
+    {
+        uint width = 0, height = 0;
+        vector<float> depth;
+    };
+    vector<Level> levels;
+
+public:
+    uint width() const { return levels.size() ? levels[0].width : 0; }
+    uint height() const { return levels.size() ? levels[0].height : 0; }
+    uint levelCount() const { return levels.size(); }
+    bool empty() const { return levels.empty(); }
+    void clear() { levels.clear(); }
+
+    float at(uint level, uint x, uint y) const { return levels[level].depth[y * levels[level].width + x]; }
+
+    // depth rows are stride floats apart, bottom row first
+    void build(const float* depth, uint w, uint h, uint stride)
+    {
+        uint count = 1;
+        for (uint s = w > h ? w : h; s > 1; s = (s + 1) / 2)
+            count++;
+        levels.resize(count);
+
+        levels[0].width = w;
+        levels[0].height = h;
+        levels[0].depth.resize(w * h);
+        for (uint y = 0; y < h; y++)
+        {
+            memcpy(&levels[0].depth[y * w], depth + y * stride, w * sizeof(float));
+        }
+
+        for (uint l = 1; l < count; l++)
+        {
+            const Level& src = levels[l - 1];
+            Level& dst = levels[l];
+            dst.width = (src.width + 1) / 2;
+            dst.height = (src.height + 1) / 2;
+            dst.depth.resize(dst.width * dst.height);
+            for (uint y = 0; y < dst.height; y++)
+            {
+                const float* r0 = &src.depth[2 * y * src.width];
+                const float* r1 = (2 * y + 1 < src.height) ? r0 + src.width : r0;
+                for (uint x = 0; x < dst.width; x++)
+                {
+                    uint x0 = 2 * x, x1 = (2 * x + 1 < src.width) ? 2 * x + 1 : 2 * x;
+                    dst.depth[y * dst.width + x] = fmaxf(fmaxf(r0[x0], r0[x1]), fmaxf(r1[x0], r1[x1]));
+                }
+            }
+        }
+    }
+
+    // true when something in the rectangle may be at or behind zmin
+    bool visible(const ScreenRect& r) const
+    {
+        if (levels.empty())
+            return true;
+        float w = (float)width(), h = (float)height();
+        // off screen is the frustum's job
+        if (r.x1 < 0.0f || r.y1 < 0.0f || r.x0 >= w || r.y0 >= h)
+            return true;
+
+        int x0 = (int)fmaxf(r.x0, 0.0f), x1 = (int)fminf(r.x1, w - 1.0f);
+        int y0 = (int)fmaxf(r.y0, 0.0f), y1 = (int)fminf(r.y1, h - 1.0f);
+
+        // the coarsest level where the rectangle still spans about 2x2 texels
+        uint level = 0;
+        int size = (x1 - x0 > y1 - y0) ? x1 - x0 : y1 - y0;
+        while ((1 << level) < size && level + 1 < levels.size())
+            level++;
+
+        for (int y = y0 >> level; y <= y1 >> level; y++)
+        {
+            for (int x = x0 >> level; x <= x1 >> level; x++)
+            {
+                if (at(level, x, y) >= r.zmin)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // fills outVisible with the index of every box the pyramid doesn't hide,
+    // in order. corners are projected SimdFloat::Width boxes at a time
+    void cull(const BoxSoA& boxes, const matrix& viewProj, vector<uint>& outVisible) const
+    {
+        outVisible.clear();
+        if (levels.empty())
+        {
+            for (uint i = 0; i < boxes.count; i++)
+                outVisible.push_back(i);
+            return;
+        }
+
+        const float* m = viewProj.m;
+        float w = (float)width(), h = (float)height();
+        for (uint i = 0; i < boxes.count; i += SimdFloat::Width)
+        {
+            SimdFloat cx = boxes.load(0, i), cy = boxes.load(1, i), cz = boxes.load(2, i);
+            SimdFloat ex = boxes.load(3, i), ey = boxes.load(4, i), ez = boxes.load(5, i);
+            SimdFloat x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+            SimdFloat zmin = INFINITY, wmin = INFINITY;
+            for (int c = 0; c < 8; c++)
+            {
+                SimdFloat px = c & 1 ? cx + ex : cx - ex;
+                SimdFloat py = c & 2 ? cy + ey : cy - ey;
+                SimdFloat pz = c & 4 ? cz + ez : cz - ez;
+                SimdFloat cw = px * m[3] + py * m[7] + pz * m[11] + m[15];
+                SimdFloat inv = SimdFloat(1.0f) / cw;
+                SimdFloat sx = (px * m[0] + py * m[4] + pz * m[8] + m[12]) * inv;
+                SimdFloat sy = (px * m[1] + py * m[5] + pz * m[9] + m[13]) * inv;
+                SimdFloat sz = (px * m[2] + py * m[6] + pz * m[10] + m[14]) * inv;
+                x0 = vmin(x0, sx);
+                x1 = vmax(x1, sx);
+                y0 = vmin(y0, sy);
+                y1 = vmax(y1, sy);
+                zmin = vmin(zmin, sz);
+                wmin = vmin(wmin, cw);
+            }
+            SimdFloat half = 0.5f;
+            float rect[5][SimdFloat::Width], nearest[SimdFloat::Width];
+            ((x0 * half + half) * w).store(rect[0]);
+            ((y0 * half + half) * h).store(rect[1]);
+            ((x1 * half + half) * w).store(rect[2]);
+            ((y1 * half + half) * h).store(rect[3]);
+            (zmin * half + half).store(rect[4]);
+            wmin.store(nearest);
+
+            uint n = (boxes.count - i < (uint)SimdFloat::Width) ? boxes.count - i : SimdFloat::Width;
+            for (uint k = 0; k < n; k++)
+            {
+                ScreenRect r;
+                r.x0 = rect[0][k];
+                r.y0 = rect[1][k];
+                r.x1 = rect[2][k];
+                r.y1 = rect[3][k];
+                r.zmin = rect[4][k];
+                if (nearest[k] <= 1e-5f || visible(r))
+                    outVisible.push_back(i + k);
+            }
+        }
+    }
+};
+
+// software depth buffer for occluder boxes, small enough to fill on the cpu
+// every frame (and the only option headless)
+//
+// a box is drawn as its outline on screen. pixels are only written when they
+// are entirely inside it, with the farthest depth its front faces reach over
+// the pixel, so the buffer never claims more than the boxes really hide.
+// rows are filled SimdFloat::Width pixels at a time
+class SoftwareDepthBuffer
+{
+    uint width, height, stride;
+    vector<float> depth;
+    matrix viewProj;
+    float3 eye;
+
+public:
+    DepthPyramid pyramid;
+
+    SoftwareDepthBuffer(uint w = 256, uint h = 128) : width(w), height(h)
+    {
+        stride = (w + SimdFloat::Width - 1) / SimdFloat::Width * SimdFloat::Width;
+        depth.resize(stride * h);
+    }
+
+    void begin(const Camera& camera)
+    {
+        viewProj = camera.view * camera.proj;
+        eye = camera.position;
+        fill(depth.begin(), depth.end(), 1.0f);
+    }
+
+    void addOccluder(const Box& b)
+    {
+        float3 lo = b.centre - b.extent, hi = b.centre + b.extent;
+        // from inside the box, or with it crossing the near plane, there is no outline to draw
+        if (eye.x >= lo.x && eye.x <= hi.x && eye.y >= lo.y && eye.y <= hi.y && eye.z >= lo.z && eye.z <= hi.z)
+            return;
+
+        float2 screen[8];
+        float z[8];
+        const float* m = viewProj.m;
+        for (int c = 0; c < 8; c++)
+        {
+            float3 p(c & 1 ? hi.x : lo.x, c & 2 ? hi.y : lo.y, c & 4 ? hi.z : lo.z);
+            float w = p.x * m[3] + p.y * m[7] + p.z * m[11] + m[15];
+            if (w <= 1e-5f)
+                return;
+            screen[c].x = ((p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12]) / w * 0.5f + 0.5f) * width;
+            screen[c].y = ((p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13]) / w * 0.5f + 0.5f) * height;
+            z[c] = (p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]) / w * 0.5f + 0.5f;
+        }
+
+        // the outline is the convex hull of the corners, counter clockwise
+        int order[8], hull[16], n = 0;
+        for (int c = 0; c < 8; c++)
+            order[c] = c;
+        sort(order, order + 8, [&](int a, int c) {
+            return screen[a].x < screen[c].x || (screen[a].x == screen[c].x && screen[a].y < screen[c].y);
+        });
+        auto turn = [&](int o, int a, int c) {
+            float2 u = screen[a] - screen[o], v = screen[c] - screen[o];
+            return u.x * v.y - u.y * v.x;
+        };
+        for (int k = 0; k < 8; k++)
+        {
+            while (n >= 2 && turn(hull[n - 2], hull[n - 1], order[k]) <= 0.0f)
+                n--;
+            hull[n++] = order[k];
+        }
+        for (int k = 6, lower = n + 1; k >= 0; k--)
+        {
+            while (n >= lower && turn(hull[n - 2], hull[n - 1], order[k]) <= 0.0f)
+                n--;
+            hull[n++] = order[k];
+        }
+        n--;
+        if (n < 3)
+            return;
+
+        // edge functions, pulled in by half a pixel's reach so only whole pixels pass
+        float ea[8], eb[8], ec[8];
+        for (int k = 0; k < n; k++)
+        {
+            float2 p0 = screen[hull[k]], p1 = screen[hull[(k + 1) % n]];
+            ea[k] = p0.y - p1.y;
+            eb[k] = p1.x - p0.x;
+            ec[k] = -(ea[k] * p0.x + eb[k] * p0.y) - 0.5f * (fabsf(ea[k]) + fabsf(eb[k]));
+        }
+
+        // the front surface of a convex shape is the farthest of its front
+        // face planes; each plane is raised to its farthest corner of the pixel
+        static const int faces[6][3] = {
+            { 0, 4, 2 }, { 1, 3, 5 },   // -x, +x
+            { 0, 1, 4 }, { 2, 6, 3 },   // -y, +y
+            { 0, 2, 1 }, { 4, 5, 6 },   // -z, +z
+        };
+        float pa[3], pb[3], pc[3];
+        int planes = 0;
+        for (int f = 0; f < 6; f++)
+        {
+            int axis = f / 2;
+            bool front = (f & 1) ? eye._x[axis] > hi._x[axis] : eye._x[axis] < lo._x[axis];
+            if (!front)
+                continue;
+            // in double, faces close to edge on have steep planes
+            const int* v = faces[f];
+            double d1x = screen[v[1]].x - screen[v[0]].x, d1y = screen[v[1]].y - screen[v[0]].y;
+            double d2x = screen[v[2]].x - screen[v[0]].x, d2y = screen[v[2]].y - screen[v[0]].y;
+            double det = d1x * d2y - d1y * d2x;
+            if (fabs(det) < 1e-9)
+                continue;   // edge on, so it covers nothing
+            double z1 = z[v[1]] - z[v[0]], z2 = z[v[2]] - z[v[0]];
+            double a = (z1 * d2y - z2 * d1y) / det;
+            double b = (z2 * d1x - z1 * d2x) / det;
+            pa[planes] = a;
+            pb[planes] = b;
+            pc[planes] = z[v[0]] - a * screen[v[0]].x - b * screen[v[0]].y + 0.5 * (fabs(a) + fabs(b));
+            planes++;
+        }
+        if (!planes)
+            return;
+
+        float fx0 = INFINITY, fy0 = INFINITY, fx1 = -INFINITY, fy1 = -INFINITY;
+        for (int k = 0; k < n; k++)
+        {
+            fx0 = fminf(fx0, screen[hull[k]].x);
+            fx1 = fmaxf(fx1, screen[hull[k]].x);
+            fy0 = fminf(fy0, screen[hull[k]].y);
+            fy1 = fmaxf(fy1, screen[hull[k]].y);
+        }
+        int x0 = (int)fmaxf(floorf(fx0), 0.0f), x1 = (int)fminf(ceilf(fx1), (float)width);
+        int y0 = (int)fmaxf(floorf(fy0), 0.0f), y1 = (int)fminf(ceilf(fy1), (float)height);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        float lanes[SimdFloat::Width];
+        for (int k = 0; k < SimdFloat::Width; k++)
+            lanes[k] = k + 0.5f;
+        SimdFloat laneOffset = SimdFloat::load(lanes);
+        SimdFloat right = (float)x1;
+        SimdFloat zero = 0.0f;
+
+        // x0 rounded down to a whole register so rows stay aligned to the stride
+        int start = x0 / SimdFloat::Width * SimdFloat::Width;
+        for (int y = y0; y < y1; y++)
+        {
+            float py = y + 0.5f;
+            float* row = &depth[y * stride];
+            for (int x = start; x < x1; x += SimdFloat::Width)
+            {
+                SimdFloat px = laneOffset + (float)x;
+                SimdFloat inside = px < right;
+                for (int k = 0; k < n; k++)
+                {
+                    inside = inside & (px * ea[k] + (eb[k] * py + ec[k]) >= zero);
+                }
+                if (!inside.mask())
+                    continue;
+                SimdFloat d = px * pa[0] + (pb[0] * py + pc[0]);
+                for (int k = 1; k < planes; k++)
+                {
+                    d = vmax(d, px * pa[k] + (pb[k] * py + pc[k]));
+                }
+                SimdFloat old = SimdFloat::load(row + x);
+                select(inside, vmin(old, d), old).store(row + x);
+            }
+        }
+    }
+
+    void end()
+    {
+        pyramid.build(&depth[0], width, height, stride);
+    }
+
+    // for debugging and tests
+    float at(uint x, uint y) const { return depth[y * stride + x]; }
+};
+
+// the same pyramid built on the gpu: occluders are drawn into a mipmapped
+// depth Surface, each level is reduced from the one below by hizps.glsl, and a
+// coarse level is read back into a pixel buffer to test against on the cpu.
+// the read back is collected a frame later so it doesn't stall, so culling
+// uses the previous frame's depth and its matrix; objects may pop for a frame
+// when the camera moves quickly. sizes should be powers of two so every level
+// halves exactly
+class HiZBuffer
+{
+    static const int Frames = 2;
+
+    Surface* surface;
+    uint levels;
+    uint readLevel;
+    Shader* occluderShader;
+    Shader* reduceShader;
+    Mesh* boxMesh;
+    Mesh* quadMesh;
+
+    GLuint packBuffers[Frames] = { 0 };
+    matrix packMatrix[Frames];
+    bool packed[Frames] = { false };
+    uint frame = 0;
+    matrix viewProj;
+
+public:
+    DepthPyramid pyramid;
+    matrix pyramidViewProj;     // the matrix the pyramid was drawn with
+
+    // readSize is the largest dimension of the level read back
+    HiZBuffer(ShaderManager* shaders, uint w = 512, uint h = 256, uint readSize = 64)
+    {
+        levels = 1;
+        for (uint s = w > h ? w : h; s > 1; s /= 2)
+            levels++;
+        readLevel = 0;
+        while (((w > h ? w : h) >> readLevel) > readSize && readLevel + 1 < levels)
+            readLevel++;
+        surface = new Surface(w, h, GL_NONE, GL_DEPTH_COMPONENT32F, levels);
+
+        occluderShader = shaders->getShader("meshvs.glsl", "meshps.glsl");
+        reduceShader = shaders->getShader("hizvs.glsl", "hizps.glsl");
+
+        MeshBuilder builder;
+        builder.box(float3(-1, -1, -1), float3(1, 1, 1), {0, 0}, {1, 1});
+        boxMesh = builder.end(shaders->getVertexAttrs("mesh_vertex"));
+
+        // a screen covering quad, hizvs.glsl passes the positions straight through
+        float3 verts[] = { float3(-1, -1, 0), float3(1, -1, 0), float3(1, 1, 0), float3(-1, 1, 0) };
+        float3 norms[4];
+        float2 tex[4];
+        ushort inds[] = { 0, 1, 2, 0, 2, 3 };
+        builder.clear();
+        builder.geometry(verts, norms, tex, inds, 4, 6);
+        quadMesh = builder.end(shaders->getVertexAttrs("mesh_vertex"));
+
+        uint rw = w >> readLevel, rh = h >> readLevel;
+        glGenBuffers(Frames, packBuffers);
+        for (int i = 0; i < Frames; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, rw * rh * sizeof(float), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    ~HiZBuffer()
+    {
+        glDeleteBuffers(Frames, packBuffers);
+        delete boxMesh;
+        delete quadMesh;
+        delete surface;
+    }
+
+    // picks up the read back from the previous frame and starts drawing occluders
+    void begin(const Camera& camera)
+    {
+        if (packed[frame])
+        {
+            uint rw = surface->width >> readLevel, rh = surface->height >> readLevel;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[frame]);
+            const float* data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rw * rh * sizeof(float), GL_MAP_READ_BIT);
+            if (data)
+            {
+                pyramid.build(data, rw, rh, rw);
+                pyramidViewProj = packMatrix[frame];
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        frame = (frame + 1) % Frames;
+
+        viewProj = camera.view * camera.proj;
+        surface->bindDepth(0);
+        glDepthMask(GL_TRUE);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+
+        occluderShader->bind();
+        occluderShader->set("View", camera.view);
+        occluderShader->set("Proj", camera.proj);
+        boxMesh->setDecode(occluderShader);
+    }
+
+    void addOccluder(const Box& b)
+    {
+        occluderShader->set("World", matrix::scale(b.extent) * matrix::translation(b.centre));
+        boxMesh->render();
+    }
+
+    // reduces the levels and queues the read back
+    void end()
+    {
+        glDepthFunc(GL_ALWAYS);
+        reduceShader->bind();
+        quadMesh->setDecode(reduceShader);
+        for (uint l = 1; l < levels; l++)
+        {
+            // sample only the level below, so it isn't read and written at once
+            reduceShader->setTexture2D("Depth", surface->depthTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, l - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, l - 1);
+            surface->bindDepth(l);
+            quadMesh->render();
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glDepthFunc(GL_LESS);
+
+        surface->bindDepth(readLevel);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[frame]);
+        glReadPixels(0, 0, surface->width >> readLevel, surface->height >> readLevel, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        packed[frame] = true;
+        packMatrix[frame] = viewProj;
+
+        surface->bindDepth(0);
+        surface->unbind();
+    }
+};
+
+// occlusion culling for a frame: occluders go in first, then cull() filters
+// the boxes that passed the frustum test and render() draws them
+//
+// the software path rasterizes the occluders for this frame's camera; the
+// hardware path builds a HiZBuffer and, since its pyramid is both coarse and a
+// frame old, sends objects covering much of the screen through an
+// GL_ANY_SAMPLES_PASSED query on their bounds instead, drawing them under
+// conditional rendering so the gpu skips them without a round trip
+class OcclusionCuller
+{
+public:
+    enum Mode { Software, Hardware };
+
+private:
+    Mode mode;
+    SoftwareDepthBuffer software;
+    HiZBuffer* hardware = nullptr;
+    Mesh* boxMesh = nullptr;
+    matrix viewProj;
+
+    vector<GLuint> queries;
+    uint queriesUsed = 0;
+
+public:
+    // screen fraction, per axis, above which the hardware path uses queries
+    float largeFraction = 0.25f;
+
+    OcclusionCuller(ShaderManager* shaders, Mode _mode) : mode(_mode)
+    {
+        if (mode == Hardware)
+        {
+            hardware = new HiZBuffer(shaders);
+            MeshBuilder builder;
+            builder.box(float3(-1, -1, -1), float3(1, 1, 1), {0, 0}, {1, 1});
+            boxMesh = builder.end(shaders->getVertexAttrs("mesh_vertex"));
+        }
+    }
+    ~OcclusionCuller()
+    {
+        if (queries.size())
+            glDeleteQueries(queries.size(), &queries[0]);
+        delete boxMesh;
+        delete hardware;
+    }
+
+    Mode getMode() const { return mode; }
+    const DepthPyramid& pyramid() const { return hardware ? hardware->pyramid : software.pyramid; }
+
+    void begin(const Camera& camera)
+    {
+        viewProj = camera.view * camera.proj;
+        queriesUsed = 0;
+        if (hardware)
+            hardware->begin(camera);
+        else
+            software.begin(camera);
+    }
+    void addOccluder(const Box& b)
+    {
+        if (hardware)
+            hardware->addOccluder(b);
+        else
+            software.addOccluder(b);
+    }
+    void end()
+    {
+        if (hardware)
+            hardware->end();
+        else
+            software.end();
+    }
+
+    void cull(const BoxSoA& boxes, vector<uint>& outVisible) const
+    {
+        if (hardware)
+            hardware->pyramid.cull(boxes, hardware->pyramidViewProj, outVisible);
+        else
+            software.pyramid.cull(boxes, viewProj, outVisible);
+    }
+
+    // draw() sets up its own shader state; large objects on the hardware path
+    // first draw their bounds with shader, without writing colour or depth
+    template<typename Draw>
+    void render(Shader* shader, const Box& bounds, const Draw& draw)
+    {
+        ScreenRect r;
+        if (!hardware || !project(bounds, viewProj, 1.0f, 1.0f, r) ||
+            (r.x1 - r.x0 < largeFraction && r.y1 - r.y0 < largeFraction))
+        {
+            draw();
+            return;
+        }
+
+        if (queriesUsed == queries.size())
+        {
+            queries.resize(queries.size() + 16);
+            glGenQueries(16, &queries[queriesUsed]);
+        }
+        GLuint query = queries[queriesUsed++];
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        shader->set("World", matrix::scale(bounds.extent) * matrix::translation(bounds.centre));
+        boxMesh->setDecode(shader);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+        boxMesh->render();
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+
+        glBeginConditionalRender(query, GL_QUERY_NO_WAIT);
+        draw();
+        glEndConditionalRender();
+    }
+};
+
+#endif
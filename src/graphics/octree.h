@@ -0,0 +1,354 @@
+#ifndef _CUBE_OCTREE_H
+#define _CUBE_OCTREE_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../jobs.h"
+#include "../collision.h"
+
+// loose octree of bounding boxes for visibility queries
+//
+// every node owns a cubic cell, but its objects may spill out to twice the
+// cell size, so an object's node only depends on its centre and size: it goes
+// to the deepest node whose cell holds the centre and whose half size is at
+// least the object's largest extent. moving an object only touches the tree
+// when it leaves its cell or outgrows it.
+//
+// frustum queries carry a mask of the planes still worth testing; a node
+// entirely inside a plane clears its bit, so whole subtrees inside the view
+// are accepted without any further tests. queries don't modify the tree, so
+// several cameras can run them at once
+class LooseOctree
+{
+public:
+    typedef int Handle;
+    static const int Null = -1;
+
+private:
+    static const uint AllPlanes = (1 << 6) - 1;
+    static const int MaxDepth = 32;
+
+    struct Node
+    {
+        float3 centre;
+        float half;             // of the cell; the loose bounds are twice that
+        int parent = Null;
+        int child[8];
+        int firstObject = Null;
+        uint objects = 0;       // in this node
+        uint subtree = 0;       // in this node and below, for pruning
+        int depth = 0;
+    };
+
+    struct Object
+    {
+        Box bounds;
+        uint userData = 0;
+        int node = Null;        // or the next free object
+        int prev = Null, next = Null;
+    };
+
+    vector<Node> nodes;
+    vector<Object> objects;
+    int freeNode = Null;
+    int freeObject = Null;
+    uint count = 0;
+    int maxDepth;
+
+    int allocNode(int parent, const float3& centre, float half)
+    {
+        int i;
+        if (freeNode != Null)
+        {
+            i = freeNode;
+            freeNode = nodes[i].parent;
+            nodes[i] = Node();
+        }
+        else
+        {
+            i = nodes.size();
+            nodes.push_back(Node());
+        }
+        Node& n = nodes[i];
+        n.centre = centre;
+        n.half = half;
+        n.parent = parent;
+        n.depth = parent == Null ? 0 : nodes[parent].depth + 1;
+        for (int& c : n.child)
+        {
+            c = Null;
+        }
+        return i;
+    }
+
+    static float largestExtent(const Box& b)
+    {
+        return fmaxf(b.extent.x, fmaxf(b.extent.y, b.extent.z));
+    }
+
+    bool fits(int node, const Box& b) const
+    {
+        const Node& n = nodes[node];
+        float3 d = b.centre - n.centre;
+        bool inside = fabsf(d.x) <= n.half && fabsf(d.y) <= n.half && fabsf(d.z) <= n.half;
+        if (n.parent == Null)
+        {
+            // the root keeps what is centred outside it or too big for a child
+            return !inside || largestExtent(b) > n.half * 0.5f;
+        }
+        return inside && largestExtent(b) <= n.half;
+    }
+
+    int findNode(const Box& b)
+    {
+        int node = 0;
+        float r = largestExtent(b);
+        float3 d = b.centre - nodes[0].centre;
+        float h = nodes[0].half;
+        // anything centred outside the root stays in it
+        if (fabsf(d.x) > h || fabsf(d.y) > h || fabsf(d.z) > h)
+            return 0;
+
+        while (nodes[node].depth < maxDepth)
+        {
+            float childHalf = nodes[node].half * 0.5f;
+            if (r > childHalf)
+                break;
+            const float3& c = nodes[node].centre;
+            int octant = (b.centre.x >= c.x ? 1 : 0) | (b.centre.y >= c.y ? 2 : 0) | (b.centre.z >= c.z ? 4 : 0);
+            int next = nodes[node].child[octant];
+            if (next == Null)
+            {
+                float3 offset(octant & 1 ? childHalf : -childHalf, octant & 2 ? childHalf : -childHalf, octant & 4 ? childHalf : -childHalf);
+                next = allocNode(node, c + offset, childHalf);
+                nodes[node].child[octant] = next;
+            }
+            node = next;
+        }
+        return node;
+    }
+
+    void link(int h, int node)
+    {
+        Object& o = objects[h];
+        Node& n = nodes[node];
+        o.node = node;
+        o.prev = Null;
+        o.next = n.firstObject;
+        if (n.firstObject != Null)
+            objects[n.firstObject].prev = h;
+        n.firstObject = h;
+        n.objects++;
+        for (int i = node; i != Null; i = nodes[i].parent)
+        {
+            nodes[i].subtree++;
+        }
+    }
+
+    void unlink(int h)
+    {
+        Object& o = objects[h];
+        Node& n = nodes[o.node];
+        if (o.prev != Null)
+            objects[o.prev].next = o.next;
+        else
+            n.firstObject = o.next;
+        if (o.next != Null)
+            objects[o.next].prev = o.prev;
+        n.objects--;
+
+        // drop nodes left empty, except the root
+        int node = o.node;
+        for (int i = node; i != Null; i = nodes[i].parent)
+        {
+            nodes[i].subtree--;
+        }
+        while (node != 0 && nodes[node].subtree == 0)
+        {
+            int parent = nodes[node].parent;
+            for (int& c : nodes[parent].child)
+            {
+                if (c == node)
+                    c = Null;
+            }
+            nodes[node].parent = freeNode;
+            freeNode = node;
+            node = parent;
+        }
+    }
+
+    // -1 outside, 1 inside, 0 straddling
+    static int classify(const float4& p, const float3& centre, const float3& extent)
+    {
+        float d = p.x * centre.x + p.y * centre.y + p.z * centre.z + p.w;
+        float r = fabsf(p.x) * extent.x + fabsf(p.y) * extent.y + fabsf(p.z) * extent.z;
+        if (d < -r)
+            return -1;
+        return d >= r ? 1 : 0;
+    }
+
+    // tests the planes left in mask, clearing the ones the box is inside of;
+    // false when it is outside one of them
+    static bool cullPlanes(const Frustum& f, const float3& centre, const float3& extent, uint& mask)
+    {
+        for (uint bits = mask; bits; bits &= bits - 1)
+        {
+            int p = __builtin_ctz(bits);
+            int side = classify(f.planes[p], centre, extent);
+            if (side < 0)
+                return false;
+            if (side > 0)
+                mask &= ~(1u << p);
+        }
+        return true;
+    }
+
+public:
+    // the root cell; objects centred outside it are kept in the root and always tested
+    LooseOctree(const float3& centre, float halfSize, int _maxDepth = 8)
+    {
+        // the query stacks hold 7 entries per level
+        maxDepth = _maxDepth < MaxDepth ? _maxDepth : MaxDepth;
+        allocNode(Null, centre, halfSize);
+    }
+
+    uint size() const { return count; }
+    uint nodeCount() const { return nodes.size(); }
+
+    Handle insert(const Box& bounds, uint userData)
+    {
+        Handle h;
+        if (freeObject != Null)
+        {
+            h = freeObject;
+            freeObject = objects[h].node;
+        }
+        else
+        {
+            h = objects.size();
+            objects.push_back(Object());
+        }
+        objects[h].bounds = bounds;
+        objects[h].userData = userData;
+        link(h, findNode(bounds));
+        count++;
+        return h;
+    }
+    void move(Handle h, const Box& bounds)
+    {
+        objects[h].bounds = bounds;
+        if (fits(objects[h].node, bounds))
+            return;
+        unlink(h);
+        link(h, findNode(bounds));
+    }
+    void remove(Handle h)
+    {
+        unlink(h);
+        objects[h].node = freeObject;
+        freeObject = h;
+        count--;
+    }
+    void clear()
+    {
+        float3 centre = nodes[0].centre;
+        float half = nodes[0].half;
+        nodes.clear();
+        objects.clear();
+        freeNode = Null;
+        freeObject = Null;
+        count = 0;
+        allocNode(Null, centre, half);
+    }
+
+    const Box& getBounds(Handle h) const { return objects[h].bounds; }
+    uint getUserData(Handle h) const { return objects[h].userData; }
+
+    // calls cb(userData) for every object intersect(f, bounds) would accept;
+    // cb returns false to stop
+    template<typename Callback>
+    void query(const Frustum& f, const Callback& cb) const
+    {
+        struct Entry { int node; uint mask; };
+        Entry stack[7 * MaxDepth + 8];
+        int top = 0;
+        stack[top++] = { 0, AllPlanes };
+
+        while (top)
+        {
+            Entry e = stack[--top];
+            const Node& n = nodes[e.node];
+
+            for (int h = n.firstObject; h != Null; h = objects[h].next)
+            {
+                const Object& o = objects[h];
+                uint mask = e.mask;
+                if (mask && !cullPlanes(f, o.bounds.centre, o.bounds.extent, mask))
+                    continue;
+                if (!cb(o.userData))
+                    return;
+            }
+
+            for (int c : n.child)
+            {
+                if (c == Null)
+                    continue;
+                uint mask = e.mask;
+                const Node& child = nodes[c];
+                float loose = child.half * 2.0f;
+                if (mask && !cullPlanes(f, child.centre, float3(loose, loose, loose), mask))
+                    continue;
+                stack[top++] = { c, mask };
+            }
+        }
+    }
+
+    template<typename Callback>
+    void query(const Box& b, const Callback& cb) const
+    {
+        int stack[7 * MaxDepth + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top)
+        {
+            const Node& n = nodes[stack[--top]];
+            for (int h = n.firstObject; h != Null; h = objects[h].next)
+            {
+                if (intersect(objects[h].bounds, b) && !cb(objects[h].userData))
+                    return;
+            }
+            for (int c : n.child)
+            {
+                if (c == Null)
+                    continue;
+                float loose = nodes[c].half * 2.0f;
+                if (intersect(Box(nodes[c].centre, float3(loose, loose, loose)), b))
+                    stack[top++] = c;
+            }
+        }
+    }
+
+    // one frustum query per camera (main view, shadow cascades, minimap...),
+    // spread over the job system; outVisible[i] gets the user data seen by frustums[i]
+    void query(const Frustum* frustums, uint cameras, vector<uint>* outVisible, JobSystem* jobs = nullptr) const
+    {
+        auto job = [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+            {
+                vector<uint>& out = outVisible[i];
+                out.clear();
+                query(frustums[i], [&](uint id) {
+                    out.push_back(id);
+                    return true;
+                });
+            }
+        };
+        if (jobs)
+            jobs->parallelFor(0, cameras, 1, job);
+        else
+            job(0, cameras);
+    }
+};
+
+#endif
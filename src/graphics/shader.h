@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include "../definitions.h"
+#include "../assets.h"
 
 struct Shader
 {
@@ -11,6 +12,10 @@ struct Shader
     Shader() = default;
     Shader(const Shader&) = delete;
     Shader& operator=(const Shader&) = delete;
+    ~Shader()
+    {
+        glDeleteProgram(program);
+    }
 
     void bind() { glUseProgram(program); }
 
@@ -19,6 +24,14 @@ struct Shader
     void set(const string& name, const matrix& mat)    { glUniformMatrix4fv(glGetUniformLocation(program, name.c_str()), 1, GL_FALSE, mat.m); }
     template<int n> void set(const string& name, const float4 (&f)[n]) { glUniform4fv(      glGetUniformLocation(program, name.c_str()), n, (float*)(void*)f); }
 
+    // reads uniform block name from whatever buffer is bound at binding
+    void setBlock(const string& name, uint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(program, name.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, binding);
+    }
+
     void setTexture2D(const string& name, GLuint texture, uint slot=0)
     {
         glActiveTexture(GL_TEXTURE0 + slot);
@@ -59,6 +72,7 @@ class ShaderManager
     map<string, ShaderSource> vertexShaders;
     map<string, ShaderSource> pixelShaders;
     map<string, vector<VertexAttr>> vertexTypes;
+    AssetRegistry<Shader> programs;     // by "vsfile|psfile"
 
     GLuint buildProgram(GLuint vs, GLuint ps, const vector<VertexAttr>& attrs)
     {
@@ -252,6 +266,7 @@ class ShaderManager
         cout << "    compiling..." << endl;
         source.shader = glCreateShader(source.shaderType);
         glShaderSource(source.shader, 1, &csrc, &len);
+        NullGL::get().labelShader(source.shader, fname);
         glCompileShader(source.shader);
         
         // output errors/info of compilation
@@ -271,7 +286,8 @@ class ShaderManager
     }
 
 public:
-    ShaderManager(const string& dir=string(RESOURCE_BASE)+"/shaders", const string& attrfile=string(RESOURCE_BASE)+"/vertex.txt")
+    ShaderManager(const string& dir=string(RESOURCE_BASE)+"/shaders", const string& attrfile=string(RESOURCE_BASE)+"/vertex.txt") :
+        programs([this](const string& key) { return createShader(key); })
     {
         baseDir = dir;
 
@@ -291,8 +307,30 @@ public:
         return vertexTypes[vertexDef];
     }
 
+    typedef AssetRegistry<Shader>::Handle Handle;
+
+    // programs are shared by everything using the same pair of files
+    Handle acquireShader(const string& vsfile, const string& psfile) { return programs.acquire(vsfile + "|" + psfile); }
+    void releaseShader(Handle h) { programs.release(h); }
+    Shader* getShader(Handle h) const { return programs.get(h); }
+
+    // takes a reference that is never released, so the program stays loaded
     Shader* getShader(const string& vsfile, const string& psfile)
     {
+        return getShader(acquireShader(vsfile, psfile));
+    }
+
+    // unloads programs released a while ago; once a frame
+    void collect() { programs.collect(); }
+    void printStats() const { programs.printStats("shaders"); }
+
+private:
+    Shader* createShader(const string& key)
+    {
+        size_t bar = key.find('|');
+        string vsfile = key.substr(0, bar);
+        string psfile = key.substr(bar + 1);
+
         // ShaderSource vshader, pshader;
         GLuint vshader = 0;
         GLuint pshader = 0;
@@ -334,6 +372,7 @@ public:
         return shader;
     }
 
+public:
     void clear()
     {
         // TODO: some kind of detaching system
@@ -0,0 +1,336 @@
+#ifndef _CUBE_SIMPLIFY_H
+#define _CUBE_SIMPLIFY_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+
+// quadric error metric mesh simplification (Garland & Heckbert)
+//
+// every vertex keeps the sum of the planes of the triangles around it, so the
+// squared distance from a point to those planes is a quadratic form. edges
+// are collapsed cheapest first, always onto one of their own vertices, so the
+// simplified triangles index the original vertex buffer and every level of
+// detail can share it. vertices on open borders or attribute seams (several
+// vertices at one position, e.g. uv or normal splits) are never moved, which
+// keeps the outline and texture mapping intact at the cost of reducing less
+// around them. simplify() can be called repeatedly with smaller targets, each
+// level continuing from the last
+class MeshSimplifier
+{
+    struct Quadric
+    {
+        // symmetric 4x4, upper triangle: a2 ab ac ad b2 bc bd c2 cd d2
+        double q[10] = { 0 };
+        double area = 0;
+
+        static Quadric plane(const float3& n, double d, double weight)
+        {
+            Quadric r;
+            double a = n.x, b = n.y, c = n.z;
+            r.q[0] = a * a * weight; r.q[1] = a * b * weight; r.q[2] = a * c * weight; r.q[3] = a * d * weight;
+            r.q[4] = b * b * weight; r.q[5] = b * c * weight; r.q[6] = b * d * weight;
+            r.q[7] = c * c * weight; r.q[8] = c * d * weight;
+            r.q[9] = d * d * weight;
+            r.area = weight;
+            return r;
+        }
+        Quadric& operator += (const Quadric& o)
+        {
+            for (int i = 0; i < 10; i++)
+                q[i] += o.q[i];
+            area += o.area;
+            return *this;
+        }
+        // mean squared distance to the planes
+        double error(const float3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+                     + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+                     + q[7]*z*z + 2*q[8]*z
+                     + q[9];
+            return area > 0 ? fmax(e, 0.0) / area : 0.0;
+        }
+    };
+
+    struct Candidate
+    {
+        double cost;
+        uint vertex;
+        uint version;
+        bool operator < (const Candidate& o) const { return cost > o.cost; }
+    };
+
+    vector<float3> positions;
+    vector<uint> indices;           // 3 per triangle, collapsed vertices are rewritten
+    vector<uint> triangleSubset;
+    vector<bool> triangleAlive;
+    uint liveTriangles = 0;
+
+    vector<vector<uint>> vertexTriangles;   // may list dead triangles
+    vector<Quadric> quadrics;
+    vector<bool> locked;
+    vector<bool> removed;
+    vector<uint> version;
+    priority_queue<Candidate> heap;
+    double maxError = 0.0;
+
+    // neighbour lists, kept to save allocations
+    vector<uint> around, aroundTarget, aroundKept;
+
+    // vertices sharing a live triangle with v
+    void neighbours(uint v, vector<uint>& out) const
+    {
+        out.clear();
+        for (uint t : vertexTriangles[v])
+        {
+            if (!triangleAlive[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                uint w = indices[t * 3 + k];
+                if (w != v && find(out.begin(), out.end(), w) == out.end())
+                    out.push_back(w);
+            }
+        }
+    }
+
+    // collapsing v onto u must keep the surface a manifold (the two may only
+    // share the neighbours of the two triangles on their edge) and must not
+    // fold any of the triangles that stay over
+    bool valid(uint v, uint u, const vector<uint>& vn, vector<uint>& scratch) const
+    {
+        neighbours(u, scratch);
+        int shared = 0;
+        for (uint w : vn)
+        {
+            if (w != u && find(scratch.begin(), scratch.end(), w) != scratch.end())
+                shared++;
+        }
+        if (shared != 2)
+            return false;
+
+        for (uint t : vertexTriangles[v])
+        {
+            if (!triangleAlive[t])
+                continue;
+            const uint* tri = &indices[t * 3];
+            if (tri[0] == u || tri[1] == u || tri[2] == u)
+                continue;
+            float3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = positions[tri[k]];
+                q[k] = tri[k] == v ? positions[u] : p[k];
+            }
+            float3 before = cross(p[1] - p[0], p[2] - p[0]);
+            float3 after = cross(q[1] - q[0], q[2] - q[0]);
+            // slivers that already have no area can't flip
+            if (dot(before, after) <= 0.0f && len2(before) > 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // the cheapest collapse of v that passes valid(), or cost INFINITY
+    double bestCollapse(uint v, uint& target)
+    {
+        neighbours(v, around);
+        double best = INFINITY;
+        for (uint u : around)
+        {
+            Quadric q = quadrics[v];
+            q += quadrics[u];
+            double cost = q.error(positions[u]);
+            if (cost < best && valid(v, u, around, aroundTarget))
+            {
+                best = cost;
+                target = u;
+            }
+        }
+        return best;
+    }
+
+    void push(uint v)
+    {
+        if (locked[v] || removed[v])
+            return;
+        version[v]++;
+        uint target;
+        double cost = bestCollapse(v, target);
+        if (cost < INFINITY)
+            heap.push({ cost, v, version[v] });
+    }
+
+    void collapse(uint v, uint u)
+    {
+        for (uint t : vertexTriangles[v])
+        {
+            if (!triangleAlive[t])
+                continue;
+            uint* tri = &indices[t * 3];
+            if (tri[0] == u || tri[1] == u || tri[2] == u)
+            {
+                triangleAlive[t] = false;
+                liveTriangles--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                if (tri[k] == v)
+                    tri[k] = u;
+            }
+            vertexTriangles[u].push_back(t);
+        }
+        vertexTriangles[v].clear();
+        quadrics[u] += quadrics[v];
+        removed[v] = true;
+
+        // costs around u have all changed
+        neighbours(u, aroundKept);
+        push(u);
+        for (uint w : aroundKept)
+        {
+            push(w);
+        }
+    }
+
+public:
+    // subsetOf gives every triangle's subset, so output can keep them apart
+    MeshSimplifier(const float3* vertices, uint vertexCount, const uint* ind, uint indexCount, const uint* subsetOf = nullptr)
+    {
+        positions.assign(vertices, vertices + vertexCount);
+        indices.assign(ind, ind + indexCount);
+        uint triangles = indexCount / 3;
+        triangleSubset.resize(triangles, 0);
+        if (subsetOf)
+            triangleSubset.assign(subsetOf, subsetOf + triangles);
+        triangleAlive.assign(triangles, true);
+        liveTriangles = triangles;
+
+        vertexTriangles.resize(vertexCount);
+        quadrics.resize(vertexCount);
+        locked.assign(vertexCount, false);
+        removed.assign(vertexCount, false);
+        version.assign(vertexCount, 0);
+
+        // both vertices of every edge, smallest first
+        vector<uint64_t> edges;
+        edges.reserve(indexCount);
+        for (uint t = 0; t < triangles; t++)
+        {
+            const uint* tri = &indices[t * 3];
+            float3 n = cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+            float area = len(n);
+            if (area > 0.0f)
+            {
+                n /= area;
+                Quadric q = Quadric::plane(n, -dot(n, positions[tri[0]]), area * 0.5);
+                for (int k = 0; k < 3; k++)
+                    quadrics[tri[k]] += q;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                vertexTriangles[tri[k]].push_back(t);
+                uint64_t a = tri[k], b = tri[(k + 1) % 3];
+                edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+            }
+        }
+
+        // open (or non-manifold) edges: anything not used by exactly two triangles
+        sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size(); )
+        {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i])
+                j++;
+            if (j - i != 2)
+            {
+                locked[edges[i] >> 32] = true;
+                locked[edges[i] & 0xffffffffu] = true;
+            }
+            i = j;
+        }
+
+        // seams: positions shared by more than one vertex
+        vector<uint> order(vertexCount);
+        for (uint i = 0; i < vertexCount; i++)
+            order[i] = i;
+        auto before = [&](uint a, uint b) {
+            const float3& p = positions[a];
+            const float3& q = positions[b];
+            return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+        };
+        sort(order.begin(), order.end(), before);
+        for (uint i = 1; i < vertexCount; i++)
+        {
+            if (!before(order[i - 1], order[i]))
+            {
+                locked[order[i - 1]] = true;
+                locked[order[i]] = true;
+            }
+        }
+
+        for (uint v = 0; v < vertexCount; v++)
+        {
+            push(v);
+        }
+    }
+
+    uint triangleCount() const { return liveTriangles; }
+
+    // largest collapse so far, as a distance from the original surface
+    float error() const { return (float)sqrt(maxError); }
+
+    // collapses edges until at most targetTriangles are left, or the next
+    // collapse would move the surface further than errorLimit
+    uint simplify(uint targetTriangles, float errorLimit = INFINITY)
+    {
+        double limit = (double)errorLimit * errorLimit;
+        while (liveTriangles > targetTriangles && !heap.empty())
+        {
+            Candidate c = heap.top();
+            heap.pop();
+            if (removed[c.vertex] || c.version != version[c.vertex])
+                continue;
+
+            // neighbours may have moved since it was queued
+            uint target;
+            double cost = bestCollapse(c.vertex, target);
+            if (cost == INFINITY)
+                continue;
+            if (cost > c.cost * (1.0 + 1e-9) + 1e-18)
+            {
+                heap.push({ cost, c.vertex, version[c.vertex] });
+                continue;
+            }
+            if (cost > limit)
+            {
+                heap.push(c);
+                break;
+            }
+            maxError = fmax(maxError, cost);
+            collapse(c.vertex, target);
+        }
+        return liveTriangles;
+    }
+
+    // the live triangles of every subset in turn; counts gets each subset's index count
+    void getIndices(uint subsets, vector<uint>& out, vector<uint>& counts) const
+    {
+        out.clear();
+        counts.assign(subsets, 0);
+        for (uint s = 0; s < subsets; s++)
+        {
+            for (uint t = 0; t < triangleAlive.size(); t++)
+            {
+                if (!triangleAlive[t] || triangleSubset[t] != s)
+                    continue;
+                out.insert(out.end(), &indices[t * 3], &indices[t * 3] + 3);
+                counts[s] += 3;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,824 @@
+#ifndef _CUBE_GRAPHICS_SOFTGL_H
+#define _CUBE_GRAPHICS_SOFTGL_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../jobs.h"
+#include "nullgl.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOFTGL_SSE 1
+#else
+#define SOFTGL_SSE 0
+#endif
+
+// software rasterizer for headless rendering tests
+//
+// sits on the NullGL draw hooks, so Mesh::render, Sprite::end etc. are rasterized
+// exactly as the engine issues them. the GLSL programs are replaced by C++
+// functions registered under the shader file names (see registerDefaultShaders).
+// draws are shaded and binned into tiles as they arrive; the tiles are rasterized
+// in parallel when the frame is presented (or cleared), each tile walking its
+// triangles in submission order, so the image doesn't depend on the thread count.
+
+static const int SoftMaxVaryings = 8;
+
+// uncompressed (stored deflate) PNG: bigger files, but no time spent compressing
+bool writePNG(const string& fname, int width, int height, const uint* rgba)
+{
+    static uint crcTable[256];
+    if (!crcTable[1])
+    {
+        for (uint n = 0; n < 256; n++)
+        {
+            uint c = n;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            crcTable[n] = c;
+        }
+    }
+
+    ofstream file(fname, ios::binary);
+    if (!file.is_open())
+    {
+        cout << "softgl: could not write " << fname << endl;
+        return false;
+    }
+
+    auto be32 = [](vector<uchar>& out, uint v) {
+        out.push_back(v >> 24); out.push_back(v >> 16); out.push_back(v >> 8); out.push_back(v);
+    };
+    auto chunk = [&](const char* type, const vector<uchar>& data) {
+        vector<uchar> out;
+        be32(out, data.size());
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        uint crc = 0xffffffffu;
+        for (size_t i = 4; i < out.size(); i++)
+            crc = crcTable[(crc ^ out[i]) & 0xff] ^ (crc >> 8);
+        be32(out, crc ^ 0xffffffffu);
+        file.write((const char*)&out[0], out.size());
+    };
+
+    const uchar signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    file.write((const char*)signature, sizeof(signature));
+
+    vector<uchar> header;
+    be32(header, width);
+    be32(header, height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bit RGBA
+
+    // scanlines with filter type 0
+    size_t rowSize = width * 4 + 1;
+    vector<uchar> raw(rowSize * height);
+    for (int y = 0; y < height; y++)
+    {
+        raw[y * rowSize] = 0;
+        memcpy(&raw[y * rowSize + 1], rgba + y * width, width * 4);
+    }
+
+    vector<uchar> zlib = { 0x78, 0x01 };
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    uint s1 = 1, s2 = 0;
+    for (size_t pos = 0; pos < raw.size() || pos == 0; )
+    {
+        size_t len = (raw.size() - pos < 65535) ? raw.size() - pos : 65535;
+        bool last = pos + len == raw.size();
+        zlib.insert(zlib.end(), { (uchar)last, (uchar)len, (uchar)(len >> 8), (uchar)~len, (uchar)(~len >> 8) });
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+        for (size_t i = pos; i < pos + len; i++)
+        {
+            s1 = (s1 + raw[i]) % 65521;
+            s2 = (s2 + s1) % 65521;
+        }
+        pos += len;
+        if (last)
+            break;
+    }
+    be32(zlib, (s2 << 16) | s1);
+
+    chunk("IHDR", header);
+    chunk("IDAT", zlib);
+    chunk("IEND", {});
+    return true;
+}
+
+// per-draw shader constants, filled once by the shader's setup function
+struct SoftConstants
+{
+    matrix m[4];
+    float4 v[4];
+    const float4* block = nullptr;  // a uniform block's contents, as vec4s
+    uint blockSize = 0;             // in vec4s
+};
+
+// reads uniforms by name from the program bound at draw time
+struct SoftUniforms
+{
+    const NullGL::ProgramObject* program;
+
+    const vector<float>* find(const char* name) const
+    {
+        auto iter = program->locations.find(name);
+        if (iter == program->locations.end())
+            return nullptr;
+        return &program->values[iter->second].f;
+    }
+    matrix getMatrix(const char* name) const
+    {
+        matrix m;
+        auto v = find(name);
+        if (v && v->size() >= 16)
+            memcpy(m.m, &(*v)[0], sizeof(m.m));
+        return m;
+    }
+    float4 getFloat4(const char* name, const float4& def = float4(1, 1, 1, 1)) const
+    {
+        auto v = find(name);
+        return (v && v->size() >= 4) ? float4((*v)[0], (*v)[1], (*v)[2], (*v)[3]) : def;
+    }
+    // what is bound to uniform block name; nullptr if nothing is
+    const float4* getBlock(const char* name, uint& vec4s) const
+    {
+        size_t bytes = 0;
+        const uchar* data = NullGL::get().getUniformBlock(*program, name, bytes);
+        vec4s = bytes / sizeof(float4);
+        return (const float4*)data;
+    }
+};
+
+struct SoftTexture
+{
+    int width = 0;
+    int height = 0;
+    const uchar* data = nullptr; // RGBA8, row 0 at t=0
+
+    // bilinear, clamp to edge
+    float4 sample(float u, float v) const
+    {
+        if (!data)
+            return float4(1, 1, 1, 1);
+
+        float x = u * width - 0.5f;
+        float y = v * height - 0.5f;
+        int x0 = (int)floorf(x);
+        int y0 = (int)floorf(y);
+        float fx = x - x0;
+        float fy = y - y0;
+
+        auto texel = [this](int x, int y) {
+            x = (x < 0) ? 0 : (x >= width) ? width - 1 : x;
+            y = (y < 0) ? 0 : (y >= height) ? height - 1 : y;
+            const uchar* p = data + (y * width + x) * 4;
+            return float4(p[0], p[1], p[2], p[3]);
+        };
+        float4 t = lerp(lerp(texel(x0, y0), texel(x0+1, y0), fx), lerp(texel(x0, y0+1), texel(x0+1, y0+1), fx), fy);
+        return t / 255.f;
+    }
+};
+
+struct SoftVertex
+{
+    float4 position; // clip space
+    float varyings[SoftMaxVaryings];
+};
+
+struct SoftVertexShader
+{
+    void(*setup)(const SoftUniforms& uniforms, SoftConstants& constants);
+    void(*shade)(const SoftConstants& constants, const float4* attribs, SoftVertex& out);
+    int numVaryings;
+};
+// return false to discard the pixel
+typedef bool(*SoftPixelShader)(const SoftTexture& texture, const float* varyings, float4& out);
+
+class SoftRasterizer
+{
+    static const int TileSize = 64;
+
+    struct DrawState
+    {
+        SoftPixelShader pixelShader;
+        GLuint texture;
+        int numVaryings;
+        bool depthTest;
+        bool blend;
+        GLenum depthFunc;
+    };
+    struct Triangle
+    {
+        // screen space x, y, depth and 1/w per vertex
+        float x[3], y[3], z[3], invw[3];
+        // varyings pre-divided by w
+        float varyings[3][SoftMaxVaryings];
+        // edge functions E(p) = a*px + b*py + c, positive inside
+        float a[3], b[3], c[3];
+        bool topLeft[3];
+        float invArea;
+        int minx, miny, maxx, maxy;
+        int draw;
+    };
+
+    NullGL& gl;
+    JobSystem* jobs;
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+
+    vector<uint> colour;
+    vector<float> depth;
+
+    map<string, SoftVertexShader> vertexShaders;
+    map<string, SoftPixelShader> pixelShaders;
+    map<GLuint, string> missing;
+
+    vector<DrawState> draws;
+    vector<Triangle> triangles;
+    vector<vector<int>> tiles;
+    vector<SoftVertex> vertices;
+
+    SoftRasterizer(const SoftRasterizer&) = delete;
+    SoftRasterizer& operator = (const SoftRasterizer&) = delete;
+
+    static float halfToFloat(ushort h)
+    {
+        uint sign = (h & 0x8000) << 16;
+        int exponent = (h >> 10) & 0x1f;
+        uint mantissa = h & 0x3ff;
+        uint bits;
+        if (exponent == 0)
+        {
+            float f = mantissa / 16777216.f;
+            return sign ? -f : f;
+        }
+        else if (exponent == 31)
+        {
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        }
+        else
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        float f;
+        memcpy(&f, &bits, 4);
+        return f;
+    }
+
+    static float4 fetch(const NullGL::VertexAttrib& a, const vector<uchar>& data, uint index)
+    {
+        float4 r(0, 0, 0, 1);
+        if (!a.enabled)
+            return r;
+
+        int typeSize = (a.type == GL_FLOAT || a.type == GL_INT || a.type == GL_UNSIGNED_INT) ? 4 :
+                       (a.type == GL_BYTE || a.type == GL_UNSIGNED_BYTE) ? 1 : 2;
+        size_t stride = a.stride ? a.stride : typeSize * a.size;
+        size_t offset = a.offset + stride * index;
+        if (offset + typeSize * a.size > data.size())
+            return r;
+
+        const uchar* p = &data[offset];
+        for (int i = 0; i < a.size && i < 4; i++)
+        {
+            float f = 0;
+            switch (a.type)
+            {
+                case GL_FLOAT:          f = ((const float*)p)[i]; break;
+                case GL_HALF_FLOAT:     f = halfToFloat(((const ushort*)p)[i]); break;
+                case GL_UNSIGNED_BYTE:  f = p[i]; if (a.normalized) f /= 255.f; break;
+                case GL_BYTE:           f = ((const int8_t*)p)[i]; if (a.normalized) f = fmaxf(f / 127.f, -1.f); break;
+                case GL_UNSIGNED_SHORT: f = ((const ushort*)p)[i]; if (a.normalized) f /= 65535.f; break;
+                case GL_SHORT:          f = ((const int16_t*)p)[i]; if (a.normalized) f = fmaxf(f / 32767.f, -1.f); break;
+                case GL_UNSIGNED_INT:   f = ((const uint*)p)[i]; break;
+                case GL_INT:            f = ((const int32_t*)p)[i]; break;
+            }
+            r._x[i] = f;
+        }
+        return r;
+    }
+
+    bool findShaders(const NullGL::ProgramObject& program, GLuint name, SoftVertexShader& vs, SoftPixelShader& ps)
+    {
+        bool haveVs = false;
+        bool havePs = false;
+        string labels;
+        for (auto s : program.shaders)
+        {
+            auto& label = gl.shaders[s].label;
+            labels += label + " ";
+            auto v = vertexShaders.find(label);
+            if (v != vertexShaders.end())
+            {
+                vs = v->second;
+                haveVs = true;
+            }
+            auto p = pixelShaders.find(label);
+            if (p != pixelShaders.end())
+            {
+                ps = p->second;
+                havePs = true;
+            }
+        }
+        if ((!haveVs || !havePs) && !missing.count(name))
+        {
+            cout << "softgl: no C++ shaders registered for program " << name << " (" << labels << "), skipping its draws" << endl;
+            missing[name] = labels;
+        }
+        return haveVs && havePs;
+    }
+
+    // clip against the near plane (z >= -w); produces 0, 1 or 2 triangles
+    int clipNear(const SoftVertex* in, SoftVertex* out, int numVaryings)
+    {
+        SoftVertex poly[4];
+        int n = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const SoftVertex& a = in[i];
+            const SoftVertex& b = in[(i+1) % 3];
+            float da = a.position.z + a.position.w;
+            float db = b.position.z + b.position.w;
+            if (da >= 0)
+            {
+                poly[n++] = a;
+            }
+            if ((da >= 0) != (db >= 0))
+            {
+                float t = da / (da - db);
+                SoftVertex& v = poly[n++];
+                v.position = lerp(a.position, b.position, t);
+                for (int k = 0; k < numVaryings; k++)
+                    v.varyings[k] = a.varyings[k] + (b.varyings[k] - a.varyings[k]) * t;
+            }
+        }
+        if (n < 3)
+            return 0;
+        out[0] = poly[0]; out[1] = poly[1]; out[2] = poly[2];
+        if (n == 3)
+            return 1;
+        out[3] = poly[0]; out[4] = poly[2]; out[5] = poly[3];
+        return 2;
+    }
+
+    void setupTriangle(const SoftVertex* v, int draw, int numVaryings)
+    {
+        Triangle t;
+        for (int i = 0; i < 3; i++)
+        {
+            float invw = 1.f / v[i].position.w;
+            t.x[i] = (v[i].position.x * invw * 0.5f + 0.5f) * width;
+            t.y[i] = (v[i].position.y * invw * 0.5f + 0.5f) * height;
+            t.z[i] = v[i].position.z * invw * 0.5f + 0.5f;
+            t.invw[i] = invw;
+            for (int k = 0; k < numVaryings; k++)
+                t.varyings[i][k] = v[i].varyings[k] * invw;
+        }
+
+        float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+        if (area == 0 || area != area)
+            return;
+        if (gl.cullFace && area < 0)
+            return; // counter-clockwise front faces, cull back
+
+        // edge i is opposite vertex i
+        float sign = (area > 0) ? 1.f : -1.f;
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3;
+            int k = (i + 2) % 3;
+            t.a[i] = -(t.y[k] - t.y[j]) * sign;
+            t.b[i] = (t.x[k] - t.x[j]) * sign;
+            t.c[i] = -(t.a[i] * t.x[j] + t.b[i] * t.y[j]);
+            // top-left fill rule so shared edges are only drawn once
+            t.topLeft[i] = (t.a[i] > 0) || (t.a[i] == 0 && t.b[i] < 0);
+        }
+        t.invArea = 1.f / (area * sign);
+
+        float minx = fminf(t.x[0], fminf(t.x[1], t.x[2]));
+        float maxx = fmaxf(t.x[0], fmaxf(t.x[1], t.x[2]));
+        float miny = fminf(t.y[0], fminf(t.y[1], t.y[2]));
+        float maxy = fmaxf(t.y[0], fmaxf(t.y[1], t.y[2]));
+        t.minx = (int)fmaxf(floorf(minx), 0);
+        t.miny = (int)fmaxf(floorf(miny), 0);
+        t.maxx = (int)fminf(ceilf(maxx), width - 1);
+        t.maxy = (int)fminf(ceilf(maxy), height - 1);
+        if (t.minx > t.maxx || t.miny > t.maxy)
+            return;
+        t.draw = draw;
+
+        int index = triangles.size();
+        triangles.push_back(t);
+        for (int ty = t.miny / TileSize; ty <= t.maxy / TileSize; ty++)
+        {
+            for (int tx = t.minx / TileSize; tx <= t.maxx / TileSize; tx++)
+            {
+                tiles[ty * tilesX + tx].push_back(index);
+            }
+        }
+    }
+
+    void onDraw(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instances, GLint baseVertex)
+    {
+        if (mode != GL_TRIANGLES || gl.framebuffer != 0)
+        {
+            // only triangle lists into the default framebuffer are emulated
+            return;
+        }
+
+        auto& program = gl.programs[gl.program];
+        SoftVertexShader vs;
+        SoftPixelShader ps;
+        if (!findShaders(program, gl.program, vs, ps))
+            return;
+
+        SoftUniforms uniforms { &program };
+        SoftConstants constants;
+        vs.setup(uniforms, constants);
+
+        DrawState state;
+        state.pixelShader = ps;
+        state.texture = 0;
+        auto sampler = program.locations.find("diffuseMap");
+        if (sampler != program.locations.end() && program.values[sampler->second].i.size())
+        {
+            int unit = program.values[sampler->second].i[0];
+            state.texture = (unit >= 0 && unit < NullGL::MaxTextureUnits) ? gl.boundTextures[unit] : 0;
+        }
+        state.numVaryings = vs.numVaryings;
+        state.depthTest = gl.depthTest;
+        state.blend = gl.blend;
+        state.depthFunc = gl.depthFunc;
+        int draw = draws.size();
+        draws.push_back(state);
+
+        // fetch and shade the vertices referenced by the index range
+        auto& vao = gl.vertexArrays[gl.vertexArray];
+        auto& ibuf = gl.buffers[vao.elementBuffer].data;
+        auto index = [&](int i) -> uint {
+            const uchar* p = &ibuf[offset];
+            return (type == GL_UNSIGNED_INT) ? ((const uint*)p)[i] : (type == GL_UNSIGNED_SHORT) ? ((const ushort*)p)[i] : p[i];
+        };
+        if (ibuf.size() < offset + count * ((type == GL_UNSIGNED_INT) ? 4 : (type == GL_UNSIGNED_SHORT) ? 2 : 1) || !count)
+            return;
+
+        // only the referenced range is shaded, vertices[0] being minIndex
+        uint minIndex = ~0u, maxIndex = 0;
+        for (int i = 0; i < count; i++)
+        {
+            minIndex = (index(i) < minIndex) ? index(i) : minIndex;
+            maxIndex = (index(i) > maxIndex) ? index(i) : maxIndex;
+        }
+
+        vertices.resize(maxIndex - minIndex + 1);
+        jobs->parallelFor(0, maxIndex - minIndex + 1, 1024, [&](int begin, int end) {
+            float4 attribs[NullGL::MaxAttribs];
+            for (int v = begin; v < end; v++)
+            {
+                for (int a = 0; a < NullGL::MaxAttribs; a++)
+                    attribs[a] = fetch(vao.attribs[a], gl.buffers[vao.attribs[a].buffer].data, v + minIndex + baseVertex);
+                vs.shade(constants, attribs, vertices[v]);
+            }
+        });
+
+        for (int i = 0; i + 2 < count; i += 3)
+        {
+            SoftVertex tri[3] = { vertices[index(i) - minIndex], vertices[index(i+1) - minIndex], vertices[index(i+2) - minIndex] };
+            SoftVertex clipped[6];
+            int n = clipNear(tri, clipped, vs.numVaryings);
+            for (int k = 0; k < n; k++)
+                setupTriangle(clipped + k * 3, draw, vs.numVaryings);
+        }
+    }
+
+    void shadePixel(const Triangle& t, const DrawState& state, const SoftTexture& texture, int x, int y, float e0, float e1, float e2)
+    {
+        float l0 = e0 * t.invArea;
+        float l1 = e1 * t.invArea;
+        float l2 = e2 * t.invArea;
+
+        uint p = y * width + x;
+        float z = l0 * t.z[0] + l1 * t.z[1] + l2 * t.z[2];
+        if (z < 0 || z > 1)
+            return;
+        if (state.depthTest)
+        {
+            float d = depth[p];
+            bool pass = true;
+            switch (state.depthFunc)
+            {
+                case GL_LESS: pass = z < d; break;
+                case GL_LEQUAL: pass = z <= d; break;
+                case GL_GREATER: pass = z > d; break;
+                case GL_GEQUAL: pass = z >= d; break;
+                case GL_EQUAL: pass = z == d; break;
+                case GL_NEVER: pass = false; break;
+            }
+            if (!pass)
+                return;
+        }
+
+        // perspective-correct varyings
+        float invw = l0 * t.invw[0] + l1 * t.invw[1] + l2 * t.invw[2];
+        float w = 1.f / invw;
+        float varyings[SoftMaxVaryings];
+        for (int k = 0; k < state.numVaryings; k++)
+            varyings[k] = (l0 * t.varyings[0][k] + l1 * t.varyings[1][k] + l2 * t.varyings[2][k]) * w;
+
+        float4 out;
+        if (!state.pixelShader(texture, varyings, out))
+            return;
+
+        if (state.depthTest)
+            depth[p] = z;
+
+        uint& dst = colour[p];
+        if (state.blend)
+        {
+            // GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+            float a = fminf(fmaxf(out.w, 0.f), 1.f);
+            float4 d((dst & 0xff) / 255.f, ((dst >> 8) & 0xff) / 255.f, ((dst >> 16) & 0xff) / 255.f, (dst >> 24) / 255.f);
+            out = out * a + d * (1 - a);
+        }
+        auto pack = [](float f) { return (uint)(fminf(fmaxf(f, 0.f), 1.f) * 255.f + 0.5f); };
+        dst = pack(out.x) | (pack(out.y) << 8) | (pack(out.z) << 16) | (pack(out.w) << 24);
+    }
+
+    void rasterizeTile(int tile)
+    {
+        int tx0 = (tile % tilesX) * TileSize;
+        int ty0 = (tile / tilesX) * TileSize;
+        int tx1 = (tx0 + TileSize < width) ? tx0 + TileSize - 1 : width - 1;
+        int ty1 = (ty0 + TileSize < height) ? ty0 + TileSize - 1 : height - 1;
+
+        int lastDraw = -1;
+        SoftTexture texture;
+        for (int index : tiles[tile])
+        {
+            const Triangle& t = triangles[index];
+            const DrawState& state = draws[t.draw];
+            if (t.draw != lastDraw)
+            {
+                lastDraw = t.draw;
+                auto& tex = gl.textures[state.texture];
+                bool rgba8 = state.texture && tex.format == GL_RGBA && tex.type == GL_UNSIGNED_BYTE && tex.data.size();
+                texture.width = tex.width;
+                texture.height = tex.height;
+                texture.data = rgba8 ? &tex.data[0] : nullptr;
+            }
+
+            int minx = (t.minx > tx0) ? t.minx : tx0;
+            int maxx = (t.maxx < tx1) ? t.maxx : tx1;
+            int miny = (t.miny > ty0) ? t.miny : ty0;
+            int maxy = (t.maxy < ty1) ? t.maxy : ty1;
+
+            for (int y = miny; y <= maxy; y++)
+            {
+                float py = y + 0.5f;
+#if SOFTGL_SSE
+                // four pixels per step
+                __m128 px0 = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                __m128 zero = _mm_setzero_ps();
+                __m128 a[3], row[3];
+                for (int e = 0; e < 3; e++)
+                {
+                    a[e] = _mm_set1_ps(t.a[e]);
+                    row[e] = _mm_set1_ps(t.b[e] * py + t.c[e]);
+                }
+                for (int x = minx; x <= maxx; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), px0);
+                    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    __m128 ev[3];
+                    for (int e = 0; e < 3; e++)
+                    {
+                        ev[e] = _mm_add_ps(_mm_mul_ps(a[e], px), row[e]);
+                        inside = _mm_and_ps(inside, t.topLeft[e] ? _mm_cmpge_ps(ev[e], zero) : _mm_cmpgt_ps(ev[e], zero));
+                    }
+                    int mask = _mm_movemask_ps(inside);
+                    if (!mask)
+                        continue;
+
+                    alignas(16) float e0[4], e1[4], e2[4];
+                    _mm_store_ps(e0, ev[0]);
+                    _mm_store_ps(e1, ev[1]);
+                    _mm_store_ps(e2, ev[2]);
+                    for (int i = 0; i < 4 && x + i <= maxx; i++)
+                    {
+                        if (mask & (1 << i))
+                            shadePixel(t, state, texture, x + i, y, e0[i], e1[i], e2[i]);
+                    }
+                }
+#else
+                for (int x = minx; x <= maxx; x++)
+                {
+                    float px = x + 0.5f;
+                    float e[3];
+                    bool inside = true;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        e[k] = t.a[k] * px + t.b[k] * py + t.c[k];
+                        inside = inside && (t.topLeft[k] ? e[k] >= 0 : e[k] > 0);
+                    }
+                    if (inside)
+                        shadePixel(t, state, texture, x, y, e[0], e[1], e[2]);
+                }
+#endif
+            }
+        }
+    }
+
+public:
+    SoftRasterizer(int w, int h, JobSystem* _jobs) :
+        gl(NullGL::get()),
+        jobs(_jobs),
+        width(w),
+        height(h),
+        tilesX((w + TileSize - 1) / TileSize),
+        tilesY((h + TileSize - 1) / TileSize),
+        colour(w * h, 0),
+        depth(w * h, 1.f),
+        tiles(tilesX * tilesY)
+    {
+        gl.keepData = true;
+        gl.setViewport(w, h);
+        gl.onDraw = [this](GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instances, GLint baseVertex) {
+            // no per-instance attributes are emulated, so instanced draws are rasterized once
+            onDraw(mode, count, type, offset, instances, baseVertex);
+        };
+        gl.onClear = [this](GLbitfield mask) { clear(mask); };
+        registerDefaultShaders();
+    }
+    ~SoftRasterizer()
+    {
+        gl.onDraw = nullptr;
+        gl.onClear = nullptr;
+    }
+
+    void registerVertexShader(const string& fname, const SoftVertexShader& vs) { vertexShaders[fname] = vs; }
+    void registerPixelShader(const string& fname, SoftPixelShader ps) { pixelShaders[fname] = ps; }
+    void registerDefaultShaders();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // RGBA8, bottom row first (GL convention)
+    const vector<uint>& getColour() const { return colour; }
+
+    // rasterize everything submitted since the last flush
+    void flush()
+    {
+        if (triangles.size())
+        {
+            PROFILE_SCOPE("softgl flush");
+            jobs->parallelFor(0, tiles.size(), 1, [this](int begin, int end) {
+                for (int i = begin; i < end; i++)
+                    rasterizeTile(i);
+            });
+        }
+        for (auto& t : tiles)
+            t.clear();
+        triangles.clear();
+        draws.clear();
+    }
+
+    void clear(GLbitfield mask)
+    {
+        flush();
+        if (mask & GL_COLOR_BUFFER_BIT)
+        {
+            auto pack = [](float f) { return (uint)(fminf(fmaxf(f, 0.f), 1.f) * 255.f + 0.5f); };
+            uint c = pack(gl.clearColour[0]) | (pack(gl.clearColour[1]) << 8) | (pack(gl.clearColour[2]) << 16) | (pack(gl.clearColour[3]) << 24);
+            fill(colour.begin(), colour.end(), c);
+        }
+        if (mask & GL_DEPTH_BUFFER_BIT)
+        {
+            fill(depth.begin(), depth.end(), 1.f);
+        }
+    }
+
+    bool writePNG(const string& fname)
+    {
+        flush();
+        vector<uint> flipped(width * height);
+        for (int y = 0; y < height; y++)
+            memcpy(&flipped[y * width], &colour[(height - 1 - y) * width], width * 4);
+        return ::writePNG(fname, width, height, &flipped[0]);
+    }
+};
+
+// mesh_vertex: iPos (quantized), iNorm (octahedral), iTex -> vTex (2), vCol (4)
+void softMeshSetup(const SoftUniforms& u, SoftConstants& c)
+{
+    c.m[1] = u.getMatrix("World");
+    c.m[0] = c.m[1] * u.getMatrix("View") * u.getMatrix("Proj");
+    c.v[0] = u.getFloat4("Colour");
+    c.v[1] = u.getFloat4("PosScale");
+    c.v[2] = u.getFloat4("PosOffset", float4(0, 0, 0, 0));
+}
+void softMeshVS(const SoftConstants& c, const float4* a, SoftVertex& out)
+{
+    float3 on(a[1].x, a[1].y, 1 - fabsf(a[1].x) - fabsf(a[1].y));
+    float t = fmaxf(-on.z, 0);
+    on.x += on.x >= 0 ? -t : t;
+    on.y += on.y >= 0 ? -t : t;
+    float4 n = mul(c.m[1], float4(on.x, on.y, on.z, 0));
+    float3 worldNorm(n.x, n.y, n.z);
+    float3 lightDir(-1, -3, 2);
+    float d = dot(normalize(-lightDir), normalize(worldNorm));
+
+    float3 p(a[0].x * c.v[1].x + c.v[2].x, a[0].y * c.v[1].y + c.v[2].y, a[0].z * c.v[1].z + c.v[2].z);
+    out.position = mul(c.m[0], float4(p.x, p.y, p.z, 1));
+    out.varyings[0] = a[2].x;
+    out.varyings[1] = a[2].y;
+    out.varyings[2] = c.v[0].x * d;
+    out.varyings[3] = c.v[0].y * d;
+    out.varyings[4] = c.v[0].z * d;
+    out.varyings[5] = c.v[0].w;
+}
+bool softMeshPS(const SoftTexture& t, const float* v, float4& out)
+{
+    out = float4(v[2], v[3], v[4], v[5]);
+    return true;
+}
+
+// animated_mesh_vertex: as mesh_vertex, skinned by iBoneIndices and
+// iBoneWeights with the Bones block (three columns a bone)
+void softSkinnedSetup(const SoftUniforms& u, SoftConstants& c)
+{
+    softMeshSetup(u, c);
+    c.block = u.getBlock("Bones", c.blockSize);
+}
+void softSkinnedVS(const SoftConstants& c, const float4* a, SoftVertex& out)
+{
+    float3 on(a[1].x, a[1].y, 1 - fabsf(a[1].x) - fabsf(a[1].y));
+    float t = fmaxf(-on.z, 0);
+    on.x += on.x >= 0 ? -t : t;
+    on.y += on.y >= 0 ? -t : t;
+    float4 pos(a[0].x * c.v[1].x + c.v[2].x, a[0].y * c.v[1].y + c.v[2].y, a[0].z * c.v[1].z + c.v[2].z, 1);
+    float4 norm(on.x, on.y, on.z, 0);
+
+    float4 p(0, 0, 0, 1), n(0, 0, 0, 0);
+    for (int i = 0; i < 4; i++)
+    {
+        uint b = (uint)a[3]._x[i] * 3;
+        float w = a[4]._x[i];
+        if (!c.block || b + 3 > c.blockSize)
+            continue;
+        p += float4(dot(c.block[b], pos), dot(c.block[b + 1], pos), dot(c.block[b + 2], pos), 0) * w;
+        n += float4(dot(c.block[b], norm), dot(c.block[b + 1], norm), dot(c.block[b + 2], norm), 0) * w;
+    }
+
+    float4 wn = mul(c.m[1], n);
+    float3 lightDir(-1, -3, 2);
+    float d = dot(normalize(-lightDir), normalize(float3(wn.x, wn.y, wn.z)));
+
+    out.position = mul(c.m[0], p);
+    out.varyings[0] = a[2].x;
+    out.varyings[1] = a[2].y;
+    out.varyings[2] = c.v[0].x * d;
+    out.varyings[3] = c.v[0].y * d;
+    out.varyings[4] = c.v[0].z * d;
+    out.varyings[5] = c.v[0].w;
+}
+
+// sprite_vertex: iPos, iTex, iCol -> vTex (2), vCol (4)
+void softSpriteSetup(const SoftUniforms& u, SoftConstants& c)
+{
+    c.m[0] = u.getMatrix("View") * u.getMatrix("Proj");
+}
+void softSpriteVS(const SoftConstants& c, const float4* a, SoftVertex& out)
+{
+    out.position = mul(c.m[0], float4(a[0].x, a[0].y, 1, 1));
+    out.varyings[0] = a[1].x;
+    out.varyings[1] = a[1].y;
+    out.varyings[2] = a[2].x;
+    out.varyings[3] = a[2].y;
+    out.varyings[4] = a[2].z;
+    out.varyings[5] = a[2].w;
+}
+bool softSpritePS(const SoftTexture& t, const float* v, float4& out)
+{
+    out = t.sample(v[0], v[1]) * float4(v[2], v[3], v[4], v[5]);
+    return true;
+}
+bool softFontPS(const SoftTexture& t, const float* v, float4& out)
+{
+    float4 samp = t.sample(v[0], 1 - v[1]);
+    if (samp.x < 0.5f)
+        return false;
+    out = samp * float4(v[2], v[3], v[4], v[5]);
+    return true;
+}
+
+void SoftRasterizer::registerDefaultShaders()
+{
+    registerVertexShader("meshvs.glsl", { softMeshSetup, softMeshVS, 6 });
+    registerVertexShader("skinnedvs.glsl", { softSkinnedSetup, softSkinnedVS, 6 });
+    registerVertexShader("spritevs.glsl", { softSpriteSetup, softSpriteVS, 6 });
+    registerPixelShader("meshps.glsl", softMeshPS);
+    registerPixelShader("spriteps.glsl", softSpritePS);
+    registerPixelShader("fontps.glsl", softFontPS);
+}
+
+#endif
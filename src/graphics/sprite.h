@@ -8,6 +8,8 @@ class Sprite
 {
     static const uint MaxQuads = 1024;
 
+    ShaderManager* shaders;
+    ShaderManager::Handle defaultHandle, fontHandle;
     Shader* defaultShader = nullptr;
     Shader* fontShader = nullptr;
 
@@ -30,10 +32,12 @@ public:
     Sprite(const Sprite&) = delete;
     Sprite& operator = (const Sprite&) = delete;
 
-    Sprite(ShaderManager* shaders)
+    Sprite(ShaderManager* _shaders) : shaders(_shaders)
     {
-        defaultShader = shaders->getShader("spritevs.glsl", "spriteps.glsl");
-        fontShader = shaders->getShader("spritevs.glsl", "fontps.glsl");
+        defaultHandle = shaders->acquireShader("spritevs.glsl", "spriteps.glsl");
+        fontHandle = shaders->acquireShader("spritevs.glsl", "fontps.glsl");
+        defaultShader = shaders->getShader(defaultHandle);
+        fontShader = shaders->getShader(fontHandle);
 
         posBuf = new Buffer();
         texBuf = new Buffer();
@@ -48,6 +52,8 @@ public:
         delete colBuf;
         delete indexBuf;
         delete array;
+        shaders->releaseShader(defaultHandle);
+        shaders->releaseShader(fontHandle);
     }
     void drawText(SpriteFont* font, const string& text, const float2& pos, const float2& scale={1,1}, const float4& color={1,1,1,1}, Shader* shader=nullptr)
     {
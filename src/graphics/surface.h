@@ -11,23 +11,53 @@ public:
 
     GLuint frameBuffer = 0;
     GLuint texture = 0;
+    GLuint depthTexture = 0;
+    uint depthLevels = 0;
 
-    Surface(uint w, uint h, GLenum iformat=GL_RGBA8)
+    // iformat GL_NONE leaves out the colour texture; a depthFormat adds a depth
+    // texture with depthLevels mip levels, each half the size of the last
+    Surface(uint w, uint h, GLenum iformat=GL_RGBA8, GLenum depthFormat=GL_NONE, uint levels=1)
     {
         width = w;
         height = h;
 
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, iformat, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
         glGenFramebuffers(1, &frameBuffer);
         glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0);
-        GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0 };
-        glDrawBuffers(1, drawBuffers);
+
+        if (iformat != GL_NONE)
+        {
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, iformat, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0);
+            GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0 };
+            glDrawBuffers(1, drawBuffers);
+        }
+        else
+        {
+            GLenum drawBuffers[] = { GL_NONE };
+            glDrawBuffers(1, drawBuffers);
+            glReadBuffer(GL_NONE);
+        }
+
+        if (depthFormat != GL_NONE)
+        {
+            depthLevels = levels;
+            glGenTextures(1, &depthTexture);
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            for (uint l = 0; l < levels; l++)
+            {
+                uint lw = (width >> l) ? width >> l : 1, lh = (height >> l) ? height >> l : 1;
+                glTexImage2D(GL_TEXTURE_2D, l, depthFormat, lw, lh, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+        }
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         GLint dims[4] = { 0 };
@@ -38,6 +68,7 @@ public:
     ~Surface()
     {
         glDeleteTextures(1, &texture);
+        glDeleteTextures(1, &depthTexture);
         glDeleteFramebuffers(1, &frameBuffer);
     }
     void bind()
@@ -45,6 +76,13 @@ public:
         glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
         glViewport(0, 0, width, height);
     }
+    // renders into one level of the depth texture
+    void bindDepth(uint level)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, level);
+        glViewport(0, 0, (width >> level) ? width >> level : 1, (height >> level) ? height >> level : 1);
+    }
     void unbind()
     {
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
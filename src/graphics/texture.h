@@ -4,6 +4,7 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include "../definitions.h"
+#include "../assets.h"
 
 struct Texture
 {
@@ -30,8 +31,16 @@ struct SpriteChar
 };
 struct SpriteFont
 {
-    Texture* texture;
+    Texture* texture = nullptr;
     SpriteChar chars[256];
+
+    SpriteFont() = default;
+    SpriteFont(const SpriteFont&) = delete;
+    SpriteFont& operator=(const SpriteFont&) = delete;
+    ~SpriteFont()
+    {
+        delete texture;
+    }
 };
 
 void getTextureSize(GLuint tex, int& w, int& h)
@@ -46,9 +55,9 @@ class TextureManager
 {
     string baseDir;
     string fontDir;
-    map<string, Texture*> textures;
-    map<string, Texture*> cubetextures;
-    map<string, SpriteFont*> fonts;
+    AssetRegistry<Texture> textures;
+    AssetRegistry<Texture> cubetextures;    // by their six names, joined with '&'
+    AssetRegistry<SpriteFont> fonts;
 
     void loadFontChars(const string& fname, SpriteChar (&chars)[256])
     {
@@ -132,73 +141,91 @@ class TextureManager
         return 0;
     }
 
-public:
-    TextureManager(const string& dir=string(RESOURCE_BASE)+"/textures", const string& fdir=string(RESOURCE_BASE)+"/fonts") : baseDir(dir), fontDir(fdir) {}
-    Texture* getTexture(const string& fname)
+    Texture* createTexture(const string& fname)
     {
-        cout << "loading texture" << fname << endl;
-        auto tex = textures.find(fname);
-        if (tex == textures.end())
-        {
-            Texture* texture = new Texture();
-            texture->texture = loadTexture(baseDir + "/" + fname);
-            getTextureSize(texture->texture, texture->width, texture->height);
-            cout << "    size: " << texture->width << "x" << texture->height << endl;
-            textures[fname] = texture;
-            return texture;
-        }
-        else
+        cout << "loading texture: " << fname << endl;
+        Texture* texture = new Texture();
+        texture->texture = loadTexture(baseDir + "/" + fname);
+        getTextureSize(texture->texture, texture->width, texture->height);
+        cout << "    size: " << texture->width << "x" << texture->height << endl;
+        return texture;
+    }
+    Texture* createCubeTexture(const string& key)
+    {
+        cout << "loading cube map: " << key << endl;
+        string fnames[6];
+        vector<string> names;
+        split(key, '&', names);
+        for (uint i = 0; i < names.size() && i < 6; i++)
         {
-            cout << "    using cache" << endl;
-            return tex->second;
+            fnames[i] = names[i];
         }
+        Texture* texture = new Texture();
+        texture->texture = loadCubeTexture(fnames);
+        return texture;
     }
-    Texture* getCubeTexture(const string (&fnames)[6])
+    SpriteFont* createFont(const string& fname)
     {
-        cout << "loading cube map: " << fnames[0] << " (etc)" << endl;
+        cout << "loading font: " << fname << endl;
+        SpriteFont* font = new SpriteFont();
+        font->texture = new Texture();
+        font->texture->texture = loadTexture(fontDir + "/" + fname + ".png");
+        getTextureSize(font->texture->texture, font->texture->width, font->texture->height);
+        cout << "    size: " << font->texture->width << "x" << font->texture->height << endl;
+        loadFontChars(fontDir + "/" + fname + ".txt", font->chars);
+        return font;
+    }
+
+public:
+    typedef AssetRegistry<Texture>::Handle Handle;
+    typedef AssetRegistry<SpriteFont>::Handle FontHandle;
 
+    TextureManager(const string& dir=string(RESOURCE_BASE)+"/textures", const string& fdir=string(RESOURCE_BASE)+"/fonts") :
+        baseDir(dir), fontDir(fdir),
+        textures([this](const string& fname) { return createTexture(fname); }),
+        cubetextures([this](const string& key) { return createCubeTexture(key); }),
+        fonts([this](const string& fname) { return createFont(fname); }) {}
+
+    Handle acquireTexture(const string& fname) { return textures.acquire(fname); }
+    void releaseTexture(Handle h) { textures.release(h); }
+    Texture* getTexture(Handle h) const { return textures.get(h); }
+
+    FontHandle acquireFont(const string& fname) { return fonts.acquire(fname); }
+    void releaseFont(FontHandle h) { fonts.release(h); }
+    SpriteFont* getFont(FontHandle h) const { return fonts.get(h); }
+
+    // these take a reference that is never released, so the asset stays loaded
+    Texture* getTexture(const string& fname)
+    {
+        return getTexture(acquireTexture(fname));
+    }
+    Texture* getCubeTexture(const string (&fnames)[6])
+    {
         string key = fnames[0]+"&"+
                      fnames[1]+"&"+
                      fnames[2]+"&"+
                      fnames[3]+"&"+
                      fnames[4]+"&"+
                      fnames[5];
-
-        auto tex = cubetextures.find(key);
-        if (tex == textures.end())
-        {
-            Texture* texture = new Texture();
-            texture->texture = loadCubeTexture(fnames);
-            textures[key] = texture;
-            return texture;
-        }
-        else
-        {
-            cout << "    using cached" << endl;
-            return tex->second;
-        }
+        return cubetextures.get(cubetextures.acquire(key));
     }
     SpriteFont* getFont(const string& fname)
     {
-        cout << "loading font: " << fname << endl;
+        return getFont(acquireFont(fname));
+    }
 
-        auto fontiter = fonts.find(fname);
-        if (fontiter == fonts.end())
-        {
-            SpriteFont* font = new SpriteFont();
-            font->texture = new Texture();
-            font->texture->texture = loadTexture(fontDir + "/" + fname + ".png");
-            getTextureSize(font->texture->texture, font->texture->width, font->texture->height);
-            cout << "    size: " << font->texture->width << "x" << font->texture->height << endl;
-            loadFontChars(fontDir + "/" + fname + ".txt", font->chars);
-            fonts[fname] = font;
-            return font;
-        }
-        else
-        {
-            cout << "    using cache" << endl;
-            return fontiter->second;
-        }
+    // unloads textures and fonts released a while ago; once a frame
+    void collect()
+    {
+        textures.collect();
+        cubetextures.collect();
+        fonts.collect();
+    }
+    void printStats() const
+    {
+        textures.printStats("textures");
+        cubetextures.printStats("cube maps");
+        fonts.printStats("fonts");
     }
 };
 
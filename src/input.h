@@ -0,0 +1,168 @@
+#ifndef _CUBE_INPUT_H
+#define _CUBE_INPUT_H
+
+#include "definitions.h"
+#include "math3d.h"
+
+struct InputEvent
+{
+    enum Type : uchar { Key, MouseButton, MouseMove, Scroll };
+
+    Type type;
+    uchar action = 0;   // GLFW_PRESS / GLFW_RELEASE / GLFW_REPEAT
+    short code = 0;     // key or mouse button
+    float2 value;       // cursor position or scroll offset
+    double time = 0;    // glfwGetTime() when the callback ran
+};
+
+// lock-free single producer / single consumer ring
+// the GLFW callbacks produce, Input::update consumes
+template<typename T, uint Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    T items[Capacity];
+    alignas(64) atomic<uint> head { 0 }; // next write
+    alignas(64) atomic<uint> tail { 0 }; // next read
+
+public:
+    bool push(const T& item)
+    {
+        uint h = head.load(memory_order_relaxed);
+        if (h - tail.load(memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        items[h & (Capacity - 1)] = item;
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+    bool pop(T& item)
+    {
+        uint t = tail.load(memory_order_relaxed);
+        if (t == head.load(memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[t & (Capacity - 1)];
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+};
+
+class Input
+{
+    friend class Game;
+
+    typedef bitset<GLFW_KEY_LAST + 1> KeySet;
+    typedef bitset<GLFW_MOUSE_BUTTON_LAST + 1> ButtonSet;
+
+    SpscQueue<InputEvent, 1024> queue;
+    atomic<uint> dropped { 0 };
+
+    // state at the end of the previous and current frame
+    KeySet oldKeys, newKeys;
+    ButtonSet oldMouse, newMouse;
+    // edges for this frame, including keys pressed and released between two updates
+    KeySet keysPressed, keysReleased;
+    ButtonSet mouseButtonsPressed, mouseButtonsReleased;
+
+    float2 oldMousePos;
+    float2 newMousePos;
+    float2 frameScroll;
+
+    vector<InputEvent> frameEvents;
+
+    template<typename Set>
+    static void applyButton(const InputEvent& e, Set& down, Set& pressedEvents, Set& releasedEvents)
+    {
+        if (e.code < 0 || e.code >= (int)down.size())
+            return;
+        if (e.action == GLFW_PRESS)
+        {
+            down.set(e.code);
+            pressedEvents.set(e.code);
+        }
+        else if (e.action == GLFW_RELEASE)
+        {
+            down.reset(e.code);
+            releasedEvents.set(e.code);
+        }
+    }
+
+public:
+    // called from the GLFW callbacks, possibly on another thread
+    void push(const InputEvent& e)
+    {
+        if (!queue.push(e))
+        {
+            dropped.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    bool keyPressed(int key)    const { return keysPressed.test(key); }
+    bool keyReleased(int key)   const { return keysReleased.test(key); }
+    bool keyDown(int key)       const { return newKeys.test(key); }
+    bool mousePressed(int but)  const { return mouseButtonsPressed.test(but); }
+    bool mouseReleased(int but) const { return mouseButtonsReleased.test(but); }
+    bool mouseDown(int but)     const { return newMouse.test(but); }
+    float2 mousePos()   const { return newMousePos; }
+    float2 mouseMove()  const { return newMousePos - oldMousePos; }
+    float2 scroll()     const { return frameScroll; }
+
+    // every event consumed by the last update(), in arrival order
+    const vector<InputEvent>& events() const { return frameEvents; }
+
+    void update()
+    {
+        oldKeys = newKeys;
+        oldMouse = newMouse;
+        oldMousePos = newMousePos;
+        frameScroll = float2();
+        frameEvents.clear();
+
+        KeySet keyPressEvents, keyReleaseEvents;
+        ButtonSet mousePressEvents, mouseReleaseEvents;
+
+        InputEvent e;
+        while (queue.pop(e))
+        {
+            switch (e.type)
+            {
+                case InputEvent::Key:
+                    applyButton(e, newKeys, keyPressEvents, keyReleaseEvents);
+                    break;
+                case InputEvent::MouseButton:
+                    applyButton(e, newMouse, mousePressEvents, mouseReleaseEvents);
+                    break;
+                case InputEvent::MouseMove:
+                    newMousePos = e.value;
+                    break;
+                case InputEvent::Scroll:
+                    frameScroll += e.value;
+                    break;
+            }
+            frameEvents.push_back(e);
+        }
+
+        // edges from the state change, plus taps that went down and up within the frame
+        KeySet keyChanged = oldKeys ^ newKeys;
+        KeySet keyTapped = keyPressEvents & keyReleaseEvents;
+        keysPressed = (keyChanged & newKeys) | keyTapped;
+        keysReleased = (keyChanged & oldKeys) | keyTapped;
+
+        ButtonSet mouseChanged = oldMouse ^ newMouse;
+        ButtonSet mouseTapped = mousePressEvents & mouseReleaseEvents;
+        mouseButtonsPressed = (mouseChanged & newMouse) | mouseTapped;
+        mouseButtonsReleased = (mouseChanged & oldMouse) | mouseTapped;
+
+        uint lost = dropped.exchange(0, memory_order_relaxed);
+        if (lost)
+        {
+            cout << "input: event queue full, dropped " << lost << " events" << endl;
+        }
+    }
+};
+
+#endif
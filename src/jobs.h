@@ -0,0 +1,331 @@
+#ifndef _CUBE_JOBS_H
+#define _CUBE_JOBS_H
+
+#include "definitions.h"
+
+// counts outstanding jobs; pass the same counter to several run() calls
+// and wait() on it to express a dependency on all of them
+struct JobCounter
+{
+    atomic<int> count { 0 };
+
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator = (const JobCounter&) = delete;
+
+    bool done() const { return count.load(memory_order_acquire) == 0; }
+};
+
+struct Job
+{
+    typedef void(*Function)(void* data, int begin, int end);
+
+    Function function = nullptr;
+    void* data = nullptr;
+    int begin = 0;
+    int end = 0;
+    JobCounter* counter = nullptr;
+};
+
+// work-stealing scheduler
+// every thread (workers + the thread that created the system) owns a deque:
+// the owner pushes and pops at the bottom, idle threads steal from the top.
+// only the owning thread and the pool's workers may call run/parallelFor/wait
+class JobSystem
+{
+    // Chase-Lev deque with a fixed capacity
+    // a full queue makes run() execute the job inline instead
+    class WorkQueue
+    {
+        static const int64_t Capacity = 4096;
+        static const int64_t Mask = Capacity - 1;
+
+        alignas(64) atomic<int64_t> top { 0 };
+        alignas(64) atomic<int64_t> bottom { 0 };
+        Job jobs[Capacity];
+
+    public:
+        bool push(const Job& job)
+        {
+            int64_t b = bottom.load(memory_order_relaxed);
+            int64_t t = top.load(memory_order_acquire);
+            if (b - t >= Capacity)
+            {
+                return false;
+            }
+
+            jobs[b & Mask] = job;
+            atomic_thread_fence(memory_order_release);
+            bottom.store(b + 1, memory_order_relaxed);
+            return true;
+        }
+        bool pop(Job& job)
+        {
+            int64_t b = bottom.load(memory_order_relaxed) - 1;
+            bottom.store(b, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            int64_t t = top.load(memory_order_relaxed);
+
+            if (t > b)
+            {
+                // empty
+                bottom.store(b + 1, memory_order_relaxed);
+                return false;
+            }
+
+            job = jobs[b & Mask];
+            if (t == b)
+            {
+                // last job: race against thieves for it
+                bool won = top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+                bottom.store(b + 1, memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+        bool steal(Job& job)
+        {
+            int64_t t = top.load(memory_order_acquire);
+            atomic_thread_fence(memory_order_seq_cst);
+            int64_t b = bottom.load(memory_order_acquire);
+
+            if (t >= b)
+            {
+                return false;
+            }
+
+            job = jobs[t & Mask];
+            return top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+        }
+        bool empty() const
+        {
+            return top.load(memory_order_relaxed) >= bottom.load(memory_order_relaxed);
+        }
+    };
+
+    vector<WorkQueue*> queues;
+    vector<thread> workers;
+    atomic<bool> running { true };
+
+    // sleeping workers are woken when new work is pushed
+    mutex sleepMutex;
+    condition_variable sleepCondition;
+    atomic<int> sleeping { 0 };
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator = (const JobSystem&) = delete;
+
+    static int& threadIndex()
+    {
+        // -1 for threads that don't belong to any JobSystem
+        static thread_local int index = -1;
+        return index;
+    }
+
+    void execute(const Job& job)
+    {
+        job.function(job.data, job.begin, job.end);
+        if (job.counter)
+        {
+            job.counter->count.fetch_sub(1, memory_order_release);
+        }
+    }
+
+    void submit(const Job& job)
+    {
+        int index = threadIndex();
+        assert(index >= 0 && index < (int)queues.size() && "run() called from a foreign thread");
+
+        if (job.counter)
+        {
+            job.counter->count.fetch_add(1, memory_order_relaxed);
+        }
+        if (!queues[index]->push(job))
+        {
+            execute(job);
+            return;
+        }
+        if (sleeping.load(memory_order_relaxed) > 0)
+        {
+            sleepCondition.notify_one();
+        }
+    }
+
+    bool findJob(Job& job)
+    {
+        int index = threadIndex();
+        if (queues[index]->pop(job))
+        {
+            return true;
+        }
+
+        // start stealing from the next queue along so thieves spread out
+        int n = queues.size();
+        for (int i = 1; i < n; i++)
+        {
+            if (queues[(index + i) % n]->steal(job))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool anyWork()
+    {
+        for (auto q : queues)
+        {
+            if (!q->empty())
+                return true;
+        }
+        return false;
+    }
+
+    void workerLoop(int index)
+    {
+        threadIndex() = index;
+
+        Job job;
+        int idle = 0;
+        while (running.load(memory_order_relaxed))
+        {
+            if (findJob(job))
+            {
+                execute(job);
+                idle = 0;
+                continue;
+            }
+
+            // spin briefly before going to sleep, jobs tend to arrive in bursts
+            if (++idle < 64)
+            {
+                this_thread::yield();
+                continue;
+            }
+
+            unique_lock<mutex> lock(sleepMutex);
+            sleeping++;
+            sleepCondition.wait_for(lock, chrono::milliseconds(1), [this] {
+                return !running.load(memory_order_relaxed) || anyWork();
+            });
+            sleeping--;
+        }
+    }
+
+    template<typename Function>
+    static void invokeRange(void* data, int begin, int end)
+    {
+        (*(Function*)data)(begin, end);
+    }
+    template<typename Function>
+    static void invoke(void* data, int, int)
+    {
+        (*(Function*)data)();
+    }
+
+public:
+    // numThreads is the number of extra worker threads;
+    // the calling thread also executes jobs while it waits
+    JobSystem(int numThreads = -1)
+    {
+        if (numThreads < 0)
+        {
+            numThreads = (int)thread::hardware_concurrency() - 1;
+        }
+        numThreads = (numThreads < 0) ? 0 : numThreads;
+
+        threadIndex() = 0;
+        for (int i = 0; i < numThreads + 1; i++)
+        {
+            queues.push_back(new WorkQueue());
+        }
+        for (int i = 0; i < numThreads; i++)
+        {
+            workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+        }
+    }
+    ~JobSystem()
+    {
+        running = false;
+        sleepCondition.notify_all();
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+        for (auto q : queues)
+        {
+            delete q;
+        }
+        threadIndex() = -1;
+    }
+
+    // total threads that execute jobs, including the owning thread
+    int numThreads() const { return queues.size(); }
+
+    // index of the calling thread in [0, numThreads()), for per-thread scratch data
+    int currentThread() const { return threadIndex(); }
+
+    // run a raw job; data must outlive the job
+    void run(Job::Function function, void* data, JobCounter* counter = nullptr, int begin = 0, int end = 0)
+    {
+        Job job;
+        job.function = function;
+        job.data = data;
+        job.begin = begin;
+        job.end = end;
+        job.counter = counter;
+        submit(job);
+    }
+
+    // run a callable; the callable is referenced, not copied,
+    // so it must stay alive until wait(counter) returns
+    template<typename Function>
+    void run(Function& function, JobCounter* counter)
+    {
+        run(&invoke<Function>, (void*)&function, counter);
+    }
+
+    // call function(begin, end) over [first, last) in chunks of at most grain
+    // and wait for all of them to finish
+    template<typename Function>
+    void parallelFor(int first, int last, int grain, const Function& function)
+    {
+        if (last <= first)
+        {
+            return;
+        }
+        grain = (grain < 1) ? 1 : grain;
+        if (last - first <= grain || queues.size() == 1)
+        {
+            function(first, last);
+            return;
+        }
+
+        JobCounter counter;
+        for (int i = first; i < last; i += grain)
+        {
+            int end = (i + grain < last) ? (i + grain) : last;
+            run(&invokeRange<const Function>, (void*)&function, &counter, i, end);
+        }
+        wait(&counter);
+    }
+
+    // returns when the counter reaches zero, running other jobs in the meantime
+    void wait(JobCounter* counter)
+    {
+        Job job;
+        while (!counter->done())
+        {
+            if (findJob(job))
+            {
+                execute(job);
+            }
+            else
+            {
+                this_thread::yield();
+            }
+        }
+    }
+};
+
+#endif
@@ -469,10 +469,10 @@ matrix operator * (const matrix& m1, const matrix& m2)
 matrix transpose(const matrix& m)
 {
     return {{
-        m.m[0], m.m[1], m.m[2], m.m[3],
-        m.m[4], m.m[5], m.m[6], m.m[7],
-        m.m[8], m.m[9], m.m[10],m.m[11],
-        m.m[12],m.m[13],m.m[14],m.m[15],
+        m.m[0], m.m[4], m.m[8], m.m[12],
+        m.m[1], m.m[5], m.m[9], m.m[13],
+        m.m[2], m.m[6], m.m[10],m.m[14],
+        m.m[3], m.m[7], m.m[11],m.m[15],
     }};
 }
 
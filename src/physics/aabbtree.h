@@ -0,0 +1,752 @@
+#ifndef _CUBE_PHYSICS_AABBTREE_H
+#define _CUBE_PHYSICS_AABBTREE_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../collision.h"
+#include "../jobs.h"
+#include "broadphase.h"
+
+// dynamic bounding volume hierarchy over boxes
+//
+// every object is a leaf holding a fat box: its bounds grown by a margin,
+// so objects that move a little don't touch the tree at all. inserts pick a
+// sibling by surface area cost and rotations keep the tree height balanced.
+// nodes live in one flat array and are recycled through a free list.
+// handles are leaf node indices and stay valid until the object is removed
+// (or the tree is rebuilt with build())
+class AabbTree
+{
+public:
+    typedef int Handle;
+    static const int Null = -1;
+
+private:
+    struct Node
+    {
+        float3 lo, hi;
+        int parent = Null;      // next free node while on the free list
+        int child[2] = { Null, Null };
+        int height = 0;         // 0 for leaves, -1 for free nodes
+        uint userData = 0;
+
+        bool leaf() const { return child[0] == Null; }
+    };
+
+    // traversal stack: inline for any sane depth, spills to the heap otherwise
+    struct Stack
+    {
+        int items[128];
+        vector<int> spill;
+        int size = 0;
+
+        bool empty() const { return size == 0 && spill.empty(); }
+        void push(int i)
+        {
+            if (size < (int)arraylen(items))
+                items[size++] = i;
+            else
+                spill.push_back(i);
+        }
+        int pop()
+        {
+            if (spill.size())
+            {
+                int i = spill.back();
+                spill.pop_back();
+                return i;
+            }
+            return items[--size];
+        }
+    };
+
+    vector<Node> nodes;
+    int root = Null;
+    int freeList = Null;
+    int leafCount = 0;
+    float margin;
+
+    static float area(const float3& lo, const float3& hi)
+    {
+        float3 d = hi - lo;
+        return d.x*d.y + d.y*d.z + d.z*d.x;
+    }
+    static float3 lower(const float3& a, const float3& b)
+    {
+        return float3(fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z));
+    }
+    static float3 upper(const float3& a, const float3& b)
+    {
+        return float3(fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z));
+    }
+    static float mergedArea(const Node& a, const float3& lo, const float3& hi)
+    {
+        return area(lower(a.lo, lo), upper(a.hi, hi));
+    }
+    static bool contains(const Node& n, const float3& lo, const float3& hi)
+    {
+        return n.lo.x <= lo.x && n.lo.y <= lo.y && n.lo.z <= lo.z
+            && n.hi.x >= hi.x && n.hi.y >= hi.y && n.hi.z >= hi.z;
+    }
+    static Box toBox(const Node& n)
+    {
+        return Box((n.lo + n.hi) * 0.5f, (n.hi - n.lo) * 0.5f);
+    }
+
+    void refit(int i)
+    {
+        Node& n = nodes[i];
+        const Node& a = nodes[n.child[0]];
+        const Node& b = nodes[n.child[1]];
+        n.lo = lower(a.lo, b.lo);
+        n.hi = upper(a.hi, b.hi);
+        n.height = 1 + (a.height > b.height ? a.height : b.height);
+    }
+
+    int allocNode()
+    {
+        if (freeList == Null)
+        {
+            nodes.push_back(Node());
+            return nodes.size() - 1;
+        }
+        int i = freeList;
+        freeList = nodes[i].parent;
+        nodes[i] = Node();
+        return i;
+    }
+    void freeNode(int i)
+    {
+        nodes[i].parent = freeList;
+        nodes[i].height = -1;
+        freeList = i;
+    }
+
+    void replaceChild(int parent, int oldChild, int newChild)
+    {
+        if (parent == Null)
+        {
+            root = newChild;
+        }
+        else
+        {
+            Node& p = nodes[parent];
+            p.child[p.child[0] == oldChild ? 0 : 1] = newChild;
+        }
+    }
+
+    // if one side is more than one level taller, rotate its taller grandchild up
+    // returns the node now at i's place in the tree
+    int balance(int iA)
+    {
+        Node& A = nodes[iA];
+        if (A.leaf() || A.height < 2)
+        {
+            return iA;
+        }
+
+        int diff = nodes[A.child[1]].height - nodes[A.child[0]].height;
+        if (diff > -2 && diff < 2)
+        {
+            return iA;
+        }
+
+        // B is the taller child, moving up into A's place; A keeps its other child
+        int side = (diff > 0) ? 1 : 0;
+        int iB = A.child[side];
+        Node& B = nodes[iB];
+        int iX = B.child[0], iY = B.child[1];
+
+        B.parent = A.parent;
+        replaceChild(B.parent, iA, iB);
+        B.child[0] = iA;
+        A.parent = iB;
+
+        // B keeps its taller child, A takes the shorter one
+        if (nodes[iX].height > nodes[iY].height)
+        {
+            int t = iX;
+            iX = iY;
+            iY = t;
+        }
+        B.child[1] = iY;
+        A.child[side] = iX;
+        nodes[iX].parent = iA;
+
+        refit(iA);
+        refit(iB);
+        return iB;
+    }
+
+    void insertLeaf(int leaf)
+    {
+        leafCount++;
+        if (root == Null)
+        {
+            root = leaf;
+            nodes[leaf].parent = Null;
+            return;
+        }
+
+        // descend towards the sibling with the lowest surface area cost:
+        // pairing with node i costs the merged box, and every ancestor grows
+        float3 lo = nodes[leaf].lo, hi = nodes[leaf].hi;
+        int i = root;
+        while (!nodes[i].leaf())
+        {
+            const Node& n = nodes[i];
+            float merged = mergedArea(n, lo, hi);
+            float cost = 2.0f * merged;
+            float inheritance = 2.0f * (merged - area(n.lo, n.hi));
+
+            float childCost[2];
+            for (int c = 0; c < 2; c++)
+            {
+                const Node& child = nodes[n.child[c]];
+                childCost[c] = mergedArea(child, lo, hi) + inheritance;
+                if (!child.leaf())
+                {
+                    childCost[c] -= area(child.lo, child.hi);
+                }
+            }
+
+            if (cost < childCost[0] && cost < childCost[1])
+                break;
+            i = n.child[childCost[0] < childCost[1] ? 0 : 1];
+        }
+
+        int sibling = i;
+        int oldParent = nodes[sibling].parent;
+        int parent = allocNode();
+        Node& p = nodes[parent];
+        p.parent = oldParent;
+        p.child[0] = sibling;
+        p.child[1] = leaf;
+        replaceChild(oldParent, sibling, parent);
+        nodes[sibling].parent = parent;
+        nodes[leaf].parent = parent;
+
+        fixUpwards(parent);
+    }
+
+    void removeLeaf(int leaf)
+    {
+        leafCount--;
+        if (leaf == root)
+        {
+            root = Null;
+            return;
+        }
+
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].child[nodes[parent].child[0] == leaf ? 1 : 0];
+
+        replaceChild(grandParent, parent, sibling);
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+
+        fixUpwards(grandParent);
+    }
+
+    void fixUpwards(int i)
+    {
+        while (i != Null)
+        {
+            refit(i);
+            i = balance(i);
+            i = nodes[i].parent;
+        }
+    }
+
+    // rayInvDir: see collision.h
+    static bool rayHitsNode(const Node& n, const float3& origin, const float3& inv, float maxDist, float& outDist)
+    {
+        float tmin = 0.0f;
+        float tmax = maxDist;
+        for (int k = 0; k < 3; k++)
+        {
+            float t1 = (n.lo._x[k] - origin._x[k]) * inv._x[k];
+            float t2 = (n.hi._x[k] - origin._x[k]) * inv._x[k];
+            tmin = fmaxf(tmin, fminf(t1, t2));
+            tmax = fminf(tmax, fmaxf(t1, t2));
+        }
+        outDist = tmin;
+        return tmin <= tmax;
+    }
+
+    template<typename Overlaps, typename Callback>
+    void traverse(const Overlaps& overlaps, const Callback& callback) const
+    {
+        if (root == Null)
+        {
+            return;
+        }
+
+        Stack stack;
+        stack.push(root);
+        while (!stack.empty())
+        {
+            const Node& n = nodes[stack.pop()];
+            if (!overlaps(n))
+            {
+                continue;
+            }
+            if (n.leaf())
+            {
+                if (!callback(n.userData))
+                    return;
+            }
+            else
+            {
+                stack.push(n.child[0]);
+                stack.push(n.child[1]);
+            }
+        }
+    }
+
+    // bulk build: top down binned SAH over a range of leaves
+    struct BuildContext
+    {
+        AabbTree* tree;
+        JobSystem* jobs;
+        vector<int> leaves;         // leaf node index per primitive, permuted while partitioning
+        vector<float3> centroids;   // per leaf node
+        vector<Handle>* handles;
+        int firstLeaf;              // leaf node of primitive 0
+    };
+    struct BuildTask
+    {
+        BuildContext* ctx;
+        int node;       // the range's subtree uses nodes [node, node + 2*count - 1)
+        int parent;
+        int begin, end;
+
+        void operator () () const { ctx->tree->buildRange(*ctx, node, parent, begin, end); }
+    };
+
+    static const int BuildBins = 16;
+    static const int ParallelBuildSize = 4096;
+
+    void buildRange(BuildContext& ctx, int node, int parent, int begin, int end)
+    {
+        int count = end - begin;
+        if (count == 1)
+        {
+            // leaves were created up front; move this one into its slot
+            int leaf = ctx.leaves[begin];
+            nodes[node] = nodes[leaf];
+            nodes[node].parent = parent;
+            (*ctx.handles)[leaf - ctx.firstLeaf] = node;
+            return;
+        }
+
+        float3 clo = ctx.centroids[ctx.leaves[begin]], chi = clo;
+        for (int i = begin + 1; i < end; i++)
+        {
+            clo = lower(clo, ctx.centroids[ctx.leaves[i]]);
+            chi = upper(chi, ctx.centroids[ctx.leaves[i]]);
+        }
+        float3 extent = chi - clo;
+        int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+
+        int mid = begin + count / 2;
+        if (extent._x[axis] > 0.0f)
+        {
+            // bin the centroids and take the cheapest of the BuildBins-1 split planes
+            float3 binLo[BuildBins], binHi[BuildBins];
+            int binCount[BuildBins] = {};
+            float scale = BuildBins * 0.9999f / extent._x[axis];
+            auto binOf = [&](int leaf) { return (int)((ctx.centroids[leaf]._x[axis] - clo._x[axis]) * scale); };
+
+            for (int i = begin; i < end; i++)
+            {
+                int leaf = ctx.leaves[i];
+                int b = binOf(leaf);
+                const Node& n = nodes[leaf];
+                binLo[b] = binCount[b] ? lower(binLo[b], n.lo) : n.lo;
+                binHi[b] = binCount[b] ? upper(binHi[b], n.hi) : n.hi;
+                binCount[b]++;
+            }
+
+            float leftArea[BuildBins];
+            int leftCount[BuildBins];
+            float3 lo, hi;
+            int n = 0;
+            for (int b = 0; b < BuildBins - 1; b++)
+            {
+                if (binCount[b])
+                {
+                    lo = n ? lower(lo, binLo[b]) : binLo[b];
+                    hi = n ? upper(hi, binHi[b]) : binHi[b];
+                    n += binCount[b];
+                }
+                leftCount[b] = n;
+                leftArea[b] = n ? area(lo, hi) : 0.0f;
+            }
+
+            float bestCost = INFINITY;
+            int bestSplit = -1;
+            n = 0;
+            for (int b = BuildBins - 1; b > 0; b--)
+            {
+                if (binCount[b])
+                {
+                    lo = n ? lower(lo, binLo[b]) : binLo[b];
+                    hi = n ? upper(hi, binHi[b]) : binHi[b];
+                    n += binCount[b];
+                }
+                if (n == 0 || leftCount[b - 1] == 0)
+                    continue;
+                float cost = leftArea[b - 1] * leftCount[b - 1] + area(lo, hi) * n;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestSplit = b;
+                }
+            }
+
+            if (bestSplit > 0)
+            {
+                mid = partition(ctx.leaves.begin() + begin, ctx.leaves.begin() + end,
+                                [&](int leaf) { return binOf(leaf) < bestSplit; }) - ctx.leaves.begin();
+            }
+        }
+        if (mid == begin || mid == end || extent._x[axis] <= 0.0f)
+        {
+            // coincident centroids: split at the median
+            mid = begin + count / 2;
+            nth_element(ctx.leaves.begin() + begin, ctx.leaves.begin() + mid, ctx.leaves.begin() + end,
+                        [&](int a, int b) { return ctx.centroids[a]._x[axis] < ctx.centroids[b]._x[axis]; });
+        }
+
+        int left = node + 1;
+        int right = node + 2 * (mid - begin);
+        BuildTask rightTask = { &ctx, right, node, mid, end };
+        if (ctx.jobs && count >= ParallelBuildSize)
+        {
+            JobCounter counter;
+            ctx.jobs->run(rightTask, &counter);
+            buildRange(ctx, left, node, begin, mid);
+            ctx.jobs->wait(&counter);
+        }
+        else
+        {
+            buildRange(ctx, left, node, begin, mid);
+            rightTask();
+        }
+
+        Node& n = nodes[node];
+        n.parent = parent;
+        n.child[0] = left;
+        n.child[1] = right;
+        refit(node);
+    }
+
+public:
+    // margin fattens every leaf, trading looser queries for fewer reinserts
+    AabbTree(float _margin = 0.1f) : margin(_margin) {}
+
+    int size() const { return leafCount; }
+    int height() const { return root == Null ? 0 : nodes[root].height; }
+
+    uint getUserData(Handle h) const { return nodes[h].userData; }
+    void setUserData(Handle h, uint userData) { nodes[h].userData = userData; }
+    Box getFatBounds(Handle h) const { return toBox(nodes[h]); }
+
+    Handle insert(const Box& bounds, uint userData)
+    {
+        int leaf = allocNode();
+        Node& n = nodes[leaf];
+        float3 m(margin, margin, margin);
+        n.lo = bounds.centre - bounds.extent - m;
+        n.hi = bounds.centre + bounds.extent + m;
+        n.userData = userData;
+        insertLeaf(leaf);
+        return leaf;
+    }
+    void remove(Handle h)
+    {
+        removeLeaf(h);
+        freeNode(h);
+    }
+    // returns true if the object left its fat box and was reinserted;
+    // displacement (this frame's movement) stretches the new fat box ahead of it
+    bool move(Handle h, const Box& bounds, const float3& displacement = float3())
+    {
+        float3 lo = bounds.centre - bounds.extent;
+        float3 hi = bounds.centre + bounds.extent;
+        if (contains(nodes[h], lo, hi))
+        {
+            return false;
+        }
+
+        removeLeaf(h);
+        float3 m(margin, margin, margin);
+        float3 ahead = displacement * 2.0f;
+        Node& n = nodes[h];
+        n.lo = lower(lo - m, lo - m + ahead);
+        n.hi = upper(hi + m, hi + m + ahead);
+        insertLeaf(h);
+        return true;
+    }
+    void clear()
+    {
+        nodes.clear();
+        root = Null;
+        freeList = Null;
+        leafCount = 0;
+    }
+
+    // replace the contents with boxes[i] (userData[i], or i if userData is empty).
+    // builds top down with binned SAH, which gives a better tree than inserting
+    // one at a time; with a job system the subtrees are built in parallel.
+    // outHandles[i] receives boxes[i]'s handle
+    void build(const vector<Box>& boxes, const vector<uint>& userData, vector<Handle>& outHandles, JobSystem* jobs = nullptr)
+    {
+        clear();
+        int n = boxes.size();
+        outHandles.resize(n);
+        if (n == 0)
+        {
+            return;
+        }
+
+        // a tree over n leaves has 2n-1 nodes; leaves start in the n slots at the end
+        // and are moved into place as the build reaches them
+        nodes.resize(3 * n - 1);
+        BuildContext ctx;
+        ctx.tree = this;
+        ctx.jobs = jobs;
+        ctx.handles = &outHandles;
+        ctx.firstLeaf = 2 * n - 1;
+        ctx.leaves.resize(n);
+        ctx.centroids.resize(nodes.size());
+
+        float3 m(margin, margin, margin);
+        for (int i = 0; i < n; i++)
+        {
+            int leaf = 2 * n - 1 + i;
+            Node& node = nodes[leaf];
+            node.lo = boxes[i].centre - boxes[i].extent - m;
+            node.hi = boxes[i].centre + boxes[i].extent + m;
+            node.userData = userData.size() ? userData[i] : (uint)i;
+            ctx.leaves[i] = leaf;
+            ctx.centroids[leaf] = boxes[i].centre;
+        }
+
+        buildRange(ctx, 0, Null, 0, n);
+
+        nodes.resize(2 * n - 1);
+        root = 0;
+        leafCount = n;
+    }
+
+    // callbacks get the userData of each leaf whose fat box passes the test
+    // and return false to stop the query early
+
+    template<typename Callback>
+    void query(const Box& box, const Callback& callback) const
+    {
+        float3 lo = box.centre - box.extent, hi = box.centre + box.extent;
+        traverse([&](const Node& n) {
+            return n.lo.x <= hi.x && n.hi.x >= lo.x
+                && n.lo.y <= hi.y && n.hi.y >= lo.y
+                && n.lo.z <= hi.z && n.hi.z >= lo.z;
+        }, callback);
+    }
+    template<typename Callback>
+    void query(const Sphere& sphere, const Callback& callback) const
+    {
+        traverse([&](const Node& n) { return intersect(sphere, toBox(n)); }, callback);
+    }
+    template<typename Callback>
+    void query(const Frustum& frustum, const Callback& callback) const
+    {
+        traverse([&](const Node& n) { return intersect(frustum, toBox(n)); }, callback);
+    }
+
+    // callback(userDataA, userDataB) is called once for every two leaves whose fat
+    // boxes overlap, and returns false to stop. one descent of the tree against
+    // itself: subtrees that don't overlap are never paired up again below
+    template<typename Callback>
+    void findPairs(const Callback& callback) const
+    {
+        if (root == Null)
+        {
+            return;
+        }
+
+        // (a, a) stands for the pairs inside subtree a
+        vector<pair<int, int>> stack;
+        stack.push_back({ root, root });
+        while (stack.size())
+        {
+            int a = stack.back().first, b = stack.back().second;
+            stack.pop_back();
+            const Node& na = nodes[a];
+            const Node& nb = nodes[b];
+            if (a == b)
+            {
+                if (!na.leaf())
+                {
+                    stack.push_back({ na.child[0], na.child[1] });
+                    stack.push_back({ na.child[1], na.child[1] });
+                    stack.push_back({ na.child[0], na.child[0] });
+                }
+                continue;
+            }
+
+            if (na.lo.x > nb.hi.x || na.hi.x < nb.lo.x
+                || na.lo.y > nb.hi.y || na.hi.y < nb.lo.y
+                || na.lo.z > nb.hi.z || na.hi.z < nb.lo.z)
+            {
+                continue;
+            }
+            if (na.leaf() && nb.leaf())
+            {
+                if (!callback(na.userData, nb.userData))
+                    return;
+            }
+            // split the bigger node, so the boxes being paired stay about the same size
+            else if (nb.leaf() || (!na.leaf() && area(na.lo, na.hi) >= area(nb.lo, nb.hi)))
+            {
+                stack.push_back({ na.child[0], b });
+                stack.push_back({ na.child[1], b });
+            }
+            else
+            {
+                stack.push_back({ a, nb.child[0] });
+                stack.push_back({ a, nb.child[1] });
+            }
+        }
+    }
+
+    // callback(userData, ray) is called for leaves along the ray, nearest boxes first,
+    // and returns the distance to clip the ray to: its own hit distance when looking for
+    // the closest hit, the current maxDist to keep going, or 0 to stop
+    template<typename Callback>
+    void raycast(const Ray& ray, float maxDist, const Callback& callback) const
+    {
+        if (root == Null)
+        {
+            return;
+        }
+
+        float3 inv(rayInvDir(ray.direction.x), rayInvDir(ray.direction.y), rayInvDir(ray.direction.z));
+        Stack stack;
+        stack.push(root);
+        while (!stack.empty() && maxDist > 0.0f)
+        {
+            const Node& n = nodes[stack.pop()];
+            float t;
+            if (!rayHitsNode(n, ray.origin, inv, maxDist, t))
+            {
+                continue;
+            }
+            if (n.leaf())
+            {
+                float clip = callback(n.userData, ray);
+                maxDist = fminf(maxDist, clip);
+                continue;
+            }
+
+            // push the farther child first so the nearer one is visited next
+            float t0, t1;
+            bool hit0 = rayHitsNode(nodes[n.child[0]], ray.origin, inv, maxDist, t0);
+            bool hit1 = rayHitsNode(nodes[n.child[1]], ray.origin, inv, maxDist, t1);
+            if (hit0 && hit1)
+            {
+                stack.push(n.child[t0 < t1 ? 1 : 0]);
+                stack.push(n.child[t0 < t1 ? 0 : 1]);
+            }
+            else if (hit0)
+            {
+                stack.push(n.child[0]);
+            }
+            else if (hit1)
+            {
+                stack.push(n.child[1]);
+            }
+        }
+    }
+};
+
+// AabbTree behind the Broadphase interface
+// pairs come from one descent of the tree against itself. movers are
+// reinserted once they leave their fat box, which is stretched along their
+// last move, so this suits mostly static scenes with some slow movers; the
+// tree itself is left public for raycasts
+class AabbTreeBroadphase : public Broadphase
+{
+    vector<Box> bounds;         // per tree handle
+    vector<uint> userData;
+    vector<uchar> alive;
+    uint count = 0;
+
+public:
+    AabbTree tree;
+
+    AabbTreeBroadphase(float margin = 0.1f) : tree(margin) {}
+
+    uint size() const override { return count; }
+
+    Handle insert(const Box& box, uint data) override
+    {
+        // leaves carry their own handle, so queries can look up the tight box
+        AabbTree::Handle h = tree.insert(box, 0);
+        tree.setUserData(h, h);
+        if (h >= (int)bounds.size())
+        {
+            bounds.resize(h + 1);
+            userData.resize(h + 1);
+            alive.resize(h + 1, 0);
+        }
+        bounds[h] = box;
+        userData[h] = data;
+        alive[h] = 1;
+        count++;
+        return h;
+    }
+    void move(Handle h, const Box& box) override
+    {
+        // the fat box reaches ahead along the move, so steady movers don't reinsert every frame
+        tree.move(h, box, box.centre - bounds[h].centre);
+        bounds[h] = box;
+    }
+    void remove(Handle h) override
+    {
+        tree.remove(h);
+        alive[h] = 0;
+        count--;
+    }
+    void clear() override
+    {
+        tree.clear();
+        bounds.clear();
+        userData.clear();
+        alive.clear();
+        count = 0;
+    }
+
+    void query(const Box& box, vector<uint>& out) override
+    {
+        out.clear();
+        tree.query(box, [&](uint h) {
+            if (overlaps(box, bounds[h]))
+                out.push_back(userData[h]);
+            return true;
+        });
+    }
+    void findPairs(vector<CollisionPair>& pairs) override
+    {
+        pairs.clear();
+        tree.findPairs([&](uint a, uint b) {
+            if (overlaps(bounds[a], bounds[b]))
+                pairs.push_back({ userData[a], userData[b] });
+            return true;
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _CUBE_PHYSICS_BROADPHASE_H
+#define _CUBE_PHYSICS_BROADPHASE_H
+
+#include "../definitions.h"
+#include "../collision.h"
+
+// a pair of objects whose bounds overlap, as the userData they were inserted with
+struct CollisionPair
+{
+    uint a;
+    uint b;
+};
+
+// the overlap test every broadphase applies, on min and max corners the way
+// SweepAndPrune stores them; intersect(Box, Box) rounds differently, so boxes
+// that only just touch could otherwise be a pair in one broadphase and not another
+bool overlaps(const Box& a, const Box& b)
+{
+    return a.centre.x - a.extent.x <= b.centre.x + b.extent.x && a.centre.x + a.extent.x >= b.centre.x - b.extent.x
+        && a.centre.y - a.extent.y <= b.centre.y + b.extent.y && a.centre.y + a.extent.y >= b.centre.y - b.extent.y
+        && a.centre.z - a.extent.z <= b.centre.z + b.extent.z && a.centre.z + a.extent.z >= b.centre.z - b.extent.z;
+}
+
+// common interface for the broadphases, so a scene can pick whichever
+// suits its motion: SpatialHash for lots of incoherent movers of similar size,
+// SweepAndPrune for coherent motion, AabbTreeBroadphase for mostly static
+// geometry of mixed sizes.
+// handles are only meaningful to the broadphase that returned them.
+// query and findPairs clear their output first, so reuse the vectors across
+// frames to avoid allocating
+class Broadphase
+{
+public:
+    typedef uint Handle;
+
+    virtual ~Broadphase() {}
+
+    virtual Handle insert(const Box& bounds, uint userData) = 0;
+    virtual void move(Handle h, const Box& bounds) = 0;
+    virtual void remove(Handle h) = 0;
+    virtual void clear() = 0;
+    virtual uint size() const = 0;
+
+    // userData of every object overlapping bounds, each reported once
+    virtual void query(const Box& bounds, vector<uint>& out) = 0;
+    // every pair of overlapping objects, each reported once
+    virtual void findPairs(vector<CollisionPair>& pairs) = 0;
+};
+
+#endif
@@ -0,0 +1,681 @@
+#ifndef _CUBE_PHYSICS_GJK_H
+#define _CUBE_PHYSICS_GJK_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../collision.h"
+
+// gjk / epa narrowphase for convex shapes
+//
+// shapes only have to provide three overloads:
+//      float3 supportCore(const Shape&, const float3& dir)  farthest point of the core along dir
+//      float coreRadius(const Shape&)                       radius added around the core
+//      float3 shapeCentre(const Shape&)                     any point inside, seeds the search
+// rounded shapes (spheres, capsules) are handled as a point or a segment plus
+// a radius: gjk converges in a few steps on the core and the radius is added
+// back afterwards, where running it on the curved surface would crawl
+
+// tolerances for objects from a few centimetres to a few hundred metres across
+static const int GjkMaxIterations = 32;
+static const float GjkRelativeTolerance = 1e-4f;   // stop when a step gains less than this fraction of the squared distance
+static const float GjkTouchDistance = 1e-4f;       // cores closer than this overlap
+static const int EpaMaxIterations = 48;
+static const float EpaTolerance = 1e-4f;           // absolute, or relative to the depth for deep contacts
+
+// convex hull of a point cloud; points inside the hull are harmless, only
+// cost time in supportCore
+struct ConvexHull
+{
+    vector<float3> points;
+    float3 centre;
+
+    ConvexHull() {}
+    ConvexHull(const vector<float3>& _points) : points(_points) { updateCentre(); }
+
+    // the solid MeshBuilder::prism builds from the same arguments
+    static ConvexHull prism(const vector<float3>& polygon, const float3& origin, const float3& extr)
+    {
+        ConvexHull h;
+        h.points.reserve(polygon.size() * 2);
+        for (const float3& p : polygon)
+        {
+            h.points.push_back(origin + p);
+            h.points.push_back(origin + p + extr);
+        }
+        h.updateCentre();
+        return h;
+    }
+
+    void translate(const float3& d)
+    {
+        for (float3& p : points)
+        {
+            p += d;
+        }
+        centre += d;
+    }
+    void updateCentre()
+    {
+        centre = float3();
+        for (const float3& p : points)
+        {
+            centre += p;
+        }
+        if (!points.empty())
+            centre /= (float)points.size();
+    }
+};
+
+inline float3 supportCore(const float3& p, const float3&) { return p; }
+inline float3 supportCore(const Sphere& s, const float3&) { return s.centre; }
+inline float3 supportCore(const Capsule& c, const float3& dir) { return dot(c.b - c.a, dir) > 0.0f ? c.b : c.a; }
+inline float3 supportCore(const Box& b, const float3& dir)
+{
+    return b.centre + float3(dir.x < 0.0f ? -b.extent.x : b.extent.x,
+                             dir.y < 0.0f ? -b.extent.y : b.extent.y,
+                             dir.z < 0.0f ? -b.extent.z : b.extent.z);
+}
+inline float3 supportCore(const ConvexHull& h, const float3& dir)
+{
+    uint best = 0;
+    float bestDot = -INFINITY;
+    for (uint i = 0; i < h.points.size(); i++)
+    {
+        float d = dot(h.points[i], dir);
+        if (d > bestDot)
+        {
+            bestDot = d;
+            best = i;
+        }
+    }
+    return h.points[best];
+}
+
+inline float coreRadius(const float3&) { return 0.0f; }
+inline float coreRadius(const Sphere& s) { return s.radius; }
+inline float coreRadius(const Capsule& c) { return c.radius; }
+inline float coreRadius(const Box&) { return 0.0f; }
+inline float coreRadius(const ConvexHull&) { return 0.0f; }
+
+inline float3 shapeCentre(const float3& p) { return p; }
+inline float3 shapeCentre(const Sphere& s) { return s.centre; }
+inline float3 shapeCentre(const Capsule& c) { return (c.a + c.b) * 0.5f; }
+inline float3 shapeCentre(const Box& b) { return b.centre; }
+inline float3 shapeCentre(const ConvexHull& h) { return h.centre; }
+
+// farthest point of the whole shape along dir
+template<typename Shape>
+float3 support(const Shape& s, const float3& dir)
+{
+    float3 p = supportCore(s, dir);
+    float r = coreRadius(s);
+    float l = len(dir);
+    if (r > 0.0f && l > 0.0f)
+        p += dir * (r / l);
+    return p;
+}
+
+// a point of the minkowski difference a - b, with the points it came from
+struct GjkVertex
+{
+    float3 w, a, b;
+    float3 dir;     // search direction that produced it
+};
+
+// the simplex a pair ended on last time; keep one per pair and pass it back
+// in, the next query starts from the same search directions and usually
+// finishes in one or two iterations when the objects barely moved
+struct GjkCache
+{
+    int count = 0;
+    float3 dirs[4];
+};
+
+struct GjkResult
+{
+    bool intersecting = false;
+    float distance = 0.0f;  // separation, or minus the penetration depth
+    float3 normal;          // unit, from a towards b
+    float3 pointA, pointB;  // closest points, or the deepest points when intersecting
+    int iterations = 0;
+};
+
+// up to 4 vertices and the barycentric weights of the point closest to the origin
+struct GjkSimplex
+{
+    GjkVertex v[4];
+    float lambda[4];
+    int count = 0;
+
+    void keep(int n, const int* idx, const float* l)
+    {
+        GjkVertex tmp[4];
+        for (int i = 0; i < n; i++)
+            tmp[i] = v[idx[i]];
+        for (int i = 0; i < n; i++)
+        {
+            v[i] = tmp[i];
+            lambda[i] = l[i];
+        }
+        count = n;
+    }
+
+    float3 point() const
+    {
+        float3 p;
+        for (int i = 0; i < count; i++)
+            p += v[i].w * lambda[i];
+        return p;
+    }
+    void witness(float3& pa, float3& pb) const
+    {
+        pa = float3();
+        pb = float3();
+        for (int i = 0; i < count; i++)
+        {
+            pa += v[i].a * lambda[i];
+            pb += v[i].b * lambda[i];
+        }
+    }
+
+    bool contains(const float3& w) const
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (len2(v[i].w - w) <= GjkTouchDistance * GjkTouchDistance)
+                return true;
+        }
+        return false;
+    }
+
+    // closest point of the triangle ijk to the origin (ericson 5.1.5),
+    // returns the squared distance and fills the sub-simplex it lies on
+    float closestTriangle(int i, int j, int k, int* idx, float* l, int& n) const
+    {
+        const float3& a = v[i].w;
+        const float3& b = v[j].w;
+        const float3& c = v[k].w;
+        float3 ab = b - a, ac = c - a;
+
+        float d1 = -dot(ab, a), d2 = -dot(ac, a);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+        {
+            n = 1; idx[0] = i; l[0] = 1.0f;
+            return len2(a);
+        }
+        float d3 = -dot(ab, b), d4 = -dot(ac, b);
+        if (d3 >= 0.0f && d4 <= d3)
+        {
+            n = 1; idx[0] = j; l[0] = 1.0f;
+            return len2(b);
+        }
+        float vc = d1*d4 - d3*d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            float t = d1 / (d1 - d3);
+            n = 2; idx[0] = i; idx[1] = j; l[0] = 1.0f - t; l[1] = t;
+            return len2(a + ab * t);
+        }
+        float d5 = -dot(ab, c), d6 = -dot(ac, c);
+        if (d6 >= 0.0f && d5 <= d6)
+        {
+            n = 1; idx[0] = k; l[0] = 1.0f;
+            return len2(c);
+        }
+        float vb = d5*d2 - d1*d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            float t = d2 / (d2 - d6);
+            n = 2; idx[0] = i; idx[1] = k; l[0] = 1.0f - t; l[1] = t;
+            return len2(a + ac * t);
+        }
+        float va = d3*d6 - d5*d4;
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        {
+            float t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            n = 2; idx[0] = j; idx[1] = k; l[0] = 1.0f - t; l[1] = t;
+            return len2(b + (c - b) * t);
+        }
+        float denom = 1.0f / (va + vb + vc);
+        float s = vb * denom, t = vc * denom;
+        n = 3; idx[0] = i; idx[1] = j; idx[2] = k;
+        l[0] = 1.0f - s - t; l[1] = s; l[2] = t;
+        return len2(a + ab * s + ac * t);
+    }
+
+    // reduce to the smallest sub-simplex holding the point closest to the
+    // origin and return that point; 4 vertices left means the origin is inside
+    float3 solve()
+    {
+        int idx[4];
+        float l[4];
+        int n = 0;
+
+        if (count == 1)
+        {
+            lambda[0] = 1.0f;
+        }
+        else if (count == 2)
+        {
+            float3 ab = v[1].w - v[0].w;
+            float t = -dot(v[0].w, ab);
+            float l2 = len2(ab);
+            if (t <= 0.0f || l2 <= 0.0f)
+            {
+                idx[0] = 0; l[0] = 1.0f;
+                keep(1, idx, l);
+            }
+            else if (t >= l2)
+            {
+                idx[0] = 1; l[0] = 1.0f;
+                keep(1, idx, l);
+            }
+            else
+            {
+                lambda[1] = t / l2;
+                lambda[0] = 1.0f - lambda[1];
+            }
+        }
+        else if (count == 3)
+        {
+            closestTriangle(0, 1, 2, idx, l, n);
+            keep(n, idx, l);
+        }
+        else if (count == 4)
+        {
+            static const int faces[4][4] = { {0,1,2,3}, {0,3,1,2}, {0,2,3,1}, {1,3,2,0} };
+
+            float3 e1 = v[1].w - v[0].w, e2 = v[2].w - v[0].w, e3 = v[3].w - v[0].w;
+            float volume = dot(e3, cross(e1, e2));
+            // flat tetrahedra can't tell inside from outside, test every face
+            bool flat = fabsf(volume) <= 1e-6f * len(e1) * len(e2) * len(e3);
+
+            bool inside = true;
+            float best = INFINITY;
+            for (auto& f : faces)
+            {
+                const float3& a = v[f[0]].w;
+                float3 nrm = cross(v[f[1]].w - a, v[f[2]].w - a);
+                float sideOrigin = -dot(a, nrm);
+                float sideOpposite = dot(v[f[3]].w - a, nrm);
+                if (!flat && sideOrigin * sideOpposite >= 0.0f)
+                    continue;
+
+                inside = false;
+                int fi[4];
+                float fl[4];
+                int fn;
+                float d2 = closestTriangle(f[0], f[1], f[2], fi, fl, fn);
+                if (d2 < best)
+                {
+                    best = d2;
+                    n = fn;
+                    for (int i = 0; i < fn; i++)
+                    {
+                        idx[i] = fi[i];
+                        l[i] = fl[i];
+                    }
+                }
+            }
+            if (inside)
+                return float3();
+            keep(n, idx, l);
+        }
+        return point();
+    }
+};
+
+template<typename A, typename B>
+GjkVertex gjkVertex(const A& a, const B& b, const float3& dir)
+{
+    GjkVertex v;
+    v.dir = dir;
+    v.a = supportCore(a, dir);
+    v.b = supportCore(b, -dir);
+    v.w = v.a - v.b;
+    return v;
+}
+
+// gjk between the cores of a and b, returns their distance, 0 when they
+// overlap. gives up early, returning a lower bound, once the cores are known
+// to be more than "separation" apart
+template<typename A, typename B>
+float gjkCore(const A& a, const B& b, GjkSimplex& s, GjkCache* cache, float separation, int& iterations)
+{
+    s.count = 0;
+    if (cache)
+    {
+        for (int i = 0; i < cache->count; i++)
+        {
+            GjkVertex w = gjkVertex(a, b, cache->dirs[i]);
+            if (!s.contains(w.w))
+                s.v[s.count++] = w;
+        }
+    }
+    if (!s.count)
+    {
+        float3 dir = shapeCentre(b) - shapeCentre(a);
+        if (len2(dir) <= GjkTouchDistance * GjkTouchDistance)
+            dir = float3(1.0f, 0.0f, 0.0f);
+        s.v[s.count++] = gjkVertex(a, b, dir);
+    }
+
+    float3 v = s.solve();
+    float dist = -1.0f;
+    for (iterations = 0; iterations < GjkMaxIterations && dist < 0.0f; iterations++)
+    {
+        float v2 = len2(v);
+        if (s.count == 4 || v2 <= GjkTouchDistance * GjkTouchDistance)
+        {
+            dist = 0.0f;
+            break;
+        }
+
+        GjkVertex w = gjkVertex(a, b, -v);
+        float vw = dot(v, w.w);
+        // vw / |v| is a lower bound on the distance
+        if (vw > 0.0f && vw * vw > separation * separation * v2)
+        {
+            dist = vw / sqrtf(v2);
+            break;
+        }
+        if (v2 - vw <= GjkRelativeTolerance * v2 || s.contains(w.w))
+            break;
+
+        s.v[s.count++] = w;
+        v = s.solve();
+        if (len2(v) >= v2)
+            break;
+    }
+    if (dist < 0.0f)
+        dist = (s.count == 4) ? 0.0f : len(v);
+
+    if (cache)
+    {
+        cache->count = s.count;
+        for (int i = 0; i < s.count; i++)
+            cache->dirs[i] = s.v[i].dir;
+    }
+    return dist;
+}
+
+// contact normal for a minkowski difference with no volume (a point, a
+// segment or a flat polygon through the origin), e.g. two crossing capsules
+inline float3 degenerateNormal(const GjkVertex* verts, int count, const float3& towards)
+{
+    float3 c = len2(towards) > 0.0f ? towards : float3(0.0f, 1.0f, 0.0f);
+    float3 n = c;
+    if (count == 2)
+    {
+        float3 e = normalize(verts[1].w - verts[0].w);
+        n = c - e * dot(c, e);
+        if (len2(n) <= 1e-12f)
+            n = cross(e, fabsf(e.x) < 0.6f ? float3(1.0f, 0.0f, 0.0f) : float3(0.0f, 1.0f, 0.0f));
+    }
+    else if (count == 3)
+    {
+        n = cross(verts[1].w - verts[0].w, verts[2].w - verts[0].w);
+        if (dot(n, c) < 0.0f)
+            n = -n;
+    }
+    return normalize(n);
+}
+
+// expanding polytope algorithm on the cores, starting from the simplex gjk
+// stopped with. gives the depth, the normal from a towards b and the deepest
+// points of the two cores
+template<typename A, typename B>
+void epaPenetration(const A& a, const B& b, const GjkSimplex& s, float& depth, float3& normal, float3& pa, float3& pb)
+{
+    static const int MaxVertices = 64;
+    static const int MaxFaces = 128;
+    static const int MaxEdges = 64;
+
+    struct Face
+    {
+        int v[3];
+        float3 n;
+        float d;
+    };
+
+    GjkVertex verts[MaxVertices];
+    Face faces[MaxFaces];
+    int edges[MaxEdges][2];
+    int nv = s.count, nf = 0;
+    for (int i = 0; i < nv; i++)
+        verts[i] = s.v[i];
+
+    // gjk stops as soon as it touches the origin; grow what it left into a tetrahedron
+    const float tol2 = EpaTolerance * EpaTolerance;
+    if (nv == 1)
+    {
+        static const float3 axes[6] = { float3(1,0,0), float3(-1,0,0), float3(0,1,0), float3(0,-1,0), float3(0,0,1), float3(0,0,-1) };
+        for (const float3& axis : axes)
+        {
+            GjkVertex w = gjkVertex(a, b, axis);
+            if (len2(w.w - verts[0].w) > tol2)
+            {
+                verts[nv++] = w;
+                break;
+            }
+        }
+    }
+    if (nv == 2)
+    {
+        float3 e = normalize(verts[1].w - verts[0].w);
+        float3 u = normalize(cross(e, fabsf(e.x) < 0.6f ? float3(1.0f, 0.0f, 0.0f) : float3(0.0f, 1.0f, 0.0f)));
+        float3 u2 = cross(e, u);
+        for (int k = 0; k < 6; k++)
+        {
+            float angle = k * pi / 3.0f;
+            GjkVertex w = gjkVertex(a, b, u * cosf(angle) + u2 * sinf(angle));
+            if (len2(cross(w.w - verts[0].w, e)) > tol2)
+            {
+                verts[nv++] = w;
+                break;
+            }
+        }
+    }
+    if (nv == 3)
+    {
+        float3 n = normalize(cross(verts[1].w - verts[0].w, verts[2].w - verts[0].w));
+        for (float sign : { 1.0f, -1.0f })
+        {
+            GjkVertex w = gjkVertex(a, b, n * sign);
+            if (fabsf(dot(w.w - verts[0].w, n)) > EpaTolerance)
+            {
+                verts[nv++] = w;
+                break;
+            }
+        }
+    }
+    if (nv < 4)
+    {
+        // no volume: the cores just touch or one of them is flat
+        depth = 0.0f;
+        normal = degenerateNormal(verts, nv, shapeCentre(b) - shapeCentre(a));
+        s.witness(pa, pb);
+        return;
+    }
+
+    auto makeFace = [&](int i, int j, int k) -> Face
+    {
+        Face f = { { i, j, k }, float3(0, 0, 0), 0.0f };
+        float3 n = cross(verts[j].w - verts[i].w, verts[k].w - verts[i].w);
+        float l = len(n);
+        if (l > 1e-12f)
+        {
+            f.n = n / l;
+            f.d = dot(f.n, verts[i].w);
+        }
+        else
+        {
+            // sliver, never picked and never removed
+            f.d = INFINITY;
+        }
+        return f;
+    };
+
+    static const int tetra[4][4] = { {0,1,2,3}, {0,3,1,2}, {0,2,3,1}, {1,3,2,0} };
+    for (auto& t : tetra)
+    {
+        // wind every face so its normal points away from the opposite vertex
+        float3 n = cross(verts[t[1]].w - verts[t[0]].w, verts[t[2]].w - verts[t[0]].w);
+        if (dot(n, verts[t[3]].w - verts[t[0]].w) > 0.0f)
+            faces[nf++] = makeFace(t[0], t[2], t[1]);
+        else
+            faces[nf++] = makeFace(t[0], t[1], t[2]);
+    }
+
+    int best = 0;
+    for (int iter = 0; iter < EpaMaxIterations; iter++)
+    {
+        best = 0;
+        for (int f = 1; f < nf; f++)
+        {
+            if (faces[f].d < faces[best].d)
+                best = f;
+        }
+        const Face& closest = faces[best];
+
+        GjkVertex w = gjkVertex(a, b, closest.n);
+        float gap = dot(w.w, closest.n) - closest.d;
+        if (gap <= fmaxf(EpaTolerance, EpaTolerance * closest.d) || nv == MaxVertices)
+            break;
+
+        // remove every face that sees the new point, keeping the edges of the hole
+        int ne = 0;
+        bool full = false;
+        for (int f = 0; f < nf && !full;)
+        {
+            if (dot(faces[f].n, w.w - verts[faces[f].v[0]].w) <= 0.0f)
+            {
+                f++;
+                continue;
+            }
+            for (int e = 0; e < 3; e++)
+            {
+                int i = faces[f].v[e], j = faces[f].v[(e + 1) % 3];
+                // an edge shared by two removed faces is inside the hole
+                int shared = -1;
+                for (int k = 0; k < ne; k++)
+                {
+                    if (edges[k][0] == j && edges[k][1] == i)
+                    {
+                        shared = k;
+                        break;
+                    }
+                }
+                if (shared >= 0)
+                {
+                    edges[shared][0] = edges[ne - 1][0];
+                    edges[shared][1] = edges[ne - 1][1];
+                    ne--;
+                }
+                else if (ne < MaxEdges)
+                {
+                    edges[ne][0] = i;
+                    edges[ne][1] = j;
+                    ne++;
+                }
+                else
+                {
+                    full = true;
+                }
+            }
+            faces[f] = faces[--nf];
+        }
+        if (full || nf + ne > MaxFaces)
+        {
+            // out of room; the polytope has a hole now, so settle for the
+            // best face found so far
+            best = -1;
+            break;
+        }
+
+        verts[nv] = w;
+        for (int k = 0; k < ne; k++)
+            faces[nf++] = makeFace(edges[k][0], edges[k][1], nv);
+        nv++;
+    }
+
+    if (best < 0)
+    {
+        best = 0;
+        for (int f = 1; f < nf; f++)
+        {
+            if (faces[f].d < faces[best].d)
+                best = f;
+        }
+    }
+    const Face& f = faces[best];
+    depth = fmaxf(f.d, 0.0f);
+    normal = f.n;
+
+    // the origin projected onto the face, in barycentric coordinates
+    const GjkVertex& v0 = verts[f.v[0]];
+    const GjkVertex& v1 = verts[f.v[1]];
+    const GjkVertex& v2 = verts[f.v[2]];
+    float3 p = f.n * f.d;
+    float3 e0 = v1.w - v0.w, e1 = v2.w - v0.w, e2 = p - v0.w;
+    float d00 = dot(e0, e0), d01 = dot(e0, e1), d11 = dot(e1, e1);
+    float d20 = dot(e2, e0), d21 = dot(e2, e1);
+    float denom = d00 * d11 - d01 * d01;
+    float l1 = 0.0f, l2 = 0.0f;
+    if (fabsf(denom) > 1e-12f)
+    {
+        l1 = (d11 * d20 - d01 * d21) / denom;
+        l2 = (d00 * d21 - d01 * d20) / denom;
+    }
+    float l0 = 1.0f - l1 - l2;
+    pa = v0.a * l0 + v1.a * l1 + v2.a * l2;
+    pb = v0.b * l0 + v1.b * l1 + v2.b * l2;
+}
+
+// exact distance, or penetration depth when the shapes overlap
+template<typename A, typename B>
+GjkResult gjkDistance(const A& a, const B& b, GjkCache* cache = nullptr)
+{
+    GjkResult r;
+    GjkSimplex s;
+    float ra = coreRadius(a), rb = coreRadius(b);
+    float d = gjkCore(a, b, s, cache, INFINITY, r.iterations);
+
+    float3 pa, pb;
+    if (d > GjkTouchDistance)
+    {
+        r.normal = -s.point() / d;
+        s.witness(pa, pb);
+        r.distance = d - ra - rb;
+    }
+    else
+    {
+        float depth;
+        epaPenetration(a, b, s, depth, r.normal, pa, pb);
+        r.distance = -(depth + ra + rb);
+    }
+    r.intersecting = r.distance <= 0.0f;
+    r.pointA = pa + r.normal * ra;
+    r.pointB = pb - r.normal * rb;
+    return r;
+}
+
+// overlap test only, stops as soon as a separating direction turns up
+template<typename A, typename B>
+bool gjkIntersect(const A& a, const B& b, GjkCache* cache = nullptr)
+{
+    GjkSimplex s;
+    int iterations;
+    float r = coreRadius(a) + coreRadius(b);
+    return gjkCore(a, b, s, cache, r, iterations) <= r;
+}
+
+bool intersect(const Capsule& c, const Box& b)             { return gjkIntersect(c, b); }
+bool intersect(const Capsule& c1, const Capsule& c2)       { return gjkIntersect(c1, c2); }
+bool intersect(const ConvexHull& h, const float3& pos)     { return gjkIntersect(h, pos); }
+bool intersect(const ConvexHull& h, const Sphere& s)       { return gjkIntersect(h, s); }
+bool intersect(const ConvexHull& h, const Box& b)          { return gjkIntersect(h, b); }
+bool intersect(const ConvexHull& h, const Capsule& c)      { return gjkIntersect(h, c); }
+bool intersect(const ConvexHull& h1, const ConvexHull& h2) { return gjkIntersect(h1, h2); }
+
+#endif
@@ -0,0 +1,621 @@
+#ifndef _CUBE_PHYSICS_PIPELINE_H
+#define _CUBE_PHYSICS_PIPELINE_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../simd.h"
+#include "../jobs.h"
+#include "../profiler.h"
+#include "../collision.h"
+#include "gjk.h"
+
+struct Contact
+{
+    uint a, b;          // user data of the two colliders
+    float3 normal;      // unit, from a towards b
+    float3 point;       // roughly halfway between the two surfaces
+    float depth;        // penetration, 0 when just touching
+};
+
+// all-pairs contact generation for a frame's worth of colliders, in stages:
+//
+//  broadphase   space is cut into a grid of regions over its two widest axes,
+//               sized for a few dozen objects each, and every region sweeps
+//               its objects along the third axis as a job. objects are copied
+//               into every region they overlap and a pair is only reported by
+//               the region holding the lower corner of the overlap, so nothing
+//               is found twice
+//  narrowphase  pairs are bucketed by shape type; sphere/sphere, sphere/box and
+//               box/box are gathered SimdFloat::Width at a time into SoA
+//               registers, anything with a capsule goes through gjk
+//  merge        every job writes contacts into its thread's buffer; the
+//               buffers are concatenated and sorted by collider indices, so the output
+//               doesn't depend on the thread count or on scheduling
+//
+// usage: clear(), add() every collider, run(jobs), then read contacts()
+class CollisionPipeline
+{
+public:
+    struct Stats
+    {
+        double broadphaseMs = 0;
+        double narrowphaseMs = 0;
+        double mergeMs = 0;
+        uint cells = 0;
+        uint pairs = 0;
+        uint contacts = 0;
+    };
+
+private:
+    enum ShapeType : uchar { SphereShape, BoxShape, CapsuleShape };
+
+    struct Collider
+    {
+        ShapeType type;
+        uint index;         // into spheres / boxes / capsules
+        uint userData;
+    };
+
+    // a pair in collider indices, ordered so the first has the lower shape type
+    struct Pair
+    {
+        uint a, b;
+    };
+
+    struct ThreadContact
+    {
+        uint64_t key;       // lower collider index in the high half
+        Contact contact;
+    };
+
+    // pairs gathered per chunk of the narrowphase
+    static const uint Chunk = 64;
+
+    vector<Collider> colliders;
+    vector<Sphere> spheres;
+    vector<Box> boxes;
+    vector<Capsule> capsules;
+
+    // bounds in SoA form for the broadphase
+    vector<float> lo[3], hi[3];
+
+    // broadphase grid: cell of every object copy, flattened per cell
+    int gridAxis[2], sweepAxis;
+    int gridSize[2];
+    float gridMin[2], gridInv[2];
+    vector<uint> cellStart, cellObjects;
+    vector<vector<Pair>> threadPairs;
+    vector<Pair> pairs;
+
+    // pair indices per shape combination
+    vector<uint> sphereSphere, sphereBox, boxBox, other;
+
+    vector<vector<ThreadContact>> threadContacts;
+    vector<ThreadContact> merged;
+    vector<Contact> output;
+
+    Stats stats;
+
+    static double msSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    void addBounds(const Box& b)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k].push_back(b.centre._x[k] - b.extent._x[k]);
+            hi[k].push_back(b.centre._x[k] + b.extent._x[k]);
+        }
+    }
+
+    int cellOf(int g, float x) const
+    {
+        int c = (int)((x - gridMin[g]) * gridInv[g]);
+        return c < 0 ? 0 : (c >= gridSize[g] ? gridSize[g] - 1 : c);
+    }
+
+    void setupGrid()
+    {
+        uint n = colliders.size();
+        float3 mn(INFINITY, INFINITY, INFINITY), mx(-INFINITY, -INFINITY, -INFINITY), size;
+        for (int k = 0; k < 3; k++)
+        {
+            for (uint i = 0; i < n; i++)
+            {
+                mn._x[k] = fminf(mn._x[k], lo[k][i]);
+                mx._x[k] = fmaxf(mx._x[k], hi[k][i]);
+                size._x[k] += hi[k][i] - lo[k][i];
+            }
+            size._x[k] /= n;
+        }
+        float3 spread = mx - mn;
+
+        // grid over the two widest axes, sweep along the narrowest
+        sweepAxis = 0;
+        for (int k = 1; k < 3; k++)
+        {
+            if (spread._x[k] < spread._x[sweepAxis])
+                sweepAxis = k;
+        }
+        gridAxis[0] = (sweepAxis + 1) % 3;
+        gridAxis[1] = (sweepAxis + 2) % 3;
+
+        // around 64 objects per cell, cells no smaller than twice the average
+        // object so few objects land in more than a couple of cells
+        float cells = n / 64.0f + 1.0f;
+        float su = fmaxf(spread._x[gridAxis[0]], 1e-6f), sv = fmaxf(spread._x[gridAxis[1]], 1e-6f);
+        float cell = sqrtf(su * sv / cells);
+        for (int g = 0; g < 2; g++)
+        {
+            int k = gridAxis[g];
+            float c = fmaxf(cell, size._x[k] * 2.0f);
+            gridSize[g] = (int)fminf(fmaxf(spread._x[k] / c, 1.0f), 4096.0f);
+            gridMin[g] = mn._x[k];
+            gridInv[g] = gridSize[g] / fmaxf(spread._x[k], 1e-6f);
+        }
+    }
+
+    void sweepCell(uint c, vector<Pair>& out)
+    {
+        uint* objects = &cellObjects[cellStart[c]];
+        uint count = cellStart[c + 1] - cellStart[c];
+
+        int w = sweepAxis, u = gridAxis[0], v = gridAxis[1];
+        const vector<float>& l = lo[w];
+        const vector<float>& h = hi[w];
+        sort(objects, objects + count, [&](uint a, uint b) {
+            return l[a] < l[b] || (l[a] == l[b] && a < b);
+        });
+
+        int cu = c % gridSize[0], cv = c / gridSize[0];
+        for (uint i = 0; i < count; i++)
+        {
+            uint a = objects[i];
+            float end = h[a];
+            for (uint j = i + 1; j < count; j++)
+            {
+                uint b = objects[j];
+                if (l[b] > end)
+                    break;
+                if (lo[u][a] > hi[u][b] || lo[u][b] > hi[u][a] || lo[v][a] > hi[v][b] || lo[v][b] > hi[v][a])
+                    continue;
+                // both objects are in every cell their overlap touches; the
+                // cell holding the overlap's lower corner reports it
+                if (cellOf(0, fmaxf(lo[u][a], lo[u][b])) != cu || cellOf(1, fmaxf(lo[v][a], lo[v][b])) != cv)
+                    continue;
+                if (colliders[a].type <= colliders[b].type)
+                    out.push_back({ a, b });
+                else
+                    out.push_back({ b, a });
+            }
+        }
+    }
+
+    void broadphase(JobSystem* jobs)
+    {
+        PROFILE_SCOPE("collision broadphase");
+        auto start = chrono::steady_clock::now();
+
+        setupGrid();
+        uint n = colliders.size();
+        uint cells = gridSize[0] * gridSize[1];
+        const vector<float> &lu = lo[gridAxis[0]], &hu = hi[gridAxis[0]];
+        const vector<float> &lv = lo[gridAxis[1]], &hv = hi[gridAxis[1]];
+
+        // counting sort of the object copies into their cells
+        cellStart.assign(cells + 1, 0);
+        for (uint i = 0; i < n; i++)
+        {
+            int u0 = cellOf(0, lu[i]), u1 = cellOf(0, hu[i]);
+            int v0 = cellOf(1, lv[i]), v1 = cellOf(1, hv[i]);
+            for (int cv = v0; cv <= v1; cv++)
+                for (int cu = u0; cu <= u1; cu++)
+                    cellStart[cv * gridSize[0] + cu + 1]++;
+        }
+        for (uint c = 0; c < cells; c++)
+        {
+            cellStart[c + 1] += cellStart[c];
+        }
+        cellObjects.resize(cellStart[cells]);
+        vector<uint> fill(cellStart.begin(), cellStart.end() - 1);
+        for (uint i = 0; i < n; i++)
+        {
+            int u0 = cellOf(0, lu[i]), u1 = cellOf(0, hu[i]);
+            int v0 = cellOf(1, lv[i]), v1 = cellOf(1, hv[i]);
+            for (int cv = v0; cv <= v1; cv++)
+                for (int cu = u0; cu <= u1; cu++)
+                    cellObjects[fill[cv * gridSize[0] + cu]++] = i;
+        }
+
+        uint threads = jobs ? jobs->numThreads() : 1;
+        threadPairs.resize(threads);
+        for (auto& p : threadPairs)
+        {
+            p.clear();
+        }
+        auto job = [&](int begin, int end) {
+            vector<Pair>& out = threadPairs[jobs ? jobs->currentThread() : 0];
+            for (int c = begin; c < end; c++)
+                sweepCell(c, out);
+        };
+        if (jobs)
+            jobs->parallelFor(0, cells, 16, job);
+        else
+            job(0, cells);
+
+        // pair order depends on scheduling here; merge() restores a fixed order
+        pairs.clear();
+        for (auto& p : threadPairs)
+        {
+            pairs.insert(pairs.end(), p.begin(), p.end());
+        }
+
+        stats.cells = cells;
+        stats.pairs = pairs.size();
+        stats.broadphaseMs = msSince(start);
+    }
+
+    void emit(vector<ThreadContact>& out, uint pair, const float3& normal, const float3& point, float depth)
+    {
+        const Pair& p = pairs[pair];
+        uint64_t key = p.a < p.b ? ((uint64_t)p.a << 32 | p.b) : ((uint64_t)p.b << 32 | p.a);
+        out.push_back({ key, { colliders[p.a].userData, colliders[p.b].userData, normal, point, depth } });
+    }
+
+    // narrowphase kernels, each takes up to Chunk pair indices
+    void sphereSphereKernel(const uint* ids, uint n, vector<ThreadContact>& out)
+    {
+        float data[7][Chunk] = {};
+        for (uint i = 0; i < n; i++)
+        {
+            const Sphere& a = spheres[colliders[pairs[ids[i]].a].index];
+            const Sphere& b = spheres[colliders[pairs[ids[i]].b].index];
+            data[0][i] = a.centre.x; data[1][i] = a.centre.y; data[2][i] = a.centre.z;
+            data[3][i] = b.centre.x - a.centre.x;
+            data[4][i] = b.centre.y - a.centre.y;
+            data[5][i] = b.centre.z - a.centre.z;
+            data[6][i] = a.radius + b.radius;
+        }
+
+        for (uint i = 0; i < n; i += SimdFloat::Width)
+        {
+            SimdFloat dx = SimdFloat::load(&data[3][i]), dy = SimdFloat::load(&data[4][i]), dz = SimdFloat::load(&data[5][i]);
+            SimdFloat r = SimdFloat::load(&data[6][i]);
+            SimdFloat d2 = dx*dx + dy*dy + dz*dz;
+            uint bits = (d2 <= r*r).mask();
+            if (i + SimdFloat::Width > n)
+                bits &= (1u << (n - i)) - 1;
+            if (!bits)
+                continue;
+
+            // concentric spheres push apart along y
+            SimdFloat d = vsqrt(d2);
+            SimdFloat zero = d <= 0.0f;
+            SimdFloat inv = select(zero, 0.0f, SimdFloat(1.0f) / d);
+            float nx[SimdFloat::Width], ny[SimdFloat::Width], nz[SimdFloat::Width], depth[SimdFloat::Width];
+            (dx * inv).store(nx);
+            select(zero, 1.0f, dy * inv).store(ny);
+            (dz * inv).store(nz);
+            (r - d).store(depth);
+
+            for (; bits; bits &= bits - 1)
+            {
+                uint lane = __builtin_ctz(bits), k = i + lane;
+                const Sphere& a = spheres[colliders[pairs[ids[k]].a].index];
+                float3 normal(nx[lane], ny[lane], nz[lane]);
+                emit(out, ids[k], normal, a.centre + normal * (a.radius - depth[lane] * 0.5f), depth[lane]);
+            }
+        }
+    }
+    void sphereBoxKernel(const uint* ids, uint n, vector<ThreadContact>& out)
+    {
+        // sphere centre relative to the box centre, box extent, radius
+        float data[7][Chunk] = {};
+        for (uint i = 0; i < n; i++)
+        {
+            const Sphere& s = spheres[colliders[pairs[ids[i]].a].index];
+            const Box& b = boxes[colliders[pairs[ids[i]].b].index];
+            for (int k = 0; k < 3; k++)
+            {
+                data[k][i] = s.centre._x[k] - b.centre._x[k];
+                data[3 + k][i] = b.extent._x[k];
+            }
+            data[6][i] = s.radius;
+        }
+
+        for (uint i = 0; i < n; i += SimdFloat::Width)
+        {
+            SimdFloat c[3], e[3], q[3], inside = SimdFloat(0.0f) <= 0.0f;
+            SimdFloat d2 = 0.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                c[k] = SimdFloat::load(&data[k][i]);
+                e[k] = SimdFloat::load(&data[3 + k][i]);
+                q[k] = vmax(vmin(c[k], e[k]), SimdFloat(0.0f) - e[k]);
+                SimdFloat d = c[k] - q[k];
+                d2 = d2 + d*d;
+                inside = inside & (vabs(c[k]) <= e[k]);
+            }
+            SimdFloat r = SimdFloat::load(&data[6][i]);
+            uint bits = (d2 <= r*r).mask();
+            if (i + SimdFloat::Width > n)
+                bits &= (1u << (n - i)) - 1;
+            if (!bits)
+                continue;
+
+            // outside: along the closest point, towards the box
+            SimdFloat d = vsqrt(d2);
+            SimdFloat inv = select(d <= 0.0f, 0.0f, SimdFloat(1.0f) / d);
+            SimdFloat n3[3];
+            for (int k = 0; k < 3; k++)
+            {
+                n3[k] = (q[k] - c[k]) * inv;
+            }
+            SimdFloat depth = r - d;
+
+            // centre inside: out through the nearest face
+            SimdFloat face[3], best = INFINITY;
+            for (int k = 0; k < 3; k++)
+            {
+                face[k] = e[k] - vabs(c[k]);
+                best = vmin(best, face[k]);
+            }
+            SimdFloat none = 0.0f, taken = none;
+            for (int k = 0; k < 3; k++)
+            {
+                // first axis on ties
+                SimdFloat axis = select(taken, none, face[k] <= best);
+                taken = taken | axis;
+                SimdFloat inward = select(c[k] < 0.0f, 1.0f, -1.0f);
+                n3[k] = select(inside, select(axis, inward, 0.0f), n3[k]);
+            }
+            depth = select(inside, r + best, depth);
+
+            float nx[SimdFloat::Width], ny[SimdFloat::Width], nz[SimdFloat::Width], dp[SimdFloat::Width];
+            n3[0].store(nx);
+            n3[1].store(ny);
+            n3[2].store(nz);
+            depth.store(dp);
+
+            for (; bits; bits &= bits - 1)
+            {
+                uint lane = __builtin_ctz(bits), k = i + lane;
+                const Sphere& s = spheres[colliders[pairs[ids[k]].a].index];
+                float3 normal(nx[lane], ny[lane], nz[lane]);
+                emit(out, ids[k], normal, s.centre + normal * (s.radius - dp[lane] * 0.5f), dp[lane]);
+            }
+        }
+    }
+    void boxBoxKernel(const uint* ids, uint n, vector<ThreadContact>& out)
+    {
+        // centre of b relative to a, both extents
+        float data[9][Chunk] = {};
+        for (uint i = 0; i < n; i++)
+        {
+            const Box& a = boxes[colliders[pairs[ids[i]].a].index];
+            const Box& b = boxes[colliders[pairs[ids[i]].b].index];
+            for (int k = 0; k < 3; k++)
+            {
+                data[k][i] = b.centre._x[k] - a.centre._x[k];
+                data[3 + k][i] = a.extent._x[k];
+                data[6 + k][i] = b.extent._x[k];
+            }
+        }
+
+        for (uint i = 0; i < n; i += SimdFloat::Width)
+        {
+            SimdFloat d[3], overlap[3], best = INFINITY, hit = SimdFloat(0.0f) <= 0.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                d[k] = SimdFloat::load(&data[k][i]);
+                overlap[k] = SimdFloat::load(&data[3 + k][i]) + SimdFloat::load(&data[6 + k][i]) - vabs(d[k]);
+                hit = hit & (overlap[k] >= 0.0f);
+                best = vmin(best, overlap[k]);
+            }
+            uint bits = hit.mask();
+            if (i + SimdFloat::Width > n)
+                bits &= (1u << (n - i)) - 1;
+            if (!bits)
+                continue;
+
+            // separate along the axis of least overlap, first one on ties
+            float dd[3][SimdFloat::Width], ov[3][SimdFloat::Width], dp[SimdFloat::Width];
+            for (int k = 0; k < 3; k++)
+            {
+                d[k].store(dd[k]);
+                overlap[k].store(ov[k]);
+            }
+            best.store(dp);
+
+            for (; bits; bits &= bits - 1)
+            {
+                uint lane = __builtin_ctz(bits), j = i + lane;
+                const Box& a = boxes[colliders[pairs[ids[j]].a].index];
+                const Box& b = boxes[colliders[pairs[ids[j]].b].index];
+                int axis = ov[0][lane] <= dp[lane] ? 0 : ov[1][lane] <= dp[lane] ? 1 : 2;
+                float3 normal;
+                normal._x[axis] = dd[axis][lane] < 0.0f ? -1.0f : 1.0f;
+
+                // middle of the overlap region
+                float3 point;
+                for (int k = 0; k < 3; k++)
+                {
+                    float l = fmaxf(a.centre._x[k] - a.extent._x[k], b.centre._x[k] - b.extent._x[k]);
+                    float h = fminf(a.centre._x[k] + a.extent._x[k], b.centre._x[k] + b.extent._x[k]);
+                    point._x[k] = (l + h) * 0.5f;
+                }
+                emit(out, ids[j], normal, point, dp[lane]);
+            }
+        }
+    }
+
+    template<typename A, typename B>
+    void gjkPair(const A& a, const B& b, uint pair, vector<ThreadContact>& out)
+    {
+        GjkResult r = gjkDistance(a, b);
+        if (r.intersecting)
+            emit(out, pair, r.normal, (r.pointA + r.pointB) * 0.5f, -r.distance);
+    }
+    void otherKernel(const uint* ids, uint n, vector<ThreadContact>& out)
+    {
+        for (uint i = 0; i < n; i++)
+        {
+            const Collider& a = colliders[pairs[ids[i]].a];
+            const Collider& b = colliders[pairs[ids[i]].b];
+            const Capsule& cb = capsules[b.index];
+            // b is the capsule, the type order puts it second
+            if (a.type == SphereShape)
+                gjkPair(spheres[a.index], cb, ids[i], out);
+            else if (a.type == BoxShape)
+                gjkPair(boxes[a.index], cb, ids[i], out);
+            else
+                gjkPair(capsules[a.index], cb, ids[i], out);
+        }
+    }
+
+    void narrowphase(JobSystem* jobs)
+    {
+        PROFILE_SCOPE("collision narrowphase");
+        auto start = chrono::steady_clock::now();
+
+        sphereSphere.clear();
+        sphereBox.clear();
+        boxBox.clear();
+        other.clear();
+        for (uint i = 0; i < pairs.size(); i++)
+        {
+            ShapeType ta = colliders[pairs[i].a].type, tb = colliders[pairs[i].b].type;
+            if (tb == CapsuleShape)
+                other.push_back(i);
+            else if (ta == SphereShape)
+                (tb == SphereShape ? sphereSphere : sphereBox).push_back(i);
+            else
+                boxBox.push_back(i);
+        }
+
+        uint threads = jobs ? jobs->numThreads() : 1;
+        threadContacts.resize(threads);
+        for (auto& c : threadContacts)
+        {
+            c.clear();
+        }
+
+        // one job list over all buckets, in chunks
+        struct Task
+        {
+            vector<uint>* bucket;
+            uint begin;
+            void (CollisionPipeline::*kernel)(const uint*, uint, vector<ThreadContact>&);
+        };
+        vector<Task> tasks;
+        auto addTasks = [&](vector<uint>& bucket, void (CollisionPipeline::*kernel)(const uint*, uint, vector<ThreadContact>&)) {
+            for (uint i = 0; i < bucket.size(); i += Chunk)
+                tasks.push_back({ &bucket, i, kernel });
+        };
+        addTasks(other, &CollisionPipeline::otherKernel);
+        addTasks(sphereSphere, &CollisionPipeline::sphereSphereKernel);
+        addTasks(sphereBox, &CollisionPipeline::sphereBoxKernel);
+        addTasks(boxBox, &CollisionPipeline::boxBoxKernel);
+
+        auto job = [&](int begin, int end) {
+            vector<ThreadContact>& out = threadContacts[jobs ? jobs->currentThread() : 0];
+            for (int t = begin; t < end; t++)
+            {
+                const Task& task = tasks[t];
+                uint n = task.bucket->size() - task.begin;
+                (this->*task.kernel)(&(*task.bucket)[task.begin], n < Chunk ? n : Chunk, out);
+            }
+        };
+        if (jobs)
+            jobs->parallelFor(0, tasks.size(), 4, job);
+        else
+            job(0, tasks.size());
+
+        stats.narrowphaseMs = msSince(start);
+    }
+
+    void merge()
+    {
+        PROFILE_SCOPE("collision merge");
+        auto start = chrono::steady_clock::now();
+
+        merged.clear();
+        for (auto& c : threadContacts)
+        {
+            merged.insert(merged.end(), c.begin(), c.end());
+        }
+        // at most one contact per pair, so the key is unique
+        sort(merged.begin(), merged.end(), [](const ThreadContact& a, const ThreadContact& b) {
+            return a.key < b.key;
+        });
+
+        output.resize(merged.size());
+        for (uint i = 0; i < merged.size(); i++)
+        {
+            output[i] = merged[i].contact;
+        }
+
+        stats.contacts = output.size();
+        stats.mergeMs = msSince(start);
+    }
+
+public:
+    void clear()
+    {
+        colliders.clear();
+        spheres.clear();
+        boxes.clear();
+        capsules.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k].clear();
+            hi[k].clear();
+        }
+    }
+
+    void add(const Sphere& s, uint userData)
+    {
+        colliders.push_back({ SphereShape, (uint)spheres.size(), userData });
+        spheres.push_back(s);
+        addBounds(Box(s.centre, float3(s.radius, s.radius, s.radius)));
+    }
+    void add(const Box& b, uint userData)
+    {
+        colliders.push_back({ BoxShape, (uint)boxes.size(), userData });
+        boxes.push_back(b);
+        addBounds(b);
+    }
+    void add(const Capsule& c, uint userData)
+    {
+        colliders.push_back({ CapsuleShape, (uint)capsules.size(), userData });
+        capsules.push_back(c);
+        float3 lo(fminf(c.a.x, c.b.x), fminf(c.a.y, c.b.y), fminf(c.a.z, c.b.z));
+        float3 hi(fmaxf(c.a.x, c.b.x), fmaxf(c.a.y, c.b.y), fmaxf(c.a.z, c.b.z));
+        addBounds(Box((lo + hi) * 0.5f, (hi - lo) * 0.5f + float3(c.radius, c.radius, c.radius)));
+    }
+
+    uint size() const { return colliders.size(); }
+
+    // jobs may be null to run everything on the calling thread
+    void run(JobSystem* jobs)
+    {
+        PROFILE_SCOPE("collision pipeline");
+        stats = Stats();
+        if (colliders.empty())
+        {
+            output.clear();
+            return;
+        }
+        broadphase(jobs);
+        narrowphase(jobs);
+        merge();
+    }
+
+    // ordered by the colliders' add() order, the same for any thread count
+    const vector<Contact>& contacts() const { return output; }
+    const Stats& lastStats() const { return stats; }
+};
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef _CUBE_PHYSICS_SPATIALHASH_H
+#define _CUBE_PHYSICS_SPATIALHASH_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../collision.h"
+#include "broadphase.h"
+
+// uniform grid broadphase for lots of moving objects
+//
+// objects are axis aligned boxes, linked into every grid cell they touch.
+// cells are hashed into a fixed bucket table, so the grid is unbounded.
+// the cell size should be about the size of a typical object: large objects
+// get an entry in every cell they cover, and tiny cells mean objects change
+// cells (and relink) more often. insert/move/remove recycle their storage,
+// so once the pools have grown to the working set nothing allocates.
+// 2D scenes can use boxes with a zero z extent
+class SpatialHash : public Broadphase
+{
+public:
+    static const uint None = ~0u;
+
+private:
+    // one per (object, cell), linked into its bucket and into the object's list
+    struct Entry
+    {
+        int3 cell;
+        uint object;
+        uint bucket;
+        uint next, prev;    // bucket list
+        uint objectNext;    // the object's next entry, or the next free entry
+    };
+    struct Object
+    {
+        Box bounds;
+        int3 cellMin, cellMax;
+        uint firstEntry = None;
+        uint userData = 0;
+        bool alive = false;
+    };
+    struct Bucket
+    {
+        uint head = None;
+        uint count = 0;
+    };
+
+    float cellSize;
+    float invCellSize;
+
+    vector<Bucket> buckets;
+    vector<Entry> entries;
+    vector<Object> objects;
+    uint freeEntry = None;
+    vector<Handle> freeObjects;
+    uint numObjects = 0;
+
+    int3 cellOf(const float3& p) const
+    {
+        return int3((int)floorf(p.x * invCellSize), (int)floorf(p.y * invCellSize), (int)floorf(p.z * invCellSize));
+    }
+    uint hash(const int3& c) const
+    {
+        uint h = (uint)c.x * 73856093u ^ (uint)c.y * 19349663u ^ (uint)c.z * 83492791u;
+        return h & (buckets.size() - 1);
+    }
+    static bool sameCell(const int3& a, const int3& b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+    // two ranges can share several cells; only the low corner of the overlap reports them
+    static bool firstSharedCell(const int3& cell, const int3& minA, const int3& minB)
+    {
+        return cell.x == (minA.x > minB.x ? minA.x : minB.x)
+            && cell.y == (minA.y > minB.y ? minA.y : minB.y)
+            && cell.z == (minA.z > minB.z ? minA.z : minB.z);
+    }
+
+    uint allocEntry()
+    {
+        if (freeEntry != None)
+        {
+            uint e = freeEntry;
+            freeEntry = entries[e].objectNext;
+            return e;
+        }
+        entries.push_back(Entry());
+        return entries.size() - 1;
+    }
+
+    void link(Handle h)
+    {
+        Object& o = objects[h];
+        for (int z = o.cellMin.z; z <= o.cellMax.z; z++)
+        for (int y = o.cellMin.y; y <= o.cellMax.y; y++)
+        for (int x = o.cellMin.x; x <= o.cellMax.x; x++)
+        {
+            uint e = allocEntry();
+            Entry& entry = entries[e];
+            entry.cell = int3(x, y, z);
+            entry.object = h;
+            entry.bucket = hash(entry.cell);
+
+            Bucket& bucket = buckets[entry.bucket];
+            entry.prev = None;
+            entry.next = bucket.head;
+            if (entry.next != None)
+            {
+                entries[entry.next].prev = e;
+            }
+            bucket.head = e;
+            bucket.count++;
+
+            entry.objectNext = o.firstEntry;
+            o.firstEntry = e;
+        }
+    }
+    void unlink(Handle h)
+    {
+        Object& o = objects[h];
+        uint e = o.firstEntry;
+        while (e != None)
+        {
+            Entry& entry = entries[e];
+            Bucket& bucket = buckets[entry.bucket];
+            if (entry.prev != None)
+                entries[entry.prev].next = entry.next;
+            else
+                bucket.head = entry.next;
+            if (entry.next != None)
+                entries[entry.next].prev = entry.prev;
+            bucket.count--;
+
+            uint next = entry.objectNext;
+            entry.objectNext = freeEntry;
+            freeEntry = e;
+            e = next;
+        }
+        o.firstEntry = None;
+    }
+
+    void setCells(Object& o)
+    {
+        o.cellMin = cellOf(o.bounds.centre - o.bounds.extent);
+        o.cellMax = cellOf(o.bounds.centre + o.bounds.extent);
+    }
+
+public:
+    // expectedObjects sizes the bucket table and pools up front
+    SpatialHash(float _cellSize, uint expectedObjects = 1024)
+    {
+        uint size = 64;
+        while (size < expectedObjects * 2)
+        {
+            size *= 2;
+        }
+        buckets.resize(size);
+        objects.reserve(expectedObjects);
+        entries.reserve(expectedObjects * 4);
+        setCellSize(_cellSize);
+    }
+
+    float getCellSize() const { return cellSize; }
+    uint size() const override { return numObjects; }
+
+    // changing the cell size relinks every object
+    void setCellSize(float size)
+    {
+        cellSize = size;
+        invCellSize = 1.0f / size;
+        for (Handle h = 0; h < objects.size(); h++)
+        {
+            if (objects[h].alive)
+            {
+                unlink(h);
+                setCells(objects[h]);
+                link(h);
+            }
+        }
+    }
+
+    Handle insert(const Box& bounds, uint userData) override
+    {
+        Handle h;
+        if (freeObjects.size())
+        {
+            h = freeObjects.back();
+            freeObjects.pop_back();
+        }
+        else
+        {
+            objects.push_back(Object());
+            h = objects.size() - 1;
+        }
+
+        Object& o = objects[h];
+        o.bounds = bounds;
+        o.userData = userData;
+        o.alive = true;
+        setCells(o);
+        link(h);
+        numObjects++;
+        return h;
+    }
+    void move(Handle h, const Box& bounds) override
+    {
+        Object& o = objects[h];
+        assert(o.alive && "moving a removed object");
+        o.bounds = bounds;
+
+        // most moves stay within the same cells and only need the new bounds
+        int3 oldMin = o.cellMin, oldMax = o.cellMax;
+        setCells(o);
+        if (!sameCell(oldMin, o.cellMin) || !sameCell(oldMax, o.cellMax))
+        {
+            unlink(h);
+            link(h);
+        }
+    }
+    void remove(Handle h) override
+    {
+        assert(objects[h].alive && "removing an object twice");
+        unlink(h);
+        objects[h].alive = false;
+        freeObjects.push_back(h);
+        numObjects--;
+    }
+    void clear() override
+    {
+        buckets.assign(buckets.size(), Bucket());
+        entries.clear();
+        objects.clear();
+        freeObjects.clear();
+        freeEntry = None;
+        numObjects = 0;
+    }
+
+    const Box& getBounds(Handle h) const { return objects[h].bounds; }
+    uint getUserData(Handle h) const { return objects[h].userData; }
+
+    void query(const Box& bounds, vector<uint>& out) override
+    {
+        out.clear();
+        int3 qmin = cellOf(bounds.centre - bounds.extent);
+        int3 qmax = cellOf(bounds.centre + bounds.extent);
+
+        for (int z = qmin.z; z <= qmax.z; z++)
+        for (int y = qmin.y; y <= qmax.y; y++)
+        for (int x = qmin.x; x <= qmax.x; x++)
+        {
+            int3 cell(x, y, z);
+            for (uint e = buckets[hash(cell)].head; e != None; e = entries[e].next)
+            {
+                const Entry& entry = entries[e];
+                const Object& o = objects[entry.object];
+                if (sameCell(entry.cell, cell) && firstSharedCell(cell, qmin, o.cellMin) && overlaps(bounds, o.bounds))
+                {
+                    out.push_back(o.userData);
+                }
+            }
+        }
+    }
+
+    void findPairs(vector<CollisionPair>& pairs) override
+    {
+        pairs.clear();
+        for (auto& bucket : buckets)
+        {
+            // most buckets hold one entry or none; the count saves following them
+            if (bucket.count < 2)
+                continue;
+
+            for (uint e = bucket.head; e != None; e = entries[e].next)
+            {
+                const Entry& ea = entries[e];
+                const Object& a = objects[ea.object];
+                for (uint f = ea.next; f != None; f = entries[f].next)
+                {
+                    const Entry& eb = entries[f];
+                    const Object& b = objects[eb.object];
+                    if (sameCell(ea.cell, eb.cell) && firstSharedCell(ea.cell, a.cellMin, b.cellMin) && overlaps(a.bounds, b.bounds))
+                    {
+                        pairs.push_back({ a.userData, b.userData });
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef _CUBE_PHYSICS_SWEEPANDPRUNE_H
+#define _CUBE_PHYSICS_SWEEPANDPRUNE_H
+
+#include "../definitions.h"
+#include "../math3d.h"
+#include "../simd.h"
+#include "../collision.h"
+#include "broadphase.h"
+
+// sweep and prune broadphase for scenes that stay coherent between frames
+//
+// the boxes are kept in structure-of-arrays form, sorted by their lower x.
+// moves write straight into the arrays; the next query re-sorts them with an
+// insertion sort, which is close to linear when objects only shuffle past a
+// few neighbours (and falls back to a full sort after large changes).
+// findPairs sweeps along x and tests each box against the boxes that start
+// before it ends, SimdFloat::Width of them at a time on all three axes
+class SweepAndPrune : public Broadphase
+{
+    static constexpr uint None = ~0u;
+
+    // sorted by xlo; padded with SimdFloat::Width entries that start at +inf
+    vector<float> xlo, xhi, ylo, yhi, zlo, zhi;
+    vector<Handle> ids;
+    uint count = 0;
+
+    // per handle
+    vector<uint> slot;          // index in the sorted arrays, or the next free handle
+    vector<uint> userData;
+    uint freeHandle = None;
+
+    bool sorted = true;
+    float maxWidth = 0.0f;      // widest box along x, bounds how far back a query has to look
+    uint removed = 0;
+    uint appended = 0;          // inserts since the last sort
+
+    // scratch for full sorts
+    vector<uint> order;
+    vector<float> sortScratch;
+    vector<Handle> idScratch;
+
+    void resizeArrays(uint n)
+    {
+        uint padded = n + SimdFloat::Width;
+        xlo.resize(padded, INFINITY);
+        xhi.resize(padded, 0.0f);
+        ylo.resize(padded, 0.0f);
+        yhi.resize(padded, 0.0f);
+        zlo.resize(padded, 0.0f);
+        zhi.resize(padded, 0.0f);
+        ids.resize(padded, None);
+        for (uint i = n; i < padded; i++)
+        {
+            xlo[i] = INFINITY;
+            ids[i] = None;
+        }
+    }
+
+    void write(uint i, const Box& b)
+    {
+        xlo[i] = b.centre.x - b.extent.x;
+        xhi[i] = b.centre.x + b.extent.x;
+        ylo[i] = b.centre.y - b.extent.y;
+        yhi[i] = b.centre.y + b.extent.y;
+        zlo[i] = b.centre.z - b.extent.z;
+        zhi[i] = b.centre.z + b.extent.z;
+    }
+
+    void compact()
+    {
+        uint n = 0;
+        for (uint i = 0; i < count; i++)
+        {
+            if (ids[i] == None)
+                continue;
+            xlo[n] = xlo[i]; xhi[n] = xhi[i];
+            ylo[n] = ylo[i]; yhi[n] = yhi[i];
+            zlo[n] = zlo[i]; zhi[n] = zhi[i];
+            ids[n] = ids[i];
+            slot[ids[n]] = n;
+            n++;
+        }
+        count = n;
+        resizeArrays(count);
+        removed = 0;
+    }
+
+    void insertionSort()
+    {
+        for (uint i = 1; i < count; i++)
+        {
+            float key = xlo[i];
+            if (xlo[i - 1] <= key)
+                continue;
+
+            float xh = xhi[i], yl = ylo[i], yh = yhi[i], zl = zlo[i], zh = zhi[i];
+            Handle id = ids[i];
+            uint j = i;
+            do
+            {
+                xlo[j] = xlo[j - 1]; xhi[j] = xhi[j - 1];
+                ylo[j] = ylo[j - 1]; yhi[j] = yhi[j - 1];
+                zlo[j] = zlo[j - 1]; zhi[j] = zhi[j - 1];
+                ids[j] = ids[j - 1];
+                slot[ids[j]] = j;
+                j--;
+            }
+            while (j > 0 && xlo[j - 1] > key);
+
+            xlo[j] = key; xhi[j] = xh;
+            ylo[j] = yl; yhi[j] = yh;
+            zlo[j] = zl; zhi[j] = zh;
+            ids[j] = id;
+            slot[id] = j;
+        }
+    }
+
+    void permute(vector<float>& v)
+    {
+        for (uint i = 0; i < count; i++)
+            sortScratch[i] = v[order[i]];
+        memcpy(&v[0], &sortScratch[0], count * sizeof(float));
+    }
+    void fullSort()
+    {
+        order.resize(count);
+        for (uint i = 0; i < count; i++)
+        {
+            order[i] = i;
+        }
+        sort(order.begin(), order.end(), [&](uint a, uint b) { return xlo[a] < xlo[b]; });
+
+        sortScratch.resize(count);
+        permute(xlo); permute(xhi);
+        permute(ylo); permute(yhi);
+        permute(zlo); permute(zhi);
+        idScratch.resize(count);
+        for (uint i = 0; i < count; i++)
+        {
+            idScratch[i] = ids[order[i]];
+            slot[idScratch[i]] = i;
+        }
+        memcpy(&ids[0], &idScratch[0], count * sizeof(Handle));
+    }
+
+    void update()
+    {
+        if (removed)
+        {
+            compact();
+        }
+        if (!sorted)
+        {
+            // appending many objects at once would make the insertion sort quadratic
+            if (appended > 64 && appended * 8 > count)
+                fullSort();
+            else
+                insertionSort();
+
+            maxWidth = 0.0f;
+            for (uint i = 0; i < count; i++)
+            {
+                maxWidth = fmaxf(maxWidth, xhi[i] - xlo[i]);
+            }
+        }
+        sorted = true;
+        appended = 0;
+    }
+
+public:
+    SweepAndPrune(uint expectedObjects = 1024)
+    {
+        slot.reserve(expectedObjects);
+        userData.reserve(expectedObjects);
+        resizeArrays(0);
+    }
+
+    uint size() const override { return count - removed; }
+
+    Handle insert(const Box& bounds, uint data) override
+    {
+        Handle h;
+        if (freeHandle != None)
+        {
+            h = freeHandle;
+            freeHandle = slot[h];
+        }
+        else
+        {
+            h = slot.size();
+            slot.push_back(0);
+            userData.push_back(0);
+        }
+
+        uint i = count++;
+        resizeArrays(count);
+        write(i, bounds);
+        ids[i] = h;
+        slot[h] = i;
+        userData[h] = data;
+
+        sorted = false;
+        appended++;
+        return h;
+    }
+    void move(Handle h, const Box& bounds) override
+    {
+        write(slot[h], bounds);
+        sorted = false;
+    }
+    void remove(Handle h) override
+    {
+        // leave a hole for update() to compact
+        ids[slot[h]] = None;
+        slot[h] = freeHandle;
+        freeHandle = h;
+        removed++;
+    }
+    void clear() override
+    {
+        count = 0;
+        resizeArrays(0);
+        slot.clear();
+        userData.clear();
+        freeHandle = None;
+        sorted = true;
+        removed = 0;
+        appended = 0;
+    }
+
+    void query(const Box& bounds, vector<uint>& out) override
+    {
+        update();
+        out.clear();
+
+        SimdFloat qxl = bounds.centre.x - bounds.extent.x, qxh = bounds.centre.x + bounds.extent.x;
+        SimdFloat qyl = bounds.centre.y - bounds.extent.y, qyh = bounds.centre.y + bounds.extent.y;
+        SimdFloat qzl = bounds.centre.z - bounds.extent.z, qzh = bounds.centre.z + bounds.extent.z;
+
+        // nothing starting before this can reach the query box
+        float first = bounds.centre.x - bounds.extent.x - maxWidth;
+        uint lo = 0, hi = count;
+        while (lo < hi)
+        {
+            uint mid = (lo + hi) / 2;
+            if (xlo[mid] < first)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (uint i = lo; i < count; i += SimdFloat::Width)
+        {
+            SimdFloat started = SimdFloat::load(&xlo[i]) <= qxh;
+            if (!started.mask())
+                break;
+
+            SimdFloat hit = started & (SimdFloat::load(&xhi[i]) >= qxl)
+                & (SimdFloat::load(&ylo[i]) <= qyh) & (SimdFloat::load(&yhi[i]) >= qyl)
+                & (SimdFloat::load(&zlo[i]) <= qzh) & (SimdFloat::load(&zhi[i]) >= qzl);
+            for (uint bits = hit.mask(); bits; bits &= bits - 1)
+            {
+                out.push_back(userData[ids[i + __builtin_ctz(bits)]]);
+            }
+        }
+    }
+
+    void findPairs(vector<CollisionPair>& pairs) override
+    {
+        update();
+        pairs.clear();
+
+        for (uint i = 0; i < count; i++)
+        {
+            SimdFloat xh = xhi[i];
+            SimdFloat yl = ylo[i], yh = yhi[i];
+            SimdFloat zl = zlo[i], zh = zhi[i];
+            uint a = userData[ids[i]];
+
+            // every box starting before box i ends overlaps it on x; the
+            // arrays are sorted, so the first register with no such box ends the sweep
+            for (uint j = i + 1; j < count; j += SimdFloat::Width)
+            {
+                SimdFloat started = SimdFloat::load(&xlo[j]) <= xh;
+                if (!started.mask())
+                    break;
+
+                SimdFloat hit = started
+                    & (SimdFloat::load(&ylo[j]) <= yh) & (SimdFloat::load(&yhi[j]) >= yl)
+                    & (SimdFloat::load(&zlo[j]) <= zh) & (SimdFloat::load(&zhi[j]) >= zl);
+                for (uint bits = hit.mask(); bits; bits &= bits - 1)
+                {
+                    pairs.push_back({ a, userData[ids[j + __builtin_ctz(bits)]] });
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,380 @@
+#ifndef _PLANEGAME_H
+#define _PLANEGAME_H
+
+// the dogfight game: a menu, a settings screen and the game itself
+
+class PlaneGameMenu : public GameState
+{
+    TextureManager::FontHandle fontHandle;
+    SpriteFont* font = nullptr;
+    Sprite* sprite = nullptr;
+
+    struct MenuItem
+    {
+        string text;
+        float2 position;
+        float2 extent = float2(150, 32);
+        bool focus = false;
+    };
+    vector<MenuItem> menu;
+
+    void init();
+    void update();
+    void render();
+    void close();
+};
+
+class PlaneGameSettings : public GameState
+{
+    TextureManager::FontHandle fontHandle;
+    SpriteFont* font = nullptr;
+    Sprite* sprite = nullptr;
+
+    void init();
+    void update();
+    void render();
+    void close();
+};
+
+class PlaneGame : public GameState
+{
+    struct Player {
+        float3 position;
+        matrix transform;
+    };
+    // bullets are a unit sphere scaled by this, and collide at the same size
+    static constexpr float BulletRadius = 2.0f;
+
+    struct Bullet{
+        float3 position;
+        float3 velocity;    // per tick
+        matrix transform;
+        uint lod = 0;
+    };
+    struct Enemy {
+        float3 position;
+        matrix transform;
+    };
+    struct Wall {
+        float3 position;
+        float3 extent;
+    };
+
+    Camera camera;
+    Player player;
+    vector<Bullet> bullets;
+    vector<Enemy> enemies;
+    vector<Wall> walls;
+    BoxSoA wallBoxes;
+    LooseOctree scene { float3(0, 0, 0), 1024.0f };
+
+    // walls drawn last frame are this frame's occluders
+    OcclusionCuller* occlusion = nullptr;
+    vector<uint> occluders;
+    vector<uint> candidates;
+    BoxSoA candidateBoxes;
+    vector<uint> visible;
+
+    // scratch for the bullet sweep
+    SphereSoA bulletSpheres;
+    Float3SoA bulletMotion;
+    vector<SweepHit> bulletHits;
+
+    MeshLOD* bulletMesh;
+    Mesh* wallMesh;
+    Mesh* shipMesh;
+
+    TextureManager::FontHandle fontHandle;
+    SpriteFont* font = nullptr;
+    Sprite* sprite = nullptr;
+    ShaderManager::Handle meshShaderHandle;
+    Shader* meshShader = nullptr;
+    float screenHeight = 720.0f;
+
+    void init();
+    void update();
+    void render();
+    void close();
+
+};
+
+void PlaneGameMenu::init()
+{
+    fontHandle = game->textures->acquireFont("Futura-60 (3)");
+    font = game->textures->getFont(fontHandle);
+    sprite = new Sprite(game->shaders);
+
+    menu.push_back({ "start game", float2(200, 256)});
+    menu.push_back({ "settings", float2(200, 288)});
+    menu.push_back({ "exit", float2(200, 320)});
+}
+void PlaneGameMenu::update()
+{
+    float2 mouse = game->input.mousePos();
+    float2 mouseMove = game->input.mouseMove();
+
+    if (game->input.keyPressed(GLFW_KEY_ESCAPE))
+    {
+        game->exit();
+    }
+
+    // focused item
+    int focus = -1;
+
+    for (int i = 0; i < menu.size(); i++)
+    {
+        auto& item = menu[i];
+        if (item.focus)
+            focus = i;
+        item.focus = false;
+    }
+
+    if (abs(mouseMove.x) > 0.01 && abs(mouseMove.y) > 0.01)
+    {
+        focus = -1;
+        for (int i =0 ; i < menu.size(); i++)
+        {
+            auto& item = menu[i];
+            if (intersect(Rect(item.position+item.extent/2.f, item.extent/2.f), mouse))
+            {
+                item.focus = true;
+                focus = i;
+                break;
+            }
+        }
+    }
+    else
+    {
+        if (game->input.keyPressed(GLFW_KEY_UP))
+        {
+            focus = max(focus-1, 0);
+        }
+        if (game->input.keyPressed(GLFW_KEY_DOWN))
+        {
+            focus = min(focus+1, (int)menu.size()-1);
+        }
+    }
+
+    if (focus >= 0)
+    {
+        menu[focus].focus = true;
+    }
+
+    if (game->input.keyPressed(GLFW_KEY_ENTER))
+    {
+        switch (focus)
+        {
+            case 0:
+                game->setState(new PlaneGame);
+                break;
+            case 1:
+                game->setState(new PlaneGameSettings);
+                break;
+            case 2:
+                game->exit();
+                break;
+            default:
+                break;
+        }
+    }
+}
+void PlaneGameMenu::render()
+{
+    sprite->drawText(font, "dogfight game", float2(200, 200), {1, 1}, {0.75, 0.75, 0, 1});
+    for (auto& item : menu)
+    {
+        float4 def(0.7, 0.7, 0.7, 1);
+        float4 focus(0.9, 0.9, 0.9, 1);
+        sprite->drawText(font, item.text, item.position, {1,1}, item.focus ? focus : def);
+    }
+
+}
+void PlaneGameMenu::close()
+{
+    delete sprite;
+    game->textures->releaseFont(fontHandle);
+}
+
+
+void PlaneGameSettings::init()
+{
+    fontHandle = game->textures->acquireFont("Futura-60 (3)");
+    font = game->textures->getFont(fontHandle);
+    sprite = new Sprite(game->shaders);
+}
+void PlaneGameSettings::update()
+{
+    if (game->input.keyPressed(GLFW_KEY_ESCAPE))
+    {
+        game->setState(new PlaneGameMenu);
+    }
+}
+void PlaneGameSettings::render()
+{
+    sprite->drawText(font, "settings", float2(200, 200), {1, 1}, {0.75, 0.75, 0, 1});
+}
+void PlaneGameSettings::close()
+{
+    delete sprite;
+    game->textures->releaseFont(fontHandle);
+}
+
+void PlaneGame::init()
+{
+    fontHandle = game->textures->acquireFont("Futura-60 (3)");
+    font = game->textures->getFont(fontHandle);
+    sprite = new Sprite(game->shaders);
+
+    for (int i = 0; i < 10; i++)
+    {
+        Wall wall;
+        wall.position = float3(
+            uniform(-1000, 1000),
+            uniform(-1000, 1000),
+            uniform(-1000, 1000)
+        );
+        wall.extent = float3(
+            uniform(0, 100),
+            uniform(0, 100),
+            uniform(0, 100)
+        );
+        walls.push_back(wall);
+    }
+
+    for (uint i = 0; i < walls.size(); i++)
+    {
+        Box bounds(walls[i].position, walls[i].extent);
+        wallBoxes.add(bounds);
+        scene.insert(bounds, i);
+    }
+
+    meshShaderHandle = game->shaders->acquireShader("meshvs.glsl", "meshps.glsl");
+    meshShader = game->shaders->getShader(meshShaderHandle);
+
+    // headless runs have no depth to read back
+    bool software = game->isHeadless() || game->config->get("occlusion", "hardware") == "software";
+    occlusion = new OcclusionCuller(game->shaders, software ? OcclusionCuller::Software : OcclusionCuller::Hardware);
+
+    MeshBuilder builder;
+    builder.box(float3(-1, -1, -1), float3(1, 1, 1), {0,0}, {1,1});
+    wallMesh = builder.end(game->shaders->getVertexAttrs("mesh_vertex"));
+
+    // most bullets are far away, so they mostly draw a coarse level
+    builder.clear();
+    builder.sphere(float3(0, 0, 0), 1.0f, 32, 16);
+    bulletMesh = builder.endLOD(game->shaders->getVertexAttrs("mesh_vertex"), 5, 0.5f, INFINITY, true);
+
+    GLint viewport[4] = { 0 };
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    screenHeight = viewport[3];
+}
+
+void PlaneGame::update()
+{
+    if (game->input.keyPressed(GLFW_KEY_ESCAPE))
+    {
+        game->setState(new PlaneGameMenu);
+        return;
+    }
+
+    if (game->input.keyPressed(GLFW_KEY_SPACE))
+    {
+        Bullet b;
+        b.position = camera.position;
+        b.velocity = normalize(camera.target - camera.position) * 50.0f;
+        bullets.push_back(b);
+    }
+
+    // bullets cover several wall thicknesses per tick, so sweep them instead of
+    // testing where they end up
+    bulletSpheres.clear();
+    bulletMotion.clear();
+    for (auto& b : bullets)
+    {
+        bulletSpheres.add(Sphere(b.position, BulletRadius));
+        bulletMotion.add(b.velocity);
+    }
+    bulletHits.resize(bullets.size());
+    sweep(bulletSpheres, bulletMotion, wallBoxes, bulletHits.data(), game->jobs);
+
+    uint alive = 0;
+    for (uint i = 0; i < bullets.size(); i++)
+    {
+        Bullet& b = bullets[i];
+        b.position += b.velocity;
+        if (bulletHits[i].index != ~0u || len2(b.position) > 4000.0f * 4000.0f)
+            continue;
+        b.transform = matrix::scale(float3(BulletRadius, BulletRadius, BulletRadius)) * matrix::translation(b.position);
+        bullets[alive++] = b;
+    }
+    bullets.resize(alive);
+}
+void PlaneGame::render()
+{
+
+    camera.position = float3(2000, 2000, 2000);
+    camera.target = float3(0, 0, 0);
+    camera.up = float3(0, 1, 0);
+    camera.znear = 1;
+    camera.zfar = 3000;
+    camera.angle = pi / 3.f;
+    camera.aspect = 1.6f;
+    camera.update();
+
+    occlusion->begin(camera);
+    for (uint i : occluders)
+    {
+        occlusion->addOccluder(Box(walls[i].position, walls[i].extent));
+    }
+    occlusion->end();
+
+    candidates.clear();
+    candidateBoxes.clear();
+    scene.query(camera.frustum, [&](uint i) {
+        candidates.push_back(i);
+        candidateBoxes.add(Box(walls[i].position, walls[i].extent));
+        return true;
+    });
+    occlusion->cull(candidateBoxes, visible);
+
+    meshShader->bind();
+    meshShader->set("View", camera.view);
+    meshShader->set("Proj", camera.proj);
+
+    occluders.clear();
+    for (uint v : visible)
+    {
+        uint i = candidates[v];
+        auto& w = walls[i];
+        occlusion->render(meshShader, Box(w.position, w.extent), [&]() {
+            meshShader->set("World", matrix::scale(w.extent) * matrix::translation(w.position));
+            wallMesh->setDecode(meshShader);
+            wallMesh->render();
+        });
+        occluders.push_back(i);
+    }
+    bulletMesh->mesh->setDecode(meshShader);
+    for (auto& b : bullets)
+    {
+        b.lod = bulletMesh->select(camera, b.position, BulletRadius, b.lod, screenHeight);
+        meshShader->set("World", b.transform);
+        bulletMesh->render(b.lod);
+    }
+    
+    
+    sprite->drawText(font, "dogfight game", float2(200, 200), {1, 1}, {0.75, 0.75, 0, 1});
+    stringstream str;
+    str << "position: " << player.position.x << ", " << player.position.y << ", " << player.position.z;
+    sprite->drawText(font, str.str(), float2(0, 0), float2(0.5, 0.5));
+}
+void PlaneGame::close()
+{
+    delete occlusion;
+    delete bulletMesh;
+    delete wallMesh;
+    delete sprite;
+    game->shaders->releaseShader(meshShaderHandle);
+    game->textures->releaseFont(fontHandle);
+}
+
+#endif
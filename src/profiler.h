@@ -0,0 +1,393 @@
+#ifndef _CUBE_PROFILER_H
+#define _CUBE_PROFILER_H
+
+#include <cstring>
+#include "definitions.h"
+#include "math3d.h"
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1
+#endif
+
+struct ProfileEvent
+{
+    const char* name = nullptr;
+    uint64_t start = 0; // nanoseconds since the profiler started
+    uint64_t end = 0;
+    uint depth = 0;
+    uint thread = 0;
+};
+
+// events recorded by one thread
+// only the owning thread writes; Profiler::endFrame reads up to 'written'
+// and keeps only what the thread can't have overwritten while it copied
+struct ProfileThreadBuffer
+{
+    static const uint Capacity = 16384;
+
+    ProfileEvent events[Capacity];
+    atomic<uint> written { 0 };
+    uint read = 0;
+    uint depth = 0;
+    uint thread = 0;
+};
+
+class Profiler
+{
+    // GL_TIME_ELAPSED results are read once the GPU has them so we never wait on it;
+    // a frame still pending after this many frames is dropped
+    static const uint MaxGpuPending = 16;
+    static const uint MaxTraceEvents = 1 << 20;
+
+    struct GpuQuery
+    {
+        const char* name;
+        GLuint query;
+        uint64_t cpuStart;
+    };
+    struct Summary
+    {
+        const char* name;
+        uint depth;
+        bool gpu;
+        double ms;
+        double smoothed;
+    };
+
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+    mutex buffersMutex;
+    vector<ProfileThreadBuffer*> buffers;
+
+    vector<GLuint> freeQueries;
+    vector<GpuQuery> gpuFrame;
+    deque<vector<GpuQuery>> gpuPending;
+    uint gpuDropped = 0;
+    bool gpuActive = false;
+
+    vector<ProfileEvent> copied;
+    vector<ProfileEvent> trace;
+    vector<ProfileEvent> gpuTrace;
+    vector<Summary> summary;
+    uint64_t frameStart = 0;
+    double frameMs = 0;
+
+    Profiler() = default;
+    Profiler(const Profiler&) = delete;
+    Profiler& operator = (const Profiler&) = delete;
+    ~Profiler()
+    {
+        for (auto b : buffers)
+        {
+            delete b;
+        }
+    }
+
+    ProfileThreadBuffer* threadBuffer()
+    {
+        static thread_local ProfileThreadBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            // registering takes a lock once per thread, recording never does
+            buffer = new ProfileThreadBuffer();
+            lock_guard<mutex> lock(buffersMutex);
+            buffer->thread = buffers.size();
+            buffers.push_back(buffer);
+        }
+        return buffer;
+    }
+
+    void accumulate(const ProfileEvent& e, bool gpu)
+    {
+        double ms = (e.end - e.start) / 1.0e6;
+        // the same name from two translation units may be two pointers
+        for (auto& s : summary)
+        {
+            if (s.gpu == gpu && (s.name == e.name || !strcmp(s.name, e.name)))
+            {
+                s.ms += ms;
+                return;
+            }
+        }
+        summary.push_back({ e.name, e.depth, gpu, ms, ms });
+    }
+
+    void collectGpu()
+    {
+        // queries finish in order, so a frame is done once its last query is
+        while (gpuPending.size())
+        {
+            auto& frame = gpuPending.front();
+            GLint available = 0;
+            glGetQueryObjectiv(frame.back().query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                break;
+            }
+            for (auto& q : frame)
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &elapsed);
+
+                ProfileEvent e;
+                e.name = q.name;
+                e.start = q.cpuStart;
+                e.end = q.cpuStart + elapsed;
+                accumulate(e, true);
+                if (gpuTrace.size() < MaxTraceEvents)
+                {
+                    gpuTrace.push_back(e);
+                }
+                freeQueries.push_back(q.query);
+            }
+            gpuPending.pop_front();
+        }
+
+        // the GPU is too far behind; give up on the oldest frame. its queries may
+        // still be in flight, so they're deleted rather than reused
+        while (gpuPending.size() > MaxGpuPending)
+        {
+            auto& frame = gpuPending.front();
+            for (auto& q : frame)
+            {
+                glDeleteQueries(1, &q.query);
+            }
+            gpuDropped += frame.size();
+            gpuPending.pop_front();
+        }
+    }
+
+public:
+    static Profiler& get()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    uint64_t now() const
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - startTime).count();
+    }
+
+    // CPU scopes, use PROFILE_SCOPE rather than calling these directly
+    uint64_t begin()
+    {
+        threadBuffer()->depth++;
+        return now();
+    }
+    void end(const char* name, uint64_t start)
+    {
+        auto buffer = threadBuffer();
+        buffer->depth--;
+
+        uint n = buffer->written.load(memory_order_relaxed);
+        auto& e = buffer->events[n % ProfileThreadBuffer::Capacity];
+        e.name = name;
+        e.start = start;
+        e.end = now();
+        e.depth = buffer->depth;
+        e.thread = buffer->thread;
+        buffer->written.store(n + 1, memory_order_release);
+    }
+
+    // GPU scopes, timed with GL_TIME_ELAPSED so they can't be nested
+    void beginGpu(const char* name)
+    {
+        assert(!gpuActive && "GPU profile scopes can't be nested");
+        gpuActive = true;
+
+        GLuint query = 0;
+        if (freeQueries.size())
+        {
+            query = freeQueries.back();
+            freeQueries.pop_back();
+        }
+        else
+        {
+            glGenQueries(1, &query);
+        }
+        gpuFrame.push_back({ name, query, now() });
+        glBeginQuery(GL_TIME_ELAPSED, query);
+    }
+    void endGpu()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuActive = false;
+    }
+
+    // gather this frame's events from every thread; call once per frame from the main thread
+    void endFrame()
+    {
+        for (auto& s : summary)
+        {
+            s.ms = 0;
+        }
+
+        {
+            lock_guard<mutex> lock(buffersMutex);
+            for (auto b : buffers)
+            {
+                uint written = b->written.load(memory_order_acquire);
+                if (written - b->read > ProfileThreadBuffer::Capacity)
+                {
+                    // the thread lapped us, the oldest events are gone
+                    b->read = written - ProfileThreadBuffer::Capacity;
+                }
+                copied.clear();
+                for (uint i = b->read; i != written; i++)
+                {
+                    copied.push_back(b->events[i % ProfileThreadBuffer::Capacity]);
+                }
+
+                // the thread keeps writing while we copy; event n goes in the
+                // slot of event n - Capacity, so anything that old may be torn
+                atomic_thread_fence(memory_order_acquire);
+                uint latest = b->written.load(memory_order_relaxed);
+                for (uint i = 0; i < copied.size(); i++)
+                {
+                    if (latest - (b->read + i) >= ProfileThreadBuffer::Capacity)
+                    {
+                        continue;
+                    }
+                    accumulate(copied[i], false);
+                    if (trace.size() < MaxTraceEvents)
+                    {
+                        trace.push_back(copied[i]);
+                    }
+                }
+                b->read = written;
+            }
+        }
+
+        if (gpuFrame.size())
+        {
+            gpuPending.push_back(move(gpuFrame));
+            gpuFrame.clear();
+        }
+        collectGpu();
+
+        for (auto& s : summary)
+        {
+            s.smoothed += (s.ms - s.smoothed) * 0.05;
+        }
+
+        uint64_t t = now();
+        frameMs += ((t - frameStart) / 1.0e6 - frameMs) * 0.05;
+        frameStart = t;
+    }
+
+    void drawOverlay(Sprite* sprite, SpriteFont* font, const float2& pos, const float2& scale={0.4f, 0.4f})
+    {
+        float lineHeight = font->chars[(uint)'A'].height * scale.y;
+        float4 colour(1, 1, 0.6, 1);
+
+        stringstream str;
+        str << fixed << setprecision(2) << "frame " << frameMs << " ms";
+        if (gpuDropped)
+        {
+            str << ", " << gpuDropped << " gpu samples dropped";
+        }
+        sprite->drawText(font, str.str(), pos, scale, colour);
+
+        float2 line = pos;
+        for (auto& s : summary)
+        {
+            line.y += lineHeight;
+            str.str("");
+            str << string(s.depth * 2, ' ') << (s.gpu ? "[gpu] " : "") << s.name << "  " << setprecision(3) << s.smoothed << " ms";
+            sprite->drawText(font, str.str(), line, scale, colour);
+        }
+    }
+
+    // write everything recorded so far in the chrome://tracing / Perfetto JSON format
+    bool exportChromeTrace(const string& fname)
+    {
+        ofstream file(fname);
+        if (!file.is_open())
+        {
+            cout << "profiler: could not open " << fname << endl;
+            return false;
+        }
+
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        auto write = [&](const ProfileEvent& e, uint tid) {
+            file << (first ? "" : ",\n")
+                 << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+                 << ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << (e.end - e.start) / 1000.0 << "}";
+            first = false;
+        };
+        for (auto& e : trace)
+        {
+            write(e, e.thread);
+        }
+        for (auto& e : gpuTrace)
+        {
+            write(e, 1000);
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+        cout << "profiler: wrote " << trace.size() + gpuTrace.size() << " events to " << fname << endl;
+        return true;
+    }
+
+    // GPU samples given up on because the GPU fell too far behind
+    uint getGpuDropped() const { return gpuDropped; }
+
+    void clear()
+    {
+        trace.clear();
+        gpuTrace.clear();
+        summary.clear();
+    }
+
+    // GL objects have to go before the context does
+    void releaseGpu()
+    {
+        for (auto& frame : gpuPending)
+        {
+            for (auto& q : frame)
+            {
+                freeQueries.push_back(q.query);
+            }
+        }
+        gpuPending.clear();
+        for (auto& q : gpuFrame)
+        {
+            freeQueries.push_back(q.query);
+        }
+        gpuFrame.clear();
+        if (freeQueries.size())
+        {
+            glDeleteQueries(freeQueries.size(), &freeQueries[0]);
+        }
+        freeQueries.clear();
+    }
+};
+
+struct ProfileScope
+{
+    const char* name;
+    uint64_t start;
+
+    ProfileScope(const char* _name) : name(_name), start(Profiler::get().begin()) {}
+    ~ProfileScope() { Profiler::get().end(name, start); }
+};
+struct GpuProfileScope
+{
+    GpuProfileScope(const char* name) { Profiler::get().beginGpu(name); }
+    ~GpuProfileScope() { Profiler::get().endGpu(); }
+};
+
+#define _PROFILE_CONCAT2(a, b) a##b
+#define _PROFILE_CONCAT(a, b) _PROFILE_CONCAT2(a, b)
+
+#if PROFILE_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope _PROFILE_CONCAT(_profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope _PROFILE_CONCAT(_gpuProfileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef _CUBE_SIMD_H
+#define _CUBE_SIMD_H
+
+#include "definitions.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CUBE_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CUBE_SIMD_WIDTH 4
+#else
+#define CUBE_SIMD_WIDTH 1
+#endif
+
+// a register's worth of floats, for code that runs the same maths over
+// structure-of-arrays data. comparisons return lane masks (all bits set
+// where true) that combine with & | and feed select() and mask().
+// the width is fixed at compile time: 8 with AVX, 4 with SSE2, 1 otherwise
+struct SimdFloat
+{
+    static const int Width = CUBE_SIMD_WIDTH;
+
+#if CUBE_SIMD_WIDTH == 8
+    __m256 v;
+
+    SimdFloat() : v(_mm256_setzero_ps()) {}
+    SimdFloat(__m256 _v) : v(_v) {}
+    SimdFloat(float f) : v(_mm256_set1_ps(f)) {}
+
+    static SimdFloat load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    // one bit per lane, lane 0 in bit 0
+    uint mask() const { return (uint)_mm256_movemask_ps(v); }
+#elif CUBE_SIMD_WIDTH == 4
+    __m128 v;
+
+    SimdFloat() : v(_mm_setzero_ps()) {}
+    SimdFloat(__m128 _v) : v(_v) {}
+    SimdFloat(float f) : v(_mm_set1_ps(f)) {}
+
+    static SimdFloat load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    uint mask() const { return (uint)_mm_movemask_ps(v); }
+#else
+    float v;
+
+    SimdFloat() : v(0) {}
+    SimdFloat(float f) : v(f) {}
+
+    static SimdFloat load(const float* p) { return *p; }
+    void store(float* p) const { *p = v; }
+    uint mask() const { uint bits; memcpy(&bits, &v, 4); return bits >> 31; }
+#endif
+};
+
+#if CUBE_SIMD_WIDTH == 8
+
+inline SimdFloat operator + (SimdFloat a, SimdFloat b) { return _mm256_add_ps(a.v, b.v); }
+inline SimdFloat operator - (SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline SimdFloat operator * (SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline SimdFloat operator / (SimdFloat a, SimdFloat b) { return _mm256_div_ps(a.v, b.v); }
+inline SimdFloat operator & (SimdFloat a, SimdFloat b) { return _mm256_and_ps(a.v, b.v); }
+inline SimdFloat operator | (SimdFloat a, SimdFloat b) { return _mm256_or_ps(a.v, b.v); }
+inline SimdFloat operator <  (SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline SimdFloat operator <= (SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline SimdFloat operator >  (SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline SimdFloat operator >= (SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline SimdFloat vmin(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a.v, b.v); }
+inline SimdFloat vmax(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a.v, b.v); }
+inline SimdFloat vsqrt(SimdFloat a) { return _mm256_sqrt_ps(a.v); }
+inline SimdFloat vabs(SimdFloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+// lanes of a where mask is set, b elsewhere
+inline SimdFloat select(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+#elif CUBE_SIMD_WIDTH == 4
+
+inline SimdFloat operator + (SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+inline SimdFloat operator - (SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdFloat operator * (SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdFloat operator / (SimdFloat a, SimdFloat b) { return _mm_div_ps(a.v, b.v); }
+inline SimdFloat operator & (SimdFloat a, SimdFloat b) { return _mm_and_ps(a.v, b.v); }
+inline SimdFloat operator | (SimdFloat a, SimdFloat b) { return _mm_or_ps(a.v, b.v); }
+inline SimdFloat operator <  (SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline SimdFloat operator <= (SimdFloat a, SimdFloat b) { return _mm_cmple_ps(a.v, b.v); }
+inline SimdFloat operator >  (SimdFloat a, SimdFloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline SimdFloat operator >= (SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline SimdFloat vmin(SimdFloat a, SimdFloat b) { return _mm_min_ps(a.v, b.v); }
+inline SimdFloat vmax(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+inline SimdFloat vsqrt(SimdFloat a) { return _mm_sqrt_ps(a.v); }
+inline SimdFloat vabs(SimdFloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline SimdFloat select(SimdFloat mask, SimdFloat a, SimdFloat b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+
+#else
+
+inline float simdMask(bool b) { uint bits = b ? ~0u : 0u; float f; memcpy(&f, &bits, 4); return f; }
+inline uint simdBits(SimdFloat a) { uint bits; memcpy(&bits, &a.v, 4); return bits; }
+
+inline SimdFloat operator + (SimdFloat a, SimdFloat b) { return a.v + b.v; }
+inline SimdFloat operator - (SimdFloat a, SimdFloat b) { return a.v - b.v; }
+inline SimdFloat operator * (SimdFloat a, SimdFloat b) { return a.v * b.v; }
+inline SimdFloat operator / (SimdFloat a, SimdFloat b) { return a.v / b.v; }
+inline SimdFloat operator & (SimdFloat a, SimdFloat b) { uint r = simdBits(a) & simdBits(b); float f; memcpy(&f, &r, 4); return f; }
+inline SimdFloat operator | (SimdFloat a, SimdFloat b) { uint r = simdBits(a) | simdBits(b); float f; memcpy(&f, &r, 4); return f; }
+inline SimdFloat operator <  (SimdFloat a, SimdFloat b) { return simdMask(a.v < b.v); }
+inline SimdFloat operator <= (SimdFloat a, SimdFloat b) { return simdMask(a.v <= b.v); }
+inline SimdFloat operator >  (SimdFloat a, SimdFloat b) { return simdMask(a.v > b.v); }
+inline SimdFloat operator >= (SimdFloat a, SimdFloat b) { return simdMask(a.v >= b.v); }
+inline SimdFloat vmin(SimdFloat a, SimdFloat b) { return (a.v < b.v) ? a.v : b.v; }
+inline SimdFloat vmax(SimdFloat a, SimdFloat b) { return (a.v > b.v) ? a.v : b.v; }
+inline SimdFloat vsqrt(SimdFloat a) { return sqrtf(a.v); }
+inline SimdFloat vabs(SimdFloat a) { return fabsf(a.v); }
+inline SimdFloat select(SimdFloat mask, SimdFloat a, SimdFloat b) { return simdBits(mask) ? a : b; }
+
+#endif
+
+// structure-of-arrays storage for batch queries
+// pack(shape, out) must write a shape's Components floats; every component
+// array is zero padded to a multiple of SimdFloat::Width so loops can always
+// load whole registers
+template<typename Shape, int Components>
+struct SoA
+{
+    vector<float> data[Components];
+    uint count = 0;
+
+    void add(const Shape& s)
+    {
+        float v[Components];
+        pack(s, v);
+        if (count % SimdFloat::Width == 0)
+        {
+            for (int c = 0; c < Components; c++)
+                data[c].resize(count + SimdFloat::Width, 0.0f);
+        }
+        for (int c = 0; c < Components; c++)
+        {
+            data[c][count] = v[c];
+        }
+        count++;
+    }
+    void set(uint i, const Shape& s)
+    {
+        float v[Components];
+        pack(s, v);
+        for (int c = 0; c < Components; c++)
+        {
+            data[c][i] = v[c];
+        }
+    }
+    void clear()
+    {
+        for (int c = 0; c < Components; c++)
+            data[c].clear();
+        count = 0;
+    }
+
+    SimdFloat load(int component, uint i) const { return SimdFloat::load(&data[component][i]); }
+
+    // hit masks are one bit per element, 32 to a uint
+    uint maskWords() const { return (count + 31) / 32; }
+};
+
+inline void pack(const float2& p, float* v) { v[0] = p.x; v[1] = p.y; }
+inline void pack(const float3& p, float* v) { v[0] = p.x; v[1] = p.y; v[2] = p.z; }
+
+typedef SoA<float2, 2> Float2SoA;
+typedef SoA<float3, 3> Float3SoA;
+
+#endif
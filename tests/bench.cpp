@@ -0,0 +1,928 @@
+// benchmarks; not run by ctest, timings depend on the machine
+//
+//      bench [name...]
+//
+// runs the named benchmarks, or all of them. every timing is the best of a
+// few runs, so one preempted run doesn't skew it
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <bitset>
+#include <queue>
+#include <deque>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+#include "../src/math3d.h"
+#include "../src/definitions.h"
+#include "../src/simd.h"
+#include "../src/jobs.h"
+#include "../src/assets.h"
+
+#include "../src/graphics/nullgl.h"
+#include "../src/graphics/buffer.h"
+#include "../src/graphics/texture.h"
+#include "../src/graphics/surface.h"
+#include "../src/graphics/shader.h"
+#include "../src/graphics/camera.h"
+#include "../src/graphics/simplify.h"
+#include "../src/graphics/meshopt.h"
+#include "../src/graphics/objloader.h"
+#include "../src/graphics/meshfile.h"
+#include "../src/graphics/meshlet.h"
+#include "../src/graphics/animation.h"
+#include "../src/graphics/mesh.h"
+#include "../src/graphics/sprite.h"
+#include "../src/profiler.h"
+#include "../src/graphics/softgl.h"
+
+#include "../src/input.h"
+#include "../src/game.h"
+#include "../src/collision.h"
+#include "../src/physics/spatialhash.h"
+#include "../src/physics/aabbtree.h"
+#include "../src/physics/sweepandprune.h"
+#include "../src/physics/gjk.h"
+#include "../src/physics/pipeline.h"
+#include "../src/graphics/octree.h"
+#include "../src/graphics/occlusion.h"
+#include "../src/cubegame.h"
+#include "../src/planegame.h"
+
+#define GLAD_GL_IMPLEMENTATION
+#include <glad.h>
+
+// seconds for the fastest of runs calls of f
+template<typename Function>
+static double bestOf(int runs, const Function& f)
+{
+    double best = INFINITY;
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        f();
+        best = fmin(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+static mt19937 rng(1);
+static float uniformf(float a, float b) { return uniform_real_distribution<float>(a, b)(rng); }
+static float3 random3(float s) { return float3(uniformf(-s, s), uniformf(-s, s), uniformf(-s, s)); }
+static float2 random2(float s) { return float2(uniformf(-s, s), uniformf(-s, s)); }
+
+// keeps results alive so the timed loops aren't optimized away
+static volatile uint sink;
+
+
+// collision: millions of tests a second, one shape against an SoA array with
+// the batch test and against the same shapes one by one with the scalar test
+
+template<typename Query, typename Shape, int N>
+static void benchIntersect(const char* name, const Query& query, const vector<Shape>& shapes, const SoA<Shape, N>& array)
+{
+    vector<uint> hits(array.maskWords());
+    const int passes = 10;
+    double batch = bestOf(5, [&] {
+        for (int p = 0; p < passes; p++)
+            intersect(query, array, &hits[0]);
+    });
+    double scalar = bestOf(5, [&] {
+        for (int p = 0; p < passes; p++)
+        {
+            for (uint i = 0; i < shapes.size(); i++)
+                hits[i / 32] ^= (uint)intersect(query, shapes[i]) << (i % 32);
+        }
+    });
+    sink = hits[0];
+    double tests = (double)passes * shapes.size() / 1e6;
+    cout << "    " << left << setw(15) << name << right << fixed << setprecision(0)
+         << setw(8) << tests / batch << " Mtests/s batch, " << setw(6) << tests / scalar << " scalar ("
+         << setprecision(1) << scalar / batch << "x)" << endl;
+}
+
+static void benchCollision()
+{
+    // bigger than L2, like a real scene's worth of bounds
+    const uint n = 1 << 20;
+    vector<Sphere> spheres;
+    vector<Box> boxes;
+    vector<float3> points3;
+    vector<Circle> circles;
+    vector<Rect> rects;
+    vector<float2> points2;
+    SphereSoA sphereArray;
+    BoxSoA boxArray;
+    Float3SoA point3Array;
+    CircleSoA circleArray;
+    RectSoA rectArray;
+    Float2SoA point2Array;
+    for (uint i = 0; i < n; i++)
+    {
+        spheres.push_back(Sphere(random3(100), uniformf(0, 2)));
+        boxes.push_back(Box(random3(100), float3(uniformf(0, 2), uniformf(0, 2), uniformf(0, 2))));
+        points3.push_back(random3(100));
+        circles.push_back(Circle(random2(100), uniformf(0, 2)));
+        rects.push_back(Rect(random2(100), float2(uniformf(0, 2), uniformf(0, 2))));
+        points2.push_back(random2(100));
+        sphereArray.add(spheres.back());
+        boxArray.add(boxes.back());
+        point3Array.add(points3.back());
+        circleArray.add(circles.back());
+        rectArray.add(rects.back());
+        point2Array.add(points2.back());
+    }
+
+    cout << "  " << n << " shapes, SIMD width " << SimdFloat::Width << endl;
+    Sphere s(float3(1, 2, 3), 10);
+    Box b(float3(1, 2, 3), float3(10, 5, 8));
+    Circle c(float2(1, 2), 10);
+    Rect r(float2(1, 2), float2(10, 5));
+    benchIntersect("sphere/sphere", s, spheres, sphereArray);
+    benchIntersect("sphere/box", s, boxes, boxArray);
+    benchIntersect("sphere/point", s, points3, point3Array);
+    benchIntersect("box/box", b, boxes, boxArray);
+    benchIntersect("box/point", b, points3, point3Array);
+    benchIntersect("circle/circle", c, circles, circleArray);
+    benchIntersect("circle/rect", c, rects, rectArray);
+    benchIntersect("circle/point", c, points2, point2Array);
+    benchIntersect("rect/rect", r, rects, rectArray);
+    benchIntersect("rect/point", r, points2, point2Array);
+
+    // the ray tests also write a distance per element
+    Ray ray(float3(-100, 1, 2), float3(1, 0.01f, 0.02f));
+    vector<uint> hits(sphereArray.maskWords());
+    vector<float> distances(sphereArray.data[0].size());
+    const int passes = 10;
+    double tests = (double)passes * n / 1e6;
+    auto rays = [&](const char* name, auto& shapes, auto& array) {
+        double batch = bestOf(5, [&] {
+            for (int p = 0; p < passes; p++)
+                intersect(ray, array, &hits[0], &distances[0]);
+        });
+        double scalar = bestOf(5, [&] {
+            for (int p = 0; p < passes; p++)
+            {
+                for (uint i = 0; i < shapes.size(); i++)
+                    hits[i / 32] ^= (uint)intersect(ray, shapes[i], distances[i]) << (i % 32);
+            }
+        });
+        sink = hits[0];
+        cout << "    " << left << setw(15) << name << right << fixed << setprecision(0)
+             << setw(8) << tests / batch << " Mtests/s batch, " << setw(6) << tests / scalar << " scalar ("
+             << setprecision(1) << scalar / batch << "x)" << endl;
+    };
+    rays("ray/sphere", spheres, sphereArray);
+    rays("ray/box", boxes, boxArray);
+}
+
+
+// jobs: what scheduling a job costs, and how a compute bound parallelFor
+// scales with the number of threads (past the core count it shows what
+// oversubscription costs)
+
+static void emptyJob(void*, int, int) {}
+
+static void benchJobs()
+{
+    uint cores = thread::hardware_concurrency();
+    cout << "  " << cores << " hardware threads" << endl;
+
+    {
+        // at least one worker, or parallelFor runs everything inline
+        JobSystem jobs(cores > 2 ? cores - 1 : 1);
+        // under the queue capacity, so nothing runs inline
+        const int count = 4000;
+        double spawn = bestOf(20, [&] {
+            JobCounter counter;
+            for (int i = 0; i < count; i++)
+                jobs.run(emptyJob, nullptr, &counter);
+            jobs.wait(&counter);
+        });
+        double loop = bestOf(20, [&] {
+            jobs.parallelFor(0, count, 1, [](int, int) {});
+        });
+        // every job spawns two children until 4095 jobs have run
+        struct Tree
+        {
+            JobSystem* jobs;
+            JobCounter* counter;
+            static void run(void* data, int depth, int)
+            {
+                Tree* tree = (Tree*)data;
+                if (depth < 11)
+                {
+                    tree->jobs->run(&Tree::run, data, tree->counter, depth + 1);
+                    tree->jobs->run(&Tree::run, data, tree->counter, depth + 1);
+                }
+            }
+        };
+        double nested = bestOf(20, [&] {
+            JobCounter counter;
+            Tree tree = { &jobs, &counter };
+            jobs.run(&Tree::run, &tree, &counter, 0);
+            jobs.wait(&counter);
+        });
+        cout << fixed << setprecision(0) << "  " << jobs.numThreads() << " threads: run + wait "
+             << spawn / count * 1e9 << " ns/job, parallelFor " << loop / count * 1e9 << " ns/chunk, nested spawns "
+             << nested / 4095 * 1e9 << " ns/job" << endl;
+    }
+
+    // about 20us of arithmetic per chunk
+    const int chunks = 2048;
+    vector<float> results(chunks);
+    auto work = [&](int begin, int end) {
+        for (int c = begin; c < end; c++)
+        {
+            float x = c;
+            for (int i = 0; i < 5000; i++)
+                x = sqrtf(x * 0.5f + i);
+            results[c] = x;
+        }
+    };
+    double base = 0;
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        JobSystem jobs(threads - 1);
+        double t = bestOf(5, [&] { jobs.parallelFor(0, chunks, 4, work); });
+        if (threads == 1)
+            base = t;
+        cout << fixed << "  " << setw(2) << threads << " threads: " << setprecision(2) << t * 1e3 << " ms, "
+             << base / t << "x" << endl;
+    }
+    sink = (uint)results[chunks - 1];
+}
+
+
+// aabb tree: building 1k, 10k and 1M boxes one at a time, top down and top
+// down on the job system, then ray casts and box, sphere and frustum queries
+// against the threaded build
+
+static void benchAabbTree()
+{
+    JobSystem jobs;
+    for (int n : { 1000, 10000, 1000000 })
+    {
+        // the same density at every size, about 1% of the volume is boxes
+        float size = cbrtf((float)n) * 5;
+        vector<Box> boxes;
+        for (int i = 0; i < n; i++)
+            boxes.push_back(Box(random3(size), float3(uniformf(0.2, 2), uniformf(0.2, 2), uniformf(0.2, 2))));
+
+        int runs = n > 100000 ? 1 : 5;
+        AabbTree inserted, built, threaded;
+        vector<uint> userData;
+        vector<AabbTree::Handle> handles;
+        double insertTime = bestOf(runs, [&] {
+            inserted.clear();
+            for (int i = 0; i < n; i++)
+                inserted.insert(boxes[i], i);
+        });
+        double buildTime = bestOf(runs, [&] { built.build(boxes, userData, handles); });
+        double threadedTime = bestOf(runs, [&] { threaded.build(boxes, userData, handles, &jobs); });
+        cout << "  " << setw(7) << n << " boxes: insert " << fixed << setprecision(1) << insertTime * 1e3 << " ms (height "
+             << inserted.height() << "), build " << buildTime * 1e3 << " ms, threaded build (" << jobs.numThreads() << ") "
+             << threadedTime * 1e3 << " ms (height " << threaded.height() << ")" << endl;
+
+        const int queries = 100000;
+        vector<Ray> rays;
+        vector<float3> centres;
+        for (int i = 0; i < queries; i++)
+        {
+            rays.push_back(Ray(random3(size), random3(1)));
+            centres.push_back(random3(size));
+        }
+        uint found = 0;
+        double rayTime = bestOf(3, [&] {
+            for (auto& ray : rays)
+            {
+                // closest hit
+                threaded.raycast(ray, INFINITY, [&](uint i, const Ray& r) {
+                    float d;
+                    return intersect(r, boxes[i], d) ? (found++, d) : INFINITY;
+                });
+            }
+        });
+        double boxTime = bestOf(3, [&] {
+            for (auto& c : centres)
+                threaded.query(Box(c, float3(3, 3, 3)), [&](uint) { found++; return true; });
+        });
+        double sphereTime = bestOf(3, [&] {
+            for (auto& c : centres)
+                threaded.query(Sphere(c, 3), [&](uint) { found++; return true; });
+        });
+
+        // a camera at the edge of the boxes looking at their centre
+        const int frustums = 100;
+        Frustum frustum = Frustum::fromMatrix(matrix::lookAt(float3(-size, 0, 0), float3(0, 0, 0), float3(0, 1, 0)) *
+                                              matrix::perspective(pi / 3, 1.6f, 1, size));
+        uint visible = 0;
+        double frustumTime = bestOf(3, [&] {
+            visible = 0;
+            for (int i = 0; i < frustums; i++)
+                threaded.query(frustum, [&](uint) { visible++; return true; });
+        });
+        sink = found;
+        cout << "           " << setprecision(2) << queries / rayTime / 1e6 << " M rays/s, " << queries / boxTime / 1e6
+             << " M box queries/s, " << queries / sphereTime / 1e6 << " M sphere queries/s, frustum query "
+             << setprecision(3) << frustumTime / frustums * 1e3 << " ms (" << visible / frustums << " visible)" << endl;
+    }
+}
+
+
+// broadphases: every Broadphase replaying the same recorded motion, a move()
+// per live object and a findPairs() per frame. the traces are built the way
+// our games move things, so they're generated rather than read from files
+
+struct MotionTrace
+{
+    const char* name;
+    float objectSize;
+    // per frame, per object; a dead object is removed, and inserted again
+    // when it comes back
+    vector<vector<Box>> frames;
+    vector<vector<bool>> alive;
+};
+
+// CubeGame: cubes on one shared velocity towards the player, replaced at the
+// far end when they pass it
+static MotionTrace cubeTrace(uint n, int frames)
+{
+    MotionTrace trace = { "cubes", 1 };
+    float width = sqrtf((float)n) * 2;
+    vector<float3> positions;
+    for (uint i = 0; i < n; i++)
+        positions.push_back(float3(uniformf(-width, width), 0, uniformf(-10, 99)));
+    for (int f = 0; f < frames; f++)
+    {
+        trace.frames.emplace_back();
+        trace.alive.emplace_back();
+        for (auto& p : positions)
+        {
+            p.z -= 0.5f;
+            bool alive = p.z >= -10;
+            if (!alive)
+                p = float3(uniformf(-width, width), 0, 99);
+            trace.frames.back().push_back(Box(p + float3(0, 0.5, 0), float3(0.5, 0.5, 0.5)));
+            trace.alive.back().push_back(alive);
+        }
+    }
+    return trace;
+}
+
+// PlaneGame: bullets crossing the level in every direction, many times their
+// own size a frame, replaced when they leave it
+static MotionTrace bulletTrace(uint n, int frames)
+{
+    MotionTrace trace = { "bullets", 4 };
+    vector<float3> positions, velocities;
+    for (uint i = 0; i < n; i++)
+    {
+        positions.push_back(random3(1000));
+        velocities.push_back(normalize(random3(1)) * 50.0f);
+    }
+    for (int f = 0; f < frames; f++)
+    {
+        trace.frames.emplace_back();
+        trace.alive.emplace_back();
+        for (uint i = 0; i < n; i++)
+        {
+            positions[i] += velocities[i];
+            bool alive = len2(positions[i]) <= 2000.0f * 2000.0f;
+            if (!alive)
+            {
+                positions[i] = random3(1000);
+                velocities[i] = normalize(random3(1)) * 50.0f;
+            }
+            trace.frames.back().push_back(Box(positions[i], float3(2, 2, 2)));
+            trace.alive.back().push_back(alive);
+        }
+    }
+    return trace;
+}
+
+// crowds: objects of mixed sizes wandering slowly, each its own way
+static MotionTrace crowdTrace(uint n, int frames)
+{
+    MotionTrace trace = { "crowd", 2 };
+    float size = cbrtf((float)n) * 3;
+    vector<float3> positions, velocities, extents;
+    for (uint i = 0; i < n; i++)
+    {
+        positions.push_back(random3(size));
+        velocities.push_back(random3(0.05f));
+        extents.push_back(float3(uniformf(0.25, 1.5), uniformf(0.25, 1.5), uniformf(0.25, 1.5)));
+    }
+    for (int f = 0; f < frames; f++)
+    {
+        trace.frames.emplace_back();
+        trace.alive.emplace_back();
+        for (uint i = 0; i < n; i++)
+        {
+            velocities[i] += random3(0.01f);
+            positions[i] += velocities[i];
+            trace.frames.back().push_back(Box(positions[i], extents[i]));
+            trace.alive.back().push_back(true);
+        }
+    }
+    return trace;
+}
+
+// ms per frame, and the pairs found over the whole trace
+static double replay(const MotionTrace& trace, Broadphase* broadphase, size_t& pairCount)
+{
+    const uint n = trace.frames[0].size();
+    vector<Broadphase::Handle> handles(n);
+    vector<bool> inserted(n, false);
+    vector<CollisionPair> pairs;
+    pairCount = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t f = 0; f < trace.frames.size(); f++)
+    {
+        for (uint i = 0; i < n; i++)
+        {
+            const Box& bounds = trace.frames[f][i];
+            if (trace.alive[f][i] && inserted[i])
+            {
+                broadphase->move(handles[i], bounds);
+            }
+            else if (trace.alive[f][i])
+            {
+                handles[i] = broadphase->insert(bounds, i);
+                inserted[i] = true;
+            }
+            else if (inserted[i])
+            {
+                broadphase->remove(handles[i]);
+                inserted[i] = false;
+            }
+        }
+        broadphase->findPairs(pairs);
+        pairCount += pairs.size();
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    delete broadphase;
+    return ms / trace.frames.size();
+}
+
+static void benchBroadphase()
+{
+    // the traces are recorded up front, so the big case gets fewer frames to fit in memory
+    const function<MotionTrace(uint, int)> traces[] = { cubeTrace, bulletTrace, crowdTrace };
+    for (uint n : { 1000, 10000, 100000 })
+    {
+        int frames = n > 10000 ? 30 : 120;
+        for (auto& makeTrace : traces)
+        {
+            MotionTrace trace = makeTrace(n, frames);
+            // every broadphase must find the same pairs
+            size_t hashPairs, sapPairs, treePairs;
+            double hash = replay(trace, new SpatialHash(trace.objectSize * 2, n), hashPairs);
+            double sap = replay(trace, new SweepAndPrune(n), sapPairs);
+            double tree = replay(trace, new AabbTreeBroadphase(0.2f), treePairs);
+            cout << "  " << left << setw(8) << trace.name << right << setw(7) << n << " objects: " << fixed << setprecision(3)
+                 << "spatial hash " << hash << " ms, sweep and prune " << sap << " ms, aabb tree " << tree << " ms per frame ("
+                 << hashPairs / frames << " pairs" << (hashPairs == sapPairs && hashPairs == treePairs ? "" : ", MISMATCH") << ")" << endl;
+        }
+    }
+}
+
+
+// pipeline: CollisionPipeline on a crowd of spheres, boxes and capsules, with
+// the time of each stage as the job system grows (JobSystem(n) runs n workers
+// and the calling thread)
+
+static void benchPipeline()
+{
+    const uint n = 20000;
+    CollisionPipeline pipeline;
+    float size = cbrtf((float)n) * 2;
+    for (uint i = 0; i < n; i++)
+    {
+        float3 centre = random3(size);
+        if (i % 3 == 0)
+        {
+            pipeline.add(Sphere(centre, uniformf(0.3f, 1.5f)), i);
+        }
+        else if (i % 3 == 1)
+        {
+            pipeline.add(Box(centre, float3(uniformf(0.3f, 1.5f), uniformf(0.3f, 1.5f), uniformf(0.3f, 1.5f))), i);
+        }
+        else
+        {
+            float3 half = random3(1);
+            pipeline.add(Capsule(centre - half, centre + half, uniformf(0.2f, 0.8f)), i);
+        }
+    }
+
+    // the fastest of a few runs, stage by stage
+    auto run = [&](JobSystem* jobs, CollisionPipeline::Stats& best) {
+        best = CollisionPipeline::Stats();
+        best.broadphaseMs = best.narrowphaseMs = best.mergeMs = INFINITY;
+        for (int i = 0; i < 5; i++)
+        {
+            pipeline.run(jobs);
+            const CollisionPipeline::Stats& s = pipeline.lastStats();
+            best.broadphaseMs = fmin(best.broadphaseMs, s.broadphaseMs);
+            best.narrowphaseMs = fmin(best.narrowphaseMs, s.narrowphaseMs);
+            best.mergeMs = fmin(best.mergeMs, s.mergeMs);
+            best.cells = s.cells;
+            best.pairs = s.pairs;
+            best.contacts = s.contacts;
+        }
+    };
+    auto print = [](const char* name, uint threads, const CollisionPipeline::Stats& s) {
+        cout << "  " << left << setw(14) << name << right << setw(2) << threads << " threads: " << fixed << setprecision(2)
+             << "broadphase " << s.broadphaseMs << " ms, narrowphase " << s.narrowphaseMs << " ms, merge " << s.mergeMs
+             << " ms, total " << s.broadphaseMs + s.narrowphaseMs + s.mergeMs << " ms" << endl;
+    };
+
+    CollisionPipeline::Stats stats;
+    run(nullptr, stats);
+    cout << "  " << n << " colliders, " << stats.cells << " cells, " << stats.pairs << " pairs, " << stats.contacts << " contacts" << endl;
+    print("no jobs", 1, stats);
+    for (uint workers = 1; workers <= 32; workers++)
+    {
+        JobSystem jobs(workers);
+        run(&jobs, stats);
+        stringstream name;
+        name << "JobSystem(" << workers << ")";
+        print(name.str().c_str(), jobs.numThreads(), stats);
+    }
+}
+
+
+// obj loading: ObjLoader with and without the job system against a plain
+// iostream parser deduplicating vertices through unordered_map, on a
+// generated uv sphere with positions, texcoords and normals
+
+static void writeObjSphere(const string& fname, int sectors, int rings)
+{
+    FILE* file = fopen(fname.c_str(), "w");
+    if (!file)
+        throw runtime_error("can't write " + fname);
+    for (int j = 0; j <= rings; j++)
+    {
+        for (int i = 0; i <= sectors; i++)
+        {
+            float lon = (float)i / sectors * pi * 2, lat = ((float)j / rings - 0.5f) * pi;
+            float3 n(sinf(lon) * cosf(lat), sinf(lat), cosf(lon) * cosf(lat));
+            fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n", n.x * 5, n.y * 5, n.z * 5,
+                    (float)i / sectors, (float)j / rings, n.x, n.y, n.z);
+        }
+    }
+    for (int j = 0; j < rings; j++)
+    {
+        for (int i = 0; i < sectors; i++)
+        {
+            int a = j * (sectors + 1) + i + 1, b = a + 1, c = a + sectors + 2, d = a + sectors + 1;
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d);
+        }
+    }
+    fclose(file);
+}
+
+// the obvious parser: getline, istringstream and a map from corner to vertex
+static void referenceObj(const string& fname, ObjGroup& out)
+{
+    ifstream file(fname);
+    vector<float3> positions, normals;
+    vector<float2> texcoords;
+    unordered_map<uint64_t, uint> vertices;
+    string line, type, corner;
+    vector<uint> polygon;
+    while (getline(file, line))
+    {
+        istringstream in(line);
+        in >> type;
+        if (type == "v")
+        {
+            float3 p;
+            in >> p.x >> p.y >> p.z;
+            positions.push_back(p);
+        }
+        else if (type == "vt")
+        {
+            float2 t;
+            in >> t.x >> t.y;
+            texcoords.push_back(t);
+        }
+        else if (type == "vn")
+        {
+            float3 n;
+            in >> n.x >> n.y >> n.z;
+            normals.push_back(n);
+        }
+        else if (type == "f")
+        {
+            polygon.clear();
+            while (in >> corner)
+            {
+                uint p = 0, t = 0, n = 0;
+                sscanf(corner.c_str(), "%u/%u/%u", &p, &t, &n);
+                uint64_t key = ((uint64_t)p << 42) | ((uint64_t)t << 21) | n;
+                auto v = vertices.find(key);
+                if (v == vertices.end())
+                {
+                    v = vertices.insert({ key, (uint)out.positions.size() }).first;
+                    out.positions.push_back(positions[p - 1]);
+                    out.texcoords.push_back(texcoords[t - 1]);
+                    out.normals.push_back(normals[n - 1]);
+                }
+                polygon.push_back(v->second);
+            }
+            for (size_t i = 2; i < polygon.size(); i++)
+                out.indices.insert(out.indices.end(), { polygon[0], polygon[i - 1], polygon[i] });
+        }
+    }
+}
+
+static void benchObj()
+{
+    string fname = "bench_sphere.obj";
+    writeObjSphere(fname, 1024, 512);
+    ifstream size(fname, ios::binary | ios::ate);
+    double megabytes = size.tellg() / 1e6;
+
+    JobSystem jobs;
+    vector<ObjGroup> serial, threaded;
+    double serialTime = bestOf(3, [&] { serial.clear(); ObjLoader::load(fname, serial); });
+    double threadedTime = bestOf(3, [&] { threaded.clear(); ObjLoader::load(fname, threaded, &jobs); });
+    ObjGroup reference;
+    double referenceTime = bestOf(1, [&] { referenceObj(fname, reference); });
+    remove(fname.c_str());
+
+    bool same = serial.size() == 1 && threaded.size() == 1 && serial[0].indices == reference.indices &&
+                threaded[0].indices == reference.indices && serial[0].positions.size() == reference.positions.size();
+    cout << fixed << setprecision(1) << "  " << megabytes << " MB, " << reference.positions.size() << " vertices, "
+         << reference.indices.size() / 3 << " triangles" << (same ? "" : ", MISMATCH") << endl;
+    cout << "  ObjLoader " << serialTime * 1e3 << " ms (" << megabytes / serialTime << " MB/s), on " << jobs.numThreads()
+         << " threads " << threadedTime * 1e3 << " ms (" << megabytes / threadedTime << " MB/s), reference "
+         << referenceTime * 1e3 << " ms (" << megabytes / referenceTime << " MB/s), " << referenceTime / threadedTime << "x" << endl;
+}
+
+
+// golden: the golden image scenes rasterized headless on SoftRasterizer at the
+// golden resolution, which is how fast `tests golden` can go; "+ png" also
+// writes every frame out the way the test does. loading is left out by
+// subtracting a one frame run
+
+static double runHeadless(const function<GameState*()>& create, int frames, int width, int height, const string& backend, const string& capture)
+{
+    // the game logs its loads and its registries' stats; keep them out of the results
+    stringstream log;
+    auto old = cout.rdbuf(log.rdbuf());
+    srandom(1);
+    Game game;
+    game.setHeadless(true, frames);
+    game.setOption("display_width", to_string(width));
+    game.setOption("display_height", to_string(height));
+    game.setOption("headless_backend", backend);
+    game.setOption("headless_capture", capture);
+    auto start = chrono::steady_clock::now();
+    game.run(create());
+    double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout.rdbuf(old);
+    return s;
+}
+
+static void benchGolden()
+{
+    struct Scene
+    {
+        const char* name;
+        function<GameState*()> create;
+    };
+    const Scene scenes[] = {
+        { "cube", [] { return new CubeGame; } },
+        { "menu", [] { return new PlaneGameMenu; } },
+        { "plane", [] { return new PlaneGame; } },
+    };
+    struct Backend
+    {
+        const char* name;
+        const char* backend;
+        const char* capture;
+    };
+    const Backend backends[] = {
+        { "null", "null", "" },
+        { "soft", "soft", "" },
+        { "soft + png", "soft", "bench_capture" },
+    };
+    mkdir("bench_capture", 0755);
+
+    const int width = 1280, height = 720, frames = 20;
+    for (auto& scene : scenes)
+    {
+        cout << "  " << left << setw(6) << scene.name << right << width << "x" << height << ":" << fixed;
+        for (auto& b : backends)
+        {
+            double load = runHeadless(scene.create, 1, width, height, b.backend, b.capture);
+            double run = runHeadless(scene.create, frames + 1, width, height, b.backend, b.capture);
+            double ms = fmax(run - load, 0.0) * 1e3 / frames;
+            cout << (&b == backends ? " " : ", ") << b.name << " " << setprecision(2) << ms << " ms";
+            if (strcmp(b.backend, "null"))
+                cout << " (" << setprecision(1) << 1000.0 / ms << " fps)";
+        }
+        cout << " per frame" << endl;
+    }
+    for (int i = 0; i <= frames; i++)
+    {
+        stringstream fname;
+        fname << "bench_capture/frame" << setw(5) << setfill('0') << i << ".png";
+        remove(fname.str().c_str());
+    }
+    rmdir("bench_capture");
+}
+
+
+// animation: skinning matrices for a crowd of characters on one skeleton,
+// each playing the same clip at its own time, with skinCharacters on one
+// thread and on the job system against toMatrix() down the hierarchy one
+// bone at a time. sampling the clip is in every timing, and on its own too
+
+// bones in deep chains, each parented to one of the few bones before it
+static Skeleton makeSkeleton(uint bones)
+{
+    Skeleton skeleton;
+    for (uint b = 0; b < bones; b++)
+    {
+        BoneTransform bind;
+        bind.translation = b ? random3(1) : float3(0, 1, 0);
+        bind.rotation = quatAxisAngle(random3(1), uniformf(-1, 1));
+        skeleton.addBone("bone" + to_string(b), b ? b - 1 - rng() % (b < 4 ? b : 4) : -1, bind);
+    }
+    return skeleton;
+}
+
+// keyRate keys a second on every bone, each swinging about an axis of its
+// own, as a clip exported without reduction is; the root walks and bobs
+static AnimationClip makeClip(const Skeleton& skeleton, float duration, float keyRate)
+{
+    AnimationClip clip;
+    clip.name = "walk";
+    clip.duration = duration;
+    for (uint b = 0; b < skeleton.size(); b++)
+    {
+        AnimationTrack track;
+        track.bone = b;
+        float3 axis = random3(1);
+        float swing = uniformf(0.1f, 1.0f), frequency = uniformf(1.0f, 4.0f), phase = uniformf(0, 6.28f);
+        for (uint k = 0; k <= (uint)(duration * keyRate); k++)
+        {
+            float t = k / keyRate;
+            BoneTransform key = skeleton.bindPose[b];
+            key.rotation = quatAxisAngle(axis, swing * sinf(frequency * t + phase));
+            if (b == 0)
+                key.translation = float3(t, 1 + 0.1f * sinf(frequency * t), 0);
+            track.times.push_back(t);
+            track.keys.push_back(key);
+        }
+        clip.tracks.push_back(track);
+    }
+    return clip;
+}
+
+static void benchAnimation()
+{
+    const uint characters = 1000, bones = 64;
+    Skeleton skeleton = makeSkeleton(bones);
+    AnimationClip clip = makeClip(skeleton, 4, 30);
+    auto pose = [&](uint i, BoneTransform* b) { clip.sample(i * 0.0137f, b); };
+    vector<SkinMatrix> out(characters * bones);
+    size_t stride = bones * sizeof(SkinMatrix);
+
+    JobSystem jobs;
+    double serial = bestOf(5, [&] { skinCharacters(skeleton, characters, pose, &out[0], stride); });
+    double threaded = bestOf(5, [&] { skinCharacters(skeleton, characters, pose, &out[0], stride, &jobs); });
+
+    vector<BoneTransform> poses(bones);
+    vector<matrix> model(bones);
+    double scalar = bestOf(5, [&] {
+        for (uint i = 0; i < characters; i++)
+        {
+            poses = skeleton.bindPose;
+            pose(i, &poses[0]);
+            for (uint b = 0; b < bones; b++)
+            {
+                int parent = skeleton.parents[b];
+                model[b] = parent < 0 ? poses[b].toMatrix() : poses[b].toMatrix() * model[parent];
+                matrix skin = skeleton.inverseBind[b] * model[b];
+                for (int j = 0; j < 3; j++)
+                    out[i * bones + b].columns[j] = float4(skin.m[j], skin.m[4 + j], skin.m[8 + j], skin.m[12 + j]);
+            }
+        }
+    });
+    double sampling = bestOf(5, [&] {
+        for (uint i = 0; i < characters; i++)
+        {
+            poses = skeleton.bindPose;
+            pose(i, &poses[0]);
+            sink = sink + (uint)poses[bones - 1].rotation.x;
+        }
+    });
+
+    double us = 1e6 / characters;
+    cout << fixed << setprecision(2) << "  " << characters << " characters, " << bones << " bones, " << SimdFloat::Width << " lanes: "
+         << "skinCharacters " << serial * us << " us per character, on " << jobs.numThreads() << " threads " << threaded * us
+         << " us, scalar " << scalar * us << " us, of which sampling the clip " << sampling * us << " us" << endl;
+}
+
+
+// clips: CompressedClip against the AnimationClip it was made from, in bytes
+// and in time to sample a pose playing at 60 Hz with a Cursor, and from the
+// top of the stream with none
+
+static void benchClips()
+{
+    const uint bones = 64, poses = 20000;
+    Skeleton skeleton = makeSkeleton(bones);
+    AnimationClip clip = makeClip(skeleton, 10, 30);
+    CompressedClip* compressed = nullptr;
+    double compressing = bestOf(1, [&] { compressed = new CompressedClip(clip); });
+
+    size_t raw = 0;
+    for (auto& t : clip.tracks)
+        raw += t.keys.size() * (sizeof(BoneTransform) + sizeof(float));
+    cout << fixed << setprecision(1) << "  " << bones << " bones, " << clip.duration << " s at 30 keys a second: " << raw / 1024.0
+         << " KB, compressed " << compressed->size() / 1024.0 << " KB (" << (double)raw / compressed->size() << "x) in "
+         << compressing * 1e3 << " ms" << endl;
+
+    vector<BoneTransform> pose(bones);
+    double source = bestOf(5, [&] {
+        for (uint i = 0; i < poses; i++)
+            clip.sample(i / 60.0f, &pose[0]);
+    });
+    CompressedClip::Cursor cursor;
+    double cursored = bestOf(5, [&] {
+        for (uint i = 0; i < poses; i++)
+            compressed->sample(i / 60.0f, &pose[0], cursor);
+    });
+    double stateless = bestOf(5, [&] {
+        for (uint i = 0; i < poses; i++)
+            compressed->sample(i / 60.0f, &pose[0]);
+    });
+    sink = sink + (uint)pose[0].translation.x;
+    delete compressed;
+
+    double us = 1e6 / poses;
+    cout << setprecision(2) << "  per pose: AnimationClip " << source * us << " us, CompressedClip with a Cursor " << cursored * us
+         << " us, without " << stateless * us << " us" << endl;
+}
+
+
+struct Benchmark
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    { "collision", benchCollision },
+    { "jobs", benchJobs },
+    { "aabbtree", benchAabbTree },
+    { "broadphase", benchBroadphase },
+    { "pipeline", benchPipeline },
+    { "obj", benchObj },
+    { "golden", benchGolden },
+    { "animation", benchAnimation },
+    { "clips", benchClips },
+};
+
+int main(int argc, char** argv)
+{
+    int ran = 0;
+    for (auto& b : benchmarks)
+    {
+        bool wanted = argc == 1;
+        for (int i = 1; i < argc; i++)
+            wanted |= string(argv[i]) == b.name;
+        if (!wanted)
+            continue;
+
+        cout << b.name << ":" << endl;
+        b.run();
+        ran++;
+    }
+    if (!ran)
+    {
+        cout << "usage: bench [name...]" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,2021 @@
+// unit tests, run by ctest; needs no window or GL context
+//
+//      tests [-update] [group...]
+//
+// runs the named groups, or all of them, and exits non-zero if any check failed.
+// -update rewrites the golden images in tests/golden instead of comparing with them;
+// SoftRasterizer writes them uncompressed, so recompress them before committing
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <bitset>
+#include <queue>
+#include <deque>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <algorithm>
+#include <set>
+#include <sys/stat.h>
+
+using namespace std;
+
+#include "../src/math3d.h"
+#include "../src/definitions.h"
+#include "../src/simd.h"
+#include "../src/jobs.h"
+#include "../src/assets.h"
+
+#include "../src/graphics/nullgl.h"
+#include "../src/graphics/buffer.h"
+#include "../src/graphics/texture.h"
+#include "../src/graphics/surface.h"
+#include "../src/graphics/shader.h"
+#include "../src/graphics/camera.h"
+#include "../src/graphics/simplify.h"
+#include "../src/graphics/meshopt.h"
+#include "../src/graphics/objloader.h"
+#include "../src/graphics/meshfile.h"
+#include "../src/graphics/meshlet.h"
+#include "../src/graphics/animation.h"
+#include "../src/graphics/mesh.h"
+#include "../src/graphics/sprite.h"
+#include "../src/profiler.h"
+#include "../src/graphics/softgl.h"
+
+#include "../src/input.h"
+#include "../src/game.h"
+#include "../src/collision.h"
+#include "../src/physics/spatialhash.h"
+#include "../src/physics/aabbtree.h"
+#include "../src/physics/sweepandprune.h"
+#include "../src/physics/gjk.h"
+#include "../src/physics/pipeline.h"
+#include "../src/graphics/octree.h"
+#include "../src/graphics/occlusion.h"
+#include "../src/cubegame.h"
+#include "../src/planegame.h"
+
+#define GLAD_GL_IMPLEMENTATION
+#include <glad.h>
+
+#ifndef GOLDEN_DIR
+#define GOLDEN_DIR "tests/golden"
+#endif
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(cond, what) check((cond), what, __FILE__, __LINE__)
+
+static bool check(bool ok, const string& what, const char* file, int line)
+{
+    checks++;
+    if (!ok)
+    {
+        // only the first few of a kind, a broken batch test fails thousands of times
+        if (failures++ < 50)
+            cout << "    FAILED " << file << ":" << line << ": " << what << endl;
+    }
+    return ok;
+}
+
+static mt19937 rng(1);
+static float uniformf(float a, float b) { return uniform_real_distribution<float>(a, b)(rng); }
+static float3 random3(float s) { return float3(uniformf(-s, s), uniformf(-s, s), uniformf(-s, s)); }
+static float2 random2(float s) { return float2(uniformf(-s, s), uniformf(-s, s)); }
+
+
+// input: edges and scroll from events queued between two updates, the way the
+// GLFW callbacks queue them
+
+static void testInput()
+{
+    auto key = [](int code, int action) { return InputEvent { InputEvent::Key, (uchar)action, (short)code }; };
+    auto scroll = [](float x, float y) {
+        InputEvent e { InputEvent::Scroll };
+        e.value = float2(x, y);
+        return e;
+    };
+
+    Input input;
+
+    // a tap inside one frame is both pressed and released, and not down
+    input.push(key(GLFW_KEY_A, GLFW_PRESS));
+    input.push(key(GLFW_KEY_A, GLFW_RELEASE));
+    input.push(scroll(0, 1));
+    input.push(scroll(0.5f, 2));
+    input.update();
+    CHECK(input.keyPressed(GLFW_KEY_A), "tapped key pressed");
+    CHECK(input.keyReleased(GLFW_KEY_A), "tapped key released");
+    CHECK(!input.keyDown(GLFW_KEY_A), "tapped key not down");
+    CHECK(input.scroll().x == 0.5f && input.scroll().y == 3.0f, "scroll summed over the frame");
+    CHECK(input.events().size() == 4, "every event kept in order");
+
+    // edges only last one frame
+    input.update();
+    CHECK(!input.keyPressed(GLFW_KEY_A) && !input.keyReleased(GLFW_KEY_A), "tap edges cleared");
+    CHECK(input.scroll().x == 0.0f && input.scroll().y == 0.0f, "scroll cleared");
+    CHECK(input.events().empty(), "events cleared");
+
+    // a held key: pressed once, down until released
+    input.push(key(GLFW_KEY_B, GLFW_PRESS));
+    input.update();
+    CHECK(input.keyPressed(GLFW_KEY_B) && input.keyDown(GLFW_KEY_B) && !input.keyReleased(GLFW_KEY_B), "held key pressed");
+    input.push(key(GLFW_KEY_B, GLFW_REPEAT));
+    input.update();
+    CHECK(!input.keyPressed(GLFW_KEY_B) && input.keyDown(GLFW_KEY_B), "repeat is not a press");
+    input.push(key(GLFW_KEY_B, GLFW_RELEASE));
+    input.update();
+    CHECK(input.keyReleased(GLFW_KEY_B) && !input.keyDown(GLFW_KEY_B) && !input.keyPressed(GLFW_KEY_B), "held key released");
+
+    // released then pressed again inside one frame: still down, and both edges seen
+    input.push(key(GLFW_KEY_C, GLFW_PRESS));
+    input.update();
+    input.push(key(GLFW_KEY_C, GLFW_RELEASE));
+    input.push(key(GLFW_KEY_C, GLFW_PRESS));
+    input.update();
+    CHECK(input.keyDown(GLFW_KEY_C) && input.keyPressed(GLFW_KEY_C) && input.keyReleased(GLFW_KEY_C), "key released and pressed again");
+
+    // mouse buttons go through the same path
+    InputEvent down { InputEvent::MouseButton, GLFW_PRESS, GLFW_MOUSE_BUTTON_LEFT };
+    InputEvent up { InputEvent::MouseButton, GLFW_RELEASE, GLFW_MOUSE_BUTTON_LEFT };
+    input.push(down);
+    input.push(up);
+    input.update();
+    CHECK(input.mousePressed(GLFW_MOUSE_BUTTON_LEFT) && input.mouseReleased(GLFW_MOUSE_BUTTON_LEFT), "mouse tap");
+    CHECK(!input.mouseDown(GLFW_MOUSE_BUTTON_LEFT), "tapped button not down");
+}
+
+
+// collision: every batch test against the scalar test, bit for bit, and the
+// scalar ray tests against marching along the ray
+
+// the bits of hits against reference(i), and no bits past the end of the array
+template<typename Shape, int N, typename Reference>
+static void checkHits(const string& name, const SoA<Shape, N>& array, const vector<uint>& hits, const Reference& reference)
+{
+    for (uint i = 0; i < array.count; i++)
+    {
+        bool hit = (hits[i / 32] >> (i % 32)) & 1;
+        CHECK(hit == reference(i), name + " element " + to_string(i));
+    }
+    for (uint i = array.count; i < array.maskWords() * 32; i++)
+    {
+        CHECK(!((hits[i / 32] >> (i % 32)) & 1), name + " padding lane " + to_string(i));
+    }
+}
+
+static void testCollision()
+{
+    // an odd count leaves a partly filled last register and mask word
+    const uint n = 1003;
+    vector<Sphere> spheres;
+    vector<Box> boxes;
+    vector<float3> points3;
+    vector<Circle> circles;
+    vector<Rect> rects;
+    vector<float2> points2;
+    SphereSoA sphereArray;
+    BoxSoA boxArray;
+    Float3SoA point3Array;
+    CircleSoA circleArray;
+    RectSoA rectArray;
+    Float2SoA point2Array;
+    for (uint i = 0; i < n; i++)
+    {
+        spheres.push_back(Sphere(random3(10), uniformf(0, 2)));
+        boxes.push_back(Box(random3(10), float3(uniformf(0, 2), uniformf(0, 2), uniformf(0, 2))));
+        points3.push_back(random3(10));
+        circles.push_back(Circle(random2(10), uniformf(0, 2)));
+        rects.push_back(Rect(random2(10), float2(uniformf(0, 2), uniformf(0, 2))));
+        points2.push_back(random2(10));
+        sphereArray.add(spheres.back());
+        boxArray.add(boxes.back());
+        point3Array.add(points3.back());
+        circleArray.add(circles.back());
+        rectArray.add(rects.back());
+        point2Array.add(points2.back());
+    }
+
+    vector<uint> hits(sphereArray.maskWords());
+    vector<float> distances(sphereArray.data[0].size());
+    for (int trial = 0; trial < 20; trial++)
+    {
+        // the first trial's shapes cover the origin, where the zeroed padding lanes are
+        Sphere s = trial ? Sphere(random3(8), uniformf(0.5, 4)) : Sphere(float3(0, 0, 0), 4);
+        Box b = trial ? Box(random3(8), float3(uniformf(0, 3), uniformf(0, 3), uniformf(0, 3))) : Box(float3(0, 0, 0), float3(3, 3, 3));
+        Circle c = trial ? Circle(random2(8), uniformf(0.5, 4)) : Circle(float2(0, 0), 4);
+        Rect r = trial ? Rect(random2(8), float2(uniformf(0, 3), uniformf(0, 3))) : Rect(float2(0, 0), float2(3, 3));
+
+        // axis aligned rays hit the zero-direction paths of the slab test
+        float3 direction = random3(1);
+        if (trial % 3 == 0)
+            direction.y = 0;
+        if (trial % 5 == 0)
+            direction = float3(1, 0, 0);
+        Ray ray(trial ? random3(12) : float3(-12, 0, 0), direction);
+
+        intersect(s, sphereArray, &hits[0]);
+        checkHits("sphere/sphere", sphereArray, hits, [&](uint i) { return intersect(s, spheres[i]); });
+        intersect(s, boxArray, &hits[0]);
+        checkHits("sphere/box", boxArray, hits, [&](uint i) { return intersect(s, boxes[i]); });
+        intersect(s, point3Array, &hits[0]);
+        checkHits("sphere/point", point3Array, hits, [&](uint i) { return intersect(s, points3[i]); });
+        intersect(b, boxArray, &hits[0]);
+        checkHits("box/box", boxArray, hits, [&](uint i) { return intersect(b, boxes[i]); });
+        intersect(b, point3Array, &hits[0]);
+        checkHits("box/point", point3Array, hits, [&](uint i) { return intersect(b, points3[i]); });
+        intersect(c, circleArray, &hits[0]);
+        checkHits("circle/circle", circleArray, hits, [&](uint i) { return intersect(c, circles[i]); });
+        intersect(c, rectArray, &hits[0]);
+        checkHits("circle/rect", rectArray, hits, [&](uint i) { return intersect(c, rects[i]); });
+        intersect(c, point2Array, &hits[0]);
+        checkHits("circle/point", point2Array, hits, [&](uint i) { return intersect(c, points2[i]); });
+        intersect(r, rectArray, &hits[0]);
+        checkHits("rect/rect", rectArray, hits, [&](uint i) { return intersect(r, rects[i]); });
+        intersect(r, point2Array, &hits[0]);
+        checkHits("rect/point", point2Array, hits, [&](uint i) { return intersect(r, points2[i]); });
+
+        intersect(ray, sphereArray, &hits[0], &distances[0]);
+        checkHits("ray/sphere", sphereArray, hits, [&](uint i) {
+            float t = -1;
+            bool hit = intersect(ray, spheres[i], t);
+            if (hit)
+                CHECK(fabsf(t - distances[i]) <= 1e-3f, "ray/sphere distance " + to_string(i));
+            return hit;
+        });
+        intersect(ray, boxArray, &hits[0], &distances[0]);
+        checkHits("ray/box", boxArray, hits, [&](uint i) {
+            float t = -1;
+            bool hit = intersect(ray, boxes[i], t);
+            if (hit)
+                CHECK(fabsf(t - distances[i]) <= 1e-3f, "ray/box distance " + to_string(i));
+            return hit;
+        });
+    }
+
+    // the scalar ray tests against the first sample point along the ray
+    // that's inside the shape
+    const float step = 0.001f;
+    for (uint i = 0; i < 200; i++)
+    {
+        Ray ray(random3(12), random3(1));
+        auto march = [&](const auto& shape, float& at) {
+            for (at = 0; at < 40; at += step)
+            {
+                if (intersect(shape, ray.origin + ray.direction * at))
+                    return true;
+            }
+            return false;
+        };
+
+        float t = 0, marched = 0;
+        bool hit = intersect(ray, spheres[i], t);
+        // marching can step over the thinnest spheres
+        if (spheres[i].radius > 0.05f && CHECK(hit == march(spheres[i], marched), "ray/sphere against marching " + to_string(i)) && hit)
+            CHECK(fabsf(t - marched) <= 0.01f, "ray/sphere distance against marching " + to_string(i));
+
+        hit = intersect(ray, boxes[i], t);
+        if (CHECK(hit == march(boxes[i], marched), "ray/box against marching " + to_string(i)) && hit)
+            CHECK(fabsf(t - marched) <= 0.01f, "ray/box distance against marching " + to_string(i));
+    }
+}
+
+
+// gjk: distances and depths against closed forms, the degenerate cases, and
+// the cache
+
+static void testGjk()
+{
+    const int pairs = 2000;
+
+    // spheres: centre distance minus the radii, either way round
+    for (int i = 0; i < pairs; i++)
+    {
+        Sphere a(random3(10), uniformf(0.1f, 3));
+        Sphere b(random3(10), uniformf(0.1f, 3));
+        float3 d = b.centre - a.centre;
+        if (len(d) < 0.01f)
+            continue;
+        float expected = len(d) - a.radius - b.radius;
+        GjkResult r = gjkDistance(a, b);
+        CHECK(r.intersecting == (expected <= 0.0f), "sphere/sphere overlap " + to_string(i));
+        CHECK(fabsf(r.distance - expected) <= 1e-3f, "sphere/sphere distance " + to_string(i));
+        CHECK(dot(r.normal, d / len(d)) >= 0.999f, "sphere/sphere normal " + to_string(i));
+    }
+
+    // axis aligned boxes: the per-axis gaps when apart, the smallest overlap when not
+    for (int i = 0; i < pairs; i++)
+    {
+        Box a(random3(4), float3(uniformf(0.2f, 2), uniformf(0.2f, 2), uniformf(0.2f, 2)));
+        Box b(random3(4), float3(uniformf(0.2f, 2), uniformf(0.2f, 2), uniformf(0.2f, 2)));
+        float3 gap, overlap;
+        for (int k = 0; k < 3; k++)
+        {
+            float g = fabsf(a.centre._x[k] - b.centre._x[k]) - a.extent._x[k] - b.extent._x[k];
+            gap._x[k] = fmaxf(g, 0.0f);
+            overlap._x[k] = -g;
+        }
+        bool apart = len2(gap) > 0.0f;
+        float expected = apart ? len(gap) : -fminf(overlap.x, fminf(overlap.y, overlap.z));
+        // touching or barely overlapping boxes are all tie
+        if (fabsf(expected) < 1e-3f)
+            continue;
+        GjkResult r = gjkDistance(a, b);
+        CHECK(r.intersecting == !apart, "box/box overlap " + to_string(i));
+        CHECK(fabsf(r.distance - expected) <= 1e-3f, "box/box " + string(apart ? "distance " : "depth ") + to_string(i));
+        CHECK(intersect(a, b) == !apart, "box/box against intersect " + to_string(i));
+    }
+
+    // capsules crossing at right angles: the difference of their cores is a flat
+    // square with no volume, so epa starts from fewer than four points
+    for (int i = 0; i < 200; i++)
+    {
+        float3 centre = random3(10);
+        float ra = uniformf(0.1f, 1), rb = uniformf(0.1f, 1);
+        float h = i % 2 ? 0.0f : uniformf(0, 0.9f) * (ra + rb);
+        Capsule a(centre - float3(2, 0, 0), centre + float3(2, 0, 0), ra);
+        Capsule b(centre + float3(0, h, -2), centre + float3(0, h, 2), rb);
+        GjkResult r = gjkDistance(a, b);
+        CHECK(r.intersecting, "crossing capsules overlap " + to_string(i));
+        CHECK(fabsf(r.distance + (ra + rb - h)) <= 1e-3f, "crossing capsules depth " + to_string(i));
+        CHECK(fabsf(r.normal.y) >= 0.999f, "crossing capsules normal " + to_string(i));
+        CHECK(intersect(a, b), "crossing capsules against intersect " + to_string(i));
+    }
+
+    // a square prism is a box, so they must agree with anything
+    const vector<float3> square = { float3(-1, 0, -1), float3(1, 0, -1), float3(1, 0, 1), float3(-1, 0, 1) };
+    for (int i = 0; i < pairs; i++)
+    {
+        float3 origin = random3(3);
+        ConvexHull prism = ConvexHull::prism(square, origin, float3(0, 2, 0));
+        Box box(origin + float3(0, 1, 0), float3(1, 1, 1));
+        Sphere s(random3(5), uniformf(0.1f, 2));
+        Box b(random3(5), float3(uniformf(0.2f, 2), uniformf(0.2f, 2), uniformf(0.2f, 2)));
+        GjkResult p1 = gjkDistance(prism, s), b1 = gjkDistance(box, s);
+        GjkResult p2 = gjkDistance(prism, b), b2 = gjkDistance(box, b);
+        CHECK(p1.intersecting == b1.intersecting && fabsf(p1.distance - b1.distance) <= 1e-3f, "prism/sphere against box/sphere " + to_string(i));
+        CHECK(p2.intersecting == b2.intersecting && fabsf(p2.distance - b2.distance) <= 1e-3f, "prism/box against box/box " + to_string(i));
+    }
+
+    // a cache from the last frame, objects nudged a little: same answer, fewer iterations
+    int warm = 0, cold = 0;
+    for (int i = 0; i < pairs; i++)
+    {
+        vector<float3> points;
+        for (int k = 0; k < 12; k++)
+            points.push_back(random3(1));
+        ConvexHull a(points);
+        Box b(a.centre + normalize(random3(1)) * uniformf(2.5f, 5), float3(uniformf(0.2f, 1), uniformf(0.2f, 1), uniformf(0.2f, 1)));
+
+        GjkCache cache;
+        gjkDistance(a, b, &cache);
+        b.centre += random3(0.01f);
+        GjkResult w = gjkDistance(a, b, &cache);
+        GjkResult c = gjkDistance(a, b);
+        CHECK(fabsf(w.distance - c.distance) <= 1e-3f, "warm against cold distance " + to_string(i));
+        warm += w.iterations;
+        cold += c.iterations;
+    }
+    cout << "    " << pairs << " nudged pairs: " << cold << " iterations cold, " << warm << " warm" << endl;
+    CHECK(warm < cold, "a warm cache takes fewer iterations");
+}
+
+
+// sweep: the batch sweeps give the same first hits on any number of threads,
+// with ties to the lowest index, and match the scalar sweeps
+
+static void testSweep()
+{
+    // every other box and target is there twice, so exact ties are common
+    BoxSoA boxes;
+    SphereSoA targets;
+    Float3SoA targetMotion;
+    vector<Box> boxList;
+    vector<Sphere> targetList;
+    vector<float3> targetMoves;
+    vector<bool> boxCopy, targetCopy;
+    for (int i = 0; i < 300; i++)
+    {
+        Box b(random3(30), float3(uniformf(0.5f, 4), uniformf(0.5f, 4), uniformf(0.5f, 4)));
+        Sphere t(random3(30), uniformf(0.5f, 4));
+        float3 m = random3(5);
+        for (int k = 0; k < 1 + i % 2; k++)
+        {
+            boxes.add(b);
+            boxList.push_back(b);
+            boxCopy.push_back(k > 0);
+            targets.add(t);
+            targetMotion.add(m);
+            targetList.push_back(t);
+            targetMoves.push_back(m);
+            targetCopy.push_back(k > 0);
+        }
+    }
+
+    // bullets (radius 0) and bigger spheres, moving far enough to cross several things
+    SphereSoA spheres;
+    Float3SoA motion;
+    vector<Sphere> sphereList;
+    vector<float3> moves;
+    for (int i = 0; i < 5000; i++)
+    {
+        Sphere s(random3(40), i % 3 ? uniformf(0.1f, 2) : 0.0f);
+        float3 d = random3(40);
+        spheres.add(s);
+        motion.add(d);
+        sphereList.push_back(s);
+        moves.push_back(d);
+    }
+
+    auto same = [](const vector<SweepHit>& a, const vector<SweepHit>& b) {
+        for (uint i = 0; i < a.size(); i++)
+        {
+            if (a[i].index != b[i].index || memcmp(&a[i].t, &b[i].t, sizeof(float)))
+                return false;
+        }
+        return true;
+    };
+
+    uint n = spheres.count;
+    vector<SweepHit> serial(n), one(n), many(n);
+    sweep(spheres, motion, boxes, serial.data());
+    {
+        JobSystem jobs(0);
+        sweep(spheres, motion, boxes, one.data(), &jobs);
+    }
+    {
+        JobSystem jobs(7);
+        sweep(spheres, motion, boxes, many.data(), &jobs);
+    }
+    CHECK(same(serial, one), "sweep against boxes, no job system against 1 thread");
+    CHECK(same(serial, many), "sweep against boxes, no job system against 8 threads");
+
+    uint hits = 0;
+    for (uint i = 0; i < n; i++)
+    {
+        if (serial[i].index == ~0u)
+            continue;
+        hits++;
+        CHECK(!boxCopy[serial[i].index], "box tie goes to the lower index " + to_string(i));
+        if (sphereList[i].radius > 0.0f)
+        {
+            // the scalar sweep, first hit and lowest index
+            SweepHit expected;
+            for (uint j = 0; j < boxList.size(); j++)
+            {
+                float t;
+                if (sweep(sphereList[i], moves[i], boxList[j], t) && t < expected.t)
+                {
+                    expected.t = t;
+                    expected.index = j;
+                }
+            }
+            CHECK(expected.index == serial[i].index && expected.t == serial[i].t, "sweep against boxes matches scalar " + to_string(i));
+        }
+    }
+    CHECK(hits > n / 4, "enough sweeps hit a box");
+
+    sweep(spheres, motion, targets, targetMotion, serial.data());
+    {
+        JobSystem jobs(0);
+        sweep(spheres, motion, targets, targetMotion, one.data(), &jobs);
+    }
+    {
+        JobSystem jobs(7);
+        sweep(spheres, motion, targets, targetMotion, many.data(), &jobs);
+    }
+    CHECK(same(serial, one), "sweep against spheres, no job system against 1 thread");
+    CHECK(same(serial, many), "sweep against spheres, no job system against 8 threads");
+    hits = 0;
+    for (uint i = 0; i < n; i++)
+    {
+        if (serial[i].index == ~0u)
+            continue;
+        hits++;
+        CHECK(!targetCopy[serial[i].index], "sphere tie goes to the lower index " + to_string(i));
+    }
+    CHECK(hits > n / 4, "enough sweeps hit a sphere");
+}
+
+
+// pipeline: the same contacts on any number of threads, and the same pairs,
+// depths and normals as gjk on every pair of colliders
+
+struct PipelineShape
+{
+    int type;   // 0 sphere, 1 box, 2 capsule
+    Sphere sphere;
+    Box box;
+    Capsule capsule;
+    Box bounds;
+};
+
+template<typename A>
+static GjkResult gjkAgainst(const A& a, const PipelineShape& b)
+{
+    if (b.type == 0)
+        return gjkDistance(a, b.sphere);
+    if (b.type == 1)
+        return gjkDistance(a, b.box);
+    return gjkDistance(a, b.capsule);
+}
+
+static GjkResult gjkShapes(const PipelineShape& a, const PipelineShape& b)
+{
+    if (a.type == 0)
+        return gjkAgainst(a.sphere, b);
+    if (a.type == 1)
+        return gjkAgainst(a.box, b);
+    return gjkAgainst(a.capsule, b);
+}
+
+static void testPipeline()
+{
+    vector<PipelineShape> shapes;
+    CollisionPipeline pipeline;
+    for (uint i = 0; i < 1500; i++)
+    {
+        PipelineShape s;
+        s.type = i % 3;
+        float3 centre = random3(25);
+        if (s.type == 0)
+        {
+            s.sphere = Sphere(centre, uniformf(0.3f, 2));
+            s.bounds = Box(centre, float3(s.sphere.radius, s.sphere.radius, s.sphere.radius));
+            pipeline.add(s.sphere, i);
+        }
+        else if (s.type == 1)
+        {
+            s.box = Box(centre, float3(uniformf(0.3f, 2), uniformf(0.3f, 2), uniformf(0.3f, 2)));
+            s.bounds = s.box;
+            pipeline.add(s.box, i);
+        }
+        else
+        {
+            float3 half = random3(1.5f);
+            float r = uniformf(0.2f, 1);
+            s.capsule = Capsule(centre - half, centre + half, r);
+            s.bounds = Box(centre, float3(fabsf(half.x) + r, fabsf(half.y) + r, fabsf(half.z) + r));
+            pipeline.add(s.capsule, i);
+        }
+        shapes.push_back(s);
+    }
+
+    auto same = [](const vector<Contact>& a, const vector<Contact>& b) {
+        if (a.size() != b.size())
+            return false;
+        for (uint i = 0; i < a.size(); i++)
+        {
+            if (a[i].a != b[i].a || a[i].b != b[i].b || a[i].depth != b[i].depth
+                || memcmp(&a[i].normal, &b[i].normal, sizeof(float3)) || memcmp(&a[i].point, &b[i].point, sizeof(float3)))
+                return false;
+        }
+        return true;
+    };
+
+    pipeline.run(nullptr);
+    vector<Contact> serial = pipeline.contacts();
+    {
+        JobSystem jobs(0);
+        pipeline.run(&jobs);
+        CHECK(same(serial, pipeline.contacts()), "pipeline, no job system against 1 thread");
+    }
+    {
+        JobSystem jobs(7);
+        for (int run = 0; run < 5; run++)
+        {
+            pipeline.run(&jobs);
+            CHECK(same(serial, pipeline.contacts()), "pipeline, no job system against 8 threads, run " + to_string(run));
+        }
+    }
+    CHECK(pipeline.lastStats().contacts == serial.size(), "pipeline stats count the contacts");
+    CHECK(serial.size() > 500, "enough colliders touch");
+
+    // in add() order, one contact per pair
+    map<pair<uint, uint>, const Contact*> found;
+    pair<uint, uint> last(0, 0);
+    for (uint i = 0; i < serial.size(); i++)
+    {
+        const Contact& c = serial[i];
+        pair<uint, uint> key(c.a < c.b ? c.a : c.b, c.a < c.b ? c.b : c.a);
+        CHECK(i == 0 || last < key, "contacts ordered by collider " + to_string(i));
+        last = key;
+        found[key] = &c;
+    }
+
+    // every pair against gjk, leaving out pairs within rounding of touching
+    int compared = 0, apart = 0;
+    for (uint i = 0; i < shapes.size(); i++)
+    {
+        for (uint j = i + 1; j < shapes.size(); j++)
+        {
+            auto it = found.find(make_pair(i, j));
+            if (!overlaps(shapes[i].bounds, shapes[j].bounds))
+            {
+                apart += it != found.end();
+                continue;
+            }
+            const Contact* c = it == found.end() ? nullptr : it->second;
+            const PipelineShape& a = shapes[c ? c->a : i];
+            const PipelineShape& b = shapes[c ? c->b : j];
+            GjkResult r = gjkShapes(a, b);
+            if (fabsf(r.distance) < 2e-3f)
+                continue;
+            string what = to_string(i) + "/" + to_string(j);
+            CHECK(r.intersecting == (c != nullptr), "pipeline pair against gjk " + what);
+            if (!c || !r.intersecting)
+                continue;
+            compared++;
+            CHECK(fabsf(c->depth + r.distance) <= 2e-3f, "pipeline depth against gjk " + what);
+            CHECK(dot(c->normal, r.normal) >= 0.99f, "pipeline normal against gjk " + what);
+        }
+    }
+    CHECK(apart == 0, "no contacts between colliders with apart bounds");
+    CHECK(compared > 500, "enough contacts compared with gjk");
+}
+
+
+// octree: frustum and box queries give exactly what intersect() gives on
+// every live object, through rounds of moves, removes and inserts
+
+static void testOctree()
+{
+    LooseOctree tree(float3(0, 0, 0), 100);
+    struct Live
+    {
+        LooseOctree::Handle handle;
+        Box bounds;
+    };
+    vector<Live> live;
+    vector<uint> ids;
+    uint nextId = 0;
+    auto randomBox = [] {
+        // mostly small, some as big as a node, a few centred outside the root
+        float size = rng() % 10 ? uniformf(0.1f, 2) : uniformf(2, 40);
+        float range = rng() % 20 ? 100.0f : 160.0f;
+        return Box(random3(range), float3(uniformf(0.2f, 1), uniformf(0.2f, 1), uniformf(0.2f, 1)) * size);
+    };
+    size_t seen = 0, total = 0;
+    auto add = [&] {
+        Box b = randomBox();
+        live.push_back({ tree.insert(b, nextId), b });
+        ids.push_back(nextId++);
+    };
+    for (int i = 0; i < 1000; i++)
+    {
+        add();
+    }
+
+    for (int round = 0; round < 20; round++)
+    {
+        // short moves stay in their cell, long ones cross the tree
+        for (uint i = 0; i < live.size(); i++)
+        {
+            if (rng() % 3)
+                continue;
+            Box b = live[i].bounds;
+            b.centre += random3(rng() % 4 ? 1.0f : 80.0f);
+            if (rng() % 8 == 0)
+                b.extent = b.extent * uniformf(0.5f, 4);
+            tree.move(live[i].handle, b);
+            live[i].bounds = b;
+        }
+        for (int i = 0; i < 100 && live.size(); i++)
+        {
+            uint k = rng() % live.size();
+            tree.remove(live[k].handle);
+            live[k] = live.back();
+            ids[k] = ids.back();
+            live.pop_back();
+            ids.pop_back();
+        }
+        for (int i = 0; i < 100 + round * 10; i++)
+        {
+            add();
+        }
+        CHECK(tree.size() == live.size(), "octree size, round " + to_string(round));
+
+        vector<Frustum> frustums;
+        for (int c = 0; c < 8; c++)
+        {
+            float3 pos = random3(150), target = random3(50);
+            matrix proj = c % 4 ? matrix::perspective(uniformf(0.3f, 2), uniformf(0.5f, 2), 0.5f, uniformf(20, 300))
+                                : matrix::ortho(uniformf(10, 100), uniformf(10, 100), -50, 200);
+            frustums.push_back(Frustum::fromMatrix(matrix::lookAt(pos, target, float3(0, 1, 0)) * proj));
+        }
+        vector<uint> visible[8];
+        JobSystem jobs(3);
+        tree.query(frustums.data(), 8, visible, &jobs);
+
+        for (int c = 0; c < 8; c++)
+        {
+            vector<uint> expected;
+            for (uint i = 0; i < live.size(); i++)
+            {
+                if (intersect(frustums[c], live[i].bounds))
+                    expected.push_back(ids[i]);
+            }
+            vector<uint> found;
+            tree.query(frustums[c], [&](uint id) {
+                found.push_back(id);
+                return true;
+            });
+            sort(expected.begin(), expected.end());
+            sort(found.begin(), found.end());
+            sort(visible[c].begin(), visible[c].end());
+            string what = ", round " + to_string(round) + " camera " + to_string(c);
+            seen += expected.size();
+            total += live.size();
+            CHECK(found == expected, "octree frustum query against intersect" + what);
+            CHECK(visible[c] == expected, "octree camera query against intersect" + what);
+
+            Box b(random3(100), float3(uniformf(1, 40), uniformf(1, 40), uniformf(1, 40)));
+            expected.clear();
+            for (uint i = 0; i < live.size(); i++)
+            {
+                if (intersect(live[i].bounds, b))
+                    expected.push_back(ids[i]);
+            }
+            found.clear();
+            tree.query(b, [&](uint id) {
+                found.push_back(id);
+                return true;
+            });
+            sort(expected.begin(), expected.end());
+            sort(found.begin(), found.end());
+            CHECK(found == expected, "octree box query against intersect" + what);
+        }
+    }
+    CHECK(seen > 0 && seen < total, "octree frustums see some objects, not all");
+
+    // stopping early
+    uint calls = 0;
+    Frustum all = Frustum::fromMatrix(matrix::ortho(1000, 1000, -1000, 1000));
+    tree.query(all, [&](uint) { return ++calls < 10; });
+    CHECK(calls == 10, "octree query stops when the callback returns false");
+}
+
+
+// occlusion: the pyramid and the software depth buffer may keep hidden boxes
+// but never cull one with a visible point, checked against rays to the eye
+
+// the segment from a towards b passes through the box before reaching b
+static bool segmentHits(const float3& a, const float3& b, const Box& box)
+{
+    float t0 = 0.0f, t1 = 1.0f;
+    for (int k = 0; k < 3; k++)
+    {
+        float d = b._x[k] - a._x[k];
+        float lo = box.centre._x[k] - box.extent._x[k] - a._x[k];
+        float hi = box.centre._x[k] + box.extent._x[k] - a._x[k];
+        if (fabsf(d) < 1e-12f)
+        {
+            if (lo > 0.0f || hi < 0.0f)
+                return false;
+            continue;
+        }
+        float u = lo / d, v = hi / d;
+        t0 = fmaxf(t0, fminf(u, v));
+        t1 = fminf(t1, fmaxf(u, v));
+        if (t0 > t1)
+            return false;
+    }
+    return true;
+}
+
+static void testOcclusion()
+{
+    // the pyramid against every level 0 texel under the rectangle
+    int hidden = 0;
+    for (int i = 0; i < 200; i++)
+    {
+        uint w = 1 + rng() % 100, h = 1 + rng() % 60;
+        vector<float> depth(w * h);
+        for (auto& d : depth)
+            d = rng() % 16 ? uniformf(0.2f, 0.6f) : uniformf(0.6f, 1);
+        DepthPyramid pyramid;
+        pyramid.build(&depth[0], w, h, w);
+        for (int j = 0; j < 50; j++)
+        {
+            ScreenRect r;
+            float2 a = random2(60) + float2(w * 0.5f, h * 0.5f), b = a + float2(uniformf(0, 12), uniformf(0, 12));
+            r.x0 = a.x;
+            r.y0 = a.y;
+            r.x1 = b.x;
+            r.y1 = b.y;
+            r.zmin = uniformf(0.5f, 1);
+            if (pyramid.visible(r))
+                continue;
+            hidden++;
+            bool seen = r.x1 < 0.0f || r.y1 < 0.0f || r.x0 >= w || r.y0 >= h;
+            int x0 = (int)fmaxf(r.x0, 0.0f), x1 = (int)fminf(r.x1, w - 1.0f);
+            int y0 = (int)fmaxf(r.y0, 0.0f), y1 = (int)fminf(r.y1, h - 1.0f);
+            for (int y = y0; y <= y1 && !seen; y++)
+                for (int x = x0; x <= x1 && !seen; x++)
+                    seen = depth[y * w + x] >= r.zmin;
+            CHECK(!seen, "pyramid hides a rectangle with a texel behind it " + to_string(i) + "/" + to_string(j));
+        }
+    }
+
+    CHECK(hidden > 150, "enough rectangles hidden");
+
+    // streets of buildings seen from around head height and from above
+    int culled = 0, visible = 0;
+    for (int scene = 0; scene < 20; scene++)
+    {
+        vector<Box> occluders;
+        for (int i = 0; i < 40; i++)
+        {
+            float3 extent(uniformf(1, 12), uniformf(2, 15), uniformf(1, 12));
+            occluders.push_back(Box(float3(uniformf(-80, 80), extent.y, uniformf(-80, 80)), extent));
+        }
+        Camera camera;
+        camera.position = float3(uniformf(-90, 90), scene % 4 ? uniformf(1, 6) : uniformf(20, 60), uniformf(-90, 90));
+        camera.target = float3(uniformf(-40, 40), uniformf(0, 5), uniformf(-40, 40));
+        camera.zfar = 500;
+        camera.update();
+        matrix viewProj = camera.view * camera.proj;
+
+        SoftwareDepthBuffer buffer(256, 128);
+        buffer.begin(camera);
+        for (auto& o : occluders)
+            buffer.addOccluder(o);
+        buffer.end();
+
+        BoxSoA boxes;
+        vector<Box> boxList;
+        for (int i = 0; i < 300; i++)
+        {
+            Box b(float3(uniformf(-100, 100), uniformf(0, 20), uniformf(-100, 100)), float3(uniformf(0.2f, 3), uniformf(0.2f, 3), uniformf(0.2f, 3)));
+            boxes.add(b);
+            boxList.push_back(b);
+        }
+        vector<uint> kept;
+        buffer.pyramid.cull(boxes, viewProj, kept);
+        vector<bool> keep(boxList.size(), false);
+        for (uint k : kept)
+            keep[k] = true;
+
+        for (uint i = 0; i < boxList.size(); i++)
+        {
+            // points on the faces turned towards the eye that land on screen and
+            // reach the eye without passing through an occluder
+            const Box& b = boxList[i];
+            float3 lo = b.centre - b.extent, hi = b.centre + b.extent;
+            bool witness = false;
+            for (int s = 0; s < 200 && !witness; s++)
+            {
+                int axis = rng() % 3;
+                bool high = camera.position._x[axis] > hi._x[axis];
+                if (!high && camera.position._x[axis] >= lo._x[axis])
+                    continue;
+                float3 p(uniformf(lo.x, hi.x), uniformf(lo.y, hi.y), uniformf(lo.z, hi.z));
+                p._x[axis] = high ? hi._x[axis] : lo._x[axis];
+
+                const float* m = viewProj.m;
+                float w = p.x * m[3] + p.y * m[7] + p.z * m[11] + m[15];
+                if (w <= camera.znear)
+                    continue;
+                float x = (p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12]) / w;
+                float y = (p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13]) / w;
+                float z = (p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]) / w;
+                if (fabsf(x) >= 0.99f || fabsf(y) >= 0.99f || z >= 1.0f)
+                    continue;
+                witness = true;
+                for (auto& o : occluders)
+                {
+                    // grown a little so grazing rays count as hidden
+                    if (segmentHits(camera.position, p, Box(o.centre, o.extent + float3(0.01f, 0.01f, 0.01f))))
+                    {
+                        witness = false;
+                        break;
+                    }
+                }
+            }
+            if (!keep[i])
+                culled++;
+            if (witness)
+                visible++;
+            CHECK(keep[i] || !witness, "culled a box with a visible point, scene " + to_string(scene) + " box " + to_string(i));
+        }
+    }
+    CHECK(culled > 500, "enough boxes culled");
+    CHECK(visible > 300, "enough boxes with a visible point");
+}
+
+
+// lod: simplified levels of a sphere get strictly smaller, and select() walks
+// through them with distance without flickering on a threshold
+
+// the vertex types from vertex.txt, with glad loaded from NullGL so meshes
+// can be uploaded; ShaderManager lists every type it reads, so it's quiet
+static ShaderManager* testShaders()
+{
+    static ShaderManager* shaders = nullptr;
+    if (!shaders)
+    {
+        CHECK(gladLoadGL(NullGL::getProcAddress), "load glad from NullGL");
+        stringstream log;
+        auto old = cout.rdbuf(log.rdbuf());
+        shaders = new ShaderManager();
+        cout.rdbuf(old);
+    }
+    return shaders;
+}
+
+static vector<VertexAttr> meshVertexAttrs()
+{
+    return testShaders()->getVertexAttrs("mesh_vertex");
+}
+
+static void testLod()
+{
+    MeshBuilder builder;
+    builder.sphere(float3(0, 0, 0), 1, 32, 16);
+    MeshLOD* lod = builder.endLOD(meshVertexAttrs(), 5, 0.5f);
+
+    CHECK(lod->levels.size() > 2, "sphere simplifies to more than one level");
+    CHECK(lod->levels[0].error == 0.0f, "level 0 is the full sphere");
+    for (uint l = 1; l < lod->levels.size(); l++)
+    {
+        CHECK(lod->levels[l].triangles < lod->levels[l - 1].triangles, "lod triangles strictly decrease, level " + to_string(l));
+        CHECK(lod->levels[l].error >= lod->levels[l - 1].error, "lod error grows, level " + to_string(l));
+    }
+
+    Camera camera;
+    camera.update();
+    const float screenHeight = 720;
+    auto selectAt = [&](float distance, uint current) {
+        return lod->select(camera, float3(0, 0, -distance), 1, current, screenHeight);
+    };
+
+    // walking away only ever coarsens, and reaches the last level
+    uint level = 0;
+    vector<float> thresholds;
+    for (float d = 2; d < 1e6f; d *= 1.01f)
+    {
+        uint next = selectAt(d, level);
+        CHECK(next >= level, "lod gets coarser walking away, at " + to_string(d));
+        if (next != level)
+            thresholds.push_back(d);
+        level = next;
+    }
+    CHECK(level == lod->levels.size() - 1, "lod reaches the coarsest level far away");
+    CHECK(selectAt(0.5f, level) == 0, "lod is the full mesh inside the near plane");
+
+    // a distance jittering by 1% around a threshold settles on one side
+    for (float t : thresholds)
+    {
+        uint current = selectAt(t * 0.9f, 0);
+        int changes = 0;
+        for (int i = 0; i < 100; i++)
+        {
+            uint next = selectAt(t * (i % 2 ? 1.01f : 0.99f), current);
+            changes += next != current;
+            current = next;
+        }
+        CHECK(changes <= 1, "lod doesn't flip flop around " + to_string(t));
+    }
+    delete lod;
+}
+
+
+// obj: ObjLoader on small fixture files written here: relative indices across
+// the chunk boundary, corner forms, materials, bad indices, and numbers read
+// the same as strtof
+
+static const char* objFixture = "obj_fixture.obj";
+
+static vector<ObjGroup> loadObj(const string& text, JobSystem* jobs = nullptr)
+{
+    FILE* file = fopen(objFixture, "wb");
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+    vector<ObjGroup> groups;
+    try
+    {
+        ObjLoader::load(objFixture, groups, jobs);
+    }
+    catch (...)
+    {
+        remove(objFixture);
+        throw;
+    }
+    remove(objFixture);
+    return groups;
+}
+
+static bool objThrows(const string& text)
+{
+    try
+    {
+        loadObj(text);
+    }
+    catch (const runtime_error&)
+    {
+        return true;
+    }
+    return false;
+}
+
+static bool sameCorner(const ObjGroup& g, uint corner, const float3& p)
+{
+    const float3& q = g.positions[g.indices[corner]];
+    return q.x == p.x && q.y == p.y && q.z == p.z;
+}
+
+static void testObj()
+{
+    // faces after the 4 MB chunk boundary counting back into the chunk before it
+    {
+        stringstream text;
+        text << "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 0 0 1\n";
+        string filler = "# " + string(98, 'x') + "\n";
+        for (int i = 0; i < (4 << 20) / 100 + 10; i++)
+            text << filler;
+        text << "v 2 0 0\nv 0 2 0\n";
+        text << "f -6 -5 -4\n";     // the first three
+        text << "f -3 -2 -1\n";     // one from each side
+        text << "f 1 5 -1\n";       // absolute and relative mixed
+        const float3 v[] = { float3(0, 0, 0), float3(1, 0, 0), float3(0, 1, 0), float3(0, 0, 1), float3(2, 0, 0), float3(0, 2, 0) };
+        const int expected[] = { 0, 1, 2, 3, 4, 5, 0, 4, 5 };
+        JobSystem jobs(3);
+        for (JobSystem* j : { (JobSystem*)nullptr, &jobs })
+        {
+            vector<ObjGroup> groups = loadObj(text.str(), j);
+            CHECK(groups.size() == 1 && groups[0].indices.size() == 9, "relative faces across chunks load");
+            for (int i = 0; i < 9 && groups.size() == 1 && groups[0].indices.size() == 9; i++)
+                CHECK(sameCorner(groups[0], i, v[expected[i]]), "relative index across chunks, corner " + to_string(i) + (j ? " on jobs" : ""));
+        }
+    }
+
+    // v//n keeps the file's normals and leaves texcoords at zero; v/t/n and v/t read both
+    {
+        vector<ObjGroup> groups = loadObj("v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0.5 0.25\nvn 0 0 1\nvn 0 1 0\n"
+                                          "f 1//1 2//1 3//2\nf 1/1/2 3/1/1 2/1/2\n");
+        CHECK(groups.size() == 1 && groups[0].indices.size() == 6, "v//n faces load");
+        const ObjGroup& g = groups[0];
+        for (int i = 0; i < 3; i++)
+        {
+            float3 n = g.normals[g.indices[i]];
+            float2 t = g.texcoords[g.indices[i]];
+            CHECK(n.z == (i < 2 ? 1.0f : 0.0f) && n.y == (i < 2 ? 0.0f : 1.0f), "v//n normal, corner " + to_string(i));
+            CHECK(t.x == 0.0f && t.y == 0.0f, "v//n has no texcoord, corner " + to_string(i));
+            t = g.texcoords[g.indices[3 + i]];
+            CHECK(t.x == 0.5f && t.y == 0.25f, "v/t/n texcoord, corner " + to_string(i));
+        }
+        CHECK(g.positions.size() == 6, "v//n and v/t/n corners are different vertices");
+    }
+
+    // faces before any usemtl get a group of their own; materials without faces don't
+    {
+        vector<ObjGroup> groups = loadObj("v 0 0 0\nv 1 0 0\nv 0 1 0\nv 0 0 1\n"
+                                          "f 1 2 3\nusemtl empty\nusemtl red\nf 1 2 4\nusemtl blue\nf 2 3 4\nusemtl red\nf 1 3 4\n");
+        CHECK(groups.size() == 3, "faces without usemtl, two materials");
+        if (groups.size() == 3)
+        {
+            CHECK(groups[0].material == "" && groups[0].indices.size() == 3, "faces before usemtl in an unnamed group");
+            CHECK(groups[1].material == "red" && groups[1].indices.size() == 6, "material used twice is one group");
+            CHECK(groups[2].material == "blue" && groups[2].indices.size() == 3, "materials in order of first use");
+            CHECK(fabsf(len(groups[0].normals[0]) - 1.0f) < 1e-5f, "faces without normals get smooth ones");
+        }
+    }
+
+    // indices out of range, zero, or malformed throw
+    const char* header = "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\n";
+    CHECK(!objThrows(string(header) + "f 1 2 3\n"), "valid face loads");
+    CHECK(objThrows(string(header) + "f 1 2 4\n"), "position index past the end throws");
+    CHECK(objThrows(string(header) + "f -4 -2 -1\n"), "relative index before the start throws");
+    CHECK(objThrows(string(header) + "f 0 1 2\n"), "index 0 throws");
+    CHECK(objThrows(string(header) + "f 1//1 2//2 3//1\n"), "normal index past the end throws");
+    CHECK(objThrows(string(header) + "f 1/1 2/1 3/1\n"), "texcoord index with no texcoords throws");
+    CHECK(objThrows(string(header) + "f 1 2 x\n"), "malformed face throws");
+    CHECK(objThrows(header), "file without faces throws");
+    CHECK(objThrows("v 0 0\nf 1 1 1\n"), "short vertex throws");
+
+    // numbers: the same float strtof gives, to the bit for up to 9 significant
+    // digits and within one step for longer ones
+    {
+        const char* formats[] = { "%.9g", "%.6f", "%e", "%E", "%g", "%.3f", "%+.5f", "%.17g", "%.0f", "%.20e" };
+        const int count = 3000;
+        vector<string> numbers;
+        stringstream text;
+        for (int i = 0; i < count; i++)
+        {
+            double magnitude = pow(10.0, uniformf(-12, 12));
+            double x = uniformf(-1, 1) * magnitude;
+            char s[64];
+            snprintf(s, sizeof(s), formats[i % 10], x);
+            string number = s;
+            // .5 and 5. forms
+            if (i % 7 == 0 && number.size() > 2 && number[0] == '0' && number[1] == '.')
+                number = number.substr(1);
+            if (i % 10 == 8 && number.find('.') == string::npos)
+                number += ".";
+            numbers.push_back(number);
+            text << "v " << number << " 0 0\n";
+        }
+        for (int i = 0; i < count; i += 3)
+            text << "f " << i + 1 << " " << i + 2 << " " << i + 3 << "\n";
+        vector<ObjGroup> groups = loadObj(text.str());
+        CHECK(groups.size() == 1 && groups[0].indices.size() == count, "number fixture loads");
+        int exact = 0;
+        for (int i = 0; i < count && groups[0].indices.size() == count; i++)
+        {
+            float expected = strtof(numbers[i].c_str(), nullptr);
+            float read = groups[0].positions[groups[0].indices[i]].x;
+            int32_t a, b;
+            memcpy(&a, &expected, 4);
+            memcpy(&b, &read, 4);
+            bool longForm = i % 10 == 7 || i % 10 == 9;
+            exact += a == b;
+            CHECK(a == b || (longForm && abs(a - b) <= 1), "parseFloat against strtof for " + numbers[i]);
+        }
+        CHECK(exact > count * 9 / 10, "parseFloat mostly matches strtof exactly");
+    }
+}
+
+
+// meshfile: a baked mesh loads back as the buffers and levels endLOD uploads,
+// and truncated, foreign or inconsistent files are rejected
+
+static bool sameSubsets(const vector<MeshSubset>& a, const vector<MeshSubset>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (uint i = 0; i < a.size(); i++)
+    {
+        if (a[i].startIndex != b[i].startIndex || a[i].numIndices != b[i].numIndices || a[i].materialId != b[i].materialId ||
+            a[i].baseVertex != b[i].baseVertex || a[i].firstMeshlet != b[i].firstMeshlet || a[i].meshletCount != b[i].meshletCount)
+            return false;
+    }
+    return true;
+}
+
+static bool meshFileThrows(const vector<char>& bytes)
+{
+    const char* fname = "meshfile_bad.mesh";
+    ofstream(fname, ios::binary).write(bytes.data(), bytes.size());
+    bool threw = false;
+    try
+    {
+        MeshFile file(fname);
+    }
+    catch (const runtime_error&)
+    {
+        threw = true;
+    }
+    remove(fname);
+    return threw;
+}
+
+static void testMeshFile()
+{
+    auto& gl = NullGL::get();
+    bool keepData = gl.keepData;
+    gl.keepData = true;
+
+    // the same sphere through endLOD and through bake and MeshManager
+    const char* fname = "meshfile_fixture.mesh";
+    const uint levels = 4;
+    MeshBuilder direct, baker;
+    for (MeshBuilder* b : { &direct, &baker })
+    {
+        b->setMeshlets();
+        b->sphere(float3(1, 2, 3), 2, 32, 16);
+    }
+    MeshLOD* expected = direct.endLOD(meshVertexAttrs(), levels, 0.5f, INFINITY, true);
+    baker.bake(fname, meshVertexAttrs(), levels);
+
+    MeshManager manager(testShaders(), nullptr, ".");
+    stringstream log;
+    auto old = cout.rdbuf(log.rdbuf());
+    MeshLOD* loaded = manager.getMeshLOD(fname);
+    cout.rdbuf(old);
+    CHECK(loaded != nullptr, "baked mesh loads");
+    if (loaded)
+    {
+        CHECK(loaded->levels.size() == expected->levels.size() && loaded->levels.size() > 1, "baked mesh levels");
+        for (uint l = 0; l < loaded->levels.size() && l < expected->levels.size(); l++)
+        {
+            const MeshLOD::Level &a = loaded->levels[l], &b = expected->levels[l];
+            string what = ", level " + to_string(l);
+            CHECK(a.triangles == b.triangles && a.error == b.error, "baked level triangles and error" + what);
+            CHECK(sameSubsets(a.subsets, b.subsets), "baked level subsets" + what);
+        }
+        CHECK(loaded->bounds.centre.x == expected->bounds.centre.x && loaded->bounds.centre.y == expected->bounds.centre.y &&
+              loaded->bounds.centre.z == expected->bounds.centre.z && loaded->bounds.radius == expected->bounds.radius, "baked bounds");
+
+        const Mesh &a = *loaded->mesh, &b = *expected->mesh;
+        CHECK(a.indexType == b.indexType && a.vertexSize == b.vertexSize, "baked index type and vertex size");
+        CHECK(!memcmp(&a.posScale, &b.posScale, sizeof(float4)) && !memcmp(&a.posOffset, &b.posOffset, sizeof(float4)), "baked position decode");
+        CHECK(sameSubsets(a.subsets, b.subsets), "baked mesh subsets");
+        CHECK(gl.buffers[a.vertexBuf->buffer].data == gl.buffers[b.vertexBuf->buffer].data, "baked vertex buffer");
+        CHECK(gl.buffers[a.indexBuf->buffer].data == gl.buffers[b.indexBuf->buffer].data, "baked index buffer");
+        CHECK(a.meshlets.size() == b.meshlets.size() && a.meshlets.size() > 0 &&
+              !memcmp(a.meshlets.data(), b.meshlets.data(), a.meshlets.size() * sizeof(Meshlet)), "baked meshlets");
+    }
+    delete expected;
+    gl.keepData = keepData;
+
+    // damaged copies of the file
+    vector<char> bytes;
+    {
+        ifstream in(fname, ios::binary);
+        bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    remove(fname);
+    MeshFileHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    CHECK(!meshFileThrows(bytes), "an undamaged copy loads");
+    for (size_t size : { (size_t)0, sizeof(header) - 1, sizeof(header), (size_t)header.vertexOffset, bytes.size() / 2, bytes.size() - 1 })
+    {
+        CHECK(meshFileThrows(vector<char>(bytes.begin(), bytes.begin() + size)), "truncated to " + to_string(size) + " bytes");
+    }
+    auto withHeader = [&](const function<void(MeshFileHeader&)>& change) {
+        vector<char> copy = bytes;
+        MeshFileHeader h = header;
+        change(h);
+        memcpy(copy.data(), &h, sizeof(h));
+        return copy;
+    };
+    CHECK(meshFileThrows(withHeader([](MeshFileHeader& h) { h.version = MeshFileVersion + 1; })), "newer version rejected");
+    CHECK(meshFileThrows(withHeader([](MeshFileHeader& h) { h.version = MeshFileVersion - 1; })), "older version rejected");
+    CHECK(meshFileThrows(withHeader([](MeshFileHeader& h) { h.magic = 0; })), "wrong magic rejected");
+    CHECK(meshFileThrows(withHeader([](MeshFileHeader& h) { h.vertexCount--; })), "vertex count below the indices rejected");
+
+    // a subset based past the vertices, and an index past them
+    vector<char> copy = bytes;
+    MeshFileSubset subset;
+    memcpy(&subset, &copy[header.subsetOffset], sizeof(subset));
+    subset.baseVertex = header.vertexCount;
+    memcpy(&copy[header.subsetOffset], &subset, sizeof(subset));
+    CHECK(meshFileThrows(copy), "subset base vertex past the vertices rejected");
+    subset.baseVertex = -1;
+    memcpy(&copy[header.subsetOffset], &subset, sizeof(subset));
+    CHECK(meshFileThrows(copy), "subset base vertex below the vertices rejected");
+
+    copy = bytes;
+    uint indexSize = header.indexType == GL_UNSIGNED_INT ? 4 : 2;
+    uint bad = header.vertexCount;
+    memcpy(&copy[header.indexOffset + (header.indexCount / 2) * indexSize], &bad, indexSize);
+    CHECK(meshFileThrows(copy), "index past the vertices rejected");
+}
+
+
+// assets: AssetRegistry handles go stale when their slot is reused, ids stay
+// findable through erases, failed ids aren't loaded twice, collect() keeps to
+// its budget and delay, and a long random run agrees with a plain model
+
+struct TestAsset
+{
+    string id;
+};
+
+// ids whose fnv-1a hashes (as the registry takes them) share their low bits,
+// so they all start probing at the same table entry
+static vector<string> collidingIds(uint count, uint bits)
+{
+    vector<string> ids;
+    uint64_t want = 0;
+    for (uint n = 0; ids.size() < count; n++)
+    {
+        string id = "asset" + to_string(n);
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (char c : id)
+            h = (h ^ (uchar)c) * 0x100000001b3ull;
+        if (ids.empty())
+            want = h & ((1u << bits) - 1);
+        if ((h & ((1u << bits) - 1)) == want)
+            ids.push_back(id);
+    }
+    return ids;
+}
+
+static void testAssets()
+{
+    uint loads = 0, created = 0, unloads = 0;
+    auto loader = [&](const string& id) -> TestAsset* {
+        loads++;
+        if (id.compare(0, 7, "missing") == 0)
+            return nullptr;
+        if (id.compare(0, 6, "broken") == 0)
+            throw runtime_error("broken asset");
+        created++;
+        return new TestAsset{ id };
+    };
+    auto unloader = [&](TestAsset* asset) {
+        unloads++;
+        delete asset;
+    };
+
+    // stale handles: an unloaded asset's handle stays dead once its slot is reused
+    {
+        AssetRegistry<TestAsset> assets(loader, unloader, 0, 100);
+        auto a = assets.acquire("a");
+        CHECK(a != assets.Null && assets.get(a) && assets.get(a)->id == "a", "acquire loads");
+        assets.release(a);
+        assets.collect();
+        CHECK(assets.get(a) == nullptr && assets.size() == 0, "collected asset is gone");
+        auto b = assets.acquire("b");
+        CHECK((b & 0xfffff) == (a & 0xfffff) && b != a, "reused slot gets a new generation");
+        CHECK(assets.get(a) == nullptr, "stale handle gets nothing");
+        assets.addRef(a);
+        assets.release(a);
+        assets.release(a);
+        assets.collect();
+        CHECK(assets.get(b) && assets.get(b)->id == "b", "stale release doesn't touch the new asset");
+        CHECK(assets.find("b") == b && assets.find("a") == assets.Null, "find by id");
+        assets.clear();
+        CHECK(assets.get(b) == nullptr, "clear makes every handle stale");
+    }
+
+    // generations wrap from the last back to 1, never to Null
+    {
+        AssetRegistry<TestAsset> assets(loader, unloader, 0, 100);
+        set<uint> seen;
+        uint first = 0;
+        bool wrapped = false, null = false;
+        for (int i = 0; i < 5000; i++)
+        {
+            auto h = assets.acquire("a");
+            null |= h == assets.Null;
+            if (i == 0)
+                first = h;
+            else if (h == first)
+            {
+                wrapped = seen.size() == 4095;
+                break;
+            }
+            seen.insert(h);
+            assets.release(h);
+            assets.collect();
+        }
+        CHECK(!null, "generations never make a Null handle");
+        CHECK(wrapped, "4095 generations, then the first comes back");
+    }
+
+    // erasing from the middle of a probe run keeps later ids reachable
+    {
+        AssetRegistry<TestAsset> assets(loader, unloader, 0, 100);
+        vector<string> ids = collidingIds(12, 6);
+        vector<AssetRegistry<TestAsset>::Handle> handles;
+        for (auto& id : ids)
+            handles.push_back(assets.acquire(id));
+        for (uint i : { 0, 5, 6, 11, 3 })
+        {
+            assets.release(handles[i]);
+            handles[i] = assets.Null;
+            assets.collect();
+            uint before = loads;
+            for (uint j = 0; j < ids.size(); j++)
+            {
+                auto found = assets.find(ids[j]);
+                CHECK(found == handles[j], "find after erase " + to_string(i) + ", id " + to_string(j));
+            }
+            CHECK(loads == before, "find never loads");
+        }
+        CHECK(assets.size() == 7, "erased ids are gone");
+    }
+
+    // an id that failed to load isn't loaded again until clear()
+    {
+        AssetRegistry<TestAsset> assets(loader, unloader, 0, 100);
+        stringstream log;
+        auto old = cout.rdbuf(log.rdbuf());
+        uint before = loads;
+        CHECK(assets.acquire("missing.mesh") == assets.Null, "missing asset is Null");
+        CHECK(assets.acquire("missing.mesh") == assets.Null, "missing asset is Null again");
+        CHECK(assets.acquire("broken.mesh") == assets.Null, "throwing loader is Null");
+        CHECK(assets.acquire("broken.mesh") == assets.Null, "throwing loader is Null again");
+        cout.rdbuf(old);
+        CHECK(loads - before == 2, "failed ids are remembered");
+        CHECK(log.str().find("broken asset") != string::npos, "loader exception is reported");
+        CHECK(assets.find("missing.mesh") == assets.Null && assets.size() == 0, "failed ids aren't loaded assets");
+        CHECK(assets.getStats().failures == 2, "failures counted");
+        assets.collect();
+        assets.clear();
+        assets.acquire("missing.mesh");
+        CHECK(loads - before == 3, "clear forgets failed ids");
+    }
+
+    // collect keeps released assets keepFrames, then unloads budget a frame
+    {
+        AssetRegistry<TestAsset> assets(loader, unloader, 10, 3);
+        vector<AssetRegistry<TestAsset>::Handle> handles;
+        for (int i = 0; i < 10; i++)
+            handles.push_back(assets.acquire("asset" + to_string(i)));
+        for (auto h : handles)
+            assets.release(h);
+        uint before = unloads;
+        for (int f = 1; f < 10; f++)
+            assets.collect();
+        CHECK(unloads == before && assets.size() == 10, "released assets kept for keepFrames");
+
+        // taken back in time, and released again later
+        auto again = assets.acquire("asset0");
+        CHECK(again == handles[0], "asset taken back before it's unloaded");
+        assets.collect();
+        CHECK(unloads - before == 3 && assets.get(again), "budget a frame, taken back one skipped");
+        assets.collect();
+        assets.collect();
+        CHECK(unloads - before == 9 && assets.size() == 1, "the rest in budget sized steps");
+        assets.release(again);
+        for (int f = 0; f < 9; f++)
+            assets.collect();
+        CHECK(assets.size() == 1, "released again, kept again");
+        assets.collect();
+        CHECK(assets.size() == 0, "and then unloaded");
+    }
+
+    // a random run of acquires, releases and collects against a model of
+    // what should be loaded
+    {
+        const uint keepFrames = 5, budget = 4;
+        AssetRegistry<TestAsset> assets(loader, unloader, keepFrames, budget);
+        struct Model
+        {
+            int refs = 0;
+            bool loaded = false;
+            AssetRegistry<TestAsset>::Handle handle = 0;
+        };
+        map<string, Model> model;
+        vector<pair<string, AssetRegistry<TestAsset>::Handle>> held;
+        vector<AssetRegistry<TestAsset>::Handle> stale;
+        stringstream log;
+        auto old = cout.rdbuf(log.rdbuf());
+        int failures = 0;
+        for (int op = 0; op < 200000; op++)
+        {
+            uint r = rng() % 100;
+            if (r < 45)
+            {
+                string id = (rng() % 50 ? "asset" : "missing") + to_string(rng() % 400);
+                auto h = assets.acquire(id);
+                Model& m = model[id];
+                if (id[0] == 'm')
+                {
+                    failures += h != assets.Null;
+                    continue;
+                }
+                if (m.loaded && h != m.handle)
+                    failures++;
+                m.loaded = true;
+                m.handle = h;
+                m.refs++;
+                held.push_back({ id, h });
+                failures += !assets.get(h) || assets.get(h)->id != id;
+            }
+            else if (r < 90 && held.size())
+            {
+                uint k = rng() % held.size();
+                assets.release(held[k].second);
+                model[held[k].first].refs--;
+                held[k] = held.back();
+                held.pop_back();
+            }
+            else if (r < 92 && stale.size())
+            {
+                // stale handles do nothing
+                auto h = stale[rng() % stale.size()];
+                assets.release(h);
+                assets.addRef(h);
+                failures += assets.get(h) != nullptr;
+            }
+            else
+            {
+                assets.collect();
+                // whatever was unloaded: nothing referenced, and its handle is dead
+                for (auto& entry : model)
+                {
+                    Model& m = entry.second;
+                    if (!m.loaded || assets.get(m.handle))
+                        continue;
+                    failures += m.refs != 0;
+                    stale.push_back(m.handle);
+                    m.loaded = false;
+                }
+            }
+        }
+        cout.rdbuf(old);
+        CHECK(failures == 0, "random run agrees with the model");
+
+        size_t loaded = 0;
+        for (auto& entry : model)
+            loaded += entry.second.loaded;
+        CHECK(assets.size() == loaded, "random run leaves the model's assets loaded");
+        CHECK(assets.getStats().unloads > 10000 && assets.getStats().hits > 10000, "random run unloads and hits plenty");
+        for (auto& h : held)
+            assets.release(h.second);
+        for (uint f = 0; f < keepFrames + model.size() / budget + 1; f++)
+            assets.collect();
+        CHECK(assets.size() == 0, "everything released is unloaded in the end");
+    }
+    CHECK(created == unloads, "every asset loaded is unloaded once");
+}
+
+
+// meshlets: renderCulled() leaves out only meshlets that can't reach the
+// screen, so with back faces culled SoftRasterizer draws the same image as
+// render() does
+
+static void testMeshlets()
+{
+    JobSystem jobs(0);
+    SoftRasterizer raster(320, 200, &jobs);
+    ShaderManager* shaders = testShaders();
+    stringstream log;
+    auto old = cout.rdbuf(log.rdbuf());
+    Shader* shader = shaders->getShader("meshvs.glsl", "meshps.glsl");
+    cout.rdbuf(old);
+    CHECK(shader != nullptr, "mesh shader builds on NullGL");
+    if (!shader)
+        return;
+
+    // closed shapes, so backfacing meshlets are hidden by the front ones
+    MeshBuilder builder;
+    builder.setMeshlets();
+    builder.sphere(float3(0, 0, 0), 1, 48, 24);
+    builder.box(float3(1.5f, -0.5f, -0.5f), float3(2.5f, 0.5f, 0.5f), { 0, 0 }, { 1, 1 });
+    Mesh* mesh = builder.end(meshVertexAttrs());
+    CHECK(mesh->meshlets.size() > 10, "mesh is clustered");
+
+    Camera camera;
+    camera.aspect = 320.0f / 200.0f;
+    camera.znear = 0.5f;
+    camera.zfar = 200;
+    vector<matrix> worlds;
+    for (int i = 0; i < 40; i++)
+    {
+        float scale = uniformf(0.5f, 3);
+        worlds.push_back(matrix::rotateY(uniformf(0, 6.28f)) * matrix::rotateX(uniformf(0, 6.28f)) *
+                         matrix::scale(scale, scale, scale) * matrix::translation(random3(20)));
+    }
+
+    auto draw = [&](bool culled, uint& triangles) {
+        glClearColor(0.1f, 0.2f, 0.3f, 1);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glEnable(GL_CULL_FACE);
+        shader->bind();
+        shader->set("View", camera.view);
+        shader->set("Proj", camera.proj);
+        mesh->setDecode(shader);
+        triangles = 0;
+        for (uint i = 0; i < worlds.size(); i++)
+        {
+            shader->set("World", worlds[i]);
+            shader->set("Colour", float4(0.3f + i % 3 * 0.3f, 0.3f + i % 5 * 0.15f, 0.3f + i % 7 * 0.1f, 1));
+            if (culled)
+            {
+                triangles += mesh->renderCulled(camera, worlds[i]);
+            }
+            else
+            {
+                mesh->render();
+                for (auto& s : mesh->subsets)
+                    triangles += s.numIndices / 3;
+            }
+        }
+        raster.flush();
+        return raster.getColour();
+    };
+
+    uint total = 0, drawn = 0;
+    for (int view = 0; view < 8; view++)
+    {
+        camera.position = random3(view % 2 ? 8.0f : 30.0f);
+        camera.target = random3(5);
+        camera.update();
+        string what = ", view " + to_string(view);
+
+        uint all, culled;
+        vector<uint> expected = draw(false, all);
+        vector<uint> image = draw(true, culled);
+        uint background = expected[0], covered = 0, differ = 0;
+        for (uint i = 0; i < image.size(); i++)
+        {
+            covered += expected[i] != background;
+            differ += image[i] != expected[i];
+        }
+        CHECK(differ == 0, "renderCulled draws what render does" + what + " (" + to_string(differ) + " pixels differ)");
+        CHECK(covered > 0, "something on screen" + what);
+        total += all;
+        drawn += culled;
+    }
+    CHECK(drawn < total / 2, "renderCulled skips most triangles (" + to_string(drawn) + " of " + to_string(total) + ")");
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    delete mesh;
+}
+
+
+// animation: skinCharacters, a register's worth of characters at a time and
+// on the job system, against each character's bones concatenated one at a
+// time with toMatrix()
+
+// bones in deep chains, each parented to one of the few bones before it
+static Skeleton testSkeleton(uint bones)
+{
+    Skeleton skeleton;
+    for (uint b = 0; b < bones; b++)
+    {
+        BoneTransform bind;
+        bind.translation = b ? random3(1) : float3(0, 1, 0);
+        bind.rotation = quatAxisAngle(random3(1), uniformf(-1, 1));
+        skeleton.addBone("bone" + to_string(b), b ? b - 1 - rng() % (b < 4 ? b : 4) : -1, bind);
+    }
+    return skeleton;
+}
+
+// keyRate keys a second on every bone, each swinging about an axis of its
+// own; the root walks and bobs and a few bones pulse in scale
+static AnimationClip testClip(const Skeleton& skeleton, float duration, float keyRate)
+{
+    AnimationClip clip;
+    clip.name = "test";
+    clip.duration = duration;
+    for (uint b = 0; b < skeleton.size(); b++)
+    {
+        AnimationTrack track;
+        track.bone = b;
+        float3 axis = random3(1);
+        float swing = uniformf(0.1f, 1.0f), frequency = uniformf(1.0f, 4.0f), phase = uniformf(0, 6.28f);
+        for (uint k = 0; k <= (uint)(duration * keyRate); k++)
+        {
+            float t = k / keyRate;
+            BoneTransform key = skeleton.bindPose[b];
+            key.rotation = quatAxisAngle(axis, swing * sinf(frequency * t + phase));
+            if (b == 0)
+                key.translation = float3(t, 1 + 0.1f * sinf(frequency * t), 0);
+            if (b % 8 == 5)
+                key.scale = float3(1, 1, 1) * (1 + 0.2f * sinf(frequency * t + phase));
+            track.times.push_back(t);
+            track.keys.push_back(key);
+        }
+        clip.tracks.push_back(track);
+    }
+    return clip;
+}
+
+static void testAnimation()
+{
+    Skeleton skeleton = testSkeleton(64);
+    AnimationClip clip = testClip(skeleton, 2, 30);
+    uint bones = skeleton.size();
+
+    // characters apart by more than their matrices, so writing past one shows
+    const uint count = SimdFloat::Width * 9 + 3;
+    const size_t stride = (bones + 1) * sizeof(SkinMatrix);
+    auto skin = [&](bool posed, JobSystem* jobs) {
+        vector<uchar> out(count * stride, 0xcd);
+        skinCharacters(skeleton, count, [&](uint i, BoneTransform* pose) {
+            if (posed)
+                clip.sample(i * 0.173f, pose);
+        }, &out[0], stride, jobs);
+        return out;
+    };
+
+    // the bind pose skins to the identity
+    vector<uchar> out = skin(false, nullptr);
+    float worst = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        const SkinMatrix* m = (const SkinMatrix*)&out[i * stride];
+        for (uint b = 0; b < bones; b++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                for (int r = 0; r < 4; r++)
+                    worst = fmaxf(worst, fabsf(m[b].columns[j]._x[r] - (r == j ? 1.0f : 0.0f)));
+            }
+        }
+    }
+    CHECK(worst < 1e-4f, "bind pose skins to the identity (off by " + to_string(worst) + ")");
+
+    // posed, against the scalar chain
+    out = skin(true, nullptr);
+    vector<BoneTransform> pose(bones);
+    vector<matrix> model(bones);
+    worst = 0;
+    bool gaps = true;
+    for (uint i = 0; i < count; i++)
+    {
+        pose = skeleton.bindPose;
+        clip.sample(i * 0.173f, &pose[0]);
+        const SkinMatrix* m = (const SkinMatrix*)&out[i * stride];
+        for (uint b = 0; b < bones; b++)
+        {
+            int parent = skeleton.parents[b];
+            model[b] = parent < 0 ? pose[b].toMatrix() : pose[b].toMatrix() * model[parent];
+            matrix expected = skeleton.inverseBind[b] * model[b];
+            for (int j = 0; j < 3; j++)
+            {
+                for (int r = 0; r < 4; r++)
+                    worst = fmaxf(worst, fabsf(m[b].columns[j]._x[r] - expected.m[r * 4 + j]));
+            }
+        }
+        for (size_t k = bones * sizeof(SkinMatrix); k < stride; k++)
+            gaps = gaps && out[i * stride + k] == 0xcd;
+    }
+    CHECK(worst < 1e-3f, "skinCharacters matches toMatrix() down the hierarchy (off by " + to_string(worst) + ")");
+    CHECK(gaps, "skinCharacters writes only its characters' matrices");
+
+    JobSystem jobs(3);
+    CHECK(skin(true, &jobs) == out, "skinCharacters on the job system matches one thread");
+}
+
+
+// clips: a CompressedClip stays within its ClipTolerance of the clip it was
+// made from at every frame it resampled, whatever rate the clip was keyed
+// at, and playing it with a Cursor (forward, skipping ahead, looping and
+// seeking back) gives exactly what sampling from the top of the stream does
+
+static void testClips()
+{
+    Skeleton skeleton = testSkeleton(32);
+    uint bones = skeleton.size();
+    ClipTolerance tolerance;
+
+    // the ratio is against the keys the clip holds, so fewer of them compress less
+    struct Rates
+    {
+        float keys, frames;
+        uint ratio;
+    };
+    for (Rates rates : { Rates{ 30, 30, 10 }, Rates{ 24, 60, 8 } })
+    {
+        AnimationClip clip = testClip(skeleton, 3, rates.keys);
+        CompressedClip compressed(clip, tolerance, rates.frames);
+        string what = ", " + to_string((int)rates.keys) + " keys a second at " + to_string((int)rates.frames) + " fps";
+
+        size_t raw = 0;
+        for (auto& t : clip.tracks)
+            raw += t.keys.size() * (sizeof(BoneTransform) + sizeof(float));
+        CHECK(compressed.size() * rates.ratio <= raw, "compressed " + to_string(rates.ratio) + " times" + what + " (" + to_string(raw) + " to " + to_string(compressed.size()) + " bytes)");
+
+        vector<BoneTransform> expected(bones), pose(bones);
+        float translation = 0, rotation = 0, scale = 0;
+        for (uint f = 0; f <= (uint)ceilf(clip.duration * rates.frames); f++)
+        {
+            float time = f / rates.frames;
+            expected = skeleton.bindPose;
+            clip.sample(time, &expected[0]);
+            pose = skeleton.bindPose;
+            compressed.sample(time, &pose[0]);
+            for (uint b = 0; b < bones; b++)
+            {
+                float4 q = dot(expected[b].rotation, pose[b].rotation) < 0 ? -pose[b].rotation : pose[b].rotation;
+                translation = fmaxf(translation, len(expected[b].translation - pose[b].translation));
+                rotation = fmaxf(rotation, 4 * atan2f(len(expected[b].rotation - q), len(expected[b].rotation + q)));
+                scale = fmaxf(scale, len(expected[b].scale - pose[b].scale));
+            }
+        }
+        CHECK(translation <= tolerance.translation, "translations within tolerance" + what + " (off by " + to_string(translation) + ")");
+        CHECK(rotation <= tolerance.rotation, "rotations within tolerance" + what + " (off by " + to_string(rotation) + ")");
+        CHECK(scale <= tolerance.scale, "scales within tolerance" + what + " (off by " + to_string(scale) + ")");
+
+        CompressedClip::Cursor cursor;
+        float time = 0;
+        uint differ = 0;
+        for (int step = 0; step < 500; step++)
+        {
+            if (step % 50 == 49)
+                time = uniformf(0, time);
+            else
+                time += step % 7 ? uniformf(0, 0.05f) : uniformf(0, 0.5f);
+            expected = skeleton.bindPose;
+            compressed.sample(time, &expected[0]);
+            pose = skeleton.bindPose;
+            compressed.sample(time, &pose[0], cursor);
+            differ += memcmp(&expected[0], &pose[0], bones * sizeof(BoneTransform)) != 0;
+        }
+        CHECK(differ == 0, "a Cursor samples what sampling from scratch does" + what + " (" + to_string(differ) + " of 500 differ)");
+    }
+}
+
+
+// scenes: every game state run headless on NullGL, with the GL work it does
+// held to a budget, so a change that breaks batching or uploads more than it
+// used to fails here rather than on someone's frame rate
+
+static NullGLStats runScene(GameState* state, int frames, int width = 512, int height = 320, const string& backend = "null", const string& capture = "")
+{
+    auto& gl = NullGL::get();
+    gl.stats = NullGLStats();
+    // uniform() draws from random(), so every run places things the same way
+    srandom(1);
+
+    Game game;
+    game.setHeadless(true, frames);
+    game.setOption("display_width", to_string(width));
+    game.setOption("display_height", to_string(height));
+    game.setOption("headless_backend", backend);
+    game.setOption("headless_capture", capture);
+    CHECK(game.run(state) == 0, "game run");
+    return gl.stats;
+}
+
+struct SceneBudget
+{
+    const char* name;
+    function<GameState*()> create;
+    int frames;
+    // totals over all the frames, loading included
+    uint64_t drawCalls;
+    uint64_t stateChanges;
+    uint64_t uniformUpdates;
+    uint64_t bytesUploaded;
+    uint64_t objectsCreated;
+};
+
+static const SceneBudget sceneBudgets[] = {
+    // measured, plus about 10%; raise one only for a change that needs it
+    { "cube", [] { return new CubeGame; }, 60, 1500, 4900, 3400, 1400000, 26 },
+    { "menu", [] { return new PlaneGameMenu; }, 10, 44, 460, 140, 1300000, 17 },
+    { "plane", [] { return new PlaneGame; }, 30, 170, 960, 630, 1300000, 31 },
+};
+
+static void testScenes()
+{
+    for (auto& scene : sceneBudgets)
+    {
+        NullGLStats stats = runScene(scene.create(), scene.frames);
+        string name = scene.name;
+        cout << "    " << name << " over " << scene.frames << " frames: " << stats.drawCalls << " draw calls, "
+             << stats.stateChanges << " state changes, " << stats.uniformUpdates << " uniform updates, "
+             << stats.bytesUploaded << " bytes uploaded, " << stats.objectsCreated << " objects created" << endl;
+        CHECK(stats.errors == 0, name + " GL errors");
+        CHECK(stats.drawCalls <= scene.drawCalls, name + " draw calls over budget");
+        CHECK(stats.stateChanges <= scene.stateChanges, name + " state changes over budget");
+        CHECK(stats.uniformUpdates <= scene.uniformUpdates, name + " uniform updates over budget");
+        CHECK(stats.bytesUploaded <= scene.bytesUploaded, name + " uploads over budget");
+        CHECK(stats.objectsCreated <= scene.objectsCreated, name + " GL objects created over budget");
+    }
+}
+
+
+// golden images: the same scenes rasterized by SoftRasterizer, with the last
+// frame compared to a checked-in PNG. the rasterizer is deterministic, but a
+// few pixels are allowed to move by a step or two so that a compiler fusing
+// floating point ops differently doesn't fail the test
+
+static bool updateGoldens = false;
+
+struct GoldenScene
+{
+    const char* name;
+    function<GameState*()> create;
+    int frames;
+};
+
+static const GoldenScene goldenScenes[] = {
+    { "cube", [] { return new CubeGame; }, 5 },
+    { "menu", [] { return new PlaneGameMenu; }, 5 },
+    { "plane", [] { return new PlaneGame; }, 5 },
+};
+
+// the menu is laid out for a big window, anything smaller cuts it off
+static const int GoldenWidth = 1280;
+static const int GoldenHeight = 720;
+
+static void testGolden()
+{
+    mkdir("golden_capture", 0755);
+    for (auto& scene : goldenScenes)
+    {
+        string name = scene.name;
+        string dir = "golden_capture/" + name;
+        mkdir(dir.c_str(), 0755);
+        runScene(scene.create(), scene.frames, GoldenWidth, GoldenHeight, "soft", dir);
+
+        // every frame is captured, only the last one is compared
+        auto framePath = [&](int i) {
+            stringstream fname;
+            fname << dir << "/frame" << setw(5) << setfill('0') << i << ".png";
+            return fname.str();
+        };
+        for (int i = 0; i < scene.frames - 1; i++)
+        {
+            remove(framePath(i).c_str());
+        }
+        string frame = framePath(scene.frames - 1);
+        string golden = string(GOLDEN_DIR) + "/" + name + ".png";
+
+        int w = 0, h = 0, c = 0;
+        uchar* actual = stbi_load(frame.c_str(), &w, &h, &c, 4);
+        CHECK(actual != nullptr, name + " captured frame");
+        if (!actual)
+            continue;
+
+        if (updateGoldens)
+        {
+            ifstream in(frame, ios::binary);
+            ofstream out(golden, ios::binary);
+            out << in.rdbuf();
+            cout << "    updated " << golden << endl;
+            stbi_image_free(actual);
+            continue;
+        }
+
+        int gw = 0, gh = 0;
+        uchar* expected = stbi_load(golden.c_str(), &gw, &gh, &c, 4);
+        CHECK(expected != nullptr, name + " golden image " + golden);
+        if (expected && gw == w && gh == h)
+        {
+            uint differ = 0;
+            for (int i = 0; i < w * h; i++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    if (abs(actual[i * 4 + k] - expected[i * 4 + k]) > 2)
+                    {
+                        differ++;
+                        break;
+                    }
+                }
+            }
+            cout << "    " << name << ": " << differ << " of " << w * h << " pixels differ" << endl;
+            bool same = differ <= (uint)(w * h) / 1000;
+            CHECK(same, name + " matches " + golden + " (see " + frame + ")");
+        }
+        else if (expected)
+        {
+            CHECK(false, name + " golden image is " + to_string(gw) + "x" + to_string(gh) + ", frame is " + to_string(w) + "x" + to_string(h));
+        }
+        stbi_image_free(expected);
+        stbi_image_free(actual);
+    }
+}
+
+
+struct TestGroup
+{
+    const char* name;
+    void (*run)();
+};
+
+static const TestGroup groups[] = {
+    { "input", testInput },
+    { "collision", testCollision },
+    { "gjk", testGjk },
+    { "sweep", testSweep },
+    { "pipeline", testPipeline },
+    { "octree", testOctree },
+    { "occlusion", testOcclusion },
+    { "lod", testLod },
+    { "obj", testObj },
+    { "meshfile", testMeshFile },
+    { "assets", testAssets },
+    { "meshlets", testMeshlets },
+    { "animation", testAnimation },
+    { "clips", testClips },
+    { "scenes", testScenes },
+    { "golden", testGolden },
+};
+
+int main(int argc, char** argv)
+{
+    int ran = 0, named = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "-update")
+            updateGoldens = true;
+        else
+            named++;
+    }
+    for (auto& g : groups)
+    {
+        bool wanted = !named;
+        for (int i = 1; i < argc; i++)
+            wanted |= string(argv[i]) == g.name;
+        if (!wanted)
+            continue;
+
+        int failed = failures, checked = checks;
+        auto start = chrono::steady_clock::now();
+        g.run();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << g.name << ": " << checks - checked << " checks, " << failures - failed << " failed (" << (int)ms << " ms)" << endl;
+        ran++;
+    }
+    if (!ran)
+    {
+        cout << "usage: tests [-update] [group...]" << endl;
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+// bakes obj meshes into mesh files (see src/graphics/meshfile.h), which
+// MeshManager loads without any parsing. the full mesh is split into
+// meshlets for Mesh::renderCulled unless -nomeshlets is given
+//
+//      meshbake [-lods n] [-nomeshlets] [-vertex vertex.txt] in.obj out.mesh
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <bitset>
+#include <queue>
+#include <deque>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#include "../src/math3d.h"
+#include "../src/definitions.h"
+#include "../src/simd.h"
+#include "../src/jobs.h"
+#include "../src/assets.h"
+
+#include "../src/graphics/nullgl.h"
+#include "../src/graphics/buffer.h"
+#include "../src/graphics/texture.h"
+#include "../src/graphics/surface.h"
+#include "../src/graphics/shader.h"
+#include "../src/graphics/camera.h"
+#include "../src/graphics/simplify.h"
+#include "../src/graphics/meshopt.h"
+#include "../src/graphics/objloader.h"
+#include "../src/graphics/meshfile.h"
+#include "../src/graphics/meshlet.h"
+#include "../src/graphics/animation.h"
+#include "../src/graphics/mesh.h"
+
+#define GLAD_GL_IMPLEMENTATION
+#include <glad.h>
+
+int main(int argc, char** argv)
+{
+    uint levels = 1;
+    bool meshlets = true;
+    string vertexFile = string(RESOURCE_BASE) + "/vertex.txt";
+    vector<string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "-lods" && i + 1 < argc)
+            levels = stoi(argv[++i]);
+        else if (arg == "-nomeshlets")
+            meshlets = false;
+        else if (arg == "-vertex" && i + 1 < argc)
+            vertexFile = argv[++i];
+        else
+            files.push_back(arg);
+    }
+    if (files.size() != 2 || levels < 1)
+    {
+        cout << "usage: meshbake [-lods n] [-nomeshlets] [-vertex vertex.txt] in.obj out.mesh" << endl;
+        return 1;
+    }
+
+    try
+    {
+        auto start = chrono::steady_clock::now();
+        ShaderManager shaders(".", vertexFile);
+        JobSystem jobs;
+        MeshBuilder builder;
+        if (meshlets)
+            builder.setMeshlets();
+        builder.obj(files[0], &jobs);
+        builder.bake(files[1], shaders.getVertexAttrs("mesh_vertex"), levels);
+        cout << "baked " << files[0] << " -> " << files[1] << " in "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+        cout << "    acmr " << builder.optimizedBefore.acmr << " -> " << builder.optimizedAfter.acmr
+             << ", atvr " << builder.optimizedBefore.atvr << " -> " << builder.optimizedAfter.atvr << endl;
+    }
+    catch (const exception& e)
+    {
+        cout << "failed: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}